@@ -8,7 +8,8 @@ function consistency()
         cd ..   # back to top level of project
         f1=/tmp/f1$$
         f2=/tmp/f2$$
-        grep 'case 0x' src/libpst.c   | awk '{print $2}' | tr A-Z a-z | sed -e 's/://g'             | sort >$f1
+        # simple properties live in pst_prop_table, the rest are switch cases in pst_process()
+        grep -oE '(case |PST_PROP(_ENUM|_NONE|_ALLOC)?\()0x[0-9A-Fa-f]+' src/libpst.c | grep -oE '0x[0-9A-Fa-f]+' | tr A-Z a-z | sort >$f1
         grep '^0x'     xml/libpst.in  | awk '{print $1}' | (for i in {1..19}; do read a; done; cat) | sort >$f2
         diff $f1 $f2
         less $f1
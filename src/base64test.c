@@ -0,0 +1,164 @@
+/***
+ * base64test.c
+ * Part of the LibPST project
+ *
+ * Check that pst_base64_encode_multiple() gives the same characters,
+ * line breaks and line count as the original character at a time
+ * encoder, with each encoding kernel this cpu can run, for single and
+ * chained calls.
+ */
+
+#include "define.h"
+
+// 0 for the scalar code, 1 up to ssse3, 2 up to avx2
+static int kernel_level = 2;
+
+static int test_cpu_supports(const char *feature) {
+#ifdef HAVE_X86_SIMD_DISPATCH
+    if (!strcmp(feature, "avx2"))  return (kernel_level >= 2) && __builtin_cpu_supports("avx2");
+    if (!strcmp(feature, "ssse3")) return (kernel_level >= 1) && __builtin_cpu_supports("ssse3");
+#endif
+    return 0;
+}
+
+// base64_encode_groups() picks its kernel through this
+#define __builtin_cpu_supports(feature) test_cpu_supports(feature)
+#include "libstrfunc.c"
+#undef __builtin_cpu_supports
+
+
+// the encoder as it was before the kernels, one character at a time
+static char reference_chars[]="ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/==";
+
+static void reference_append(char **ou, int *line_count, char data) {
+    if (*line_count == 76) {
+        *(*ou)++ = '\n';
+        *line_count = 0;
+    }
+    *(*ou)++ = data;
+    if (*line_count >= 0) (*line_count)++;
+}
+
+
+static char *reference_encode(void *data, size_t size, int *line_count) {
+    char *output;
+    char *ou;
+    unsigned char *p   = (unsigned char *)data;
+    unsigned char *dte = p + size;
+
+    if (data == NULL || size == 0) return NULL;
+
+    ou = output = (char *)malloc(size / 3 * 4 + (size / 57) + 6);
+    if (!output) return NULL;
+
+    while((dte-p) >= 3) {
+        unsigned char x = p[0];
+        unsigned char y = p[1];
+        unsigned char z = p[2];
+        reference_append(&ou, line_count, reference_chars[ x >> 2 ]);
+        reference_append(&ou, line_count, reference_chars[ ((x & 0x03) << 4) | (y >> 4) ]);
+        reference_append(&ou, line_count, reference_chars[ ((y & 0x0F) << 2) | (z >> 6) ]);
+        reference_append(&ou, line_count, reference_chars[ z & 0x3F ]);
+        p+=3;
+    };
+    if ((dte-p) == 2) {
+        reference_append(&ou, line_count, reference_chars[ *p >> 2 ]);
+        reference_append(&ou, line_count, reference_chars[ ((*p & 0x03) << 4) | (p[1] >> 4) ]);
+        reference_append(&ou, line_count, reference_chars[ ((p[1] & 0x0F) << 2) ]);
+        reference_append(&ou, line_count, '=');
+    } else if ((dte-p) == 1) {
+        reference_append(&ou, line_count, reference_chars[ *p >> 2 ]);
+        reference_append(&ou, line_count, reference_chars[ ((*p & 0x03) << 4) ]);
+        reference_append(&ou, line_count, '=');
+        reference_append(&ou, line_count, '=');
+    };
+
+    *ou=0;
+    return output;
+}
+
+
+#define TEST_SIZE 2000
+
+static const int start_counts[] = {-1, 0, 1, 75, 76, 77, 100};
+static int failures = 0;
+
+
+/** @return non-zero if one call on size bytes differs, in the text or the line count */
+static int single_differs(const unsigned char *in, size_t size, int start) {
+    int want_count = start, got_count = start, rc;
+    char *want = reference_encode((void*)in, size, &want_count);
+    char *got  = pst_base64_encode_multiple((void*)in, size, &got_count);
+    if (!want || !got) rc = (want != got);
+    else               rc = strcmp(want, got) || (want_count != got_count);
+    free(want);
+    free(got);
+    return rc;
+}
+
+
+/** @return non-zero if encoding in as pieces of the given sizes differs */
+static int chained_differs(const unsigned char *in, const size_t *pieces, size_t count, int start) {
+    int want_count = start, got_count = start, rc = 0;
+    size_t i, done = 0;
+    for (i=0; i<count && !rc; i++) {
+        char *want = reference_encode((void*)(in+done), pieces[i], &want_count);
+        char *got  = pst_base64_encode_multiple((void*)(in+done), pieces[i], &got_count);
+        if (!want || !got) rc = (want != got);
+        else               rc = strcmp(want, got) || (want_count != got_count);
+        free(want);
+        free(got);
+        done += pieces[i];
+    }
+    return rc;
+}
+
+
+static void check_level(const char *name, int level) {
+    unsigned char in[TEST_SIZE];
+    size_t i, size, off, pieces[64];
+    int s;
+    kernel_level = level;
+    srand(1);
+    for (i=0; i<TEST_SIZE; i++) in[i] = (unsigned char)rand();
+    for (s=0; s<(int)(sizeof(start_counts)/sizeof(start_counts[0])); s++) {
+        // every size up to a few vectors from every start offset, plus a long buffer
+        for (off=0; off<32; off++) {
+            for (size=0; size<=100+1; size++) {
+                if (size == 100+1) size = TEST_SIZE - off;
+                if (single_differs(in+off, size, start_counts[s])) {
+                    printf("%s differs at offset %d size %d line count %d\n", name, (int)off, (int)size, start_counts[s]);
+                    failures++;
+                    return;
+                }
+            }
+        }
+        // the same line carried across calls on random pieces
+        for (i=0; i<200; i++) {
+            size_t count = 0, total = 0;
+            while (count < 64) {
+                size_t z = (size_t)(rand() % 120);
+                if (total + z > TEST_SIZE) break;
+                pieces[count++] = z;
+                total += z;
+            }
+            if (chained_differs(in, pieces, count, start_counts[s])) {
+                printf("%s differs in chained calls, round %d line count %d\n", name, (int)i, start_counts[s]);
+                failures++;
+                return;
+            }
+        }
+    }
+}
+
+
+int main() {
+    check_level("scalar", 0);
+#ifdef HAVE_X86_SIMD_DISPATCH
+    if (__builtin_cpu_supports("ssse3")) check_level("ssse3", 1);
+    else                                 printf("no ssse3, skipping that kernel\n");
+    if (__builtin_cpu_supports("avx2"))  check_level("avx2", 2);
+    else                                 printf("no avx2, skipping that kernel\n");
+#endif
+    return (failures) ? 1 : 0;
+}
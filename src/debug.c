@@ -1,18 +1,15 @@
 #include "define.h"
 
 
-struct pst_debug_func {
-    char * name;
-    struct pst_debug_func *next;
-};
-
-
 #define NUM_COL 32
 #define MAX_DEPTH 32
+#define MAX_FUNC 256    // deeper calls are counted but not named
 
-static struct pst_debug_func *func_head = NULL;
-static int func_depth = 0;
+// each thread keeps its own stack of active functions, the names are string literals
+static PST_THREAD_LOCAL const char *func_stack[MAX_FUNC];
+static PST_THREAD_LOCAL int func_depth = 0;
 static int pst_debuglevel = 0;
+int pst_debug_active = 0;
 static char indent[MAX_DEPTH*4+1];
 static FILE *debug_fp = NULL;
 #ifdef HAVE_SEMAPHORE_H
@@ -53,31 +50,21 @@ void pst_debug_init(const char* fname, void* output_mutex) {
         fprintf(stderr, "Opening of file %s failed\n", fname);
         exit(1);
     }
+    pst_debug_active = 1;
 }
 
 
 void pst_debug_func(int level, const char* function) {
     if (pst_debuglevel > level) return;
-    struct pst_debug_func *func_ptr = pst_malloc (sizeof(struct pst_debug_func));
-    func_ptr->name = strdup(function);
-    func_ptr->next = func_head;
-    func_head = func_ptr;
+    if (func_depth < MAX_FUNC) func_stack[func_depth] = function;
     func_depth++;
 }
 
 
 void pst_debug_func_ret(int level) {
     if (pst_debuglevel > level) return;
-    //remove the head item
-    struct pst_debug_func *func_ptr = func_head;
-    if (func_head) {
-        func_head = func_head->next;
-        free(func_ptr->name);
-        free(func_ptr);
-        func_depth--;
-    } else {
-        DIE(("function list is empty!\n"));
-    }
+    // a function entered before the debug file was opened has nothing to pop
+    if (func_depth > 0) func_depth--;
 }
 
 
@@ -86,7 +73,8 @@ static void pst_debug_info(int level, int line, const char* file) {
     if (pst_debuglevel > level) return;
     int le = (func_depth > MAX_DEPTH) ? MAX_DEPTH : func_depth;
     if (le > 0) le--;
-    char *func = (func_head ? func_head->name : "No Function");
+    const char *func = (func_depth == 0)       ? "No Function" :
+                       (func_depth > MAX_FUNC) ? func_stack[MAX_FUNC-1] : func_stack[func_depth-1];
     pst_debug_lock();
     fprintf(debug_fp, "%06d %.*s%s %s(%d) ", getpid(), le*4, indent, func, file, line);
 }
@@ -155,12 +143,8 @@ void pst_debug_hexdumper(FILE *out, const char *buf, size_t size, int cols, int
 
 
 void pst_debug_close(void) {
-    while (func_head) {
-        struct pst_debug_func *func_ptr = func_head;
-        func_head = func_head->next;
-        free(func_ptr->name);
-        free(func_ptr);
-    }
+    pst_debug_active = 0;
+    func_depth = 0;
     if (debug_fp) fclose(debug_fp);
     debug_fp = NULL;
 }
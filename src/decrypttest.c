@@ -0,0 +1,110 @@
+/***
+ * decrypttest.c
+ * Part of the LibPST project
+ *
+ * Check that every pst_decrypt() kernel this cpu can run gives the same
+ * result as the scalar code, and that pst_decrypt() still gives the
+ * result the original byte at a time code gave for a known buffer.
+ */
+
+#include "libpst.c"
+
+
+// 48 bytes of (i * 37 + 11), decrypted by the original code, i_id 0x12345678
+static const unsigned char known_comp[48] = {
+    0xeb, 0x8f, 0x46, 0xb1, 0x9b, 0x2b, 0x81, 0x94, 0xca, 0xc0, 0x21, 0xf0,
+    0x77, 0xe4, 0xbb, 0x01, 0x7e, 0x87, 0x3a, 0xb6, 0x8a, 0xe8, 0x2d, 0x16,
+    0xa4, 0x04, 0x7f, 0x11, 0xab, 0x95, 0xa9, 0x6f, 0x55, 0xfd, 0x8b, 0xba,
+    0x23, 0x0d, 0x56, 0xe5, 0x41, 0xed, 0xc3, 0x5e, 0xdf, 0xb3, 0x38, 0xd8
+};
+static const unsigned char known_high[48] = {
+    0x8f, 0xc9, 0x22, 0xfb, 0x83, 0xb4, 0xb5, 0xbe, 0x17, 0x57, 0x99, 0x3e,
+    0xb2, 0xe1, 0x2d, 0x02, 0x13, 0x87, 0x53, 0xfc, 0xc0, 0x11, 0xcc, 0x95,
+    0x22, 0x73, 0xb6, 0xc4, 0x78, 0xe7, 0x20, 0x4e, 0x6b, 0x74, 0x4a, 0xeb,
+    0x2f, 0x9a, 0x62, 0x07, 0x20, 0x80, 0x9a, 0x7a, 0xc0, 0x9c, 0xdf, 0xc3
+};
+
+#define TEST_SIZE 1000
+
+typedef void (*comp_kernel)(unsigned char *buf, size_t size);
+typedef void (*high_kernel)(uint16_t salt, unsigned char *buf, size_t size);
+
+static int failures = 0;
+
+
+static void fill(unsigned char *buf, size_t size) {
+    size_t i;
+    for (i=0; i<size; i++) buf[i] = (unsigned char)(i * 37 + 11);
+}
+
+
+static void check_known(const char *name, unsigned char type, const unsigned char *known) {
+    unsigned char buf[48];
+    fill(buf, sizeof(buf));
+    pst_decrypt(0x12345678, (char*)buf, sizeof(buf), type);
+    if (memcmp(buf, known, sizeof(buf))) {
+        printf("pst_decrypt %s does not match the known result\n", name);
+        failures++;
+    }
+}
+
+
+/** @return non-zero if the kernel and the scalar code disagree on size bytes at in+off */
+static int comp_differs(comp_kernel kernel, const unsigned char *in, size_t off, size_t size) {
+    unsigned char want[TEST_SIZE], got[TEST_SIZE];
+    memcpy(want, in+off, size);
+    memcpy(got,  in+off, size);
+    pst_decrypt_comp_scalar(want, size);
+    kernel(got, size);
+    return memcmp(want, got, size);
+}
+
+
+static int high_differs(high_kernel kernel, const unsigned char *in, size_t off, size_t size) {
+    unsigned char want[TEST_SIZE], got[TEST_SIZE];
+    // salts that wrap around inside the buffer as well as simple ones
+    uint16_t salt = (uint16_t)(0xfff0 + off*131);
+    memcpy(want, in+off, size);
+    memcpy(got,  in+off, size);
+    pst_decrypt_high_scalar(salt, want, size);
+    kernel(salt, got, size);
+    return memcmp(want, got, size);
+}
+
+
+/** run the kernels over every start offset and size up to 3 vectors, plus a long buffer */
+static void check_kernels(const char *name, comp_kernel comp, high_kernel high) {
+    unsigned char in[TEST_SIZE];
+    size_t off, size;
+    fill(in, TEST_SIZE);
+    for (off=0; off<32; off++) {
+        for (size=0; size<=96+1; size++) {
+            if (size == 96+1) size = TEST_SIZE - off;
+            if (comp_differs(comp, in, off, size)) {
+                printf("%s compressible decryption differs at offset %d size %d\n", name, (int)off, (int)size);
+                failures++;
+                return;
+            }
+            if (high_differs(high, in, off, size)) {
+                printf("%s strong decryption differs at offset %d size %d\n", name, (int)off, (int)size);
+                failures++;
+                return;
+            }
+        }
+    }
+}
+
+
+int main() {
+    check_known("PST_COMP_ENCRYPT", PST_COMP_ENCRYPT, known_comp);
+    check_known("PST_ENCRYPT",      PST_ENCRYPT,      known_high);
+#if defined(HAVE_X86_SIMD_DISPATCH)
+    if (__builtin_cpu_supports("ssse3")) check_kernels("ssse3", pst_decrypt_comp_ssse3, pst_decrypt_high_ssse3);
+    else                                 printf("no ssse3, skipping those kernels\n");
+    if (__builtin_cpu_supports("avx2"))  check_kernels("avx2",  pst_decrypt_comp_avx2,  pst_decrypt_high_avx2);
+    else                                 printf("no avx2, skipping those kernels\n");
+#elif defined(PST_HAVE_NEON)
+    check_kernels("neon", pst_decrypt_comp_neon, pst_decrypt_high_neon);
+#endif
+    return (failures) ? 1 : 0;
+}
@@ -116,10 +116,18 @@
     #include <sys/types.h>
 #endif
 
+#ifdef HAVE_SYS_RESOURCE_H
+    #include <sys/resource.h>
+#endif
+
 #ifdef HAVE_SYS_SHM_H
     #include <sys/shm.h>
 #endif
 
+#ifdef HAVE_SYS_MMAN_H
+    #include <sys/mman.h>
+#endif
+
 #ifdef HAVE_SYS_WAIT_H
     #include <sys/wait.h>
 #endif
@@ -128,10 +136,43 @@
     #include <dirent.h>
 #endif
 
+#ifdef HAVE_FCNTL_H
+    #include <fcntl.h>
+#endif
+
 #ifdef HAVE_SEMAPHORE_H
     #include <semaphore.h>
 #endif
 
+#ifdef HAVE_PTHREAD_H
+    #include <pthread.h>
+#endif
+
+#ifdef HAVE_X86_SIMD_DISPATCH
+    #include <immintrin.h>
+#endif
+
+#ifdef __SSE2__
+    #include <emmintrin.h>
+#endif
+
+#if defined(__aarch64__) && defined(__ARM_NEON)
+    #include <arm_neon.h>
+    #define PST_HAVE_NEON 1
+#endif
+
+// storage class for state that must not be shared between threads
+#if defined(_MSC_VER)
+    #define PST_THREAD_LOCAL __declspec(thread)
+#elif defined(__GNUC__) || defined(__SUNPRO_C) || defined(__SUNPRO_CC)
+    #define PST_THREAD_LOCAL __thread
+#else
+    #define PST_THREAD_LOCAL
+#endif
+
+
+// non-zero while a debug file is open, see DEBUG_INIT
+extern int pst_debug_active;
 
 void  pst_debug_lock();
 void  pst_debug_unlock();
@@ -146,9 +187,17 @@ void  pst_debug_close();
 void* pst_malloc(size_t size);
 void *pst_realloc(void *ptr, size_t size);
 
-#define MESSAGEPRINT1(...) pst_debug(1, __LINE__, __FILE__,  __VA_ARGS__)
-#define MESSAGEPRINT2(...) pst_debug(2, __LINE__, __FILE__,  __VA_ARGS__)
-#define MESSAGEPRINT3(...) pst_debug(3, __LINE__, __FILE__,  __VA_ARGS__)
+// tracing costs one branch until DEBUG_INIT opens a debug file,
+// and configure --disable-pst-trace removes it altogether
+#ifdef PST_NO_TRACE
+    #define DEBUG_ACTIVE 0
+#else
+    #define DEBUG_ACTIVE pst_debug_active
+#endif
+
+#define MESSAGEPRINT1(...) ((DEBUG_ACTIVE) ? pst_debug(1, __LINE__, __FILE__,  __VA_ARGS__) : (void)0)
+#define MESSAGEPRINT2(...) ((DEBUG_ACTIVE) ? pst_debug(2, __LINE__, __FILE__,  __VA_ARGS__) : (void)0)
+#define MESSAGEPRINT3(...) ((DEBUG_ACTIVE) ? pst_debug(3, __LINE__, __FILE__,  __VA_ARGS__) : (void)0)
 
 #define WARN(x) {           \
     MESSAGEPRINT3 x;	    \
@@ -165,19 +214,23 @@ void *pst_realloc(void *ptr, size_t size);
 
 #define DEBUG_WARN(x)           MESSAGEPRINT3 x
 #define DEBUG_INFO(x)           MESSAGEPRINT2 x
-#define DEBUG_HEXDUMP(x, s)     pst_debug_hexdump(1, __LINE__, __FILE__, (char*)x, s, 0x10, 0)
-#define DEBUG_HEXDUMPC(x, s, c) pst_debug_hexdump(1, __LINE__, __FILE__, (char*)x, s, c, 0)
+#define DEBUG_HEXDUMP(x, s)     ((DEBUG_ACTIVE) ? pst_debug_hexdump(1, __LINE__, __FILE__, (char*)x, s, 0x10, 0) : (void)0)
+#define DEBUG_HEXDUMPC(x, s, c) ((DEBUG_ACTIVE) ? pst_debug_hexdump(1, __LINE__, __FILE__, (char*)x, s, c, 0) : (void)0)
 
 
 #define DEBUG_ENT(x)                                            \
     {                                                           \
-      pst_debug_func(1, x);                                      \
-      pst_debug(1, __LINE__, __FILE__, "Entering function\n");	 \
+      if (DEBUG_ACTIVE) {                                       \
+        pst_debug_func(1, x);                                   \
+        pst_debug(1, __LINE__, __FILE__, "Entering function\n"); \
+      }                                                         \
     }
 #define DEBUG_RET()                                             \
     {                                                           \
-      pst_debug(1, __LINE__, __FILE__, "Leaving function\n");    \
-      pst_debug_func_ret(1);					 \
+      if (DEBUG_ACTIVE) {                                       \
+        pst_debug(1, __LINE__, __FILE__, "Leaving function\n");  \
+        pst_debug_func_ret(1);                                  \
+      }                                                         \
     }
 
 #define DEBUG_INIT(fname,mutex) {pst_debug_init(fname,mutex);}
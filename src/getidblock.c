@@ -1,7 +1,7 @@
 
 #include "define.h"
 
-int process = 0, binary = 0;
+int process = 0, binary = 0, descriptor = 0;
 pst_file pstfile;
 
 
@@ -14,12 +14,13 @@ void usage()
     printf("\toptions\n");
     printf("\t\t-p\tProcess the block before finishing.\n");
     printf("\t\t-b\tDump the blocks in binary to stdout.\n");
+    printf("\t\t-d\tThe id is a descriptor id, dump the blocks of that descriptor.\n");
     printf("\t\t\tView the debug log for information\n");
 }
 
 
-void dumper(uint64_t i_id);
-void dumper(uint64_t i_id)
+void dumper(uint64_t i_id, pst_desc_tree *owner);
+void dumper(uint64_t i_id, pst_desc_tree *owner)
 {
     char *buf = NULL;
     size_t readSize;
@@ -44,13 +45,16 @@ void dumper(uint64_t i_id)
 
     if (process) {
         DEBUG_INFO(("Parsing block id %#"PRIx64"\n", i_id));
-        ptr = pstfile.d_head;
-        while (ptr) {
-            if (ptr->assoc_tree && ptr->assoc_tree->i_id == i_id)
-                break;
-            if (ptr->desc && ptr->desc->i_id == i_id)
-                break;
-            ptr = pst_getNextDptr(ptr);
+        ptr = owner;
+        if (!ptr) {
+            ptr = pstfile.d_head;
+            while (ptr) {
+                if (ptr->assoc_tree && ptr->assoc_tree->i_id == i_id)
+                    break;
+                if (ptr->desc && ptr->desc->i_id == i_id)
+                    break;
+                ptr = pst_getNextDptr(ptr);
+            }
         }
         if (!ptr) {
             ptr = (pst_desc_tree *) pst_malloc(sizeof(pst_desc_tree));
@@ -72,14 +76,30 @@ void dump_desc(pst_desc_tree *ptr, pst_desc_tree *parent)
             ptr->d_id, parent_d_id, ptr->no_child,
             (ptr->desc       ? ptr->desc->i_id       : (uint64_t)0),
             (ptr->assoc_tree ? ptr->assoc_tree->i_id : (uint64_t)0));
-        if (ptr->desc       && ptr->desc->i_id)       dumper(ptr->desc->i_id);
-        if (ptr->assoc_tree && ptr->assoc_tree->i_id) dumper(ptr->assoc_tree->i_id);
+        if (ptr->desc       && ptr->desc->i_id)       dumper(ptr->desc->i_id, ptr);
+        if (ptr->assoc_tree && ptr->assoc_tree->i_id) dumper(ptr->assoc_tree->i_id, ptr);
         if (ptr->child) dump_desc(ptr->child, ptr);
         ptr = ptr->next;
     }
 }
 
 
+void dump_d_id(uint64_t d_id);
+void dump_d_id(uint64_t d_id)
+{
+    pst_desc_tree *ptr = pst_getDptr(&pstfile, d_id);
+    if (!ptr) {
+        DIE(("Descriptor %#"PRIx64" not found\n", d_id));
+    }
+    printf("Descriptor block d_id %#"PRIx64" parent d_id %#"PRIx64" children %i desc.i_id=%#"PRIx64", assoc tree.i_id=%#"PRIx64"\n",
+        ptr->d_id, ptr->parent_d_id, ptr->no_child,
+        (ptr->desc       ? ptr->desc->i_id       : (uint64_t)0),
+        (ptr->assoc_tree ? ptr->assoc_tree->i_id : (uint64_t)0));
+    if (ptr->desc       && ptr->desc->i_id)       dumper(ptr->desc->i_id, ptr);
+    if (ptr->assoc_tree && ptr->assoc_tree->i_id) dumper(ptr->assoc_tree->i_id, ptr);
+}
+
+
 int main(int argc, char* const* argv)
 {
     // pass the id number to display on the command line
@@ -90,12 +110,16 @@ int main(int argc, char* const* argv)
     DEBUG_INIT("getidblock.log", NULL);
     DEBUG_ENT("main");
 
-    while ((c = getopt(argc, argv, "bp")) != -1) {
+    while ((c = getopt(argc, argv, "bdp")) != -1) {
         switch (c) {
             case 'b':
                 // enable binary output
                 binary = 1;
                 break;
+            case 'd':
+                // look up the id in the descriptor tree
+                descriptor = 1;
+                break;
             case 'p':
                 // enable procesing of block
                 process = 1;
@@ -122,17 +146,26 @@ int main(int argc, char* const* argv)
     }
 
     DEBUG_INFO(("Loading Index\n"));
-    if (pst_load_index(&pstfile) != 0) {
+    if (i_id && (descriptor || !process)) {
+        // a single lookup only needs the b-tree nodes on its path
+        if (pst_load_index_lazy(&pstfile) != 0) {
+            DIE(("Error loading file index\n"));
+        }
+    }
+    else if (pst_load_index(&pstfile) != 0) {
         DIE(("Error loading file index\n"));
     }
 
-    if (i_id) {
-        dumper(i_id);
+    if (i_id && descriptor) {
+        dump_d_id(i_id);
+    }
+    else if (i_id) {
+        dumper(i_id, NULL);
     }
     else {
         size_t i;
         for (i = 0; i < pstfile.i_count; i++) {
-            dumper(pstfile.i_table[i].i_id);
+            dumper(pstfile.i_table[i].i_id, NULL);
         }
         dump_desc(pstfile.d_head, NULL);
     }
@@ -48,6 +48,9 @@
 
 #define PST_SIGNATURE 0x4E444221
 
+// bytes of an attachment base64 encoded at a time, a multiple of 3 so the pieces join up
+#define PST_BASE64_CHUNK (3*16*1024)
+
 
 typedef struct pst_block_offset {
     uint16_t from;
@@ -69,6 +72,7 @@ typedef struct pst_holder {
     int     base64_line_count;      // base64 bytes emitted on the current line
     size_t  base64_extra;           // count of bytes held in base64_extra_chars
     char    base64_extra_chars[2];  // up to two pending unencoded bytes
+    pst_vbuf *vb;                   // base64 encoding into this buffer rather than fp
 } pst_holder;
 
 
@@ -98,11 +102,255 @@ typedef struct pst_mapi_object {
     int32_t count_elements;     // count of active elements
     int32_t orig_count;         // originally allocated elements
     int32_t count_objects;      // number of mapi objects in the list
+    struct pst_arena *arena;    // holds the list, its elements and their data
+    int32_t count_skipped;      // elements dropped by a property filter
+    uint32_t skipped_owners;    // bit per pst_prop_owner of elements dropped by a property filter
     struct pst_mapi_element **elements;
     struct pst_mapi_object *next;
 } pst_mapi_object;
 
 
+/** A set of MAPI ids that pst_parse_block() keeps (or drops, if
+ *  exclude is set), sorted so that each element costs a binary search.
+ */
+typedef struct pst_prop_filter {
+    const uint32_t *ids;
+    size_t          count;
+    int             exclude;
+} pst_prop_filter;
+
+
+/** Where to find the large properties of an item that were left out
+ *  by pst_parse_item() when pf->lazy_bodies is set, see pst_load_bodies().
+ */
+typedef struct pst_item_deferred {
+    uint64_t      block_id;     // descriptor block of the item
+    pst_index_ll *assoc_tree;   // to rebuild the id2 tree, or NULL
+    pst_id2_tree *id2_head;     // private copy of the supplied id2 tree when there is no assoc_tree
+} pst_item_deferred;
+
+
+#define PST_ARENA_CHUNK     (64*1024)   // bytes in a regular arena chunk
+#define PST_ARENA_SPARE     8           // idle arenas kept by a pst_file
+
+
+typedef struct pst_arena_chunk {
+    struct pst_arena_chunk *next;
+    size_t                  size;       // usable bytes after the header
+    size_t                  used;
+} pst_arena_chunk;
+
+#define PST_ARENA_HDR   ((sizeof(pst_arena_chunk) + 15) & ~(size_t)15)
+
+
+/** bump allocator behind one list returned by pst_parse_block(). The
+ *  objects, their elements and the element values all live in it and
+ *  pst_free_list() releases them in one go. */
+typedef struct pst_arena {
+    pst_arena_chunk        *head;       // chunk being filled, older chunks follow
+    void                  **owned;      // malloc'ed buffers freed with the arena
+    size_t                  owned_count;
+    size_t                  owned_capacity;
+    struct pst_arena_pool  *pool;       // where a released arena goes, may be NULL
+    struct pst_arena       *next_free;
+} pst_arena;
+
+
+/** idle arenas of a pst_file, so that successive pst_parse_item()
+ *  calls reuse the same chunks instead of going back to malloc. Items
+ *  may be freed after pst_close(), so the pool stays until the last
+ *  arena made for it is gone. */
+struct pst_arena_pool {
+    pst_arena          *free_list;
+    size_t              count;
+    size_t              refs;           // the pst_file and every arena made for the pool
+    int                 closed;         // pst_close() was called, released arenas are freed
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_t     lock;           // concurrent pst_parse_item() calls share the pool
+#endif
+};
+
+
+typedef struct pst_cached_block {
+    uint64_t    i_id;
+    size_t      size;
+    char       *data;                       // decrypted block contents
+    struct pst_cached_block *hash_next;     // next entry in the same bucket
+    struct pst_cached_block *lru_prev;      // towards the most recently used entry
+    struct pst_cached_block *lru_next;      // towards the least recently used entry
+} pst_cached_block;
+
+
+struct pst_block_cache {
+    pst_cached_block  **buckets;
+    size_t              bucket_count;       // always a power of two
+    size_t              count;
+    size_t              bytes;
+    size_t              max_bytes;
+    pst_cached_block   *lru_head;           // most recently used
+    pst_cached_block   *lru_tail;           // least recently used, evicted first
+    uint64_t            hits;
+    uint64_t            misses;
+    uint64_t            evictions;
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_t     lock;               // concurrent pst_parse_item() calls share the cache
+#endif
+};
+
+
+#define PST_MAX_BTREE_DEPTH 32   // guard against loops in damaged b-trees
+
+
+typedef struct pst_id_map_slot {
+    uint64_t    id;
+    void       *ptr;            // NULL for an empty slot
+} pst_id_map_slot;
+
+
+/** open addressing hash keyed by a 64 bit id, used for the
+ *  descriptor nodes in pf->d_map and the lazily read index
+ *  entries in pf->i_map */
+typedef struct pst_id_map {
+    pst_id_map_slot *slots;
+    size_t           mask;      // number of slots - 1, slots is a power of two
+    size_t           count;
+} pst_id_map;
+
+
+#define PST_ID2_CACHE_SIZE  16      // id2 trees kept for the next items that share an assoc_tree
+
+
+/** an id2 tree flattened into one array in depth first order, so
+ *  that the child of nodes[i] is nodes[i+1]. Everyone holding a
+ *  pointer into the tree holds a reference, see pst_build_id2() */
+typedef struct pst_id2_set {
+    pst_id2_tree       *nodes;      // nodes[0] is the head of the tree
+    size_t             *scope;      // a search from nodes[i] covers nodes[i] .. nodes[scope[i]-1]
+    size_t             *same;       // next node with the same id2, or count
+    size_t              count;
+    pst_id_map          first;      // id2 -> first node with that id2
+    uint64_t            i_id;       // assoc_tree block the tree was built from
+    int                 refs;       // changed atomically, the tree may outlive its pst_file
+    struct pst_id2_set *lru_next;   // next older tree while in the cache
+} pst_id2_set;
+
+
+/** recently built id2 trees of a pst_file, most recently used first */
+struct pst_id2_cache {
+    pst_id2_set        *lru_head;
+    size_t              count;
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_t     lock;       // concurrent pst_parse_item() calls share the cache
+#endif
+};
+
+
+/** an id2 tree while it is being read, see pst_id2_build_level() */
+typedef struct pst_id2_build {
+    pst_id2_tree   *nodes;
+    size_t         *scope;
+    size_t         *end;            // nodes[i]'s subtree is nodes[i] .. nodes[end[i]-1]
+    size_t          count;
+    size_t          capacity;
+} pst_id2_build;
+
+
+/** index1 entries in the order they were read from the index1 b-tree */
+typedef struct pst_id_build {
+    pst_index_ll   *table;
+    size_t          count;
+    size_t          capacity;
+} pst_id_build;
+
+
+/** i_ids named by a descriptor record, resolved once index1 is loaded */
+typedef struct pst_desc_ids {
+    uint64_t        desc_id;
+    uint64_t        tree_id;
+} pst_desc_ids;
+
+
+/** descriptor nodes in the order they were read from the index2 b-tree */
+typedef struct pst_desc_build {
+    pst_desc_tree **nodes;
+    pst_desc_ids   *ids;            // parallel to nodes
+    size_t          count;
+    size_t          capacity;
+} pst_desc_build;
+
+
+#define PST_INDEX_THREADS   8       // max threads reading the b-trees in pst_load_index()
+
+
+/** one subtree of the index1 or index2 b-tree, read by a single thread */
+typedef struct pst_btree_task {
+    int             is_desc;        // 1 for the index2 b-tree
+    int64_t         offset;
+    int32_t         depth;
+    uint64_t        linku1;
+    uint64_t        start_val;
+    uint64_t        end_val;
+    pst_id_build    ids;            // output for index1 subtrees
+    pst_desc_build  descs;          // output for index2 subtrees
+} pst_btree_task;
+
+
+typedef struct pst_btree_tasks {
+    pst_btree_task *tasks;
+    size_t          count;
+    size_t          capacity;
+    size_t          next;           // next task to be claimed by a worker
+    pst_file       *pf;
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_t lock;
+#endif
+} pst_btree_tasks;
+
+
+#define PST_INDEX_CACHE_MAGIC       "LIBPSTIX"
+#define PST_INDEX_CACHE_VERSION     2
+#define PST_INDEX_CACHE_BYTE_ORDER  0x01020304
+
+
+/** header of the sidecar index cache file, all values in host byte order.
+ *  It is followed by i_count pst_index_ll records, d_count
+ *  pst_index_cache_desc records in depth first order, and x_count
+ *  pst_index_cache_xattrib records each followed by its data. */
+typedef struct pst_index_cache_header {
+    char     magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint64_t total_size;        // size of the whole sidecar file
+    uint64_t file_size;         // size of the pst file
+    int64_t  file_mtime;        // modification time of the pst file
+    uint64_t index1;
+    uint64_t index1_back;
+    uint64_t index2;
+    uint64_t index2_back;
+    int32_t  do_read64;
+    int32_t  x_result;          // return value of pst_load_extended_attributes()
+    uint64_t i_count;
+    uint64_t d_count;
+    uint64_t x_count;
+} pst_index_cache_header;
+
+
+typedef struct pst_index_cache_desc {
+    uint64_t d_id;
+    uint64_t parent_d_id;
+    uint64_t desc;              // 1 + position in i_table, 0 for NULL
+    uint64_t assoc_tree;        // 1 + position in i_table, 0 for NULL
+    uint64_t parent;            // 1 + position of the parent record, 0 for the top level
+} pst_index_cache_desc;
+
+
+typedef struct pst_index_cache_xattrib {
+    uint32_t mytype;
+    uint32_t map;
+    uint32_t size;              // bytes of data following this record
+} pst_index_cache_xattrib;
+
+
 typedef struct pst_desc32 {
     uint32_t d_id;
     uint32_t desc_id;
@@ -256,9 +504,12 @@ static unsigned char comp_high2 [] = {
 };
 
 static size_t           pst_append_holder(pst_holder *h, size_t size, char **buf, size_t z);
-static int              pst_build_desc_ptr(pst_file *pf, int64_t offset, int32_t depth, uint64_t linku1, uint64_t start_val, uint64_t end_val);
+static int              pst_build_desc_ptr(pst_file *pf, pst_desc_build *build, int64_t offset, int32_t depth, uint64_t linku1, uint64_t start_val, uint64_t end_val);
 static pst_id2_tree*    pst_build_id2(pst_file *pf, pst_index_ll* list);
-static int              pst_build_id_ptr(pst_file *pf, int64_t offset, int32_t depth, uint64_t linku1, uint64_t start_val, uint64_t end_val);
+static pst_id2_tree*    pst_share_id2(pst_id2_tree *head);
+static struct pst_id2_cache* pst_new_id2_cache(void);
+static void             pst_free_id2_cache(struct pst_id2_cache *cache);
+static int              pst_build_id_ptr(pst_file *pf, pst_id_build *build, int64_t offset, int32_t depth, uint64_t linku1, uint64_t start_val, uint64_t end_val);
 static int              pst_chr_count(char *str, char x);
 static size_t           pst_ff_compile_ID(pst_file *pf, uint64_t i_id, pst_holder *h, size_t size);
 static size_t           pst_ff_getIDblock(pst_file *pf, uint64_t i_id, char** buf);
@@ -270,14 +521,34 @@ static void             pst_free_desc (pst_desc_tree *head);
 static void             pst_free_id2(pst_id2_tree * head);
 static void             pst_free_list(pst_mapi_object *list);
 static void             pst_free_xattrib(pst_x_attrib_ll *x);
+static void             pst_free_block_cache(struct pst_block_cache *cache);
+static void             pst_free_id_map(struct pst_id_map *map);
+static void             pst_free_lazy_index(pst_file *pf);
+static void             pst_build_index(pst_file *pf, pst_desc_build *build);
+static void             pst_index_keys(pst_file *pf);
+static int              pst_index_ll_compare(const void *a, const void *b);
+static pst_desc_tree*   pst_lazy_getDptr(pst_file *pf, uint64_t d_id);
+static pst_index_ll*    pst_lazy_getID(pst_file *pf, uint64_t i_id);
 static size_t           pst_getAtPos(pst_file *pf, int64_t pos, void* buf, size_t size);
+static int              pst_read_extended_attributes(pst_file *pf);
+static int              pst_read_index_cache(pst_file *pf);
+static void             pst_write_index_cache(pst_file *pf, int x_result);
 static int              pst_getBlockOffsetPointer(pst_file *pf, pst_id2_tree *i2_head, pst_subblocks *subblocks, uint32_t offset, pst_block_offset_pointer *p);
 static int              pst_getBlockOffset(char *buf, size_t read_size, uint32_t i_offset, uint32_t offset, pst_block_offset *p);
 static pst_id2_tree*    pst_getID2(pst_id2_tree * ptr, uint64_t id);
-static pst_desc_tree*   pst_getDptr(pst_file *pf, uint64_t d_id);
 static uint64_t         pst_getIntAt(pst_file *pf, char *buf);
 static uint64_t         pst_getIntAtPos(pst_file *pf, int64_t pos);
-static pst_mapi_object* pst_parse_block(pst_file *pf, uint64_t block_id, pst_id2_tree *i2_head);
+static pst_mapi_object* pst_parse_block(pst_file *pf, uint64_t block_id, pst_id2_tree *i2_head, const pst_prop_filter *filter);
+static pst_item*        pst_parse_item_filtered(pst_file *pf, pst_desc_tree *d_ptr, pst_id2_tree *m_head, const pst_prop_filter *filter);
+static int              pst_prop_wanted(const pst_prop_filter *filter, uint32_t mapi_id);
+static int              pst_prop_owner_of(uint32_t mapi_id, uint16_t ref_type);
+static void             pst_alloc_skipped_owners(pst_item *item, uint32_t owners);
+static void             pst_free_deferred(pst_item_deferred *deferred);
+static struct pst_arena_pool* pst_new_arena_pool(void);
+static void*            pst_arena_alloc(pst_arena *arena, size_t size);
+static pst_arena*       pst_arena_acquire(pst_file *pf);
+static void             pst_arena_release(pst_arena *arena);
+static void             pst_free_arena_pool(struct pst_arena_pool *pool);
 static void             pst_printDptr(pst_file *pf, pst_desc_tree *ptr);
 static void             pst_printID2ptr(pst_id2_tree *ptr);
 static int              pst_process(uint64_t block_id, pst_mapi_object *list, pst_item *item, pst_item_attach *attach);
@@ -299,7 +570,60 @@ static char *pst_getcwd(void) {
 }
 
 
+/**
+ * Map the whole pst file read-only into memory. Failure is not an
+ * error, pf->map stays NULL and all reads fall back to stdio.
+ *
+ * @param pf   PST file structure with an open file pointer
+ */
+static void pst_map_file(pst_file *pf) {
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H)
+    struct stat st;
+    void *m;
+    DEBUG_ENT("pst_map_file");
+    if (fstat(fileno(pf->fp), &st) || (st.st_size <= 0)) {
+        DEBUG_WARN(("cannot stat pst file, not mapping it\n"));
+        DEBUG_RET();
+        return;
+    }
+    if ((uint64_t)st.st_size > (uint64_t)(size_t)-1) {
+        DEBUG_WARN(("pst file too large for the address space, not mapping it\n"));
+        DEBUG_RET();
+        return;
+    }
+    m = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fileno(pf->fp), 0);
+    if (m == MAP_FAILED) {
+        DEBUG_WARN(("mmap failed, reading through stdio\n"));
+        DEBUG_RET();
+        return;
+    }
+    pf->map      = (char*)m;
+    pf->map_size = (uint64_t)st.st_size;
+    DEBUG_INFO(("mapped %#"PRIx64" bytes\n", pf->map_size));
+    DEBUG_RET();
+#endif
+}
+
+
+static void pst_unmap_file(pst_file *pf) {
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H)
+    if (pf->map) {
+        if (munmap(pf->map, (size_t)pf->map_size)) {
+            DEBUG_WARN(("munmap returned non-zero value\n"));
+        }
+    }
+#endif
+    pf->map      = NULL;
+    pf->map_size = 0;
+}
+
+
 int pst_open(pst_file *pf, const char *name, const char *charset) {
+    return pst_open_flags(pf, name, charset, 0);
+}
+
+
+int pst_open_flags(pst_file *pf, const char *name, const char *charset, int flags) {
     int32_t sig;
 
     pst_unicode_init();
@@ -320,8 +644,13 @@ int pst_open(pst_file *pf, const char *name, const char *charset) {
         return -1;
     }
 
+    if (flags & PST_OPEN_MMAP) pst_map_file(pf);
+    pst_set_block_cache(pf, PST_BLOCK_CACHE_DEFAULT);
+
     // Check pst file magic
     if (pst_getAtPos(pf, 0, &sig, sizeof(sig)) != sizeof(sig)) {
+        pst_set_block_cache(pf, 0);
+        pst_unmap_file(pf);
         (void)fclose(pf->fp);
         DEBUG_WARN(("cannot read signature from PST file. Closing with error\n"));
         DEBUG_RET();
@@ -330,6 +659,8 @@ int pst_open(pst_file *pf, const char *name, const char *charset) {
     LE32_CPU(sig);
     DEBUG_INFO(("sig = %X\n", sig));
     if (sig != (int32_t)PST_SIGNATURE) {
+        pst_set_block_cache(pf, 0);
+        pst_unmap_file(pf);
         (void)fclose(pf->fp);
         DEBUG_WARN(("not a PST file that I know. Closing with error\n"));
         DEBUG_RET();
@@ -349,6 +680,8 @@ int pst_open(pst_file *pf, const char *name, const char *charset) {
             pf->do_read64 = 1;
             break;
         default:
+            pst_set_block_cache(pf, 0);
+            pst_unmap_file(pf);
             (void)fclose(pf->fp);
             DEBUG_WARN(("unknown .pst format, possibly newer than Outlook 2003 PST file?\n"));
             DEBUG_RET();
@@ -372,22 +705,30 @@ int pst_open(pst_file *pf, const char *name, const char *charset) {
 
     pf->cwd   = pst_getcwd();
     pf->fname = strdup(name);
+    pf->arena_pool = pst_new_arena_pool();
+    pf->id2_cache  = pst_new_id2_cache();
     return 0;
 }
 
 
 int  pst_reopen(pst_file *pf) {
-    char *cwd;
-    cwd = pst_getcwd();
-    if (cwd == NULL)                       return -1;
-    if (chdir(pf->cwd))                    goto err;
-    if (!freopen(pf->fname, "rb", pf->fp)) goto err;
-    if (chdir(cwd))                        goto err;
-    free(cwd);
+    // a relative name is looked up in the directory pst_open() saw, without
+    // changing the cwd, which other threads of the caller may depend on
+    char *path;
+    int absolute = (pf->fname[0] == '/') || (pf->fname[0] == '\\') ||
+                   (pf->fname[0] && pf->fname[1] == ':');
+    if (absolute || !pf->cwd) {
+        path = strdup(pf->fname);
+    } else {
+        path = (char*)pst_malloc(strlen(pf->cwd)+strlen(pf->fname)+2);
+        sprintf(path, "%s/%s", pf->cwd, pf->fname);
+    }
+    if (!freopen(path, "rb", pf->fp)) {
+        free(path);
+        return -1;
+    }
+    free(path);
     return 0;
-err:
-    free(cwd);
-    return -1;
 }
 
 
@@ -397,6 +738,7 @@ int pst_close(pst_file *pf) {
         DEBUG_RET();
         return 0;
     }
+    pst_unmap_file(pf);
     if (fclose(pf->fp)) {
         DEBUG_WARN(("fclose returned non-zero value\n"));
     }
@@ -404,14 +746,93 @@ int pst_close(pst_file *pf) {
     free(pf->cwd);
     free(pf->fname);
     // we must free the id array and the desc tree
+    pst_free_lazy_index(pf);
     free(pf->i_table);
+    free(pf->i_keys);
     pst_free_desc(pf->d_head);
     pst_free_xattrib(pf->x_head);
+    free(pf->x_table);
+    pst_free_block_cache(pf->block_cache);
+    pf->block_cache = NULL;
+    pst_free_id_map(pf->d_map);
+    pf->d_map = NULL;
+    pst_free_arena_pool(pf->arena_pool);
+    pf->arena_pool = NULL;
+    pst_free_id2_cache(pf->id2_cache);
+    pf->id2_cache = NULL;
+    free(pf->index_cache);
+    pf->index_cache = NULL;
     DEBUG_RET();
     return 0;
 }
 
 
+static size_t pst_id_map_hash(pst_id_map *map, uint64_t id) {
+    uint64_t h = id * (uint64_t)0x9E3779B97F4A7C15;
+    return (size_t)(h ^ (h >> 32)) & map->mask;
+}
+
+
+static void pst_id_map_init(pst_id_map *map, size_t count) {
+    size_t n = 16;
+    while (n < count * 2) n <<= 1;
+    map->slots = (pst_id_map_slot*)pst_malloc(n * sizeof(pst_id_map_slot));
+    memset(map->slots, 0, n * sizeof(pst_id_map_slot));
+    map->mask  = n - 1;
+    map->count = 0;
+}
+
+
+static pst_id_map* pst_new_id_map(size_t count) {
+    pst_id_map *map = (pst_id_map*)pst_malloc(sizeof(pst_id_map));
+    pst_id_map_init(map, count);
+    return map;
+}
+
+
+static void pst_free_id_map(pst_id_map *map) {
+    if (!map) return;
+    free(map->slots);
+    free(map);
+}
+
+
+static void* pst_id_map_get(pst_id_map *map, uint64_t id) {
+    size_t i;
+    if (!map) return NULL;
+    i = pst_id_map_hash(map, id);
+    while (map->slots[i].ptr) {
+        if (map->slots[i].id == id) return map->slots[i].ptr;
+        i = (i + 1) & map->mask;
+    }
+    return NULL;
+}
+
+
+/** add an entry, unless an entry with the same id is already present */
+static void pst_id_map_add(pst_id_map *map, uint64_t id, void *ptr) {
+    size_t i;
+    if ((map->count + 1) * 2 > map->mask + 1) {
+        // keep the load factor at or below one half
+        pst_id_map bigger;
+        pst_id_map_init(&bigger, map->count + 1);
+        for (i=0; i<=map->mask; i++) {
+            if (map->slots[i].ptr) pst_id_map_add(&bigger, map->slots[i].id, map->slots[i].ptr);
+        }
+        free(map->slots);
+        *map = bigger;
+    }
+    i = pst_id_map_hash(map, id);
+    while (map->slots[i].ptr) {
+        if (map->slots[i].id == id) return;
+        i = (i + 1) & map->mask;
+    }
+    map->slots[i].id  = id;
+    map->slots[i].ptr = ptr;
+    map->count++;
+}
+
+
 /**
  * add a pst descriptor node to a linked list of such nodes.
  *
@@ -437,6 +858,46 @@ static void add_descriptor_to_list(pst_desc_tree *node, pst_desc_tree **head, ps
 }
 
 
+/**
+ * find the id by walking the descriptor tree depth first, so that of
+ * several nodes with the same id the first one in tree order is found.
+ *
+ * @param ptr   the first top level node
+ * @param d_id  the id we are looking for
+ * @return pointer to the node, or NULL
+ */
+static pst_desc_tree* pst_walk_desc(pst_desc_tree *ptr, uint64_t d_id) {
+    while (ptr && (ptr->d_id != d_id)) {
+        //DEBUG_INFO(("Looking for %#"PRIx64" at node %#"PRIx64" with parent %#"PRIx64"\n", id, ptr->d_id, ptr->parent_d_id));
+        if (ptr->child) {
+            ptr = ptr->child;
+            continue;
+        }
+        while (!ptr->next && ptr->parent) {
+            ptr = ptr->parent;
+        }
+        ptr = ptr->next;
+    }
+    return ptr;
+}
+
+
+/** add the nodes to map in tree order, so pst_getDptr() finds what pst_walk_desc() would */
+static void pst_map_desc_tree(pst_id_map *map, pst_desc_tree *ptr) {
+    while (ptr) {
+        pst_id_map_add(map, ptr->d_id, ptr);
+        if (ptr->child) {
+            ptr = ptr->child;
+            continue;
+        }
+        while (!ptr->next && ptr->parent) {
+            ptr = ptr->parent;
+        }
+        ptr = ptr->next;
+    }
+}
+
+
 /**
  * add a pst descriptor node into the global tree.
  *
@@ -452,6 +913,7 @@ static void record_descriptor(pst_file *pf, pst_desc_tree *node)
     node->child      = NULL;
     node->child_tail = NULL;
     node->no_child   = 0;
+    if (!pf->d_map) pf->d_map = pst_new_id_map(0);
 
     // find any orphan children of this node, and collect them
     pst_desc_tree *n = pf->d_head;
@@ -485,7 +947,7 @@ static void record_descriptor(pst_file *pf, pst_desc_tree *node)
         add_descriptor_to_list(node, &pf->d_head, &pf->d_tail);
     } else {
         //DEBUG_INFO(("Searching for parent %#"PRIx64" of %#"PRIx64"\n", node->parent_d_id, node->d_id));
-        pst_desc_tree *parent = pst_getDptr(pf, node->parent_d_id);
+        pst_desc_tree *parent = pst_walk_desc(pf->d_head, node->parent_d_id);
         if (parent) {
             //DEBUG_INFO(("Found parent %#"PRIx64"\n", node->parent_d_id));
             parent->no_child++;
@@ -497,27 +959,105 @@ static void record_descriptor(pst_file *pf, pst_desc_tree *node)
             add_descriptor_to_list(node, &pf->d_head, &pf->d_tail);
         }
     }
+    pst_id_map_add(pf->d_map, node->d_id, node);
     DEBUG_RET();
 }
 
 
+static void pst_desc_build_add(pst_desc_build *build, pst_desc_tree *node, uint64_t desc_id, uint64_t tree_id) {
+    if (build->count == build->capacity) {
+        build->capacity += (build->capacity >> 1) + 16;
+        build->nodes = (pst_desc_tree**)pst_realloc(build->nodes, build->capacity * sizeof(pst_desc_tree*));
+        build->ids   = (pst_desc_ids*)pst_realloc(build->ids, build->capacity * sizeof(pst_desc_ids));
+    }
+    build->ids[build->count].desc_id = desc_id;
+    build->ids[build->count].tree_id = tree_id;
+    build->nodes[build->count++] = node;
+}
+
+
+/** @return 1 if node is ancestor or one of its descendants */
+static int pst_desc_is_below(pst_desc_tree *node, pst_desc_tree *ancestor) {
+    while (node) {
+        if (node == ancestor) return 1;
+        node = node->parent;
+    }
+    return 0;
+}
+
+
 /**
- * make a deep copy of part of the id2 mapping tree, for use
- * by an attachment containing an embedded rfc822 message.
+ * hook all the descriptor nodes read from the index2 b-tree into the
+ * global tree, after looking up their desc and assoc_tree entries in
+ * the fully loaded i_table. This produces the same tree as calling record_descriptor()
+ * for each node in turn, children stay in the order they were read,
+ * but the parents are found through a hash rather than by walking the
+ * tree, and orphans are attached in this single pass. A node whose
+ * parent turns out to be its own descendant stays at the top level.
+ * Files with duplicate d_ids fall back to record_descriptor(), since
+ * there the parent is whichever duplicate comes first in the tree at
+ * the time. The hash is kept in pf->d_map for pst_getDptr().
  *
- * @param   head  pointer to the subtree to be copied
- * @return        pointer to the new copy of the subtree
+ * @param pf    global pst file pointer
+ * @param build the nodes in the order they were read
  */
-static pst_id2_tree* deep_copy(pst_id2_tree *head);
-static pst_id2_tree* deep_copy(pst_id2_tree *head)
+static void link_descriptors(pst_file *pf, pst_desc_build *build);
+static void link_descriptors(pst_file *pf, pst_desc_build *build)
 {
-    if (!head) return NULL;
-    pst_id2_tree* me = (pst_id2_tree*) pst_malloc(sizeof(pst_id2_tree));
-    me->id2 = head->id2;
-    me->id  = head->id;
-    me->child = deep_copy(head->child);
-    me->next  = deep_copy(head->next);
-    return me;
+    size_t i;
+    pst_id_map *map;
+    DEBUG_ENT("link_descriptors");
+    pst_free_id_map(pf->d_map);
+    map = pst_new_id_map(build->count);
+    pf->d_map = map;
+    for (i=0; i<build->count; i++) {
+        pst_desc_tree *node = build->nodes[i];
+        node->assoc_tree = pst_getID(pf, build->ids[i].tree_id);
+        node->desc       = pst_getID(pf, build->ids[i].desc_id);
+        node->parent     = NULL;
+        node->child      = NULL;
+        node->child_tail = NULL;
+        node->no_child   = 0;
+        pst_id_map_add(map, node->d_id, node);
+    }
+    if (map->count < build->count) {
+        // a corrupt file with duplicate d_ids, where the parent depends on which
+        // duplicates were already in the tree; replay record_descriptor() for them
+        DEBUG_WARN(("%i duplicate descriptor ids\n", (int)(build->count - map->count)));
+        for (i=0; i<build->count; i++) record_descriptor(pf, build->nodes[i]);
+        pst_free_id_map(map);
+        map = pst_new_id_map(build->count);
+        pf->d_map = map;
+        pst_map_desc_tree(map, pf->d_head);
+        DEBUG_RET();
+        return;
+    }
+    for (i=0; i<build->count; i++) {
+        pst_desc_tree *node = build->nodes[i];
+        pst_desc_tree *parent = NULL;
+        if (node->parent_d_id == node->d_id) {
+            DEBUG_INFO(("%#"PRIx64" is its own parent. What is this world coming to?\n", node->d_id));
+        }
+        else if (node->parent_d_id != 0) {
+            parent = (pst_desc_tree*)pst_id_map_get(map, node->parent_d_id);
+            if (!parent) DEBUG_INFO(("No parent %#"PRIx64", have an orphan child %#"PRIx64"\n", node->parent_d_id, node->d_id));
+            else if (pst_desc_is_below(parent, node)) {
+                // a corrupt file with a cycle of parents, keep this node at the top
+                // as record_descriptor() would, rather than losing the whole cycle
+                DEBUG_INFO(("Parent %#"PRIx64" of %#"PRIx64" is its own descendant\n", node->parent_d_id, node->d_id));
+                parent = NULL;
+            }
+        }
+        if (parent) {
+            parent->no_child++;
+            node->parent = parent;
+            add_descriptor_to_list(node, &parent->child, &parent->child_tail);
+        }
+        else {
+            add_descriptor_to_list(node, &pf->d_head, &pf->d_tail);
+        }
+    }
+    DEBUG_RET();
 }
 
 
@@ -601,6 +1141,41 @@ size_t pst_attach_to_file(pst_file *pf, pst_item_attach *attach, FILE* fp) {
 }
 
 
+size_t pst_attach_to_vbuf_base64(pst_file *pf, pst_item_attach *attach, pst_vbuf *vb) {
+    pst_index_ll *ptr;
+    pst_holder h = {NULL, NULL, 1, 0, 0};
+    size_t size = 0;
+    DEBUG_ENT("pst_attach_to_vbuf_base64");
+    h.vb = vb;
+    if ((!attach->data.data) && (attach->i_id != (uint64_t)-1)) {
+        ptr = pst_getID(pf, attach->i_id);
+        if (ptr) {
+            size = pst_ff_getID2data(pf, ptr, &h);
+        } else {
+            DEBUG_WARN(("Couldn't find ID pointer. Cannot save attachment to Base64\n"));
+        }
+    } else {
+        size = attach->data.size;
+        if (attach->data.data && size) {
+            // encode a piece at a time, so the encoding is never held whole
+            size_t done, z;
+            for (done=0; done<size; done+=z) {
+                char *c;
+                z = size - done;
+                if (z > PST_BASE64_CHUNK) z = PST_BASE64_CHUNK;
+                c = pst_base64_encode_multiple(attach->data.data+done, z, &h.base64_line_count);
+                if (c) {
+                    pst_vbappend(vb, c, strlen(c));
+                    free(c);
+                }
+            }
+        }
+    }
+    DEBUG_RET();
+    return size;
+}
+
+
 size_t pst_attach_to_file_base64(pst_file *pf, pst_item_attach *attach, FILE* fp) {
     pst_index_ll *ptr;
     pst_holder h = {NULL, fp, 1, 0, 0};
@@ -630,7 +1205,7 @@ size_t pst_attach_to_file_base64(pst_file *pf, pst_item_attach *attach, FILE* fp
 
 
 int pst_load_index (pst_file *pf) {
-    int  x;
+    pst_desc_build build = {NULL, NULL, 0, 0};
     DEBUG_ENT("pst_load_index");
     if (!pf) {
         DEBUG_WARN(("Cannot load index for a NULL pst_file\n"));
@@ -638,13 +1213,28 @@ int pst_load_index (pst_file *pf) {
         return -1;
     }
 
-    x = pst_build_id_ptr(pf, pf->index1, 0, pf->index1_back, 0, UINT64_MAX);
-    DEBUG_INFO(("build id ptr returns %i\n", x));
+    if (pf->lazy_index) {
+        // forget everything found in lazy mode
+        pst_free_desc(pf->d_head);
+        pf->d_head = NULL;
+        pf->d_tail = NULL;
+        pst_free_id_map(pf->d_map);
+        pf->d_map = NULL;
+        pst_free_lazy_index(pf);
+    }
+
+    if (pf->index_cache && (pst_read_index_cache(pf) == 0)) {
+        DEBUG_INFO(("index restored from %s\n", pf->index_cache));
+        DEBUG_RET();
+        return 0;
+    }
 
-    x = pst_build_desc_ptr(pf, pf->index2, 0, pf->index2_back, (uint64_t)0x21, UINT64_MAX);
-    DEBUG_INFO(("build desc ptr returns %i\n", x));
+    pst_build_index(pf, &build);
+    link_descriptors(pf, &build);
+    free(build.nodes);
+    free(build.ids);
 
-    pst_printDptr(pf, pf->d_head);
+    if (DEBUG_ACTIVE) pst_printDptr(pf, pf->d_head);
 
     DEBUG_RET();
     return 0;
@@ -672,10 +1262,88 @@ typedef struct pst_x_attrib {
 } pst_x_attrib;
 
 
-/** Try to load the extended attributes from the pst file.
+/** mapped property ids start here, pf->x_table has one slot for each
+ *  id from PST_X_MAP_BASE to 0xFFFF */
+#define PST_X_MAP_BASE  0x8000
+#define PST_X_MAP_COUNT 0x8000
+
+
+/**
+ * build the direct lookup table of the extended attributes and relink
+ * them into pf->x_head in sorted order. If a map id occurs more than
+ * once the last one read wins, as it did with the old insertion sort.
+ * Mappings outside the table can never match a 16 bit property id and
+ * are dropped.
+ *
+ * @param pf   PST file structure
+ * @param list extended attributes in the order they were read
+ */
+static void pst_index_xattrib(pst_file *pf, pst_x_attrib_ll *list) {
+    pst_x_attrib_ll *x, *next, *tail = NULL;
+    size_t i;
+    DEBUG_ENT("pst_index_xattrib");
+    free(pf->x_table);
+    pf->x_table = (pst_x_attrib_ll**) pst_malloc(sizeof(pst_x_attrib_ll*) * PST_X_MAP_COUNT);
+    memset(pf->x_table, 0, sizeof(pst_x_attrib_ll*) * PST_X_MAP_COUNT);
+    for (x = list; x; x = next) {
+        next    = x->next;
+        x->next = NULL;
+        if ((x->map < PST_X_MAP_BASE) || (x->map >= PST_X_MAP_BASE + PST_X_MAP_COUNT)) {
+            DEBUG_INFO(("dropping unreachable mapping %#"PRIx32"\n", x->map));
+            pst_free_xattrib(x);
+            continue;
+        }
+        i = x->map - PST_X_MAP_BASE;
+        if (pf->x_table[i]) pst_free_xattrib(pf->x_table[i]);
+        pf->x_table[i] = x;
+    }
+    pf->x_head = NULL;
+    for (i = 0; i < PST_X_MAP_COUNT; i++) {
+        if (!(x = pf->x_table[i])) continue;
+        if (tail) tail->next = x; else pf->x_head = x;
+        tail = x;
+    }
+    DEBUG_RET();
+}
+
+
+/** @return the extended attribute mapping for a property id, or NULL */
+static pst_x_attrib_ll* pst_find_xattrib(pst_file *pf, uint32_t map) {
+    if (!pf->x_table || (map < PST_X_MAP_BASE) || (map >= PST_X_MAP_BASE + PST_X_MAP_COUNT)) return NULL;
+    return pf->x_table[map - PST_X_MAP_BASE];
+}
+
+
+int pst_set_index_cache(pst_file *pf, const char *name) {
+    DEBUG_ENT("pst_set_index_cache");
+    if (!pf) {
+        DEBUG_RET();
+        return -1;
+    }
+    free(pf->index_cache);
+    pf->index_cache = (name) ? strdup(name) : NULL;
+    DEBUG_RET();
+    return 0;
+}
+
+
+/** Try to load the extended attributes, from the sidecar index cache
+ *  if the index was restored from there, otherwise from the pst file.
     @return true(1) or false(0) to indicate whether the extended attributes have been loaded
  */
 int pst_load_extended_attributes(pst_file *pf) {
+    int r;
+    if (pf->index_from_cache) return pf->x_from_cache;
+    r = pst_read_extended_attributes(pf);
+    if (pf->index_cache && !pf->lazy_index) pst_write_index_cache(pf, r);
+    return r;
+}
+
+
+/** Try to load the extended attributes from the pst file.
+    @return true(1) or false(0) to indicate whether the extended attributes have been loaded
+ */
+static int pst_read_extended_attributes(pst_file *pf) {
     // for PST files this will load up d_id 0x61 and check it's "assoc_tree" attribute.
     pst_desc_tree *p;
     pst_mapi_object *list;
@@ -684,7 +1352,7 @@ int pst_load_extended_attributes(pst_file *pf) {
     size_t bsize=0, hsize=0, bptr=0;
     pst_x_attrib xattrib;
     int32_t tint, x;
-    pst_x_attrib_ll *ptr, *p_head=NULL;
+    pst_x_attrib_ll *ptr, *p_head=NULL, *p_tail=NULL;
 
     DEBUG_ENT("pst_loadExtendedAttributes");
     p = pst_getDptr(pf, (uint64_t)0x61);
@@ -702,12 +1370,12 @@ int pst_load_extended_attributes(pst_file *pf) {
 
     if (p->assoc_tree) {
         id2_head = pst_build_id2(pf, p->assoc_tree);
-        pst_printID2ptr(id2_head);
+        if (DEBUG_ACTIVE) pst_printID2ptr(id2_head);
     } else {
         DEBUG_WARN(("Have not been able to fetch any id2 values for d_id 0x61. Brace yourself!\n"));
     }
 
-    list = pst_parse_block(pf, p->desc->i_id, id2_head);
+    list = pst_parse_block(pf, p->desc->i_id, id2_head, NULL);
     if (!list) {
         DEBUG_WARN(("Cannot process desc block for item 0x61. Not loading extended Attributes\n"));
         pst_free_id2(id2_head);
@@ -778,70 +1446,333 @@ int pst_load_extended_attributes(pst_file *pf) {
         }
 
         if (!err) {
-            // add it to the list
-            pst_x_attrib_ll *p_sh  = p_head;
-            pst_x_attrib_ll *p_sh2 = NULL;
-            while (p_sh && (ptr->map > p_sh->map)) {
-                p_sh2 = p_sh;
-                p_sh  = p_sh->next;
-            }
-            if (!p_sh2) {
-                // needs to go before first item
-                ptr->next = p_head;
-                p_head = ptr;
-            } else {
-                // it will go after p_sh2
-                ptr->next = p_sh2->next;
-                p_sh2->next = ptr;
-            }
+            // add it to the list, pst_index_xattrib() sorts it afterwards
+            if (p_tail) p_tail->next = ptr; else p_head = ptr;
+            p_tail = ptr;
         } else {
             free(ptr);
         }
     }
     pst_free_id2(id2_head);
     pst_free_list(list);
-    pf->x_head = p_head;
+    pst_index_xattrib(pf, p_head);
     DEBUG_RET();
     return 1;
 }
 
 
-#define ITEM_COUNT_OFFSET32        0x1f0    // count byte
-#define LEVEL_INDICATOR_OFFSET32   0x1f3    // node or leaf
-#define BACKLINK_OFFSET32          0x1f8    // backlink u1 value
-#define ITEM_SIZE32                12
-#define DESC_SIZE32                16
-#define INDEX_COUNT_MAX32          41       // max active items
-#define DESC_COUNT_MAX32           31       // max active items
+/**
+ * fill in the parts of a sidecar index cache header that identify
+ * the pst file it belongs to.
+ *
+ * @return 0 if ok, -1 if the pst file cannot be examined
+ */
+static int pst_index_cache_identify(pst_file *pf, pst_index_cache_header *h) {
+    struct stat st;
+    memset(h, 0, sizeof(*h));
+    if (fstat(fileno(pf->fp), &st)) return -1;
+    memcpy(h->magic, PST_INDEX_CACHE_MAGIC, sizeof(h->magic));
+    h->version     = PST_INDEX_CACHE_VERSION;
+    h->byte_order  = PST_INDEX_CACHE_BYTE_ORDER;
+    h->file_size   = (uint64_t)st.st_size;
+    h->file_mtime  = (int64_t)st.st_mtime;
+    h->index1      = pf->index1;
+    h->index1_back = pf->index1_back;
+    h->index2      = pf->index2;
+    h->index2_back = pf->index2_back;
+    h->do_read64   = pf->do_read64;
+    return 0;
+}
 
-#define ITEM_COUNT_OFFSET64        0x1e8    // count byte
-#define LEVEL_INDICATOR_OFFSET64   0x1eb    // node or leaf
-#define BACKLINK_OFFSET64          0x1f8    // backlink u1 value
-#define ITEM_SIZE64                24
-#define DESC_SIZE64                32
-#define INDEX_COUNT_MAX64          20       // max active items
-#define DESC_COUNT_MAX64           15       // max active items
 
-#define BLOCK_SIZE                 512      // index blocks
-#define DESC_BLOCK_SIZE            512      // descriptor blocks
-#define ITEM_COUNT_OFFSET        (size_t)((pf->do_read64) ? ITEM_COUNT_OFFSET64      : ITEM_COUNT_OFFSET32)
-#define LEVEL_INDICATOR_OFFSET   (size_t)((pf->do_read64) ? LEVEL_INDICATOR_OFFSET64 : LEVEL_INDICATOR_OFFSET32)
-#define BACKLINK_OFFSET          (size_t)((pf->do_read64) ? BACKLINK_OFFSET64        : BACKLINK_OFFSET32)
-#define ITEM_SIZE                (size_t)((pf->do_read64) ? ITEM_SIZE64              : ITEM_SIZE32)
-#define DESC_SIZE                (size_t)((pf->do_read64) ? DESC_SIZE64              : DESC_SIZE32)
-#define INDEX_COUNT_MAX         (int32_t)((pf->do_read64) ? INDEX_COUNT_MAX64        : INDEX_COUNT_MAX32)
-#define DESC_COUNT_MAX          (int32_t)((pf->do_read64) ? DESC_COUNT_MAX64         : DESC_COUNT_MAX32)
+static uint64_t pst_index_cache_count_desc(pst_desc_tree *ptr) {
+    uint64_t n = 0;
+    while (ptr) {
+        n += 1 + pst_index_cache_count_desc(ptr->child);
+        ptr = ptr->next;
+    }
+    return n;
+}
 
 
-static size_t pst_decode_desc(pst_file *pf, pst_desc *desc, char *buf);
-static size_t pst_decode_desc(pst_file *pf, pst_desc *desc, char *buf) {
-    size_t r;
-    if (pf->do_read64) {
-        DEBUG_INFO(("Decoding desc64\n"));
-        DEBUG_HEXDUMPC(buf, sizeof(pst_desc), 0x10);
-        memcpy(desc, buf, sizeof(pst_desc));
-        LE64_CPU(desc->d_id);
-        LE64_CPU(desc->desc_id);
+static uint64_t pst_index_cache_id(pst_file *pf, pst_index_ll *id) {
+    if (!id || (id < pf->i_table) || (id >= pf->i_table + pf->i_count)) return 0;
+    return (uint64_t)(id - pf->i_table) + 1;
+}
+
+
+static int pst_index_cache_write_desc(FILE *fp, pst_file *pf, pst_desc_tree *ptr, uint64_t parent, uint64_t *pos) {
+    pst_index_cache_desc rec;
+    while (ptr) {
+        uint64_t me = ++(*pos);
+        rec.d_id        = ptr->d_id;
+        rec.parent_d_id = ptr->parent_d_id;
+        rec.desc        = pst_index_cache_id(pf, ptr->desc);
+        rec.assoc_tree  = pst_index_cache_id(pf, ptr->assoc_tree);
+        rec.parent      = parent;
+        if (fwrite(&rec, sizeof(rec), (size_t)1, fp) != 1) return -1;
+        if (ptr->child && pst_index_cache_write_desc(fp, pf, ptr->child, me, pos)) return -1;
+        ptr = ptr->next;
+    }
+    return 0;
+}
+
+
+static uint32_t pst_index_cache_xattrib_size(pst_x_attrib_ll *x) {
+    if (!x->data) return 0;
+    if (x->mytype == PST_MAP_HEADER) return (uint32_t)strlen((char*)x->data) + 1;
+    return (uint32_t)sizeof(uint32_t);
+}
+
+
+/**
+ * write the index and the extended attribute mapping of the pst file
+ * to the sidecar index cache. The file is written under a temporary
+ * name and renamed into place, so readers never see a partial file.
+ *
+ * @param pf       PST file structure with the index loaded
+ * @param x_result return value of pst_load_extended_attributes()
+ */
+static void pst_write_index_cache(pst_file *pf, int x_result) {
+    pst_index_cache_header h;
+    pst_index_cache_xattrib xrec;
+    pst_x_attrib_ll *x;
+    uint64_t pos = 0;
+    size_t len;
+    char *tmp;
+    FILE *fp;
+    int err = 0;
+    DEBUG_ENT("pst_write_index_cache");
+    if (pst_index_cache_identify(pf, &h)) {
+        DEBUG_WARN(("cannot stat the pst file, not writing %s\n", pf->index_cache));
+        DEBUG_RET();
+        return;
+    }
+    h.x_result   = x_result;
+    h.i_count    = pf->i_count;
+    h.d_count    = pst_index_cache_count_desc(pf->d_head);
+    h.total_size = sizeof(h) + h.i_count * sizeof(pst_index_ll) + h.d_count * sizeof(pst_index_cache_desc);
+    for (x = pf->x_head; x; x = x->next) {
+        h.x_count++;
+        h.total_size += sizeof(xrec) + pst_index_cache_xattrib_size(x);
+    }
+
+    len = strlen(pf->index_cache) + 5;
+    tmp = (char*)pst_malloc(len);
+    snprintf(tmp, len, "%s.tmp", pf->index_cache);
+    if (!(fp = fopen(tmp, "wb"))) {
+        DEBUG_WARN(("cannot create %s\n", tmp));
+        free(tmp);
+        DEBUG_RET();
+        return;
+    }
+    if (fwrite(&h, sizeof(h), (size_t)1, fp) != 1) err = 1;
+    if (!err && pf->i_count && (fwrite(pf->i_table, sizeof(pst_index_ll), pf->i_count, fp) != pf->i_count)) err = 1;
+    if (!err && pst_index_cache_write_desc(fp, pf, pf->d_head, 0, &pos)) err = 1;
+    for (x = pf->x_head; x && !err; x = x->next) {
+        xrec.mytype = x->mytype;
+        xrec.map    = x->map;
+        xrec.size   = pst_index_cache_xattrib_size(x);
+        if (fwrite(&xrec, sizeof(xrec), (size_t)1, fp) != 1) err = 1;
+        if (!err && xrec.size && (fwrite(x->data, (size_t)xrec.size, (size_t)1, fp) != 1)) err = 1;
+    }
+    if (fclose(fp)) err = 1;
+    if (err || rename(tmp, pf->index_cache)) {
+        DEBUG_WARN(("failed to write the index cache %s\n", pf->index_cache));
+        (void)remove(tmp);
+    }
+    free(tmp);
+    DEBUG_RET();
+}
+
+
+/**
+ * restore the index and the extended attribute mapping from the
+ * sidecar index cache, provided it was written for this pst file.
+ * The whole sidecar is read with a single read.
+ *
+ * @param pf   PST file structure without an index
+ * @return     0 if the index was restored, -1 if the cache is
+ *             missing, stale or damaged
+ */
+static int pst_read_index_cache(pst_file *pf) {
+    pst_index_cache_header h, want;
+    pst_index_cache_desc rec;
+    pst_index_cache_xattrib xrec;
+    pst_desc_tree **nodes = NULL;
+    pst_x_attrib_ll *x_tail = NULL;
+    struct stat st;
+    char *buf, *b;
+    size_t size;
+    uint64_t i;
+    FILE *fp;
+    DEBUG_ENT("pst_read_index_cache");
+
+    if (pst_index_cache_identify(pf, &want) || !(fp = fopen(pf->index_cache, "rb"))) {
+        DEBUG_RET();
+        return -1;
+    }
+    if (fstat(fileno(fp), &st) || ((uint64_t)st.st_size < sizeof(h)) || ((uint64_t)st.st_size > (uint64_t)(size_t)-1)) {
+        (void)fclose(fp);
+        DEBUG_RET();
+        return -1;
+    }
+    size = (size_t)st.st_size;
+    buf  = (char*)pst_malloc(size);
+    if (fread(buf, (size_t)1, size, fp) != size) {
+        (void)fclose(fp);
+        free(buf);
+        DEBUG_RET();
+        return -1;
+    }
+    (void)fclose(fp);
+
+    memcpy(&h, buf, sizeof(h));
+    if (memcmp(h.magic, want.magic, sizeof(h.magic)) ||
+        (h.version     != want.version)     ||
+        (h.byte_order  != want.byte_order)  ||
+        (h.total_size  != (uint64_t)size)   ||
+        (h.file_size   != want.file_size)   ||
+        (h.file_mtime  != want.file_mtime)  ||
+        (h.index1      != want.index1)      ||
+        (h.index1_back != want.index1_back) ||
+        (h.index2      != want.index2)      ||
+        (h.index2_back != want.index2_back) ||
+        (h.do_read64   != want.do_read64)   ||
+        (h.i_count     > size / sizeof(pst_index_ll)) ||
+        (h.d_count     > size / sizeof(pst_index_cache_desc)) ||
+        (sizeof(h) + h.i_count * sizeof(pst_index_ll) + h.d_count * sizeof(pst_index_cache_desc) > size)) {
+        DEBUG_INFO(("index cache %s does not match the pst file\n", pf->index_cache));
+        free(buf);
+        DEBUG_RET();
+        return -1;
+    }
+    b = buf + sizeof(h);
+
+    pf->i_count    = (size_t)h.i_count;
+    pf->i_capacity = (size_t)h.i_count;
+    pf->i_table    = (pst_index_ll*)pst_malloc(sizeof(pst_index_ll) * (h.i_count ? (size_t)h.i_count : 1));
+    memcpy(pf->i_table, b, sizeof(pst_index_ll) * (size_t)h.i_count);
+    b += sizeof(pst_index_ll) * (size_t)h.i_count;
+
+    pf->d_map = pst_new_id_map((size_t)h.d_count);
+    nodes = (pst_desc_tree**)pst_malloc(sizeof(pst_desc_tree*) * (h.d_count ? (size_t)h.d_count : 1));
+    for (i=0; i<h.d_count; i++) {
+        pst_desc_tree *node, *parent;
+        memcpy(&rec, b, sizeof(rec));
+        b += sizeof(rec);
+        if ((rec.desc > h.i_count) || (rec.assoc_tree > h.i_count) || (rec.parent > i)) goto damaged;
+        node = (pst_desc_tree*) pst_malloc(sizeof(pst_desc_tree));
+        memset(node, 0, sizeof(*node));
+        node->d_id        = rec.d_id;
+        node->parent_d_id = rec.parent_d_id;
+        node->desc        = (rec.desc)       ? pf->i_table + (rec.desc - 1)       : NULL;
+        node->assoc_tree  = (rec.assoc_tree) ? pf->i_table + (rec.assoc_tree - 1) : NULL;
+        parent            = (rec.parent)     ? nodes[rec.parent - 1]              : NULL;
+        if (parent) {
+            parent->no_child++;
+            node->parent = parent;
+            add_descriptor_to_list(node, &parent->child, &parent->child_tail);
+        }
+        else {
+            add_descriptor_to_list(node, &pf->d_head, &pf->d_tail);
+        }
+        pst_id_map_add(pf->d_map, node->d_id, node);
+        nodes[i] = node;
+    }
+
+    for (i=0; i<h.x_count; i++) {
+        pst_x_attrib_ll *x;
+        if ((size_t)(b - buf) + sizeof(xrec) > size) goto damaged;
+        memcpy(&xrec, b, sizeof(xrec));
+        b += sizeof(xrec);
+        if ((size_t)(b - buf) + xrec.size > size) goto damaged;
+        // pst_parse_block() reads a whole int for an attribute, and a
+        // terminated string for a header
+        if ((xrec.mytype == PST_MAP_ATTRIB) && (xrec.size != sizeof(uint32_t))) goto damaged;
+        if ((xrec.mytype == PST_MAP_HEADER) && (!xrec.size || b[xrec.size - 1])) goto damaged;
+        if ((xrec.mytype != PST_MAP_ATTRIB) && (xrec.mytype != PST_MAP_HEADER)) goto damaged;
+        x = (pst_x_attrib_ll*) pst_malloc(sizeof(*x));
+        x->mytype = xrec.mytype;
+        x->map    = xrec.map;
+        x->data   = NULL;
+        x->next   = NULL;
+        if (xrec.size) {
+            x->data = pst_malloc((size_t)xrec.size);
+            memcpy(x->data, b, (size_t)xrec.size);
+            b += xrec.size;
+        }
+        if (x_tail) x_tail->next = x; else pf->x_head = x;
+        x_tail = x;
+    }
+
+    pst_index_xattrib(pf, pf->x_head);
+    pst_index_keys(pf);
+    free(nodes);
+    free(buf);
+    pf->index_from_cache = 1;
+    pf->x_from_cache     = h.x_result;
+    DEBUG_RET();
+    return 0;
+
+damaged:
+    DEBUG_WARN(("index cache %s is damaged, ignoring it\n", pf->index_cache));
+    free(nodes);
+    free(buf);
+    free(pf->i_table);
+    pf->i_table    = NULL;
+    pf->i_count    = 0;
+    pf->i_capacity = 0;
+    pst_free_desc(pf->d_head);
+    pf->d_head = NULL;
+    pf->d_tail = NULL;
+    pst_free_id_map(pf->d_map);
+    pf->d_map = NULL;
+    pst_free_xattrib(pf->x_head);
+    pf->x_head = NULL;
+    free(pf->x_table);
+    pf->x_table = NULL;
+    DEBUG_RET();
+    return -1;
+}
+
+
+#define ITEM_COUNT_OFFSET32        0x1f0    // count byte
+#define LEVEL_INDICATOR_OFFSET32   0x1f3    // node or leaf
+#define BACKLINK_OFFSET32          0x1f8    // backlink u1 value
+#define ITEM_SIZE32                12
+#define DESC_SIZE32                16
+#define INDEX_COUNT_MAX32          41       // max active items
+#define DESC_COUNT_MAX32           31       // max active items
+
+#define ITEM_COUNT_OFFSET64        0x1e8    // count byte
+#define LEVEL_INDICATOR_OFFSET64   0x1eb    // node or leaf
+#define BACKLINK_OFFSET64          0x1f8    // backlink u1 value
+#define ITEM_SIZE64                24
+#define DESC_SIZE64                32
+#define INDEX_COUNT_MAX64          20       // max active items
+#define DESC_COUNT_MAX64           15       // max active items
+
+#define BLOCK_SIZE                 512      // index blocks
+#define DESC_BLOCK_SIZE            512      // descriptor blocks
+#define ITEM_COUNT_OFFSET        (size_t)((pf->do_read64) ? ITEM_COUNT_OFFSET64      : ITEM_COUNT_OFFSET32)
+#define LEVEL_INDICATOR_OFFSET   (size_t)((pf->do_read64) ? LEVEL_INDICATOR_OFFSET64 : LEVEL_INDICATOR_OFFSET32)
+#define BACKLINK_OFFSET          (size_t)((pf->do_read64) ? BACKLINK_OFFSET64        : BACKLINK_OFFSET32)
+#define ITEM_SIZE                (size_t)((pf->do_read64) ? ITEM_SIZE64              : ITEM_SIZE32)
+#define DESC_SIZE                (size_t)((pf->do_read64) ? DESC_SIZE64              : DESC_SIZE32)
+#define INDEX_COUNT_MAX         (int32_t)((pf->do_read64) ? INDEX_COUNT_MAX64        : INDEX_COUNT_MAX32)
+#define DESC_COUNT_MAX          (int32_t)((pf->do_read64) ? DESC_COUNT_MAX64         : DESC_COUNT_MAX32)
+
+
+static size_t pst_decode_desc(pst_file *pf, pst_desc *desc, char *buf);
+static size_t pst_decode_desc(pst_file *pf, pst_desc *desc, char *buf) {
+    size_t r;
+    if (pf->do_read64) {
+        DEBUG_INFO(("Decoding desc64\n"));
+        DEBUG_HEXDUMPC(buf, sizeof(pst_desc), 0x10);
+        memcpy(desc, buf, sizeof(pst_desc));
+        LE64_CPU(desc->d_id);
+        LE64_CPU(desc->desc_id);
         LE64_CPU(desc->tree_id);
         LE32_CPU(desc->parent_d_id);
         LE32_CPU(desc->u1);
@@ -981,12 +1912,12 @@ static size_t pst_decode_type3(pst_file *pf, pst_table3_rec *table3_rec, char *b
 }
 
 
-/** Process the index1 b-tree from the pst file and create the
- *  pf->i_head linked list from it. This tree holds the location
- *  (offset and size) of lower level objects (0xbcec descriptor
- *  blocks, etc) in the pst file.
+/** Process the index1 b-tree from the pst file and append its
+ *  entries to build->table in ascending i_id order. This tree holds
+ *  the location (offset and size) of lower level objects (0xbcec
+ *  descriptor blocks, etc) in the pst file.
  */
-static int pst_build_id_ptr(pst_file *pf, int64_t offset, int32_t depth, uint64_t linku1, uint64_t start_val, uint64_t end_val) {
+static int pst_build_id_ptr(pst_file *pf, pst_id_build *build, int64_t offset, int32_t depth, uint64_t linku1, uint64_t start_val, uint64_t end_val) {
     struct pst_table_ptr_struct table, table2;
     pst_index_ll *i_ptr=NULL;
     pst_index index;
@@ -1042,11 +1973,11 @@ static int pst_build_id_ptr(pst_file *pf, int64_t offset, int32_t depth, uint64_
                 return -1;
             }
             old = index.id;
-            if (pf->i_count == pf->i_capacity) {
-                pf->i_capacity += (pf->i_capacity >> 1) + 16; // arbitrary growth rate
-                pf->i_table = pst_realloc(pf->i_table, pf->i_capacity * sizeof(pst_index_ll));
+            if (build->count == build->capacity) {
+                build->capacity += (build->capacity >> 1) + 16; // arbitrary growth rate
+                build->table = pst_realloc(build->table, build->capacity * sizeof(pst_index_ll));
             }
-            i_ptr = &pf->i_table[pf->i_count++];
+            i_ptr = &build->table[build->count++];
             i_ptr->i_id   = index.id;
             i_ptr->offset = index.offset;
             i_ptr->u1     = index.u1;
@@ -1074,7 +2005,7 @@ static int pst_build_id_ptr(pst_file *pf, int64_t offset, int32_t depth, uint64_
                 return -1;
             }
             old = table.start;
-            (void)pst_build_id_ptr(pf, table.offset, depth+1, table.u1, table.start, table2.start);
+            (void)pst_build_id_ptr(pf, build, table.offset, depth+1, table.u1, table.start, table2.start);
         }
     }
     if (buf) free (buf);
@@ -1083,11 +2014,12 @@ static int pst_build_id_ptr(pst_file *pf, int64_t offset, int32_t depth, uint64_
 }
 
 
-/** Process the index2 b-tree from the pst file and create the
- *  pf->d_head tree from it. This tree holds descriptions of the
- *  higher level objects (email, contact, etc) in the pst file.
+/** Process the index2 b-tree from the pst file and collect the
+ *  descriptor nodes for the pf->d_head tree from it. This tree holds
+ *  descriptions of the higher level objects (email, contact, etc) in
+ *  the pst file. The nodes are hooked into the tree by link_descriptors().
  */
-static int pst_build_desc_ptr (pst_file *pf, int64_t offset, int32_t depth, uint64_t linku1, uint64_t start_val, uint64_t end_val) {
+static int pst_build_desc_ptr (pst_file *pf, pst_desc_build *build, int64_t offset, int32_t depth, uint64_t linku1, uint64_t start_val, uint64_t end_val) {
     struct pst_table_ptr_struct table, table2;
     pst_desc desc_rec;
     int32_t item_count;
@@ -1145,9 +2077,10 @@ static int pst_build_desc_ptr (pst_file *pf, int64_t offset, int32_t depth, uint
                 pst_desc_tree *d_ptr = (pst_desc_tree*) pst_malloc(sizeof(pst_desc_tree));
                 d_ptr->d_id        = desc_rec.d_id;
                 d_ptr->parent_d_id = desc_rec.parent_d_id;
-                d_ptr->assoc_tree  = pst_getID(pf, desc_rec.tree_id);
-                d_ptr->desc        = pst_getID(pf, desc_rec.desc_id);
-                record_descriptor(pf, d_ptr);   // add to the global tree
+                d_ptr->assoc_tree  = NULL;
+                d_ptr->desc        = NULL;
+                // the i_ids are resolved and the node is linked into the global tree later
+                pst_desc_build_add(build, d_ptr, desc_rec.desc_id, desc_rec.tree_id);
             }
         }
     } else {
@@ -1177,7 +2110,7 @@ static int pst_build_desc_ptr (pst_file *pf, int64_t offset, int32_t depth, uint
                 return -1;
             }
             old = table.start;
-            (void)pst_build_desc_ptr(pf, table.offset, depth+1, table.u1, table.start, table2.start);
+            (void)pst_build_desc_ptr(pf, build, table.offset, depth+1, table.u1, table.start, table2.start);
         }
     }
     if (buf) free(buf);
@@ -1186,108 +2119,589 @@ static int pst_build_desc_ptr (pst_file *pf, int64_t offset, int32_t depth, uint
 }
 
 
-/** Process a high level object from the pst file.
+static void pst_btree_add_task(pst_btree_tasks *tasks, int is_desc, int64_t offset, int32_t depth, uint64_t linku1, uint64_t start_val, uint64_t end_val) {
+    pst_btree_task *task;
+    if (tasks->count == tasks->capacity) {
+        tasks->capacity += (tasks->capacity >> 1) + 16;
+        tasks->tasks = (pst_btree_task*)pst_realloc(tasks->tasks, tasks->capacity * sizeof(pst_btree_task));
+    }
+    task = &tasks->tasks[tasks->count++];
+    memset(task, 0, sizeof(*task));
+    task->is_desc   = is_desc;
+    task->offset    = offset;
+    task->depth     = depth;
+    task->linku1    = linku1;
+    task->start_val = start_val;
+    task->end_val   = end_val;
+}
+
+
+/**
+ * Split one of the b-trees into tasks, one for each subtree below the
+ * root node, so the subtrees can be read concurrently. A root that is
+ * a leaf, or that cannot be read, becomes a single task and any error
+ * is reported when that task is run. Subtrees after an out of order
+ * entry are dropped, as pst_build_id_ptr() and pst_build_desc_ptr()
+ * would do.
+ *
+ * @param pf        PST file structure
+ * @param tasks     list the new tasks are appended to
+ * @param is_desc   1 for the index2 b-tree, 0 for index1
+ * @param offset    file offset of the root node
+ * @param linku1    back pointer value required in the root node
+ * @param start_val lowest id in the tree
+ * @param end_val   one past the highest id in the tree
  */
-pst_item* pst_parse_item(pst_file *pf, pst_desc_tree *d_ptr, pst_id2_tree *m_head) {
-    pst_mapi_object * list;
-    pst_id2_tree *id2_head = m_head;
-    pst_id2_tree *id2_ptr  = NULL;
-    pst_item *item = NULL;
-    pst_item_attach *attach = NULL;
-    int32_t x;
-    DEBUG_ENT("pst_parse_item");
-    if (!d_ptr) {
-        DEBUG_WARN(("you cannot pass me a NULL! I don't want it!\n"));
+static void pst_split_btree(pst_file *pf, pst_btree_tasks *tasks, int is_desc, int64_t offset, uint64_t linku1, uint64_t start_val, uint64_t end_val) {
+    struct pst_table_ptr_struct table, table2;
+    int32_t x, item_count;
+    uint64_t old = start_val;
+    char *buf = NULL, *bptr;
+    DEBUG_ENT("pst_split_btree");
+    if ((end_val <= start_val) ||
+        (pst_read_block_size(pf, offset, BLOCK_SIZE, &buf) < BLOCK_SIZE) ||
+        (buf[LEVEL_INDICATOR_OFFSET] == '\0') ||
+        (pst_getIntAt(pf, buf+BACKLINK_OFFSET) != linku1) ||
+        ((int32_t)(unsigned)(buf[ITEM_COUNT_OFFSET]) > INDEX_COUNT_MAX)) {
+        pst_btree_add_task(tasks, is_desc, offset, 0, linku1, start_val, end_val);
+        if (buf) free(buf);
         DEBUG_RET();
-        return NULL;
+        return;
+    }
+    item_count = (int32_t)(unsigned)(buf[ITEM_COUNT_OFFSET]);
+    bptr = buf;
+    for (x=0; x<item_count; x++) {
+        bptr += pst_decode_table(pf, &table, bptr);
+        if (table.start == 0) break;
+        if (x < (item_count-1)) {
+            (void)pst_decode_table(pf, &table2, bptr);
+        }
+        else {
+            table2.start = end_val;
+        }
+        if ((table.start >= end_val) || (table.start < old)) {
+            DEBUG_WARN(("This table isn't right. Must be corruption, or I got it wrong!\n"));
+            break;
+        }
+        old = table.start;
+        pst_btree_add_task(tasks, is_desc, table.offset, 1, table.u1, table.start, table2.start);
     }
+    free(buf);
+    DEBUG_RET();
+}
 
-    if (!d_ptr->desc) {
-        DEBUG_WARN(("why is d_ptr->desc == NULL? I don't want to do anything else with this record\n"));
-        DEBUG_RET();
-        return NULL;
+
+static void* pst_btree_worker(void *arg) {
+    pst_btree_tasks *tasks = (pst_btree_tasks*)arg;
+    while (1) {
+        pst_btree_task *task;
+#ifdef HAVE_PTHREAD_H
+        pthread_mutex_lock(&tasks->lock);
+#endif
+        task = (tasks->next < tasks->count) ? &tasks->tasks[tasks->next++] : NULL;
+#ifdef HAVE_PTHREAD_H
+        pthread_mutex_unlock(&tasks->lock);
+#endif
+        if (!task) break;
+        if (task->is_desc)
+            (void)pst_build_desc_ptr(tasks->pf, &task->descs, task->offset, task->depth, task->linku1, task->start_val, task->end_val);
+        else
+            (void)pst_build_id_ptr(tasks->pf, &task->ids, task->offset, task->depth, task->linku1, task->start_val, task->end_val);
     }
+    return NULL;
+}
 
-    if (d_ptr->assoc_tree) {
-        if (m_head) {
-            DEBUG_WARN(("supplied master head, but have a list that is building a new id2_head\n"));
-            m_head = NULL;
+
+/**
+ * Read both b-trees, producing the sorted pf->i_table and the
+ * descriptor nodes in read order. The subtrees below the two root
+ * nodes are shared out to a small pool of threads, so the reads of
+ * many nodes are in flight at once. Each subtree collects its own
+ * results, and these are joined in tree order afterwards, so the
+ * output is the same as a serial depth first walk.
+ *
+ * @param pf    PST file structure
+ * @param build receives the descriptor nodes
+ */
+static void pst_build_index(pst_file *pf, pst_desc_build *build) {
+    pst_btree_tasks tasks;
+    size_t i, i_count = 0;
+    DEBUG_ENT("pst_build_index");
+    memset(&tasks, 0, sizeof(tasks));
+    tasks.pf = pf;
+    pst_split_btree(pf, &tasks, 0, pf->index1, pf->index1_back, 0, UINT64_MAX);
+    pst_split_btree(pf, &tasks, 1, pf->index2, pf->index2_back, (uint64_t)0x21, UINT64_MAX);
+    DEBUG_INFO(("reading %i b-tree subtrees\n", (int)tasks.count));
+
+#ifdef HAVE_PTHREAD_H
+    {
+        pthread_t threads[PST_INDEX_THREADS-1];
+        size_t n = 0, want = tasks.count - 1;
+        if (want > PST_INDEX_THREADS-1) want = PST_INDEX_THREADS-1;
+#ifndef HAVE_PREAD
+        if (!pf->map) want = 0;     // the stdio file position is shared
+#endif
+        pthread_mutex_init(&tasks.lock, NULL);
+        while ((n < want) && (pthread_create(&threads[n], NULL, pst_btree_worker, &tasks) == 0)) n++;
+        (void)pst_btree_worker(&tasks);
+        for (i=0; i<n; i++) pthread_join(threads[i], NULL);
+        pthread_mutex_destroy(&tasks.lock);
+    }
+#else
+    (void)pst_btree_worker(&tasks);
+#endif
+
+    for (i=0; i<tasks.count; i++) i_count += tasks.tasks[i].ids.count;
+    free(pf->i_table);
+    pf->i_table    = (i_count) ? (pst_index_ll*)pst_malloc(i_count * sizeof(pst_index_ll)) : NULL;
+    pf->i_count    = 0;
+    pf->i_capacity = i_count;
+    for (i=0; i<tasks.count; i++) {
+        pst_btree_task *task = &tasks.tasks[i];
+        size_t j;
+        if (task->ids.count) {
+            memcpy(pf->i_table + pf->i_count, task->ids.table, task->ids.count * sizeof(pst_index_ll));
+            pf->i_count += task->ids.count;
         }
-        id2_head = pst_build_id2(pf, d_ptr->assoc_tree);
+        for (j=0; j<task->descs.count; j++) {
+            pst_desc_build_add(build, task->descs.nodes[j], task->descs.ids[j].desc_id, task->descs.ids[j].tree_id);
+        }
+        free(task->ids.table);
+        free(task->descs.nodes);
+        free(task->descs.ids);
     }
-    pst_printID2ptr(id2_head);
+    free(tasks.tasks);
 
-    list = pst_parse_block(pf, d_ptr->desc->i_id, id2_head);
-    if (!list) {
-        DEBUG_WARN(("pst_parse_block() returned an error for d_ptr->desc->i_id [%#"PRIx64"]\n", d_ptr->desc->i_id));
-        if (!m_head) pst_free_id2(id2_head);
-        DEBUG_RET();
-        return NULL;
+    // pst_getID() needs ascending ids, each subtree only checks its own range
+    for (i=1; i<pf->i_count; i++) {
+        if (pf->i_table[i].i_id < pf->i_table[i-1].i_id) {
+            DEBUG_WARN(("index1 entries out of order, sorting them\n"));
+            qsort(pf->i_table, pf->i_count, sizeof(pst_index_ll), pst_index_ll_compare);
+            break;
+        }
+    }
+    pst_index_keys(pf);
+    DEBUG_INFO(("loaded %i index entries and %i descriptors\n", (int)pf->i_count, (int)build->count));
+    DEBUG_RET();
+}
+
+
+/**
+ * fill pf->i_keys from the sorted pf->i_table. Four byte keys in
+ * their own array keep the whole search path of pst_getID() within
+ * a few cache lines, where bsearch() over i_table touches a 24 byte
+ * record at every step. Files with wider ids fall back to bsearch().
+ */
+static void pst_index_keys(pst_file *pf) {
+    size_t i;
+    free(pf->i_keys);
+    pf->i_keys = NULL;
+    if (!pf->i_count || (pf->i_table[pf->i_count-1].i_id > UINT32_MAX)) return;
+    pf->i_keys = (uint32_t*)pst_malloc(sizeof(uint32_t) * pf->i_count);
+    for (i=0; i<pf->i_count; i++) pf->i_keys[i] = (uint32_t)pf->i_table[i].i_id;
+}
+
+
+/** @return the position of the first key not below id, or count */
+static size_t pst_lower_bound32(const uint32_t *keys, size_t count, uint32_t id) {
+    const uint32_t *base = keys;
+    size_t n = count;
+    if (!n) return 0;
+    while (n > 1) {
+        size_t half = n / 2;
+        base += (base[half-1] < id) ? half : 0;     // compiles to a conditional move
+        n    -= half;
     }
+    return (size_t)(base - keys) + (*base < id);
+}
 
-    item = (pst_item*) pst_malloc(sizeof(pst_item));
-    memset(item, 0, sizeof(pst_item));
-    item->pf = pf;
 
-    if (pst_process(d_ptr->desc->i_id, list, item, NULL)) {
-        DEBUG_WARN(("pst_process() returned non-zero value. That is an error\n"));
-        pst_freeItem(item);
-        pst_free_list(list);
-        if (!m_head) pst_free_id2(id2_head);
+int pst_load_index_lazy(pst_file *pf) {
+    DEBUG_ENT("pst_load_index_lazy");
+    if (!pf) {
+        DEBUG_WARN(("Cannot load index for a NULL pst_file\n"));
         DEBUG_RET();
-        return NULL;
+        return -1;
     }
-    pst_free_list(list);
+    if (!pf->lazy_index) {
+        if (pf->i_count || pf->d_head) {
+            DEBUG_WARN(("The index is already loaded\n"));
+            DEBUG_RET();
+            return -1;
+        }
+        pf->lazy_index = 1;
+        pf->i_map      = pst_new_id_map(0);
+        pf->d_map      = pst_new_id_map(0);
+    }
+    DEBUG_RET();
+    return 0;
+}
 
-    if ((id2_ptr = pst_getID2(id2_head, (uint64_t)0x692))) {
-        // DSN/MDN reports?
-        DEBUG_INFO(("DSN/MDN processing\n"));
-        list = pst_parse_block(pf, id2_ptr->id->i_id, id2_head);
-        if (list) {
-            for (x=0; x < list->count_objects; x++) {
-                attach = (pst_item_attach*) pst_malloc(sizeof(pst_item_attach));
-                memset(attach, 0, sizeof(pst_item_attach));
-                attach->next = item->attach;
-                item->attach = attach;
-            }
-            if (pst_process(id2_ptr->id->i_id, list, item, item->attach)) {
-                DEBUG_WARN(("ERROR pst_process() failed with DSN/MDN attachments\n"));
-                pst_freeItem(item);
-                pst_free_list(list);
-                if (!m_head) pst_free_id2(id2_head);
-                DEBUG_RET();
-                return NULL;
-            }
-            pst_free_list(list);
-        } else {
-            DEBUG_WARN(("ERROR error processing main DSN/MDN record\n"));
-            // if (!m_head) pst_free_id2(id2_head);
-            // DEBUG_RET();
-            // return item;
+
+static void pst_free_lazy_index(pst_file *pf) {
+    size_t i;
+    if (pf->i_map) {
+        for (i=0; i<=pf->i_map->mask; i++) {
+            free(pf->i_map->slots[i].ptr);
         }
+        pst_free_id_map(pf->i_map);
     }
+    pf->i_map      = NULL;
+    pf->lazy_index = 0;
+}
 
-    if ((id2_ptr = pst_getID2(id2_head, (uint64_t)0x671))) {
-        DEBUG_INFO(("ATTACHMENT processing attachment\n"));
-        list = pst_parse_block(pf, id2_ptr->id->i_id, id2_head);
-        if (!list) {
-            if (item->flags & PST_FLAG_HAS_ATTACHMENT) {
-                // Only report an error if we expected to see an attachment table and didn't.
-                DEBUG_WARN(("ERROR error processing main attachment record\n"));
-            }
-            if (!m_head) pst_free_id2(id2_head);
-            DEBUG_RET();
-            return item;
+
+/**
+ * Walk down one of the b-trees towards a key, reading only the nodes
+ * on that path. Both b-trees use 512 byte nodes with the same layout
+ * of the interior nodes.
+ *
+ * @param pf     PST file structure
+ * @param offset file offset of the root node
+ * @param linku1 back pointer value required in the root node
+ * @param key    the i_id or d_id we are looking for
+ * @return       buffer holding the leaf node that may contain the key, or
+ *               NULL if there is none. The caller must free this buffer.
+ */
+static char* pst_find_leaf(pst_file *pf, uint64_t offset, uint64_t linku1, uint64_t key) {
+    struct pst_table_ptr_struct table, found;
+    int32_t x, item_count, depth, have;
+    char *buf = NULL, *bptr;
+    DEBUG_ENT("pst_find_leaf");
+    for (depth=0; depth<PST_MAX_BTREE_DEPTH; depth++) {
+        if (pst_read_block_size(pf, (int64_t)offset, BLOCK_SIZE, &buf) < BLOCK_SIZE) {
+            DEBUG_WARN(("Failed to read %i bytes\n", BLOCK_SIZE));
+            break;
         }
-        for (x=0; x < list->count_objects; x++) {
-            attach = (pst_item_attach*) pst_malloc(sizeof(pst_item_attach));
-            memset(attach, 0, sizeof(pst_item_attach));
-            attach->next = item->attach;
-            item->attach = attach;
+        if (pst_getIntAt(pf, buf+BACKLINK_OFFSET) != linku1) {
+            DEBUG_WARN(("Backlink in node at %#"PRIx64" does not match required %#"PRIx64"\n", offset, linku1));
+            break;
         }
-        if (pst_process(id2_ptr->id->i_id, list, item, item->attach)) {
-            DEBUG_WARN(("ERROR pst_process() failed with attachments\n"));
-            pst_freeItem(item);
+        if (buf[LEVEL_INDICATOR_OFFSET] == '\0') {
+            DEBUG_RET();
+            return buf;
+        }
+        item_count = (int32_t)(unsigned)(buf[ITEM_COUNT_OFFSET]);
+        if (item_count > INDEX_COUNT_MAX) {
+            DEBUG_WARN(("Item count %i too large, max is %i\n", item_count, INDEX_COUNT_MAX));
+            break;
+        }
+        // descend into the last child whose range starts at or before the key
+        bptr = buf;
+        have = 0;
+        for (x=0; x<item_count; x++) {
+            bptr += pst_decode_table(pf, &table, bptr);
+            if ((table.start == 0) || (table.start > key)) break;
+            found = table;
+            have  = 1;
+        }
+        if (!have) break;
+        offset = found.offset;
+        linku1 = found.u1;
+    }
+    if (buf) free(buf);
+    DEBUG_RET();
+    return NULL;
+}
+
+
+/**
+ * Find an index entry by reading the path to it in the index1 b-tree.
+ * All the entries of the leaf node are remembered in pf->i_map.
+ *
+ * @param pf   PST file structure set up by pst_load_index_lazy()
+ * @param i_id the id we are looking for, with the low bit cleared
+ * @return     pointer to the entry, or NULL if not found
+ */
+static pst_index_ll* pst_lazy_getID(pst_file *pf, uint64_t i_id) {
+    pst_index_ll *ptr = NULL;
+    pst_index index;
+    int32_t x, item_count;
+    char *buf, *bptr;
+    DEBUG_ENT("pst_lazy_getID");
+    buf = pst_find_leaf(pf, pf->index1, pf->index1_back, i_id);
+    if (!buf) {
+        DEBUG_RET();
+        return NULL;
+    }
+    item_count = (int32_t)(unsigned)(buf[ITEM_COUNT_OFFSET]);
+    if (item_count > INDEX_COUNT_MAX) item_count = 0;
+    bptr = buf;
+    for (x=0; x<item_count; x++) {
+        pst_index_ll *e;
+        bptr += pst_decode_index(pf, &index, bptr);
+        if (index.id == 0) break;
+        e = (pst_index_ll*)pst_id_map_get(pf->i_map, index.id);
+        if (!e) {
+            e = (pst_index_ll*)pst_malloc(sizeof(pst_index_ll));
+            e->i_id   = index.id;
+            e->offset = index.offset;
+            e->u1     = index.u1;
+            e->size   = index.size;
+            pst_id_map_add(pf->i_map, e->i_id, e);
+        }
+        if (e->i_id == i_id) ptr = e;
+    }
+    free(buf);
+    DEBUG_RET();
+    return ptr;
+}
+
+
+/**
+ * Find a descriptor by reading the path to it in the index2 b-tree.
+ * The new node is added to the top level of the descriptor tree and
+ * to pf->d_map, without any children.
+ *
+ * @param pf   PST file structure set up by pst_load_index_lazy()
+ * @param d_id the id we are looking for
+ * @return     pointer to the descriptor, or NULL if not found
+ */
+static pst_desc_tree* pst_lazy_getDptr(pst_file *pf, uint64_t d_id) {
+    pst_desc_tree *ptr = NULL;
+    pst_desc desc_rec;
+    int32_t x, item_count;
+    char *buf, *bptr;
+    DEBUG_ENT("pst_lazy_getDptr");
+    buf = pst_find_leaf(pf, pf->index2, pf->index2_back, d_id);
+    if (!buf) {
+        DEBUG_RET();
+        return NULL;
+    }
+    item_count = (int32_t)(unsigned)(buf[ITEM_COUNT_OFFSET]);
+    if (item_count > DESC_COUNT_MAX) item_count = 0;
+    bptr = buf;
+    for (x=0; x<item_count; x++) {
+        bptr += pst_decode_desc(pf, &desc_rec, bptr);
+        if (desc_rec.d_id != d_id) continue;
+        ptr = (pst_desc_tree*) pst_malloc(sizeof(pst_desc_tree));
+        memset(ptr, 0, sizeof(*ptr));
+        ptr->d_id        = desc_rec.d_id;
+        ptr->parent_d_id = desc_rec.parent_d_id;
+        ptr->assoc_tree  = pst_getID(pf, desc_rec.tree_id);
+        ptr->desc        = pst_getID(pf, desc_rec.desc_id);
+        add_descriptor_to_list(ptr, &pf->d_head, &pf->d_tail);
+        pst_id_map_add(pf->d_map, ptr->d_id, ptr);
+        break;
+    }
+    free(buf);
+    DEBUG_RET();
+    return ptr;
+}
+
+
+static int pst_prop_id_compare(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t*)a;
+    uint32_t y = *(const uint32_t*)b;
+    return (x < y) ? -1 : (x > y) ? 1 : 0;
+}
+
+
+/** Ids that pst_parse_item_props() keeps whatever the caller asks
+ *  for, since the item type, the attachment list and the charset that
+ *  pst_convert_utf8() picks depend on them.
+ */
+static const uint32_t pst_prop_filter_required[] = {
+    0x001A, // PR_MESSAGE_CLASS
+    0x0E07, // PR_MESSAGE_FLAGS
+    0x3613, // PR_CONTAINER_CLASS
+    0x3FDE, // PR_INTERNET_CPID
+    0x3FFD, // PR_MESSAGE_CODEPAGE
+    0x67F2, // ID2 value of the attachment
+    (uint32_t)PST_ATTRIB_HEADER,    // internet headers, for the content-type charset
+};
+
+
+/** Test whether an element with this MAPI id survives the filter.
+ *  A NULL filter keeps everything.
+ */
+static int pst_prop_wanted(const pst_prop_filter *filter, uint32_t mapi_id) {
+    size_t lo, hi;
+    if (!filter) return 1;
+    lo = 0;
+    hi = filter->count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (filter->ids[mid] < mapi_id)
+            lo = mid + 1;
+        else if (filter->ids[mid] > mapi_id)
+            hi = mid;
+        else
+            return !filter->exclude;
+    }
+    return filter->exclude;
+}
+
+
+/** The potentially large properties that pst_parse_item() leaves for
+ *  pst_load_bodies() when pf->lazy_bodies is set, sorted.
+ */
+static const uint32_t pst_deferred_props[] = {
+    0x007D, // PR_TRANSPORT_MESSAGE_HEADERS
+    0x1000, // PR_BODY
+    0x1009, // PR_RTF_COMPRESSED
+    0x1013, // PR_BODY_HTML
+};
+
+static const pst_prop_filter pst_deferred_skip = {
+    pst_deferred_props, sizeof(pst_deferred_props)/sizeof(pst_deferred_props[0]), 1
+};
+
+static const pst_prop_filter pst_deferred_load = {
+    pst_deferred_props, sizeof(pst_deferred_props)/sizeof(pst_deferred_props[0]), 0
+};
+
+
+pst_item* pst_parse_item(pst_file *pf, pst_desc_tree *d_ptr, pst_id2_tree *m_head) {
+    return pst_parse_item_filtered(pf, d_ptr, m_head, NULL);
+}
+
+
+pst_item* pst_parse_item_props(pst_file *pf, pst_desc_tree *d_ptr, pst_id2_tree *m_head, const uint32_t *props, size_t count) {
+    size_t n = sizeof(pst_prop_filter_required) / sizeof(pst_prop_filter_required[0]);
+    size_t i, j;
+    uint32_t *ids;
+    pst_prop_filter filter;
+    pst_item *item;
+    if (!props) return pst_parse_item_filtered(pf, d_ptr, m_head, NULL);
+    ids = (uint32_t*) pst_malloc((count + n) * sizeof(uint32_t));
+    memcpy(ids, props, count * sizeof(uint32_t));
+    memcpy(ids + count, pst_prop_filter_required, n * sizeof(uint32_t));
+    qsort(ids, count + n, sizeof(uint32_t), pst_prop_id_compare);
+    for (i = j = 0; i < count + n; i++) {
+        if (!j || (ids[j-1] != ids[i])) ids[j++] = ids[i];
+    }
+    filter.ids     = ids;
+    filter.count   = j;
+    filter.exclude = 0;
+    item = pst_parse_item_filtered(pf, d_ptr, m_head, &filter);
+    free(ids);
+    return item;
+}
+
+
+/** Process a high level object from the pst file, keeping only the
+ *  elements that pass the filter. Without a filter, the large bodies
+ *  are deferred to pst_load_bodies() if pf->lazy_bodies is set.
+ */
+static pst_item* pst_parse_item_filtered(pst_file *pf, pst_desc_tree *d_ptr, pst_id2_tree *m_head, const pst_prop_filter *filter) {
+    pst_mapi_object * list;
+    const pst_prop_filter *item_filter = filter;
+    pst_id2_tree *id2_head = m_head;
+    pst_id2_tree *id2_ptr  = NULL;
+    pst_item *item = NULL;
+    pst_item_attach *attach = NULL;
+    int32_t x;
+    DEBUG_ENT("pst_parse_item");
+    if (!d_ptr) {
+        DEBUG_WARN(("you cannot pass me a NULL! I don't want it!\n"));
+        DEBUG_RET();
+        return NULL;
+    }
+
+    if (!d_ptr->desc) {
+        DEBUG_WARN(("why is d_ptr->desc == NULL? I don't want to do anything else with this record\n"));
+        DEBUG_RET();
+        return NULL;
+    }
+
+    if (d_ptr->assoc_tree) {
+        if (m_head) {
+            DEBUG_WARN(("supplied master head, but have a list that is building a new id2_head\n"));
+            m_head = NULL;
+        }
+        id2_head = pst_build_id2(pf, d_ptr->assoc_tree);
+    }
+    if (DEBUG_ACTIVE) pst_printID2ptr(id2_head);
+
+    if (!filter && pf->lazy_bodies) item_filter = &pst_deferred_skip;
+    list = pst_parse_block(pf, d_ptr->desc->i_id, id2_head, item_filter);
+    if (!list) {
+        DEBUG_WARN(("pst_parse_block() returned an error for d_ptr->desc->i_id [%#"PRIx64"]\n", d_ptr->desc->i_id));
+        if (!m_head) pst_free_id2(id2_head);
+        DEBUG_RET();
+        return NULL;
+    }
+
+    if (pf->item_arena) {
+        pst_arena *arena = pst_arena_acquire(pf);
+        item = (pst_item*) pst_arena_alloc(arena, sizeof(pst_item));
+        memset(item, 0, sizeof(pst_item));
+        item->arena = arena;
+    }
+    else {
+        item = (pst_item*) pst_malloc(sizeof(pst_item));
+        memset(item, 0, sizeof(pst_item));
+    }
+    item->pf = pf;
+
+    if (pst_process(d_ptr->desc->i_id, list, item, NULL)) {
+        DEBUG_WARN(("pst_process() returned non-zero value. That is an error\n"));
+        pst_freeItem(item);
+        pst_free_list(list);
+        if (!m_head) pst_free_id2(id2_head);
+        DEBUG_RET();
+        return NULL;
+    }
+    pst_alloc_skipped_owners(item, list->skipped_owners);
+    if ((item_filter == &pst_deferred_skip) && list->count_skipped) {
+        pst_item_deferred *deferred = (pst_item_deferred*) pst_malloc(sizeof(pst_item_deferred));
+        deferred->block_id   = d_ptr->desc->i_id;
+        deferred->assoc_tree = d_ptr->assoc_tree;
+        deferred->id2_head   = (d_ptr->assoc_tree) ? NULL : pst_share_id2(id2_head);
+        item->deferred = deferred;
+    }
+    pst_free_list(list);
+
+    if ((id2_ptr = pst_getID2(id2_head, (uint64_t)0x692))) {
+        // DSN/MDN reports?
+        DEBUG_INFO(("DSN/MDN processing\n"));
+        list = pst_parse_block(pf, id2_ptr->id->i_id, id2_head, filter);
+        if (list) {
+            for (x=0; x < list->count_objects; x++) {
+                attach = (pst_item_attach*) pst_malloc(sizeof(pst_item_attach));
+                memset(attach, 0, sizeof(pst_item_attach));
+                attach->next = item->attach;
+                item->attach = attach;
+            }
+            if (pst_process(id2_ptr->id->i_id, list, item, item->attach)) {
+                DEBUG_WARN(("ERROR pst_process() failed with DSN/MDN attachments\n"));
+                pst_freeItem(item);
+                pst_free_list(list);
+                if (!m_head) pst_free_id2(id2_head);
+                DEBUG_RET();
+                return NULL;
+            }
+            pst_free_list(list);
+        } else {
+            DEBUG_WARN(("ERROR error processing main DSN/MDN record\n"));
+            // if (!m_head) pst_free_id2(id2_head);
+            // DEBUG_RET();
+            // return item;
+        }
+    }
+
+    if ((id2_ptr = pst_getID2(id2_head, (uint64_t)0x671))) {
+        DEBUG_INFO(("ATTACHMENT processing attachment\n"));
+        list = pst_parse_block(pf, id2_ptr->id->i_id, id2_head, filter);
+        if (!list) {
+            if (item->flags & PST_FLAG_HAS_ATTACHMENT) {
+                // Only report an error if we expected to see an attachment table and didn't.
+                DEBUG_WARN(("ERROR error processing main attachment record\n"));
+            }
+            if (!m_head) pst_free_id2(id2_head);
+            DEBUG_RET();
+            return item;
+        }
+        for (x=0; x < list->count_objects; x++) {
+            attach = (pst_item_attach*) pst_malloc(sizeof(pst_item_attach));
+            memset(attach, 0, sizeof(pst_item_attach));
+            attach->next = item->attach;
+            item->attach = attach;
+        }
+        if (pst_process(id2_ptr->id->i_id, list, item, item->attach)) {
+            DEBUG_WARN(("ERROR pst_process() failed with attachments\n"));
+            pst_freeItem(item);
             pst_free_list(list);
             if (!m_head) pst_free_id2(id2_head);
             DEBUG_RET();
@@ -1305,7 +2719,7 @@ pst_item* pst_parse_item(pst_file *pf, pst_desc_tree *d_ptr, pst_id2_tree *m_hea
                 // id2_ptr is a record describing the attachment
                 // we pass NULL instead of id2_head cause we don't want it to
                 // load all the extra stuff here.
-                list = pst_parse_block(pf, id2_ptr->id->i_id, NULL);
+                list = pst_parse_block(pf, id2_ptr->id->i_id, NULL, filter);
                 if (!list) {
                     DEBUG_WARN(("ERROR error processing an attachment record\n"));
                     continue;
@@ -1328,7 +2742,7 @@ pst_item* pst_parse_item(pst_file *pf, pst_desc_tree *d_ptr, pst_id2_tree *m_hea
                     DEBUG_WARN(("second pass attachment updating id2 %#"PRIx64" found i_id %#"PRIx64"\n", attach->id2_val, id2_ptr->id->i_id));
                     // i_id has been updated to the datablock containing the attachment data
                     attach->i_id     = id2_ptr->id->i_id;
-                    attach->id2_head = deep_copy(id2_ptr->child);
+                    attach->id2_head = pst_share_id2(id2_ptr->child);
                 } else {
                     DEBUG_WARN(("have not located the correct value for the attachment [%#"PRIx64"]\n", attach->id2_val));
                 }
@@ -1338,39 +2752,412 @@ pst_item* pst_parse_item(pst_file *pf, pst_desc_tree *d_ptr, pst_id2_tree *m_hea
             }
         }
     }
-
-    if (!m_head) pst_free_id2(id2_head);
-    DEBUG_RET();
-    return item;
+
+    if (!m_head) pst_free_id2(id2_head);
+    DEBUG_RET();
+    return item;
+}
+
+
+void pst_set_lazy_bodies(pst_file *pf, int enable) {
+    pf->lazy_bodies = enable ? 1 : 0;
+}
+
+
+void pst_set_item_arena(pst_file *pf, int enable) {
+    pf->item_arena = enable ? 1 : 0;
+}
+
+
+int pst_load_bodies(pst_item *item) {
+    pst_item_deferred *deferred;
+    pst_id2_tree *id2_head;
+    pst_mapi_object *list;
+    int r = 0;
+    if (!item || !item->deferred) return 0;
+    DEBUG_ENT("pst_load_bodies");
+    deferred = item->deferred;
+    item->deferred = NULL;
+    id2_head = (deferred->assoc_tree) ? pst_build_id2(item->pf, deferred->assoc_tree) : deferred->id2_head;
+    list = pst_parse_block(item->pf, deferred->block_id, id2_head, &pst_deferred_load);
+    if (!list) {
+        DEBUG_WARN(("pst_parse_block() returned an error for deferred block %#"PRIx64"\n", deferred->block_id));
+        r = -1;
+    }
+    else {
+        if (pst_process(deferred->block_id, list, item, NULL)) {
+            DEBUG_WARN(("pst_process() failed on the deferred properties\n"));
+            r = -1;
+        }
+        pst_free_list(list);
+    }
+    if (deferred->assoc_tree) pst_free_id2(id2_head);
+    pst_free_deferred(deferred);
+    DEBUG_RET();
+    return r;
+}
+
+
+static void pst_free_deferred(pst_item_deferred *deferred) {
+    if (!deferred) return;
+    pst_free_id2(deferred->id2_head);
+    free(deferred);
+}
+
+
+static void freeall(pst_subblocks *subs, pst_block_offset_pointer *p1,
+                                         pst_block_offset_pointer *p2,
+                                         pst_block_offset_pointer *p3,
+                                         pst_block_offset_pointer *p4,
+                                         pst_block_offset_pointer *p5,
+                                         pst_block_offset_pointer *p6,
+                                         pst_block_offset_pointer *p7);
+static void freeall(pst_subblocks *subs, pst_block_offset_pointer *p1,
+                                         pst_block_offset_pointer *p2,
+                                         pst_block_offset_pointer *p3,
+                                         pst_block_offset_pointer *p4,
+                                         pst_block_offset_pointer *p5,
+                                         pst_block_offset_pointer *p6,
+                                         pst_block_offset_pointer *p7) {
+    size_t i;
+    for (i=0; i<subs->subblock_count; i++) {
+        if (subs->subs[i].buf) free(subs->subs[i].buf);
+    }
+    free(subs->subs);
+    if (p1->needfree) free(p1->from);
+    if (p2->needfree) free(p2->from);
+    if (p3->needfree) free(p3->from);
+    if (p4->needfree) free(p4->from);
+    if (p5->needfree) free(p5->from);
+    if (p6->needfree) free(p6->from);
+    if (p7->needfree) free(p7->from);
+}
+
+
+static void* pst_arena_alloc(pst_arena *arena, size_t size) {
+    pst_arena_chunk *c = arena->head;
+    char *p;
+    size = (size + 15) & ~(size_t)15;
+    if (!c || (c->size - c->used < size)) {
+        if (size > PST_ARENA_CHUNK / 4) {
+            // large values get a chunk of their own behind the one being
+            // filled, so the free space in that one is not wasted
+            c = (pst_arena_chunk*) pst_malloc(PST_ARENA_HDR + size);
+            c->size = c->used = size;
+            if (arena->head) {
+                c->next = arena->head->next;
+                arena->head->next = c;
+            }
+            else {
+                c->next = NULL;
+                arena->head = c;
+            }
+            return (char*)c + PST_ARENA_HDR;
+        }
+        c = (pst_arena_chunk*) pst_malloc(PST_ARENA_HDR + PST_ARENA_CHUNK);
+        c->size = PST_ARENA_CHUNK;
+        c->used = 0;
+        c->next = arena->head;
+        arena->head = c;
+    }
+    p = (char*)c + PST_ARENA_HDR + c->used;
+    c->used += size;
+    return p;
+}
+
+
+/** Test whether ptr points into one of the arena's chunks. */
+static int pst_arena_owns(pst_arena *arena, const void *ptr) {
+    pst_arena_chunk *c;
+    for (c = arena->head; c; c = c->next) {
+        const char *data = (const char*)c + PST_ARENA_HDR;
+        if (((const char*)ptr >= data) && ((const char*)ptr < data + c->size)) return 1;
+    }
+    return 0;
+}
+
+
+/** Hand a malloc'ed buffer to the arena, to be freed with it. */
+static void pst_arena_adopt(pst_arena *arena, void *ptr) {
+    if (arena->owned_count == arena->owned_capacity) {
+        arena->owned_capacity = (arena->owned_capacity) ? arena->owned_capacity * 2 : 8;
+        arena->owned = (void**) pst_realloc(arena->owned, arena->owned_capacity * sizeof(void*));
+    }
+    arena->owned[arena->owned_count++] = ptr;
+}
+
+
+/** Empty the arena, keeping one regular chunk for the next list. */
+static void pst_arena_reset(pst_arena *arena) {
+    pst_arena_chunk *keep = NULL;
+    pst_arena_chunk *c = arena->head;
+    size_t i;
+    while (c) {
+        pst_arena_chunk *next = c->next;
+        if (!keep && (c->size == PST_ARENA_CHUNK)) {
+            keep = c;
+            keep->used = 0;
+            keep->next = NULL;
+        }
+        else {
+            free(c);
+        }
+        c = next;
+    }
+    arena->head = keep;
+    for (i=0; i<arena->owned_count; i++) free(arena->owned[i]);
+    arena->owned_count = 0;
+}
+
+
+/** drop one reference to a pool, freeing it with the last one */
+static void pst_arena_pool_unref(struct pst_arena_pool *pool) {
+    size_t refs;
+    if (!pool) return;
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_lock(&pool->lock);
+#endif
+    refs = --pool->refs;
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_unlock(&pool->lock);
+#endif
+    if (refs) return;
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_destroy(&pool->lock);
+#endif
+    free(pool);
+}
+
+
+static void pst_free_arena(pst_arena *arena) {
+    struct pst_arena_pool *pool = arena->pool;
+    pst_arena_reset(arena);
+    free(arena->head);
+    free(arena->owned);
+    free(arena);
+    pst_arena_pool_unref(pool);
+}
+
+
+static struct pst_arena_pool* pst_new_arena_pool(void) {
+    struct pst_arena_pool *pool = (struct pst_arena_pool*) pst_malloc(sizeof(struct pst_arena_pool));
+    memset(pool, 0, sizeof(struct pst_arena_pool));
+    pool->refs = 1;
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_init(&pool->lock, NULL);
+#endif
+    return pool;
+}
+
+
+/** Free the idle arenas and drop the reference of the pst_file. Arenas
+ *  still held by items are freed when the items are. */
+static void pst_free_arena_pool(struct pst_arena_pool *pool) {
+    pst_arena *arena;
+    if (!pool) return;
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_lock(&pool->lock);
+#endif
+    pool->closed    = 1;
+    arena           = pool->free_list;
+    pool->free_list = NULL;
+    pool->count     = 0;
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_unlock(&pool->lock);
+#endif
+    while (arena) {
+        pst_arena *next = arena->next_free;
+        pst_free_arena(arena);
+        arena = next;
+    }
+    pst_arena_pool_unref(pool);
+}
+
+
+/** Take an idle arena from the pst_file, or make a new one. */
+static pst_arena* pst_arena_acquire(pst_file *pf) {
+    struct pst_arena_pool *pool = pf->arena_pool;
+    pst_arena *arena = NULL;
+    if (pool) {
+#ifdef HAVE_PTHREAD_H
+        pthread_mutex_lock(&pool->lock);
+#endif
+        arena = pool->free_list;
+        if (arena) {
+            pool->free_list = arena->next_free;
+            pool->count--;
+        }
+#ifdef HAVE_PTHREAD_H
+        pthread_mutex_unlock(&pool->lock);
+#endif
+    }
+    if (!arena) {
+        arena = (pst_arena*) pst_malloc(sizeof(pst_arena));
+        memset(arena, 0, sizeof(pst_arena));
+        arena->pool = pool;
+        if (pool) {
+#ifdef HAVE_PTHREAD_H
+            pthread_mutex_lock(&pool->lock);
+#endif
+            pool->refs++;
+#ifdef HAVE_PTHREAD_H
+            pthread_mutex_unlock(&pool->lock);
+#endif
+        }
+    }
+    arena->next_free = NULL;
+    return arena;
+}
+
+
+/** Empty the arena and give it back to its pool, or free it if the
+ *  pool already has enough spares or its pst_file is closed. */
+static void pst_arena_release(pst_arena *arena) {
+    struct pst_arena_pool *pool = arena->pool;
+    pst_arena_reset(arena);
+    if (pool) {
+#ifdef HAVE_PTHREAD_H
+        pthread_mutex_lock(&pool->lock);
+#endif
+        if (!pool->closed && (pool->count < PST_ARENA_SPARE)) {
+            arena->next_free = pool->free_list;
+            pool->free_list  = arena;
+            pool->count++;
+            arena = NULL;
+        }
+#ifdef HAVE_PTHREAD_H
+        pthread_mutex_unlock(&pool->lock);
+#endif
+    }
+    if (arena) pst_free_arena(arena);
+}
+
+
+/*
+ * UTF-16LE to UTF-8 without iconv for the 0x1f strings. Runs of ASCII
+ * are found and narrowed 8 or 16 code units at a time; SSE2 is part of
+ * every x86-64 cpu, so unlike pst_decrypt() nothing is chosen at run
+ * time. Both vector forms work on bytes, so the byte order of the host
+ * does not matter.
+ */
+
+/** @return the number of leading code units of in that are ASCII */
+static size_t pst_utf16_ascii_prefix(const unsigned char *in, size_t units) {
+    size_t i = 0;
+#if defined(__SSE2__)
+    // the low byte of an ASCII unit is below 0x80 and the high byte is zero
+    const __m128i mask = _mm_set1_epi16((short)0xff80);
+    for (; i+8 <= units; i += 8) {
+        __m128i v = _mm_and_si128(_mm_loadu_si128((const __m128i*)(in + 2*i)), mask);
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_setzero_si128())) != 0xffff) break;
+    }
+#elif defined(PST_HAVE_NEON)
+    static const uint8_t masks[16] = {0x80, 0xff, 0x80, 0xff, 0x80, 0xff, 0x80, 0xff,
+                                      0x80, 0xff, 0x80, 0xff, 0x80, 0xff, 0x80, 0xff};
+    const uint8x16_t mask = vld1q_u8(masks);
+    for (; i+8 <= units; i += 8) {
+        if (vmaxvq_u8(vandq_u8(vld1q_u8(in + 2*i), mask))) break;
+    }
+#endif
+    while ((i < units) && (in[2*i] < 0x80) && (in[2*i+1] == 0)) i++;
+    return i;
+}
+
+
+/** copy a run of ASCII code units to out, one byte each */
+static void pst_utf16_narrow(const unsigned char *in, size_t units, char *out) {
+    size_t i = 0;
+#if defined(__SSE2__)
+    for (; i+16 <= units; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i*)(in + 2*i));
+        __m128i b = _mm_loadu_si128((const __m128i*)(in + 2*i + 16));
+        _mm_storeu_si128((__m128i*)(out + i), _mm_packus_epi16(a, b));
+    }
+#elif defined(PST_HAVE_NEON)
+    for (; i+16 <= units; i += 16) {
+        vst1q_u8((uint8_t*)(out + i), vld2q_u8(in + 2*i).val[0]);
+    }
+#endif
+    for (; i < units; i++) out[i] = (char)in[2*i];
+}
+
+
+/**
+ * Convert UTF-16LE to UTF-8, or only measure the result if out is NULL.
+ *
+ * @param in    the UTF-16LE string, not terminated
+ * @param units number of 16 bit code units in in
+ * @param out   receives the UTF-8 bytes, not terminated, or NULL
+ * @return      number of UTF-8 bytes, or (size_t)-1 on an unpaired
+ *              surrogate, which is left to iconv
+ */
+static size_t pst_utf16le_to_utf8(const unsigned char *in, size_t units, char *out) {
+    size_t i = 0, n = 0;
+    while (i < units) {
+        uint32_t c;
+        size_t run = pst_utf16_ascii_prefix(in + 2*i, units - i);
+        if (run) {
+            if (out) pst_utf16_narrow(in + 2*i, run, out + n);
+            i += run;
+            n += run;
+            continue;
+        }
+        c = (uint32_t)in[2*i] | ((uint32_t)in[2*i+1] << 8);
+        i++;
+        if ((c >= 0xD800) && (c <= 0xDFFF)) {
+            uint32_t d;
+            if ((c >= 0xDC00) || (i == units)) return (size_t)-1;
+            d = (uint32_t)in[2*i] | ((uint32_t)in[2*i+1] << 8);
+            if ((d < 0xDC00) || (d > 0xDFFF)) return (size_t)-1;
+            i++;
+            c = 0x10000 + ((c - 0xD800) << 10) + (d - 0xDC00);
+        }
+        if (c < 0x800) {
+            if (out) {
+                out[n]   = (char)(0xC0 | (c >> 6));
+                out[n+1] = (char)(0x80 | (c & 0x3F));
+            }
+            n += 2;
+        }
+        else if (c < 0x10000) {
+            if (out) {
+                out[n]   = (char)(0xE0 | (c >> 12));
+                out[n+1] = (char)(0x80 | ((c >> 6) & 0x3F));
+                out[n+2] = (char)(0x80 | (c & 0x3F));
+            }
+            n += 3;
+        }
+        else {
+            if (out) {
+                out[n]   = (char)(0xF0 | (c >> 18));
+                out[n+1] = (char)(0x80 | ((c >> 12) & 0x3F));
+                out[n+2] = (char)(0x80 | ((c >> 6) & 0x3F));
+                out[n+3] = (char)(0x80 | (c & 0x3F));
+            }
+            n += 4;
+        }
+    }
+    return n;
 }
 
 
-static void freeall(pst_subblocks *subs, pst_block_offset_pointer *p1,
-                                         pst_block_offset_pointer *p2,
-                                         pst_block_offset_pointer *p3,
-                                         pst_block_offset_pointer *p4,
-                                         pst_block_offset_pointer *p5,
-                                         pst_block_offset_pointer *p6,
-                                         pst_block_offset_pointer *p7);
-static void freeall(pst_subblocks *subs, pst_block_offset_pointer *p1,
-                                         pst_block_offset_pointer *p2,
-                                         pst_block_offset_pointer *p3,
-                                         pst_block_offset_pointer *p4,
-                                         pst_block_offset_pointer *p5,
-                                         pst_block_offset_pointer *p6,
-                                         pst_block_offset_pointer *p7) {
-    size_t i;
-    for (i=0; i<subs->subblock_count; i++) {
-        if (subs->subs[i].buf) free(subs->subs[i].buf);
+// scratch buffers for the 0x1f strings iconv converts, one pair per thread
+static PST_THREAD_LOCAL pst_vbuf *utf16buf = NULL;
+static PST_THREAD_LOCAL pst_vbuf *utf8buf  = NULL;
+
+
+void pst_thread_cleanup() {
+    if (utf16buf) {
+        free(utf16buf->buf);
+        free(utf16buf);
+        utf16buf = NULL;
     }
-    free(subs->subs);
-    if (p1->needfree) free(p1->from);
-    if (p2->needfree) free(p2->from);
-    if (p3->needfree) free(p3->from);
-    if (p4->needfree) free(p4->from);
-    if (p5->needfree) free(p5->from);
-    if (p6->needfree) free(p6->from);
-    if (p7->needfree) free(p7->from);
+    if (utf8buf) {
+        free(utf8buf->buf);
+        free(utf8buf);
+        utf8buf = NULL;
+    }
+    pst_unicode_close();
 }
 
 
@@ -1379,12 +3166,13 @@ static void freeall(pst_subblocks *subs, pst_block_offset_pointer *p1,
  *
  *  @return list of MAPI objects
  */
-static pst_mapi_object* pst_parse_block(pst_file *pf, uint64_t block_id, pst_id2_tree *i2_head) {
+static pst_mapi_object* pst_parse_block(pst_file *pf, uint64_t block_id, pst_id2_tree *i2_head, const pst_prop_filter *filter) {
     pst_mapi_object *mo_head = NULL;
     char  *buf       = NULL;
     size_t read_size = 0;
     pst_subblocks  subblocks;
     pst_mapi_object *mo_ptr = NULL;
+    pst_arena *arena = NULL;
     pst_block_offset_pointer block_offset1;
     pst_block_offset_pointer block_offset2;
     pst_block_offset_pointer block_offset3;
@@ -1618,14 +3406,16 @@ static pst_mapi_object* pst_parse_block(pst_file *pf, uint64_t block_id, pst_id2
     }
 
     DEBUG_INFO(("found %i mapi objects each with %i mapi elements\n", num_mapi_objects, num_mapi_elements));
+    if (num_mapi_objects > 0) arena = pst_arena_acquire(pf);
     for (count_mapi_objects=0; count_mapi_objects<num_mapi_objects; count_mapi_objects++) {
         // put another mapi object on the linked list
-        mo_ptr = (pst_mapi_object*) pst_malloc(sizeof(pst_mapi_object));
+        mo_ptr = (pst_mapi_object*) pst_arena_alloc(arena, sizeof(pst_mapi_object));
         memset(mo_ptr, 0, sizeof(pst_mapi_object));
+        mo_ptr->arena = arena;
         mo_ptr->next = mo_head;
         mo_head = mo_ptr;
         // allocate the array of mapi elements
-        mo_ptr->elements        = (pst_mapi_element**) pst_malloc(sizeof(pst_mapi_element)*num_mapi_elements);
+        mo_ptr->elements        = (pst_mapi_element**) pst_arena_alloc(arena, sizeof(pst_mapi_element*)*num_mapi_elements);
         mo_ptr->count_elements  = num_mapi_elements;
         mo_ptr->orig_count      = num_mapi_elements;
         mo_ptr->count_objects   = (int32_t)num_mapi_objects; // each record will have a record of the total number of records
@@ -1685,14 +3475,13 @@ static pst_mapi_object* pst_parse_block(pst_file *pf, uint64_t block_id, pst_id2
                 x, table_rec.type, table_rec.ref_type, table_rec.value));
 
             if (!mo_ptr->elements[x]) {
-                mo_ptr->elements[x] = (pst_mapi_element*) pst_malloc(sizeof(pst_mapi_element));
+                mo_ptr->elements[x] = (pst_mapi_element*) pst_arena_alloc(arena, sizeof(pst_mapi_element));
             }
             memset(mo_ptr->elements[x], 0, sizeof(pst_mapi_element)); //init it
 
             // check here to see if the id of the attribute is a mapped one
-            mapptr = pf->x_head;
-            while (mapptr && (mapptr->map < table_rec.type)) mapptr = mapptr->next;
-            if (mapptr && (mapptr->map == table_rec.type)) {
+            mapptr = pst_find_xattrib(pf, table_rec.type);
+            if (mapptr) {
                 if (mapptr->mytype == PST_MAP_ATTRIB) {
                     mo_ptr->elements[x]->mapi_id = *((uint32_t*)mapptr->data);
                     DEBUG_INFO(("Mapped attrib %#x to %#x\n", table_rec.type, mo_ptr->elements[x]->mapi_id));
@@ -1709,6 +3498,15 @@ static pst_mapi_object* pst_parse_block(pst_file *pf, uint64_t block_id, pst_id2
                 mo_ptr->elements[x]->mapi_id = table_rec.type;
             }
             mo_ptr->elements[x]->type = 0; // checked later before it is set
+            if (!pst_prop_wanted(filter, mo_ptr->elements[x]->mapi_id)) {
+                // not asked for, so neither fetch nor copy the value, but remember
+                // which part of the item it would have created
+                int owner = pst_prop_owner_of(mo_ptr->elements[x]->mapi_id, table_rec.ref_type);
+                if (owner >= 0) mo_ptr->skipped_owners |= (uint32_t)1 << owner;
+                mo_ptr->count_skipped++;
+                mo_ptr->count_elements --; //we will be skipping a row
+                continue;
+            }
             /* Reference Types
                 0x0002 - Signed 16bit value
                 0x0003 - Signed 32bit value
@@ -1737,7 +3535,7 @@ static pst_mapi_object* pst_parse_block(pst_file *pf, uint64_t block_id, pst_id2
                 //contains 32 bits of data
                 mo_ptr->elements[x]->size = sizeof(int32_t);
                 mo_ptr->elements[x]->type = table_rec.ref_type;
-                mo_ptr->elements[x]->data = pst_malloc(sizeof(int32_t));
+                mo_ptr->elements[x]->data = pst_arena_alloc(arena, sizeof(int32_t));
                 memcpy(mo_ptr->elements[x]->data, &(table_rec.value), sizeof(int32_t));
                 // are we missing an LE32_CPU() call here? table_rec.value is still
                 // in the original order.
@@ -1762,7 +3560,7 @@ static pst_mapi_object* pst_parse_block(pst_file *pf, uint64_t block_id, pst_id2
                     // directly stored in this block.
                     mo_ptr->elements[x]->size = value_size;
                     mo_ptr->elements[x]->type = table_rec.ref_type;
-                    mo_ptr->elements[x]->data = pst_malloc(value_size);
+                    mo_ptr->elements[x]->data = pst_arena_alloc(arena, value_size);
                     memcpy(mo_ptr->elements[x]->data, value_pointer, value_size);
                 }
                 else if (pst_getBlockOffsetPointer(pf, i2_head, &subblocks, table_rec.value, &block_offset7)) {
@@ -1784,47 +3582,64 @@ static pst_mapi_object* pst_parse_block(pst_file *pf, uint64_t block_id, pst_id2
                     value_size = (size_t)(block_offset7.to - block_offset7.from);
                     mo_ptr->elements[x]->size = value_size;
                     mo_ptr->elements[x]->type = table_rec.ref_type;
-                    mo_ptr->elements[x]->data = pst_malloc(value_size+1);
+                    mo_ptr->elements[x]->data = pst_arena_alloc(arena, value_size+1);
                     memcpy(mo_ptr->elements[x]->data, block_offset7.from, value_size);
                     mo_ptr->elements[x]->data[value_size] = '\0';  // it might be a string, null terminate it.
                 }
                 if (table_rec.ref_type == (uint16_t)0xd) {
                     // there is still more to do for the type of 0xD embedded objects
+                    char *id2_data = NULL;
                     type_d_rec = (struct _type_d_rec*) mo_ptr->elements[x]->data;
                     LE32_CPU(type_d_rec->id);
-                    mo_ptr->elements[x]->size = pst_ff_getID2block(pf, type_d_rec->id, i2_head, &(mo_ptr->elements[x]->data));
+                    mo_ptr->elements[x]->size = pst_ff_getID2block(pf, type_d_rec->id, i2_head, &id2_data);
                     if (!mo_ptr->elements[x]->size){
                         DEBUG_WARN(("not able to read the ID2 data. Setting to be read later. %#x\n", type_d_rec->id));
-                        mo_ptr->elements[x]->type = type_d_rec->id;    // fetch before freeing data, alias pointer
-                        free(mo_ptr->elements[x]->data);
+                        mo_ptr->elements[x]->type = type_d_rec->id;
                         mo_ptr->elements[x]->data = NULL;
+                        if (id2_data) free(id2_data);
+                    }
+                    else {
+                        // the holder grew this buffer with realloc, so the arena adopts it
+                        pst_arena_adopt(arena, id2_data);
+                        mo_ptr->elements[x]->data = id2_data;
                     }
                 }
                 if (table_rec.ref_type == (uint16_t)0x1f) {
                     // there is more to do for the type 0x1f unicode strings
                     size_t rc;
-                    static pst_vbuf *utf16buf = NULL;
-                    static pst_vbuf *utf8buf  = NULL;
-                    if (!utf16buf) utf16buf = pst_vballoc((size_t)1024);
-                    if (!utf8buf)  utf8buf  = pst_vballoc((size_t)1024);
-
-                    //need UTF-16 zero-termination
-                    pst_vbset(utf16buf, mo_ptr->elements[x]->data, mo_ptr->elements[x]->size);
-                    pst_vbappend(utf16buf, "\0\0", (size_t)2);
-                    DEBUG_INFO(("Iconv in:\n"));
-                    DEBUG_HEXDUMPC(utf16buf->b, utf16buf->dlen, 0x10);
-                    rc = pst_vb_utf16to8(utf8buf, utf16buf->b, utf16buf->dlen);
-                    if (rc == (size_t)-1) {
-                        DEBUG_WARN(("Failed to convert utf-16 to utf-8\n"));
+                    const unsigned char *utf16 = (const unsigned char*)mo_ptr->elements[x]->data;
+                    size_t units = mo_ptr->elements[x]->size / 2;
+                    size_t len   = (mo_ptr->elements[x]->size & 1) ? (size_t)-1 : pst_utf16le_to_utf8(utf16, units, NULL);
+                    if (len != (size_t)-1) {
+                        // the result keeps the terminating zero, as the iconv conversion below does
+                        char *utf8 = (char*) pst_arena_alloc(arena, len+1);
+                        pst_utf16le_to_utf8(utf16, units, utf8);
+                        utf8[len] = '\0';
+                        mo_ptr->elements[x]->size = len+1;
+                        mo_ptr->elements[x]->data = utf8;
                     }
                     else {
-                        free(mo_ptr->elements[x]->data);
-                        mo_ptr->elements[x]->size = utf8buf->dlen;
-                        mo_ptr->elements[x]->data = pst_malloc(utf8buf->dlen);
-                        memcpy(mo_ptr->elements[x]->data, utf8buf->b, utf8buf->dlen);
+                        // odd length or broken surrogates, let iconv decide
+                        if (!utf16buf) utf16buf = pst_vballoc((size_t)1024);
+                        if (!utf8buf)  utf8buf  = pst_vballoc((size_t)1024);
+
+                        //need UTF-16 zero-termination
+                        pst_vbset(utf16buf, mo_ptr->elements[x]->data, mo_ptr->elements[x]->size);
+                        pst_vbappend(utf16buf, "\0\0", (size_t)2);
+                        DEBUG_INFO(("Iconv in:\n"));
+                        DEBUG_HEXDUMPC(utf16buf->b, utf16buf->dlen, 0x10);
+                        rc = pst_vb_utf16to8(utf8buf, utf16buf->b, utf16buf->dlen);
+                        if (rc == (size_t)-1) {
+                            DEBUG_WARN(("Failed to convert utf-16 to utf-8\n"));
+                        }
+                        else {
+                            mo_ptr->elements[x]->size = utf8buf->dlen;
+                            mo_ptr->elements[x]->data = pst_arena_alloc(arena, utf8buf->dlen);
+                            memcpy(mo_ptr->elements[x]->data, utf8buf->b, utf8buf->dlen);
+                        }
+                        DEBUG_INFO(("Iconv out:\n"));
+                        DEBUG_HEXDUMPC(mo_ptr->elements[x]->data, mo_ptr->elements[x]->size, 0x10);
                     }
-                    DEBUG_INFO(("Iconv out:\n"));
-                    DEBUG_HEXDUMPC(mo_ptr->elements[x]->data, mo_ptr->elements[x]->size, 0x10);
                 }
                 if (mo_ptr->elements[x]->type == 0) mo_ptr->elements[x]->type = table_rec.ref_type;
             } else {
@@ -1847,22 +3662,49 @@ static pst_mapi_object* pst_parse_block(pst_file *pf, uint64_t block_id, pst_id2
 }
 
 
+/** Allocate memory that belongs to an item, from its arena if it has one. */
+static void* pst_item_alloc(pst_arena *arena, size_t size) {
+    return (arena) ? pst_arena_alloc(arena, size) : pst_malloc(size);
+}
+
+
+/** Make room for a new value of an item field. Unlike realloc() the old
+ *  contents are not kept in an arena, callers overwrite them anyway. */
+static void* pst_item_realloc(pst_arena *arena, void *ptr, size_t size) {
+    return (arena) ? pst_arena_alloc(arena, size) : pst_realloc(ptr, size);
+}
+
+
+static char* pst_item_strdup(pst_arena *arena, const char *str) {
+    size_t n = strlen(str) + 1;
+    char *r = (char*) pst_item_alloc(arena, n);
+    memcpy(r, str, n);
+    return r;
+}
+
+
+/** Free memory of an item field, which is a no-op in an arena. */
+static void pst_item_free(pst_arena *arena, void *ptr) {
+    if (!arena && ptr) free(ptr);
+}
+
+
 // This version of free does NULL check first
 #define SAFE_FREE(x) {if (x) free(x);}
 #define SAFE_FREE_STR(x) SAFE_FREE(x.str)
 #define SAFE_FREE_BIN(x) SAFE_FREE(x.data)
 
 // check if item->email is NULL, and init if so
-#define MALLOC_EMAIL(x)        { if (!x->email)         { x->email         = (pst_item_email*)         pst_malloc(sizeof(pst_item_email));         memset(x->email,         0, sizeof(pst_item_email)        );} }
-#define MALLOC_FOLDER(x)       { if (!x->folder)        { x->folder        = (pst_item_folder*)        pst_malloc(sizeof(pst_item_folder));        memset(x->folder,        0, sizeof(pst_item_folder)       );} }
-#define MALLOC_CONTACT(x)      { if (!x->contact)       { x->contact       = (pst_item_contact*)       pst_malloc(sizeof(pst_item_contact));       memset(x->contact,       0, sizeof(pst_item_contact)      );} }
-#define MALLOC_MESSAGESTORE(x) { if (!x->message_store) { x->message_store = (pst_item_message_store*) pst_malloc(sizeof(pst_item_message_store)); memset(x->message_store, 0, sizeof(pst_item_message_store));} }
-#define MALLOC_JOURNAL(x)      { if (!x->journal)       { x->journal       = (pst_item_journal*)       pst_malloc(sizeof(pst_item_journal));       memset(x->journal,       0, sizeof(pst_item_journal)      );} }
-#define MALLOC_APPOINTMENT(x)  { if (!x->appointment)   { x->appointment   = (pst_item_appointment*)   pst_malloc(sizeof(pst_item_appointment));   memset(x->appointment,   0, sizeof(pst_item_appointment)  );} }
+#define MALLOC_EMAIL(x)        { if (!x->email)         { x->email         = (pst_item_email*)         pst_item_alloc(x->arena, sizeof(pst_item_email));         memset(x->email,         0, sizeof(pst_item_email)        );} }
+#define MALLOC_FOLDER(x)       { if (!x->folder)        { x->folder        = (pst_item_folder*)        pst_item_alloc(x->arena, sizeof(pst_item_folder));        memset(x->folder,        0, sizeof(pst_item_folder)       );} }
+#define MALLOC_CONTACT(x)      { if (!x->contact)       { x->contact       = (pst_item_contact*)       pst_item_alloc(x->arena, sizeof(pst_item_contact));       memset(x->contact,       0, sizeof(pst_item_contact)      );} }
+#define MALLOC_MESSAGESTORE(x) { if (!x->message_store) { x->message_store = (pst_item_message_store*) pst_item_alloc(x->arena, sizeof(pst_item_message_store)); memset(x->message_store, 0, sizeof(pst_item_message_store));} }
+#define MALLOC_JOURNAL(x)      { if (!x->journal)       { x->journal       = (pst_item_journal*)       pst_item_alloc(x->arena, sizeof(pst_item_journal));       memset(x->journal,       0, sizeof(pst_item_journal)      );} }
+#define MALLOC_APPOINTMENT(x)  { if (!x->appointment)   { x->appointment   = (pst_item_appointment*)   pst_item_alloc(x->arena, sizeof(pst_item_appointment));   memset(x->appointment,   0, sizeof(pst_item_appointment)  );} }
 
 // malloc space and copy the current item's data null terminated
 #define LIST_COPY(targ, type) {                                    \
-    targ = type pst_realloc(targ, list->elements[x]->size+1);      \
+    targ = type pst_item_realloc(arena, targ, list->elements[x]->size+1); \
     memcpy(targ, list->elements[x]->data, list->elements[x]->size);\
     memset(((char*)targ)+list->elements[x]->size, 0, (size_t)1);   \
 }
@@ -1876,7 +3718,7 @@ static pst_mapi_object* pst_parse_block(pst_file *pf, uint64_t block_id, pst_id2
     else {                                                                  \
         DEBUG_WARN(("src not 0x1e or 0x1f or 0x102 for string dst\n"));     \
         DEBUG_HEXDUMP(list->elements[x]->data, list->elements[x]->size);    \
-        SAFE_FREE(targ);                                                    \
+        pst_item_free(arena, targ);                                         \
         targ = NULL;                                                        \
     }                                                                       \
 }
@@ -1900,30 +3742,6 @@ static pst_mapi_object* pst_parse_block(pst_file *pf, uint64_t block_id, pst_id2
     LIST_COPY_BOOL(label, targ)                                 \
 }
 
-#define LIST_COPY_CONTACT_BOOL(label, targ) {                   \
-    MALLOC_CONTACT(item);                                       \
-    LIST_COPY_BOOL(label, targ)                                 \
-}
-
-#define LIST_COPY_APPT_BOOL(label, targ) {                      \
-    MALLOC_APPOINTMENT(item);                                   \
-    LIST_COPY_BOOL(label, targ)                                 \
-}
-
-#define LIST_COPY_INT16_N(targ) {                                           \
-    if (list->elements[x]->type != 0x02) {                                  \
-        DEBUG_WARN(("src not 0x02 for int16 dst\n"));                       \
-        DEBUG_HEXDUMP(list->elements[x]->data, list->elements[x]->size);    \
-    }                                                                       \
-    memcpy(&(targ), list->elements[x]->data, sizeof(targ));                 \
-    LE16_CPU(targ);                                                         \
-}
-
-#define LIST_COPY_INT16(label, targ) {                          \
-    LIST_COPY_INT16_N(targ);                                    \
-    DEBUG_INFO((label" - %i %#x\n", (int)targ, (int)targ));     \
-}
-
 #define LIST_COPY_INT32_N(targ) {                                           \
     if (list->elements[x]->type != 0x03) {                                  \
         DEBUG_WARN(("src not 0x03 for int32 dst\n"));                       \
@@ -1938,78 +3756,6 @@ static pst_mapi_object* pst_parse_block(pst_file *pf, uint64_t block_id, pst_id2
     DEBUG_INFO((label" - %i %#x\n", (int)targ, (int)targ));     \
 }
 
-#define LIST_COPY_EMAIL_INT32(label, targ) {                    \
-    MALLOC_EMAIL(item);                                         \
-    LIST_COPY_INT32(label, targ);                               \
-}
-
-#define LIST_COPY_APPT_INT32(label, targ) {                     \
-    MALLOC_APPOINTMENT(item);                                   \
-    LIST_COPY_INT32(label, targ);                               \
-}
-
-#define LIST_COPY_FOLDER_INT32(label, targ) {                   \
-    MALLOC_FOLDER(item);                                        \
-    LIST_COPY_INT32(label, targ);                               \
-}
-
-#define LIST_COPY_STORE_INT32(label, targ) {                    \
-    MALLOC_MESSAGESTORE(item);                                  \
-    LIST_COPY_INT32(label, targ);                               \
-}
-
-#define LIST_COPY_ENUM(label, targ, delta, count, ...) {        \
-    char *tlabels[] = {__VA_ARGS__};                            \
-    LIST_COPY_INT32_N(targ);                                    \
-    targ += delta;                                              \
-    DEBUG_INFO((label" - %s [%i]\n",                            \
-        (((int)targ < 0) || ((int)targ >= count))               \
-            ? "**invalid"                                       \
-            : tlabels[(int)targ], (int)targ));                  \
-}
-
-#define LIST_COPY_EMAIL_ENUM(label, targ, delta, count, ...) {  \
-    MALLOC_EMAIL(item);                                         \
-    LIST_COPY_ENUM(label, targ, delta, count, __VA_ARGS__);     \
-}
-
-#define LIST_COPY_APPT_ENUM(label, targ, delta, count, ...) {   \
-    MALLOC_APPOINTMENT(item);                                   \
-    LIST_COPY_ENUM(label, targ, delta, count, __VA_ARGS__);     \
-}
-
-#define LIST_COPY_ENUM16(label, targ, delta, count, ...) {      \
-    char *tlabels[] = {__VA_ARGS__};                            \
-    LIST_COPY_INT16_N(targ);                                    \
-    targ += delta;                                              \
-    DEBUG_INFO((label" - %s [%i]\n",                            \
-        (((int)targ < 0) || ((int)targ >= count))               \
-            ? "**invalid"                                       \
-            : tlabels[(int)targ], (int)targ));                  \
-}
-
-#define LIST_COPY_CONTACT_ENUM16(label, targ, delta, count, ...) {  \
-    MALLOC_CONTACT(item);                                           \
-    LIST_COPY_ENUM16(label, targ, delta, count, __VA_ARGS__);       \
-}
-
-#define LIST_COPY_ENTRYID(label, targ) {                        \
-    LIST_COPY(targ, (pst_entryid*));                            \
-    LE32_CPU(targ->u1);                                         \
-    LE32_CPU(targ->id);                                         \
-    DEBUG_INFO((label" u1=%#x, id=%#x\n", targ->u1, targ->id)); \
-}
-
-#define LIST_COPY_EMAIL_ENTRYID(label, targ) {                  \
-    MALLOC_EMAIL(item);                                         \
-    LIST_COPY_ENTRYID(label, targ);                             \
-}
-
-#define LIST_COPY_STORE_ENTRYID(label, targ) {                  \
-    MALLOC_MESSAGESTORE(item);                                  \
-    LIST_COPY_ENTRYID(label, targ);                             \
-}
-
 
 // malloc space and copy the current item's data null terminated
 // including the utf8 flag
@@ -2019,62 +3765,6 @@ static pst_mapi_object* pst_parse_block(pst_file *pf, uint64_t block_id, pst_id2
     DEBUG_INFO((label" - unicode %d - %s\n", targ.is_utf8, targ.str));  \
 }
 
-#define LIST_COPY_EMAIL_STR(label, targ) {                      \
-    MALLOC_EMAIL(item);                                         \
-    LIST_COPY_STR(label, targ);                                 \
-}
-
-#define LIST_COPY_CONTACT_STR(label, targ) {                    \
-    MALLOC_CONTACT(item);                                       \
-    LIST_COPY_STR(label, targ);                                 \
-}
-
-#define LIST_COPY_APPT_STR(label, targ) {                       \
-    MALLOC_APPOINTMENT(item);                                   \
-    LIST_COPY_STR(label, targ);                                 \
-}
-
-#define LIST_COPY_JOURNAL_STR(label, targ) {                    \
-    MALLOC_JOURNAL(item);                                       \
-    LIST_COPY_STR(label, targ);                                 \
-}
-
-// malloc space and copy the item filetime
-#define LIST_COPY_TIME(label, targ) {                                       \
-    if ((list->elements[x]->type != 0x40) ||                                \
-        (list->elements[x]->size != sizeof(FILETIME))) {                    \
-        DEBUG_WARN(("src not 0x40 or wrong length for filetime dst\n"));    \
-        DEBUG_HEXDUMP(list->elements[x]->data, list->elements[x]->size);    \
-    }                                                                       \
-    else {                                                                  \
-        targ = (FILETIME*) pst_realloc(targ, sizeof(FILETIME));             \
-        memcpy(targ, list->elements[x]->data, sizeof(FILETIME));            \
-        LE32_CPU(targ->dwLowDateTime);                                      \
-        LE32_CPU(targ->dwHighDateTime);                                     \
-        DEBUG_INFO((label" - %s", pst_fileTimeToAscii(targ, time_buffer))); \
-    }                                                                       \
-}
-
-#define LIST_COPY_EMAIL_TIME(label, targ) {                     \
-    MALLOC_EMAIL(item);                                         \
-    LIST_COPY_TIME(label, targ);                                \
-}
-
-#define LIST_COPY_CONTACT_TIME(label, targ) {                   \
-    MALLOC_CONTACT(item);                                       \
-    LIST_COPY_TIME(label, targ);                                \
-}
-
-#define LIST_COPY_APPT_TIME(label, targ) {                      \
-    MALLOC_APPOINTMENT(item);                                   \
-    LIST_COPY_TIME(label, targ);                                \
-}
-
-#define LIST_COPY_JOURNAL_TIME(label, targ) {                   \
-    MALLOC_JOURNAL(item);                                       \
-    LIST_COPY_TIME(label, targ);                                \
-}
-
 // malloc space and copy the current item's data and size
 #define LIST_COPY_BIN(targ) {                                       \
     targ.size = list->elements[x]->size;                            \
@@ -2088,19 +3778,521 @@ static pst_mapi_object* pst_parse_block(pst_file *pf, uint64_t block_id, pst_id2
     }                                                               \
 }
 
-#define LIST_COPY_EMAIL_BIN(label, targ) {          \
-    MALLOC_EMAIL(item);                             \
-    LIST_COPY_BIN(targ);                            \
-    DEBUG_INFO((label"\n"));                        \
+#define NULL_CHECK(x) { if (!x) { DEBUG_WARN(("NULL_CHECK: Null Found\n")); break;} }
+
+
+/** how pst_process() converts a property found in pst_prop_table */
+typedef enum pst_prop_conv {
+    PST_CONV_NONE,          // known, but not processed
+    PST_CONV_STR,           // pst_string
+    PST_CONV_BOOL,          // int
+    PST_CONV_INT32,         // int32_t
+    PST_CONV_ENUM,          // int32_t with value labels
+    PST_CONV_ENUM16,        // int16_t with value labels
+    PST_CONV_TIME,          // FILETIME*
+    PST_CONV_BIN,           // pst_binary
+    PST_CONV_ENTRYID        // pst_entryid*
+} pst_prop_conv;
+
+
+/** the structure that holds a property */
+typedef enum pst_prop_owner {
+    PST_OWNER_ITEM,
+    PST_OWNER_EMAIL,
+    PST_OWNER_FOLDER,
+    PST_OWNER_CONTACT,
+    PST_OWNER_STORE,
+    PST_OWNER_JOURNAL,
+    PST_OWNER_APPT,
+    PST_OWNER_ATTACH
+} pst_prop_owner;
+
+#define PST_STRUCT_ITEM     pst_item
+#define PST_STRUCT_EMAIL    pst_item_email
+#define PST_STRUCT_FOLDER   pst_item_folder
+#define PST_STRUCT_CONTACT  pst_item_contact
+#define PST_STRUCT_STORE    pst_item_message_store
+#define PST_STRUCT_JOURNAL  pst_item_journal
+#define PST_STRUCT_APPT     pst_item_appointment
+#define PST_STRUCT_ATTACH   pst_item_attach
+
+
+typedef struct pst_prop_desc {
+    uint32_t     mapi_id;
+    uint8_t      conv;          // pst_prop_conv
+    uint8_t      alloc;         // pst_prop_owner of the sub structure to create, normally the owner
+    uint8_t      owner;         // pst_prop_owner of the structure holding the field
+    int8_t       delta;         // added to enum values
+    uint16_t     offset;        // of the field in the owner structure
+    uint16_t     count;         // number of enum labels
+    const char  *label;         // for the debug log
+    const char **labels;        // names of the enum values
+} pst_prop_desc;
+
+#define PST_PROP(id, conv, owner, field, label) \
+    { (uint32_t)id, PST_CONV_##conv, PST_OWNER_##owner, PST_OWNER_##owner, 0, (uint16_t)offsetof(PST_STRUCT_##owner, field), 0, label, NULL }
+#define PST_PROP_ALLOC(id, conv, alloc, owner, field, label) \
+    { (uint32_t)id, PST_CONV_##conv, PST_OWNER_##alloc, PST_OWNER_##owner, 0, (uint16_t)offsetof(PST_STRUCT_##owner, field), 0, label, NULL }
+#define PST_PROP_ENUM(id, conv, owner, field, label, delta, labels) \
+    { (uint32_t)id, PST_CONV_##conv, PST_OWNER_##owner, PST_OWNER_##owner, delta, (uint16_t)offsetof(PST_STRUCT_##owner, field), \
+      (uint16_t)(sizeof(labels)/sizeof(labels[0])), label, labels }
+#define PST_PROP_NONE(id, label) \
+    { (uint32_t)id, PST_CONV_NONE, PST_OWNER_ITEM, PST_OWNER_ITEM, 0, 0, 0, label, NULL }
+
+static const char *pst_importance_labels[] = {"Low", "Normal", "High"};
+static const char *pst_priority_labels[] = {"NonUrgent", "Normal", "Urgent"};
+static const char *pst_sensitivity_labels[] = {"None", "Personal", "Private", "Company Confidential"};
+static const char *pst_attach_method_labels[] = {"No Attachment", "Attach By Value", "Attach By Reference", "Attach by Reference Resolve", "Attach by Reference Only", "Embedded Message", "OLE"};
+static const char *pst_gender_labels[] = {"Unspecified", "Female", "Male"};
+static const char *pst_showas_labels[] = {"Free", "Tentative", "Busy", "Out Of Office"};
+static const char *pst_appointment_labels[] = {"None", "Important", "Business", "Personal", "Vacation", "Must Attend", "Travel Required", "Needs Preparation", "Birthday", "Anniversary", "Phone Call"};
+static const char *pst_recurrence_labels[] = {"None", "Daily", "Weekly", "Monthly", "Yearly"};
+
+/** The properties that pst_process() copies straight into a field of
+ *  the item, sorted by mapi_id for pst_find_prop(). Properties that
+ *  need more work than that are handled by the switch in pst_process().
+ *  Every id here or in that switch should be documented in xml/libpst.in,
+ *  which regression/regression-tests.bash checks. */
+static const pst_prop_desc pst_prop_table[] = {
+    PST_PROP_NONE(0x0003, "Extended Attributes Table"),    // Extended Attributes table
+    PST_PROP_ENUM(0x0017, ENUM,    EMAIL,   importance, "Importance Level", 0, pst_importance_labels),    // PR_IMPORTANCE - How important the sender deems it to be
+    PST_PROP_ENUM(0x0026, ENUM,    EMAIL,   priority, "Priority", 1, pst_priority_labels),    // PR_PRIORITY
+    PST_PROP(0x0029, BOOL,    EMAIL,   read_receipt,               "Read Receipt"),    // PR_READ_RECEIPT_REQUESTED
+    PST_PROP(0x002B, BOOL,    ITEM,    private_member,             "Reassignment Prohibited (Private)"),    // PR_RECIPIENT_REASSIGNMENT_PROHIBITED
+    PST_PROP_ENUM(0x002E, ENUM,    EMAIL,   original_sensitivity, "Original Sensitivity", 0, pst_sensitivity_labels),    // PR_ORIGINAL_SENSITIVITY - the sensitivity of the message before being replied to or forwarded
+    PST_PROP(0x0032, TIME,    EMAIL,   report_time,                "Report time"),    // PR_REPORT_TIME
+    PST_PROP_ENUM(0x0036, ENUM,    EMAIL,   sensitivity, "Sensitivity", 0, pst_sensitivity_labels),    // PR_SENSITIVITY - sender's opinion of the sensitivity of an email
+    PST_PROP(0x0039, TIME,    EMAIL,   sent_date,                  "Date sent"),    // PR_CLIENT_SUBMIT_TIME Date Email Sent/Created
+    PST_PROP(0x003B, STR,     EMAIL,   outlook_sender,             "Sent on behalf of address 1"),    // PR_SENT_REPRESENTING_SEARCH_KEY Sender address 1
+    PST_PROP_NONE(0x003F, "Recipient Structure 1"),    // PR_RECEIVED_BY_ENTRYID Structure containing Recipient
+    PST_PROP(0x0040, STR,     EMAIL,   outlook_received_name1,     "Received By Name 1"),    // PR_RECEIVED_BY_NAME Name of Recipient Structure
+    PST_PROP_NONE(0x0041, "Sent on behalf of Structure 1"),    // PR_SENT_REPRESENTING_ENTRYID Structure containing Sender
+    PST_PROP(0x0042, STR,     EMAIL,   outlook_sender_name,        "Sent on behalf of"),    // PR_SENT_REPRESENTING_NAME
+    PST_PROP_NONE(0x0043, "Received on behalf of Structure"),    // PR_RCVD_REPRESENTING_ENTRYID Recipient Structure 2
+    PST_PROP(0x0044, STR,     EMAIL,   outlook_recipient_name,     "Received on behalf of"),    // PR_RCVD_REPRESENTING_NAME
+    PST_PROP_NONE(0x004F, "Reply-To Structure"),    // PR_REPLY_RECIPIENT_ENTRIES Reply-To Structure
+    PST_PROP(0x0050, STR,     EMAIL,   reply_to,                   "Reply-To"),    // PR_REPLY_RECIPIENT_NAMES Name of Reply-To Structure
+    PST_PROP(0x0051, STR,     EMAIL,   outlook_recipient,          "Recipient's Address 1"),    // PR_RECEIVED_BY_SEARCH_KEY Recipient Address 1
+    PST_PROP(0x0052, STR,     EMAIL,   outlook_recipient2,         "Recipient's Address 2"),    // PR_RCVD_REPRESENTING_SEARCH_KEY Recipient Address 2
+    // this user is listed explicitly in the TO address
+    PST_PROP(0x0057, BOOL,    EMAIL,   message_to_me,              "My address in TO field"),    // PR_MESSAGE_TO_ME
+    // this user is listed explicitly in the CC address
+    PST_PROP(0x0058, BOOL,    EMAIL,   message_cc_me,              "My address in CC field"),    // PR_MESSAGE_CC_ME
+    // this user appears in TO, CC or BCC address list
+    PST_PROP(0x0059, BOOL,    EMAIL,   message_recip_me,           "Message addressed to me"),    // PR_MESSAGE_RECIP_ME
+    PST_PROP(0x0063, BOOL,    ITEM,    response_requested,         "Response requested"),    // PR_RESPONSE_REQUESTED
+    PST_PROP(0x0064, STR,     EMAIL,   sender_access,              "Sent on behalf of address type"),    // PR_SENT_REPRESENTING_ADDRTYPE Access method for Sender Address
+    PST_PROP(0x0065, STR,     EMAIL,   sender_address,             "Sent on behalf of address"),    // PR_SENT_REPRESENTING_EMAIL_ADDRESS Sender Address
+    PST_PROP(0x0070, STR,     EMAIL,   processed_subject,          "Processed Subject (Conversation Topic)"),    // PR_CONVERSATION_TOPIC Processed Subject
+    PST_PROP(0x0071, BIN,     EMAIL,   conversation_index,         "Conversation Index"),    // PR_CONVERSATION_INDEX
+    PST_PROP(0x0072, STR,     EMAIL,   original_bcc,               "Original display bcc"),    // PR_ORIGINAL_DISPLAY_BCC
+    PST_PROP(0x0073, STR,     EMAIL,   original_cc,                "Original display cc"),    // PR_ORIGINAL_DISPLAY_CC
+    PST_PROP(0x0074, STR,     EMAIL,   original_to,                "Original display to"),    // PR_ORIGINAL_DISPLAY_TO
+    PST_PROP(0x0075, STR,     EMAIL,   recip_access,               "Received by Address type"),    // PR_RECEIVED_BY_ADDRTYPE Recipient Access Method
+    PST_PROP(0x0076, STR,     EMAIL,   recip_address,              "Received by Address"),    // PR_RECEIVED_BY_EMAIL_ADDRESS Recipient Address
+    PST_PROP(0x0077, STR,     EMAIL,   recip2_access,              "Received on behalf of Address type"),    // PR_RCVD_REPRESENTING_ADDRTYPE Recipient Access Method 2
+    PST_PROP(0x0078, STR,     EMAIL,   recip2_address,             "Received on behalf of Address"),    // PR_RCVD_REPRESENTING_EMAIL_ADDRESS Recipient Address 2
+    PST_PROP(0x007D, STR,     EMAIL,   header,                     "Internet Header"),    // PR_TRANSPORT_MESSAGE_HEADERS Internet Header
+    PST_PROP(0x0C04, INT32,   EMAIL,   ndr_reason_code,            "NDR reason code"),    // PR_NDR_REASON_CODE
+    PST_PROP(0x0C05, INT32,   EMAIL,   ndr_diag_code,              "NDR diag code"),    // PR_NDR_DIAG_CODE
+    PST_PROP_NONE(0x0C06, "Non-Receipt Notification Requested"),    // PR_NON_RECEIPT_NOTIFICATION_REQUESTED
+    PST_PROP(0x0C17, BOOL,    EMAIL,   reply_requested,            "Reply Requested"),    // PR_REPLY_REQUESTED
+    PST_PROP_NONE(0x0C19, "Sender Structure 2"),    // PR_SENDER_ENTRYID Sender Structure 2
+    PST_PROP(0x0C1A, STR,     EMAIL,   outlook_sender_name2,       "Name of Sender Structure 2"),    // PR_SENDER_NAME Name of Sender Structure 2
+    PST_PROP(0x0C1B, STR,     EMAIL,   supplementary_info,         "Supplementary info"),    // PR_SUPPLEMENTARY_INFO
+    PST_PROP(0x0C1D, STR,     EMAIL,   outlook_sender2,            "Name of Sender Address 2 (Sender search key)"),    // PR_SENDER_SEARCH_KEY Name of Sender Address 2
+    PST_PROP(0x0C1E, STR,     EMAIL,   sender2_access,             "Sender Address type"),    // PR_SENDER_ADDRTYPE Sender Address 2 access method
+    PST_PROP(0x0C1F, STR,     EMAIL,   sender2_address,            "Sender Address"),    // PR_SENDER_EMAIL_ADDRESS Sender Address 2
+    PST_PROP(0x0C20, INT32,   EMAIL,   ndr_status_code,            "NDR status code"),    // PR_NDR_STATUS_CODE
+    PST_PROP(0x0E01, BOOL,    EMAIL,   delete_after_submit,        "Delete after submit"),    // PR_DELETE_AFTER_SUBMIT
+    PST_PROP(0x0E02, STR,     EMAIL,   bcc_address,                "Display BCC Addresses"),    // PR_DISPLAY_BCC BCC Addresses
+    PST_PROP(0x0E03, STR,     EMAIL,   cc_address,                 "Display CC Addresses"),    // PR_DISPLAY_CC CC Addresses
+    PST_PROP(0x0E04, STR,     EMAIL,   sentto_address,             "Display Sent-To Address"),    // PR_DISPLAY_TO Address Sent-To
+    PST_PROP(0x0E06, TIME,    EMAIL,   arrival_date,               "Date 3 (Delivery Time)"),    // PR_MESSAGE_DELIVERY_TIME Date 3 - Email Arrival Date
+    PST_PROP_ALLOC(0x0E07, INT32,   EMAIL,   ITEM,    flags, "Message Flags"),    // PR_MESSAGE_FLAGS Email Flag
+    PST_PROP(0x0E08, INT32,   ITEM,    message_size,               "Message Size"),    // PR_MESSAGE_SIZE Total size of a message object
+    // folder that this message is sent to after submission
+    PST_PROP(0x0E0A, ENTRYID, EMAIL,   sentmail_folder,            "Sentmail EntryID"),    // PR_SENTMAIL_ENTRYID
+    PST_PROP(0x0E1D, STR,     EMAIL,   outlook_normalized_subject, "Normalized subject"),    // PR_NORMALIZED_SUBJECT
+    // True means that the rtf version is same as text body
+    // False means rtf version is more up-to-date than text body
+    // if this value doesn't exist, text body is more up-to-date than rtf and
+    // cannot update to the rtf
+    PST_PROP(0x0E1F, BOOL,    EMAIL,   rtf_in_sync,                "Compressed RTF in Sync"),    // PR_RTF_IN_SYNC
+    PST_PROP(0x0FF9, BIN,     ITEM,    record_key,                 "Record Key"),    // PR_RECORD_KEY Record Header 1
+    PST_PROP(0x1000, STR,     ITEM,    body,                       "Plain Text body"),    // PR_BODY
+    PST_PROP(0x1001, STR,     EMAIL,   report_text,                "Report Text"),    // PR_REPORT_TEXT
+    PST_PROP(0x1006, INT32,   EMAIL,   rtf_body_crc,               "RTF Sync Body CRC"),    // PR_RTF_SYNC_BODY_CRC
+    // a count of the *significant* charcters in the rtf body. Doesn't count
+    // whitespace and other ignorable characters
+    PST_PROP(0x1007, INT32,   EMAIL,   rtf_body_char_count,        "RTF Sync Body character count"),    // PR_RTF_SYNC_BODY_COUNT
+    // the first couple of lines of RTF body so that after modification, then beginning can
+    // once again be found
+    PST_PROP(0x1008, STR,     EMAIL,   rtf_body_tag,               "RTF Sync body tag"),    // PR_RTF_SYNC_BODY_TAG
+    PST_PROP(0x1009, BIN,     EMAIL,   rtf_compressed,             "RTF Compressed body"),    // PR_RTF_COMPRESSED - rtf data is lzw compressed
+    // a count of the ignored characters before the first significant character
+    PST_PROP(0x1010, INT32,   EMAIL,   rtf_ws_prefix_count,        "RTF whitespace prefix count"),    // PR_RTF_SYNC_PREFIX_COUNT
+    // a count of the ignored characters after the last significant character
+    PST_PROP(0x1011, INT32,   EMAIL,   rtf_ws_trailing_count,      "RTF whitespace tailing count"),    // PR_RTF_SYNC_TRAILING_COUNT
+    PST_PROP(0x1013, STR,     EMAIL,   htmlbody,                   "HTML body"),    // HTML body
+    PST_PROP(0x1035, STR,     EMAIL,   messageid,                  "Message ID"),    // Message ID
+    PST_PROP(0x1042, STR,     EMAIL,   in_reply_to,                "In-Reply-To"),    // in-reply-to
+    PST_PROP(0x1046, STR,     EMAIL,   return_path_address,        "Return Path"),    // Return Path - this seems to be the message-id of the rfc822 mail that is being returned
+    PST_PROP(0x3001, STR,     ITEM,    file_as,                    "Display Name"),    // PR_DISPLAY_NAME File As
+    PST_PROP(0x3002, STR,     CONTACT, address1_transport,         "Address Type"),    // PR_ADDRTYPE
+    PST_PROP(0x3003, STR,     CONTACT, address1,                   "Contact email Address"),    // PR_EMAIL_ADDRESS
+    PST_PROP(0x3004, STR,     ITEM,    comment,                    "Comment"),    // PR_COMMENT Comment for item - usually folders
+    PST_PROP(0x3007, TIME,    ITEM,    create_date,                "Date 4 (Item Creation Date)"),    // PR_CREATION_TIME Date 4 - Creation Date?
+    PST_PROP(0x3008, TIME,    ITEM,    modify_date,                "Date 5 (Modify Date)"),    // PR_LAST_MODIFICATION_TIME Date 5 - Modify Date
+    PST_PROP(0x300B, STR,     EMAIL,   outlook_search_key,         "Record Search 2"),    // PR_SEARCH_KEY Record Header 2
+    PST_PROP(0x35DF, INT32,   STORE,   valid_mask,                 "Valid Folder Mask"),    // PR_VALID_FOLDER_MASK
+    PST_PROP(0x35E0, ENTRYID, STORE,   top_of_personal_folder,     "Top of Personal Folder Record"),    // PR_IPM_SUBTREE_ENTRYID Top of Personal Folder Record
+    PST_PROP(0x35E2, ENTRYID, STORE,   default_outbox_folder,      "Default Outbox Folder record"),    // PR_IPM_OUTBOX_ENTRYID
+    PST_PROP(0x35E3, ENTRYID, STORE,   deleted_items_folder,       "Deleted Items Folder record"),    // PR_IPM_WASTEBASKET_ENTRYID
+    PST_PROP(0x35E4, ENTRYID, STORE,   sent_items_folder,          "Sent Items Folder record"),    // PR_IPM_SENTMAIL_ENTRYID
+    PST_PROP(0x35E5, ENTRYID, STORE,   user_views_folder,          "User Views Folder record"),    // PR_VIEWS_ENTRYID
+    PST_PROP(0x35E6, ENTRYID, STORE,   common_view_folder,         "Common View Folder record"),    // PR_COMMON_VIEWS_ENTRYID
+    PST_PROP(0x35E7, ENTRYID, STORE,   search_root_folder,         "Search Root Folder record"),    // PR_FINDER_ENTRYID
+    PST_PROP(0x3602, INT32,   FOLDER,  item_count,                 "Folder Email Count"),    // PR_CONTENT_COUNT Number of emails stored in a folder
+    PST_PROP(0x3603, INT32,   FOLDER,  unseen_item_count,          "Unread Email Count"),    // PR_CONTENT_UNREAD Number of unread emails
+    PST_PROP(0x360A, BOOL,    FOLDER,  subfolder,                  "Has Subfolders"),    // PR_SUBFOLDERS Has children
+    // associated content are items that are attached to this folder
+    // but are hidden from users
+    PST_PROP(0x3617, INT32,   FOLDER,  assoc_count,                "Associated Content count"),    // PR_ASSOC_CONTENT_COUNT
+    PST_PROP(0x3704, STR,     ATTACH,  filename1,                  "Attachment Filename"),    // PR_ATTACH_FILENAME Attachment filename (8.3)
+    PST_PROP_ENUM(0x3705, ENUM,    ATTACH,  method, "Attachment method", 0, pst_attach_method_labels),    // PR_ATTACH_METHOD
+    PST_PROP(0x3707, STR,     ATTACH,  filename2,                  "Attachment Filename long"),    // PR_ATTACH_LONG_FILENAME Attachment filename (long?)
+    // position in characters that the attachment appears in the plain text body
+    PST_PROP(0x370B, INT32,   ATTACH,  position,                   "Attachment Position"),    // PR_RENDERING_POSITION
+    PST_PROP(0x370E, STR,     ATTACH,  mimetype,                   "Attachment mime encoding"),    // PR_ATTACH_MIME_TAG Mime type of encoding
+    // sequence number for mime parts. Includes body
+    PST_PROP(0x3710, INT32,   ATTACH,  sequence,                   "Attachment Mime Sequence"),    // PR_ATTACH_MIME_SEQUENCE
+    // content identification header (Content-ID)
+    PST_PROP(0x3712, STR,     ATTACH,  content_id,                 "Content ID"),    // PR_ATTACH_CONTENT_ID
+    PST_PROP(0x3A00, STR,     CONTACT, account_name,               "Contact's Account name"),    // PR_ACCOUNT
+    PST_PROP_NONE(0x3A01, "Contact Alternate Recipient"),    // PR_ALTERNATE_RECIPIENT
+    PST_PROP(0x3A02, STR,     CONTACT, callback_phone,             "Callback telephone number"),    // PR_CALLBACK_TELEPHONE_NUMBER
+    PST_PROP(0x3A03, BOOL,    EMAIL,   conversion_prohibited,      "Message Conversion Prohibited"),    // PR_CONVERSION_PROHIBITED
+    PST_PROP(0x3A05, STR,     CONTACT, suffix,                     "Contacts Suffix"),    // PR_GENERATION suffix
+    PST_PROP(0x3A06, STR,     CONTACT, first_name,                 "Contacts First Name"),    // PR_GIVEN_NAME Contact's first name
+    PST_PROP(0x3A07, STR,     CONTACT, gov_id,                     "Contacts Government ID Number"),    // PR_GOVERNMENT_ID_NUMBER
+    PST_PROP(0x3A08, STR,     CONTACT, business_phone,             "Business Telephone Number"),    // PR_BUSINESS_TELEPHONE_NUMBER
+    PST_PROP(0x3A09, STR,     CONTACT, home_phone,                 "Home Telephone Number"),    // PR_HOME_TELEPHONE_NUMBER
+    PST_PROP(0x3A0A, STR,     CONTACT, initials,                   "Contacts Initials"),    // PR_INITIALS Contact's Initials
+    PST_PROP(0x3A0B, STR,     CONTACT, keyword,                    "Keyword"),    // PR_KEYWORD
+    PST_PROP(0x3A0C, STR,     CONTACT, language,                   "Contact's Language"),    // PR_LANGUAGE
+    PST_PROP(0x3A0D, STR,     CONTACT, location,                   "Contact's Location"),    // PR_LOCATION
+    PST_PROP(0x3A0E, BOOL,    CONTACT, mail_permission,            "Mail Permission"),    // PR_MAIL_PERMISSION - Can the recipient receive and send email
+    PST_PROP(0x3A0F, STR,     CONTACT, common_name,                "MHS Common Name"),    // PR_MHS_COMMON_NAME
+    PST_PROP(0x3A10, STR,     CONTACT, org_id,                     "Organizational ID #"),    // PR_ORGANIZATIONAL_ID_NUMBER
+    PST_PROP(0x3A11, STR,     CONTACT, surname,                    "Contacts Surname"),    // PR_SURNAME Contact's Surname
+    PST_PROP_NONE(0x3A12, "Original Entry ID"),    // PR_ORIGINAL_ENTRY_ID
+    PST_PROP_NONE(0x3A13, "Original Display Name"),    // PR_ORIGINAL_DISPLAY_NAME
+    PST_PROP_NONE(0x3A14, "Original Search Key"),    // PR_ORIGINAL_SEARCH_KEY
+    PST_PROP(0x3A15, STR,     CONTACT, def_postal_address,         "Default Postal Address"),    // PR_POSTAL_ADDRESS
+    PST_PROP(0x3A16, STR,     CONTACT, company_name,               "Company Name"),    // PR_COMPANY_NAME
+    PST_PROP(0x3A17, STR,     CONTACT, job_title,                  "Job Title"),    // PR_TITLE - Job Title
+    PST_PROP(0x3A18, STR,     CONTACT, department,                 "Department Name"),    // PR_DEPARTMENT_NAME
+    PST_PROP(0x3A19, STR,     CONTACT, office_loc,                 "Office Location"),    // PR_OFFICE_LOCATION
+    PST_PROP(0x3A1A, STR,     CONTACT, primary_phone,              "Primary Telephone"),    // PR_PRIMARY_TELEPHONE_NUMBER
+    PST_PROP(0x3A1B, STR,     CONTACT, business_phone2,            "Business Phone Number 2"),    // PR_BUSINESS2_TELEPHONE_NUMBER
+    PST_PROP(0x3A1C, STR,     CONTACT, mobile_phone,               "Mobile Phone Number"),    // PR_MOBILE_TELEPHONE_NUMBER
+    PST_PROP(0x3A1D, STR,     CONTACT, radio_phone,                "Radio Phone Number"),    // PR_RADIO_TELEPHONE_NUMBER
+    PST_PROP(0x3A1E, STR,     CONTACT, car_phone,                  "Car Phone Number"),    // PR_CAR_TELEPHONE_NUMBER
+    PST_PROP(0x3A1F, STR,     CONTACT, other_phone,                "Other Phone Number"),    // PR_OTHER_TELEPHONE_NUMBER
+    PST_PROP(0x3A20, STR,     CONTACT, transmittable_display_name, "Transmittable Display Name"),    // PR_TRANSMITTABLE_DISPLAY_NAME
+    PST_PROP(0x3A21, STR,     CONTACT, pager_phone,                "Pager Phone Number"),    // PR_PAGER_TELEPHONE_NUMBER
+    PST_PROP_NONE(0x3A22, "User Certificate"),    // PR_USER_CERTIFICATE
+    PST_PROP(0x3A23, STR,     CONTACT, primary_fax,                "Primary Fax Number"),    // PR_PRIMARY_FAX_NUMBER
+    PST_PROP(0x3A24, STR,     CONTACT, business_fax,               "Business Fax Number"),    // PR_BUSINESS_FAX_NUMBER
+    PST_PROP(0x3A25, STR,     CONTACT, home_fax,                   "Home Fax Number"),    // PR_HOME_FAX_NUMBER
+    PST_PROP(0x3A26, STR,     CONTACT, business_country,           "Business Address Country"),    // PR_BUSINESS_ADDRESS_COUNTRY
+    PST_PROP(0x3A27, STR,     CONTACT, business_city,              "Business Address City"),    // PR_BUSINESS_ADDRESS_CITY
+    PST_PROP(0x3A28, STR,     CONTACT, business_state,             "Business Address State"),    // PR_BUSINESS_ADDRESS_STATE_OR_PROVINCE
+    PST_PROP(0x3A29, STR,     CONTACT, business_street,            "Business Address Street"),    // PR_BUSINESS_ADDRESS_STREET
+    PST_PROP(0x3A2A, STR,     CONTACT, business_postal_code,       "Business Postal Code"),    // PR_BUSINESS_POSTAL_CODE
+    PST_PROP(0x3A2B, STR,     CONTACT, business_po_box,            "Business PO Box"),    // PR_BUSINESS_PO_BOX
+    PST_PROP(0x3A2C, STR,     CONTACT, telex,                      "Telex Number"),    // PR_TELEX_NUMBER
+    PST_PROP(0x3A2D, STR,     CONTACT, isdn_phone,                 "ISDN Number"),    // PR_ISDN_NUMBER
+    PST_PROP(0x3A2E, STR,     CONTACT, assistant_phone,            "Assistant Phone Number"),    // PR_ASSISTANT_TELEPHONE_NUMBER
+    PST_PROP(0x3A2F, STR,     CONTACT, home_phone2,                "Home Phone 2"),    // PR_HOME2_TELEPHONE_NUMBER
+    PST_PROP(0x3A30, STR,     CONTACT, assistant_name,             "Assistant's Name"),    // PR_ASSISTANT
+    PST_PROP(0x3A40, BOOL,    CONTACT, rich_text,                  "Can receive Rich Text"),    // PR_SEND_RICH_INFO
+    PST_PROP(0x3A41, TIME,    CONTACT, wedding_anniversary,        "Wedding Anniversary"),    // PR_WEDDING_ANNIVERSARY
+    PST_PROP(0x3A42, TIME,    CONTACT, birthday,                   "Birthday"),    // PR_BIRTHDAY
+    PST_PROP(0x3A43, STR,     CONTACT, hobbies,                    "Hobbies"),    // PR_HOBBIES
+    PST_PROP(0x3A44, STR,     CONTACT, middle_name,                "Middle Name"),    // PR_MIDDLE_NAME
+    PST_PROP(0x3A45, STR,     CONTACT, display_name_prefix,        "Display Name Prefix (Title)"),    // PR_DISPLAY_NAME_PREFIX
+    PST_PROP(0x3A46, STR,     CONTACT, profession,                 "Profession"),    // PR_PROFESSION
+    PST_PROP(0x3A47, STR,     CONTACT, pref_name,                  "Preferred By Name"),    // PR_PREFERRED_BY_NAME
+    PST_PROP(0x3A48, STR,     CONTACT, spouse_name,                "Spouse's Name"),    // PR_SPOUSE_NAME
+    PST_PROP(0x3A49, STR,     CONTACT, computer_name,              "Computer Network Name"),    // PR_COMPUTER_NETWORK_NAME
+    PST_PROP(0x3A4A, STR,     CONTACT, customer_id,                "Customer ID"),    // PR_CUSTOMER_ID
+    PST_PROP(0x3A4B, STR,     CONTACT, ttytdd_phone,               "TTY/TDD Phone"),    // PR_TTYTDD_PHONE_NUMBER
+    PST_PROP(0x3A4C, STR,     CONTACT, ftp_site,                   "Ftp Site"),    // PR_FTP_SITE
+    PST_PROP_ENUM(0x3A4D, ENUM16,  CONTACT, gender, "Gender", 0, pst_gender_labels),    // PR_GENDER
+    PST_PROP(0x3A4E, STR,     CONTACT, manager_name,               "Manager's Name"),    // PR_MANAGER_NAME
+    PST_PROP(0x3A4F, STR,     CONTACT, nickname,                   "Nickname"),    // PR_NICKNAME
+    PST_PROP(0x3A50, STR,     CONTACT, personal_homepage,          "Personal Home Page"),    // PR_PERSONAL_HOME_PAGE
+    PST_PROP(0x3A51, STR,     CONTACT, business_homepage,          "Business Home Page"),    // PR_BUSINESS_HOME_PAGE
+    PST_PROP(0x3A57, STR,     CONTACT, company_main_phone,         "Company Main Phone"),    // PR_COMPANY_MAIN_PHONE_NUMBER
+    PST_PROP_NONE(0x3A58, "Children's Names"),    // PR_CHILDRENS_NAMES
+    PST_PROP(0x3A59, STR,     CONTACT, home_city,                  "Home Address City"),    // PR_HOME_ADDRESS_CITY
+    PST_PROP(0x3A5A, STR,     CONTACT, home_country,               "Home Address Country"),    // PR_HOME_ADDRESS_COUNTRY
+    PST_PROP(0x3A5B, STR,     CONTACT, home_postal_code,           "Home Address Postal Code"),    // PR_HOME_ADDRESS_POSTAL_CODE
+    PST_PROP(0x3A5C, STR,     CONTACT, home_state,                 "Home Address State or Province"),    // PR_HOME_ADDRESS_STATE_OR_PROVINCE
+    PST_PROP(0x3A5D, STR,     CONTACT, home_street,                "Home Address Street"),    // PR_HOME_ADDRESS_STREET
+    PST_PROP(0x3A5E, STR,     CONTACT, home_po_box,                "Home Address Post Office Box"),    // PR_HOME_ADDRESS_POST_OFFICE_BOX
+    PST_PROP(0x3A5F, STR,     CONTACT, other_city,                 "Other Address City"),    // PR_OTHER_ADDRESS_CITY
+    PST_PROP(0x3A60, STR,     CONTACT, other_country,              "Other Address Country"),    // PR_OTHER_ADDRESS_COUNTRY
+    PST_PROP(0x3A61, STR,     CONTACT, other_postal_code,          "Other Address Postal Code"),    // PR_OTHER_ADDRESS_POSTAL_CODE
+    PST_PROP(0x3A62, STR,     CONTACT, other_state,                "Other Address State"),    // PR_OTHER_ADDRESS_STATE_OR_PROVINCE
+    PST_PROP(0x3A63, STR,     CONTACT, other_street,               "Other Address Street"),    // PR_OTHER_ADDRESS_STREET
+    PST_PROP(0x3A64, STR,     CONTACT, other_po_box,               "Other Address Post Office box"),    // PR_OTHER_ADDRESS_POST_OFFICE_BOX
+    PST_PROP(0x3FDE, INT32,   ITEM,    internet_cpid,              "Internet code page"),    // PR_INTERNET_CPID
+    PST_PROP(0x3FFD, INT32,   ITEM,    message_codepage,           "Message code page"),    // PR_MESSAGE_CODEPAGE
+    PST_PROP(0x65E3, BIN,     ITEM,    predecessor_change,         "Predecessor Change"),    // PR_PREDECESSOR_CHANGE_LIST
+    PST_PROP(0x67FF, INT32,   STORE,   pwd_chksum,                 "Password checksum"),    // Extra Property Identifier (Password CheckSum)
+    PST_PROP(0x6F02, BIN,     EMAIL,   encrypted_htmlbody,         "Secure HTML Body"),    // Secure HTML Body
+    PST_PROP(0x6F04, BIN,     EMAIL,   encrypted_body,             "Secure Text Body"),    // Secure Text Body
+    PST_PROP(0x7C07, ENTRYID, STORE,   top_of_folder,              "Top of folders RecID"),    // top of folders ENTRYID
+    PST_PROP(0x8005, STR,     CONTACT, fullname,                   "Contact Fullname"),    // Contact's Fullname
+    PST_PROP(0x801A, STR,     CONTACT, home_address,               "Home Address"),    // Full Home Address
+    PST_PROP(0x801B, STR,     CONTACT, business_address,           "Business Address"),    // Full Business Address
+    PST_PROP(0x801C, STR,     CONTACT, other_address,              "Other Address"),    // Full Other Address
+    PST_PROP(0x8045, STR,     CONTACT, work_address_street,        "Work address street"),    // Work address street
+    PST_PROP(0x8046, STR,     CONTACT, work_address_city,          "Work address city"),    // Work address city
+    PST_PROP(0x8047, STR,     CONTACT, work_address_state,         "Work address state"),    // Work address state
+    PST_PROP(0x8048, STR,     CONTACT, work_address_postalcode,    "Work address postalcode"),    // Work address postalcode
+    PST_PROP(0x8049, STR,     CONTACT, work_address_country,       "Work address country"),    // Work address country
+    PST_PROP(0x804A, STR,     CONTACT, work_address_postofficebox, "Work address postofficebox"),    // Work address postofficebox
+    PST_PROP(0x8082, STR,     CONTACT, address1_transport,         "Email Address 1 Transport"),    // Email Address 1 Transport
+    PST_PROP(0x8083, STR,     CONTACT, address1,                   "Email Address 1 Address"),    // Email Address 1 Address
+    PST_PROP(0x8084, STR,     CONTACT, address1_desc,              "Email Address 1 Description"),    // Email Address 1 Description
+    PST_PROP(0x8085, STR,     CONTACT, address1a,                  "Email Address 1 Record"),    // Email Address 1 Record
+    PST_PROP(0x8092, STR,     CONTACT, address2_transport,         "Email Address 2 Transport"),    // Email Address 2 Transport
+    PST_PROP(0x8093, STR,     CONTACT, address2,                   "Email Address 2 Address"),    // Email Address 2 Address
+    PST_PROP(0x8094, STR,     CONTACT, address2_desc,              "Email Address 2 Description"),    // Email Address 2 Description
+    PST_PROP(0x8095, STR,     CONTACT, address2a,                  "Email Address 2 Record"),    // Email Address 2 Record
+    PST_PROP(0x80A2, STR,     CONTACT, address3_transport,         "Email Address 3 Transport"),    // Email Address 3 Transport
+    PST_PROP(0x80A3, STR,     CONTACT, address3,                   "Email Address 3 Address"),    // Email Address 3 Address
+    PST_PROP(0x80A4, STR,     CONTACT, address3_desc,              "Email Address 3 Description"),    // Email Address 3 Description
+    PST_PROP(0x80A5, STR,     CONTACT, address3a,                  "Email Address 3 Record"),    // Email Address 3 Record
+    PST_PROP(0x80D8, STR,     CONTACT, free_busy_address,          "Internet Free/Busy"),    // Internet Free/Busy
+    PST_PROP_ENUM(0x8205, ENUM,    APPT,    showas, "Appointment shows as", 0, pst_showas_labels),    // PR_OUTLOOK_EVENT_SHOW_TIME_AS
+    PST_PROP(0x8208, STR,     APPT,    location,                   "Appointment Location"),    // PR_OUTLOOK_EVENT_LOCATION
+    PST_PROP(0x820D, TIME,    APPT,    start,                      "Appointment Date Start"),    // PR_OUTLOOK_EVENT_START_DATE
+    PST_PROP(0x820E, TIME,    APPT,    end,                        "Appointment Date End"),    // PR_OUTLOOK_EVENT_START_END
+    PST_PROP_ENUM(0x8214, ENUM,    APPT,    label, "Label for appointment", 0, pst_appointment_labels),    // Label for an appointment
+    PST_PROP(0x8215, BOOL,    APPT,    all_day,                    "All day flag"),    // PR_OUTLOOK_EVENT_ALL_DAY
+    PST_PROP(0x8216, BIN,     APPT,    recurrence_data,            "Appointment recurrence data"),    // PR_OUTLOOK_EVENT_RECURRENCE_DATA
+    PST_PROP(0x8223, BOOL,    APPT,    is_recurring,               "Is recurring"),    // PR_OUTLOOK_EVENT_IS_RECURRING
+    PST_PROP_ENUM(0x8231, ENUM,    APPT,    recurrence_type, "Appointment recurrence type ", 0, pst_recurrence_labels),    // Recurrence type
+    PST_PROP(0x8232, STR,     APPT,    recurrence_description,     "Appointment recurrence description"),    // Recurrence description
+    PST_PROP(0x8234, STR,     APPT,    timezonestring,             "TimeZone of times"),    // TimeZone as String
+    PST_PROP(0x8235, TIME,    APPT,    recurrence_start,           "Recurrence Start Date"),    // PR_OUTLOOK_EVENT_RECURRENCE_START
+    PST_PROP(0x8236, TIME,    APPT,    recurrence_end,             "Recurrence End Date"),    // PR_OUTLOOK_EVENT_RECURRENCE_END
+    PST_PROP(0x8501, INT32,   APPT,    alarm_minutes,              "Alarm minutes"),    // PR_OUTLOOK_COMMON_REMINDER_MINUTES_BEFORE
+    PST_PROP(0x8503, BOOL,    APPT,    alarm,                      "Reminder alarm"),    // PR_OUTLOOK_COMMON_REMINDER_SET
+    PST_PROP(0x851F, STR,     APPT,    alarm_filename,             "Appointment reminder sound filename"),    // Play reminder sound filename
+    PST_PROP(0x8530, STR,     CONTACT, followup,                   "Followup String"),    // Followup
+    PST_PROP(0x8534, STR,     CONTACT, mileage,                    "Mileage"),    // Mileage
+    PST_PROP(0x8535, STR,     CONTACT, billing_information,        "Billing Information"),    // Billing Information
+    PST_PROP(0x8554, STR,     ITEM,    outlook_version,            "Outlook Version"),    // PR_OUTLOOK_VERSION
+    PST_PROP(0x8560, TIME,    APPT,    reminder,                   "Appointment Reminder Time"),    // Appointment Reminder Time
+    PST_PROP(0x8700, STR,     JOURNAL, type,                       "Journal Entry Type"),    // Journal Type
+    PST_PROP(0x8706, TIME,    JOURNAL, start,                      "Start Timestamp"),    // Journal Start date/time
+    PST_PROP(0x8708, TIME,    JOURNAL, end,                        "End Timestamp"),    // Journal End date/time
+    PST_PROP(0x8712, STR,     JOURNAL, description,                "Journal description"),    // Journal Type Description
+};
+
+#undef PST_PROP
+#undef PST_PROP_ALLOC
+#undef PST_PROP_ENUM
+#undef PST_PROP_NONE
+
+
+static const pst_prop_desc* pst_find_prop(uint32_t mapi_id) {
+    size_t lo = 0, hi = sizeof(pst_prop_table)/sizeof(pst_prop_table[0]);
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        uint32_t id = pst_prop_table[mid].mapi_id;
+        if (id == mapi_id) return &pst_prop_table[mid];
+        if (id < mapi_id) lo = mid + 1;
+        else              hi = mid;
+    }
+    return NULL;
 }
-#define LIST_COPY_APPT_BIN(label, targ) {           \
-    MALLOC_APPOINTMENT(item);                       \
-    LIST_COPY_BIN(targ);                            \
-    DEBUG_INFO((label"\n"));                        \
-    DEBUG_HEXDUMP(targ.data, targ.size);            \
+
+
+/** The sub structure of the item that processing this mapi_id, with
+ *  values of ref_type, creates, or -1 if it creates none.
+ */
+static int pst_prop_owner_of(uint32_t mapi_id, uint16_t ref_type) {
+    const pst_prop_desc *prop;
+    // not in the table, the pst_process() switch makes item->email for a boolean
+    if ((mapi_id == 0x0002) || (mapi_id == 0x0023)) return (ref_type == 0x000b) ? PST_OWNER_EMAIL : -1;
+    prop = pst_find_prop(mapi_id);
+    if (!prop || (prop->alloc == PST_OWNER_ITEM) || (prop->alloc == PST_OWNER_ATTACH)) return -1;
+    return prop->alloc;
 }
 
-#define NULL_CHECK(x) { if (!x) { DEBUG_WARN(("NULL_CHECK: Null Found\n")); break;} }
+
+/** Allocate the sub structures of the item that a full parse would
+ *  have created for the elements dropped by a property filter, so that
+ *  callers can keep testing item->email and friends to classify it.
+ */
+static void pst_alloc_skipped_owners(pst_item *item, uint32_t owners) {
+    if (owners & (1 << PST_OWNER_EMAIL))   MALLOC_EMAIL(item);
+    if (owners & (1 << PST_OWNER_FOLDER))  MALLOC_FOLDER(item);
+    if (owners & (1 << PST_OWNER_CONTACT)) MALLOC_CONTACT(item);
+    if (owners & (1 << PST_OWNER_STORE))   MALLOC_MESSAGESTORE(item);
+    if (owners & (1 << PST_OWNER_JOURNAL)) MALLOC_JOURNAL(item);
+    if (owners & (1 << PST_OWNER_APPT))    MALLOC_APPOINTMENT(item);
+}
+
+
+/**
+ * copy one MAPI element into the field of the item described by the
+ * table entry, with the same checks as the LIST_COPY_* macros.
+ *
+ * @param prop   table entry for the element's mapi_id
+ * @param e      the MAPI element
+ * @param item   the item being built
+ * @param attach the attachment record matching this MAPI object, may be NULL
+ */
+static void pst_process_prop(const pst_prop_desc *prop, pst_mapi_element *e, pst_item *item, pst_item_attach *attach) {
+    char *base = NULL;
+    void *field;
+    char time_buffer[30];
+    pst_arena *arena = item->arena;
+
+    // attachments and the encrypted bodies, which readpst turns into
+    // attachments, are handed around by callers so they stay on the heap
+    if ((prop->owner == PST_OWNER_ATTACH) || (prop->mapi_id == 0x6F02) || (prop->mapi_id == 0x6F04)) arena = NULL;
+
+    switch (prop->alloc) {
+        case PST_OWNER_EMAIL:   MALLOC_EMAIL(item);         break;
+        case PST_OWNER_FOLDER:  MALLOC_FOLDER(item);        break;
+        case PST_OWNER_CONTACT: MALLOC_CONTACT(item);       break;
+        case PST_OWNER_STORE:   MALLOC_MESSAGESTORE(item);  break;
+        case PST_OWNER_JOURNAL: MALLOC_JOURNAL(item);       break;
+        case PST_OWNER_APPT:    MALLOC_APPOINTMENT(item);   break;
+        default:                                            break;
+    }
+    switch (prop->owner) {
+        case PST_OWNER_ITEM:    base = (char*)item;                 break;
+        case PST_OWNER_EMAIL:   base = (char*)item->email;          break;
+        case PST_OWNER_FOLDER:  base = (char*)item->folder;         break;
+        case PST_OWNER_CONTACT: base = (char*)item->contact;        break;
+        case PST_OWNER_STORE:   base = (char*)item->message_store;  break;
+        case PST_OWNER_JOURNAL: base = (char*)item->journal;        break;
+        case PST_OWNER_APPT:    base = (char*)item->appointment;    break;
+        case PST_OWNER_ATTACH:  base = (char*)attach;               break;
+    }
+    if (!base) {
+        DEBUG_WARN(("NULL_CHECK: Null Found\n"));
+        return;
+    }
+    field = base + prop->offset;
+
+    switch (prop->conv) {
+        case PST_CONV_NONE:
+            DEBUG_INFO(("%s - NOT PROCESSED\n", prop->label));
+            break;
+        case PST_CONV_STR: {
+            pst_string *targ = (pst_string*)field;
+            if ((e->type == 0x1f) || (e->type == 0x1e) || (e->type == 0x102)) {
+                targ->str = (char*)pst_item_realloc(arena, targ->str, e->size+1);
+                memcpy(targ->str, e->data, e->size);
+                targ->str[e->size] = '\0';
+            }
+            else {
+                DEBUG_WARN(("src not 0x1e or 0x1f or 0x102 for string dst\n"));
+                DEBUG_HEXDUMP(e->data, e->size);
+                pst_item_free(arena, targ->str);
+                targ->str = NULL;
+            }
+            targ->is_utf8 = (e->type == 0x1f) ? 1 : 0;
+            DEBUG_INFO(("%s - unicode %d - %s\n", prop->label, targ->is_utf8, targ->str));
+            } break;
+        case PST_CONV_BOOL: {
+            int *targ = (int*)field;
+            if (e->type != 0x0b) {
+                DEBUG_WARN(("src not 0x0b for boolean dst\n"));
+                DEBUG_HEXDUMP(e->data, e->size);
+            }
+            *targ = (*(int16_t*)e->data) ? 1 : 0;
+            DEBUG_INFO(("%s - %s\n", prop->label, (*targ) ? "True" : "False"));
+            } break;
+        case PST_CONV_INT32:
+        case PST_CONV_ENUM: {
+            int32_t *targ = (int32_t*)field;
+            if (e->type != 0x03) {
+                DEBUG_WARN(("src not 0x03 for int32 dst\n"));
+                DEBUG_HEXDUMP(e->data, e->size);
+            }
+            memcpy(targ, e->data, sizeof(*targ));
+            LE32_CPU(*targ);
+            if (prop->conv == PST_CONV_INT32) {
+                DEBUG_INFO(("%s - %i %#x\n", prop->label, (int)*targ, (int)*targ));
+                break;
+            }
+            *targ += prop->delta;
+            DEBUG_INFO(("%s - %s [%i]\n", prop->label,
+                (((int)*targ < 0) || ((int)*targ >= prop->count)) ? "**invalid" : prop->labels[(int)*targ], (int)*targ));
+            } break;
+        case PST_CONV_ENUM16: {
+            int16_t *targ = (int16_t*)field;
+            if (e->type != 0x02) {
+                DEBUG_WARN(("src not 0x02 for int16 dst\n"));
+                DEBUG_HEXDUMP(e->data, e->size);
+            }
+            memcpy(targ, e->data, sizeof(*targ));
+            LE16_CPU(*targ);
+            *targ += prop->delta;
+            DEBUG_INFO(("%s - %s [%i]\n", prop->label,
+                (((int)*targ < 0) || ((int)*targ >= prop->count)) ? "**invalid" : prop->labels[(int)*targ], (int)*targ));
+            } break;
+        case PST_CONV_TIME: {
+            FILETIME **targ = (FILETIME**)field;
+            if ((e->type != 0x40) || (e->size != sizeof(FILETIME))) {
+                DEBUG_WARN(("src not 0x40 or wrong length for filetime dst\n"));
+                DEBUG_HEXDUMP(e->data, e->size);
+            }
+            else {
+                *targ = (FILETIME*) pst_item_realloc(arena, *targ, sizeof(FILETIME));
+                memcpy(*targ, e->data, sizeof(FILETIME));
+                LE32_CPU((*targ)->dwLowDateTime);
+                LE32_CPU((*targ)->dwHighDateTime);
+                DEBUG_INFO(("%s - %s", prop->label, pst_fileTimeToAscii(*targ, time_buffer)));
+            }
+            } break;
+        case PST_CONV_BIN: {
+            pst_binary *targ = (pst_binary*)field;
+            targ->size = e->size;
+            if (targ->size) {
+                targ->data = (char*)pst_item_realloc(arena, targ->data, targ->size);
+                memcpy(targ->data, e->data, targ->size);
+            }
+            else {
+                pst_item_free(arena, targ->data);
+                targ->data = NULL;
+            }
+            DEBUG_INFO(("%s\n", prop->label));
+            DEBUG_HEXDUMP(targ->data, targ->size);
+            } break;
+        case PST_CONV_ENTRYID: {
+            pst_entryid **targ = (pst_entryid**)field;
+            *targ = (pst_entryid*) pst_item_realloc(arena, *targ, e->size+1);
+            memcpy(*targ, e->data, e->size);
+            memset(((char*)*targ)+e->size, 0, (size_t)1);
+            LE32_CPU((*targ)->u1);
+            LE32_CPU((*targ)->id);
+            DEBUG_INFO(("%s u1=%#x, id=%#x\n", prop->label, (*targ)->u1, (*targ)->id));
+            } break;
+    }
+}
 
 
 /**
@@ -2119,22 +4311,30 @@ static pst_mapi_object* pst_parse_block(pst_file *pf, uint64_t block_id, pst_id2
  * @return 0 for ok, -1 for error.
  */
 static int pst_process(uint64_t block_id, pst_mapi_object *list, pst_item *item, pst_item_attach *attach) {
+    pst_arena *arena;
     DEBUG_ENT("pst_process");
     if (!item) {
         DEBUG_WARN(("item cannot be NULL.\n"));
         DEBUG_RET();
         return -1;
     }
+    arena = item->arena;    // for the LIST_COPY macros
 
     item->block_id = block_id;
     while (list) {
         int32_t x;
         char time_buffer[30];
         for (x=0; x<list->count_elements; x++) {
+            const pst_prop_desc *prop;
             int32_t t;
             uint32_t ut;
             DEBUG_INFO(("#%d - mapi-id: %#x type: %#x length: %#x\n", x, list->elements[x]->mapi_id, list->elements[x]->type, list->elements[x]->size));
 
+            prop = pst_find_prop(list->elements[x]->mapi_id);
+            if (prop) {
+                pst_process_prop(prop, list->elements[x], item, attach);
+                continue;
+            }
             switch (list->elements[x]->mapi_id) {
                 case PST_ATTRIB_HEADER: // CUSTOM attribute for saying the Extra Headers
                     if (list->elements[x]->extra) {
@@ -2144,15 +4344,15 @@ static int pst_process(uint64_t block_id, pst_mapi_object *list, pst_item *item,
                             int32_t p = 0;
                             int32_t array_element_count = PST_LE_GET_INT32(list->elements[x]->data); p+=4;
                             for (i = 1; i <= array_element_count; i++) {
-                                pst_item_extra_field *ef = (pst_item_extra_field*) pst_malloc(sizeof(pst_item_extra_field));
+                                pst_item_extra_field *ef = (pst_item_extra_field*) pst_item_alloc(arena, sizeof(pst_item_extra_field));
                                 memset(ef, 0, sizeof(pst_item_extra_field));
                                 offset      = PST_LE_GET_INT32(list->elements[x]->data + p); p+=4;
                                 next_offset = (i == array_element_count) ? list->elements[x]->size : PST_LE_GET_INT32(list->elements[x]->data + p);;
                                 string_length = next_offset - offset;
-                                ef->value = pst_malloc(string_length + 1);
+                                ef->value = pst_item_alloc(arena, string_length + 1);
                                 memcpy(ef->value, list->elements[x]->data + offset, string_length);
                                 ef->value[string_length] = '\0';
-                                ef->field_name = strdup(list->elements[x]->extra);
+                                ef->field_name = pst_item_strdup(arena, list->elements[x]->extra);
                                 ef->next       = item->extra_fields;
                                 item->extra_fields = ef;
                                 DEBUG_INFO(("Extra Field - \"%s\" = \"%s\"\n", ef->field_name, ef->value));
@@ -2160,11 +4360,11 @@ static int pst_process(uint64_t block_id, pst_mapi_object *list, pst_item *item,
                         }
                         else {
                             // should be a single string
-                            pst_item_extra_field *ef = (pst_item_extra_field*) pst_malloc(sizeof(pst_item_extra_field));
+                            pst_item_extra_field *ef = (pst_item_extra_field*) pst_item_alloc(arena, sizeof(pst_item_extra_field));
                             memset(ef, 0, sizeof(pst_item_extra_field));
                             LIST_COPY_CSTR(ef->value);
                             if (ef->value) {
-                                ef->field_name = strdup(list->elements[x]->extra);
+                                ef->field_name = pst_item_strdup(arena, list->elements[x]->extra);
                                 ef->next       = item->extra_fields;
                                 item->extra_fields = ef;
                                 DEBUG_INFO(("Extra Field - \"%s\" = \"%s\"\n", ef->field_name, ef->value));
@@ -2175,9 +4375,9 @@ static int pst_process(uint64_t block_id, pst_mapi_object *list, pst_item *item,
                                         char *pp = strchr(p, '"');
                                         if (pp) {
                                             *pp = '\0';
-                                            char *set = strdup(p);
+                                            char *set = pst_item_strdup(arena, p);
                                             *pp = '"';
-                                            if (item->body_charset.str) free(item->body_charset.str);
+                                            pst_item_free(arena, item->body_charset.str);
                                             item->body_charset.str     = set;
                                             item->body_charset.is_utf8 = 1;
                                             DEBUG_INFO(("body charset %s from content-type extra field\n", set));
@@ -2188,7 +4388,7 @@ static int pst_process(uint64_t block_id, pst_mapi_object *list, pst_item *item,
                             else {
                                 DEBUG_WARN(("What does this mean? Internet header %s value\n", list->elements[x]->extra));
                                 DEBUG_HEXDUMP(list->elements[x]->data, list->elements[x]->size);
-                                free(ef);   // caught by valgrind
+                                pst_item_free(arena, ef);   // caught by valgrind
                             }
                         }
                     }
@@ -2203,17 +4403,11 @@ static int pst_process(uint64_t block_id, pst_mapi_object *list, pst_item *item,
                         DEBUG_HEXDUMP(list->elements[x]->data, list->elements[x]->size);
                     }
                     break;
-                case 0x0003: // Extended Attributes table
-                    DEBUG_INFO(("Extended Attributes Table - NOT PROCESSED\n"));
-                    break;
-                case 0x0017: // PR_IMPORTANCE - How important the sender deems it to be
-                    LIST_COPY_EMAIL_ENUM("Importance Level", item->email->importance, 0, 3, "Low", "Normal", "High");
-                    break;
                 case 0x001A: // PR_MESSAGE_CLASS IPM.x
                     if ((list->elements[x]->type == 0x1e) ||
                         (list->elements[x]->type == 0x1f)) {
                         LIST_COPY_CSTR(item->ascii_type);
-                        if (!item->ascii_type) item->ascii_type = strdup("unknown");
+                        if (!item->ascii_type) item->ascii_type = pst_item_strdup(arena, "unknown");
                         if (pst_strincmp("IPM.Note", item->ascii_type, 8) == 0)
                             item->type = PST_TYPE_NOTE;
                         else if (pst_stricmp("IPM", item->ascii_type) == 0)
@@ -2236,208 +4430,33 @@ static int pst_process(uint64_t block_id, pst_mapi_object *list, pst_item *item,
                             item->type = PST_TYPE_OTHER;
                         DEBUG_INFO(("Message class %s [%"PRIi32"] \n", item->ascii_type, item->type));
                     }
-                    else {
-                        DEBUG_WARN(("What does this mean?\n"));
-                        DEBUG_HEXDUMP(list->elements[x]->data, list->elements[x]->size);
-                    }
-                    break;
-                case 0x0023: // PR_ORIGINATOR_DELIVERY_REPORT_REQUESTED
-                    if (list->elements[x]->type == 0x0b) {
-                        // set if the sender wants a delivery report from all recipients
-                        LIST_COPY_EMAIL_BOOL("Global Delivery Report", item->email->delivery_report);
-                    }
-                    else {
-                        DEBUG_WARN(("What does this mean?\n"));
-                        DEBUG_HEXDUMP(list->elements[x]->data, list->elements[x]->size);
-                    }
-                    break;
-                case 0x0026: // PR_PRIORITY
-                    LIST_COPY_EMAIL_ENUM("Priority", item->email->priority, 1, 3, "NonUrgent", "Normal", "Urgent");
-                    break;
-                case 0x0029: // PR_READ_RECEIPT_REQUESTED
-                    LIST_COPY_EMAIL_BOOL("Read Receipt", item->email->read_receipt);
-                    break;
-                case 0x002B: // PR_RECIPIENT_REASSIGNMENT_PROHIBITED
-                    LIST_COPY_BOOL("Reassignment Prohibited (Private)", item->private_member);
-                    break;
-                case 0x002E: // PR_ORIGINAL_SENSITIVITY - the sensitivity of the message before being replied to or forwarded
-                    LIST_COPY_EMAIL_ENUM("Original Sensitivity", item->email->original_sensitivity, 0, 4,
-                        "None", "Personal", "Private", "Company Confidential");
-                    break;
-                case 0x0032: // PR_REPORT_TIME
-                    LIST_COPY_EMAIL_TIME("Report time", item->email->report_time);
-                    break;
-                case 0x0036: // PR_SENSITIVITY - sender's opinion of the sensitivity of an email
-                    LIST_COPY_EMAIL_ENUM("Sensitivity", item->email->sensitivity, 0, 4,
-                        "None", "Personal", "Private", "Company Confidential");
-                    break;
-                case 0x0037: // PR_SUBJECT raw subject
-                    {
-                        int off = 0;
-                        if ((list->elements[x]->size > 2) && (((uint8_t)list->elements[x]->data[0]) < 0x20)) {
-                            off = 2;
-                        }
-                        list->elements[x]->data += off;
-                        list->elements[x]->size -= off;
-                        LIST_COPY_STR("Raw Subject", item->subject);
-                        list->elements[x]->size += off;
-                        list->elements[x]->data -= off;
-                    }
-                    break;
-                case 0x0039: // PR_CLIENT_SUBMIT_TIME Date Email Sent/Created
-                    LIST_COPY_EMAIL_TIME("Date sent", item->email->sent_date);
-                    break;
-                case 0x003B: // PR_SENT_REPRESENTING_SEARCH_KEY Sender address 1
-                    LIST_COPY_EMAIL_STR("Sent on behalf of address 1", item->email->outlook_sender);
-                    break;
-                case 0x003F: // PR_RECEIVED_BY_ENTRYID Structure containing Recipient
-                    DEBUG_INFO(("Recipient Structure 1 -- NOT PROCESSED\n"));
-                    break;
-                case 0x0040: // PR_RECEIVED_BY_NAME Name of Recipient Structure
-                    LIST_COPY_EMAIL_STR("Received By Name 1", item->email->outlook_received_name1);
-                    break;
-                case 0x0041: // PR_SENT_REPRESENTING_ENTRYID Structure containing Sender
-                    DEBUG_INFO(("Sent on behalf of Structure 1 -- NOT PROCESSED\n"));
-                    break;
-                case 0x0042: // PR_SENT_REPRESENTING_NAME
-                    LIST_COPY_EMAIL_STR("Sent on behalf of", item->email->outlook_sender_name);
-                    break;
-                case 0x0043: // PR_RCVD_REPRESENTING_ENTRYID Recipient Structure 2
-                    DEBUG_INFO(("Received on behalf of Structure -- NOT PROCESSED\n"));
-                    break;
-                case 0x0044: // PR_RCVD_REPRESENTING_NAME
-                    LIST_COPY_EMAIL_STR("Received on behalf of", item->email->outlook_recipient_name);
-                    break;
-                case 0x004F: // PR_REPLY_RECIPIENT_ENTRIES Reply-To Structure
-                    DEBUG_INFO(("Reply-To Structure -- NOT PROCESSED\n"));
-                    break;
-                case 0x0050: // PR_REPLY_RECIPIENT_NAMES Name of Reply-To Structure
-                    LIST_COPY_EMAIL_STR("Reply-To", item->email->reply_to);
-                    break;
-                case 0x0051: // PR_RECEIVED_BY_SEARCH_KEY Recipient Address 1
-                    LIST_COPY_EMAIL_STR("Recipient's Address 1", item->email->outlook_recipient);
-                    break;
-                case 0x0052: // PR_RCVD_REPRESENTING_SEARCH_KEY Recipient Address 2
-                    LIST_COPY_EMAIL_STR("Recipient's Address 2", item->email->outlook_recipient2);
-                    break;
-                case 0x0057: // PR_MESSAGE_TO_ME
-                    // this user is listed explicitly in the TO address
-                    LIST_COPY_EMAIL_BOOL("My address in TO field", item->email->message_to_me);
-                    break;
-                case 0x0058: // PR_MESSAGE_CC_ME
-                    // this user is listed explicitly in the CC address
-                    LIST_COPY_EMAIL_BOOL("My address in CC field", item->email->message_cc_me);
-                    break;
-                case 0x0059: // PR_MESSAGE_RECIP_ME
-                    // this user appears in TO, CC or BCC address list
-                    LIST_COPY_EMAIL_BOOL("Message addressed to me", item->email->message_recip_me);
-                    break;
-                case 0x0063: // PR_RESPONSE_REQUESTED
-                    LIST_COPY_BOOL("Response requested", item->response_requested);
-                    break;
-                case 0x0064: // PR_SENT_REPRESENTING_ADDRTYPE Access method for Sender Address
-                    LIST_COPY_EMAIL_STR("Sent on behalf of address type", item->email->sender_access);
-                    break;
-                case 0x0065: // PR_SENT_REPRESENTING_EMAIL_ADDRESS Sender Address
-                    LIST_COPY_EMAIL_STR("Sent on behalf of address", item->email->sender_address);
-                    break;
-                case 0x0070: // PR_CONVERSATION_TOPIC Processed Subject
-                    LIST_COPY_EMAIL_STR("Processed Subject (Conversation Topic)", item->email->processed_subject);
-                    break;
-                case 0x0071: // PR_CONVERSATION_INDEX
-                    LIST_COPY_EMAIL_BIN("Conversation Index", item->email->conversation_index);
-                    break;
-                case 0x0072: // PR_ORIGINAL_DISPLAY_BCC
-                    LIST_COPY_EMAIL_STR("Original display bcc", item->email->original_bcc);
-                    break;
-                case 0x0073: // PR_ORIGINAL_DISPLAY_CC
-                    LIST_COPY_EMAIL_STR("Original display cc", item->email->original_cc);
-                    break;
-                case 0x0074: // PR_ORIGINAL_DISPLAY_TO
-                    LIST_COPY_EMAIL_STR("Original display to", item->email->original_to);
-                    break;
-                case 0x0075: // PR_RECEIVED_BY_ADDRTYPE Recipient Access Method
-                    LIST_COPY_EMAIL_STR("Received by Address type", item->email->recip_access);
-                    break;
-                case 0x0076: // PR_RECEIVED_BY_EMAIL_ADDRESS Recipient Address
-                    LIST_COPY_EMAIL_STR("Received by Address", item->email->recip_address);
-                    break;
-                case 0x0077: // PR_RCVD_REPRESENTING_ADDRTYPE Recipient Access Method 2
-                    LIST_COPY_EMAIL_STR("Received on behalf of Address type", item->email->recip2_access);
-                    break;
-                case 0x0078: // PR_RCVD_REPRESENTING_EMAIL_ADDRESS Recipient Address 2
-                    LIST_COPY_EMAIL_STR("Received on behalf of Address", item->email->recip2_address);
-                    break;
-                case 0x007D: // PR_TRANSPORT_MESSAGE_HEADERS Internet Header
-                    LIST_COPY_EMAIL_STR("Internet Header", item->email->header);
-                    break;
-                case 0x0C04: // PR_NDR_REASON_CODE
-                    LIST_COPY_EMAIL_INT32("NDR reason code", item->email->ndr_reason_code);
-                    break;
-                case 0x0C05: // PR_NDR_DIAG_CODE
-                    LIST_COPY_EMAIL_INT32("NDR diag code", item->email->ndr_diag_code);
-                    break;
-                case 0x0C06: // PR_NON_RECEIPT_NOTIFICATION_REQUESTED
-                    DEBUG_INFO(("Non-Receipt Notification Requested -- NOT PROCESSED\n"));
-                    break;
-                case 0x0C17: // PR_REPLY_REQUESTED
-                    LIST_COPY_EMAIL_BOOL("Reply Requested", item->email->reply_requested);
-                    break;
-                case 0x0C19: // PR_SENDER_ENTRYID Sender Structure 2
-                    DEBUG_INFO(("Sender Structure 2 -- NOT PROCESSED\n"));
-                    break;
-                case 0x0C1A: // PR_SENDER_NAME Name of Sender Structure 2
-                    LIST_COPY_EMAIL_STR("Name of Sender Structure 2", item->email->outlook_sender_name2);
-                    break;
-                case 0x0C1B: // PR_SUPPLEMENTARY_INFO
-                    LIST_COPY_EMAIL_STR("Supplementary info", item->email->supplementary_info);
-                    break;
-                case 0x0C1D: // PR_SENDER_SEARCH_KEY Name of Sender Address 2
-                    LIST_COPY_EMAIL_STR("Name of Sender Address 2 (Sender search key)", item->email->outlook_sender2);
-                    break;
-                case 0x0C1E: // PR_SENDER_ADDRTYPE Sender Address 2 access method
-                    LIST_COPY_EMAIL_STR("Sender Address type", item->email->sender2_access);
-                    break;
-                case 0x0C1F: // PR_SENDER_EMAIL_ADDRESS Sender Address 2
-                    LIST_COPY_EMAIL_STR("Sender Address", item->email->sender2_address);
-                    break;
-                case 0x0C20: // PR_NDR_STATUS_CODE
-                    LIST_COPY_EMAIL_INT32("NDR status code", item->email->ndr_status_code);
-                    break;
-                case 0x0E01: // PR_DELETE_AFTER_SUBMIT
-                    LIST_COPY_EMAIL_BOOL("Delete after submit", item->email->delete_after_submit);
-                    break;
-                case 0x0E02: // PR_DISPLAY_BCC BCC Addresses
-                    LIST_COPY_EMAIL_STR("Display BCC Addresses", item->email->bcc_address);
-                    break;
-                case 0x0E03: // PR_DISPLAY_CC CC Addresses
-                    LIST_COPY_EMAIL_STR("Display CC Addresses", item->email->cc_address);
-                    break;
-                case 0x0E04: // PR_DISPLAY_TO Address Sent-To
-                    LIST_COPY_EMAIL_STR("Display Sent-To Address", item->email->sentto_address);
-                    break;
-                case 0x0E06: // PR_MESSAGE_DELIVERY_TIME Date 3 - Email Arrival Date
-                    LIST_COPY_EMAIL_TIME("Date 3 (Delivery Time)", item->email->arrival_date);
-                    break;
-                case 0x0E07: // PR_MESSAGE_FLAGS Email Flag
-                    LIST_COPY_EMAIL_INT32("Message Flags", item->flags);
-                    break;
-                case 0x0E08: // PR_MESSAGE_SIZE Total size of a message object
-                    LIST_COPY_INT32("Message Size", item->message_size);
-                    break;
-                case 0x0E0A: // PR_SENTMAIL_ENTRYID
-                    // folder that this message is sent to after submission
-                    LIST_COPY_EMAIL_ENTRYID("Sentmail EntryID", item->email->sentmail_folder);
+                    else {
+                        DEBUG_WARN(("What does this mean?\n"));
+                        DEBUG_HEXDUMP(list->elements[x]->data, list->elements[x]->size);
+                    }
                     break;
-                case 0x0E1D: // PR_NORMALIZED_SUBJECT
-                    LIST_COPY_EMAIL_STR("Normalized subject", item->email->outlook_normalized_subject);
+                case 0x0023: // PR_ORIGINATOR_DELIVERY_REPORT_REQUESTED
+                    if (list->elements[x]->type == 0x0b) {
+                        // set if the sender wants a delivery report from all recipients
+                        LIST_COPY_EMAIL_BOOL("Global Delivery Report", item->email->delivery_report);
+                    }
+                    else {
+                        DEBUG_WARN(("What does this mean?\n"));
+                        DEBUG_HEXDUMP(list->elements[x]->data, list->elements[x]->size);
+                    }
                     break;
-                case 0x0E1F: // PR_RTF_IN_SYNC
-                    // True means that the rtf version is same as text body
-                    // False means rtf version is more up-to-date than text body
-                    // if this value doesn't exist, text body is more up-to-date than rtf and
-                    // cannot update to the rtf
-                    LIST_COPY_EMAIL_BOOL("Compressed RTF in Sync", item->email->rtf_in_sync);
+                case 0x0037: // PR_SUBJECT raw subject
+                    {
+                        int off = 0;
+                        if ((list->elements[x]->size > 2) && (((uint8_t)list->elements[x]->data[0]) < 0x20)) {
+                            off = 2;
+                        }
+                        list->elements[x]->data += off;
+                        list->elements[x]->size -= off;
+                        LIST_COPY_STR("Raw Subject", item->subject);
+                        list->elements[x]->size += off;
+                        list->elements[x]->data -= off;
+                    }
                     break;
                 case 0x0E20: // PR_ATTACH_SIZE binary Attachment data in record
                     NULL_CHECK(attach);
@@ -2445,108 +4464,6 @@ static int pst_process(uint64_t block_id, pst_mapi_object *list, pst_item *item,
                     // ignore this. we either get data and size from 0x3701
                     // or id codes from 0x3701 or 0x67f2
                     break;
-                case 0x0FF9: // PR_RECORD_KEY Record Header 1
-                    LIST_COPY_BIN(item->record_key);
-                    DEBUG_INFO(("Record Key\n"));
-                    DEBUG_HEXDUMP(item->record_key.data, item->record_key.size);
-                    break;
-                case 0x1000: // PR_BODY
-                    LIST_COPY_STR("Plain Text body", item->body);
-                    break;
-                case 0x1001: // PR_REPORT_TEXT
-                    LIST_COPY_EMAIL_STR("Report Text", item->email->report_text);
-                    break;
-                case 0x1006: // PR_RTF_SYNC_BODY_CRC
-                    LIST_COPY_EMAIL_INT32("RTF Sync Body CRC", item->email->rtf_body_crc);
-                    break;
-                case 0x1007: // PR_RTF_SYNC_BODY_COUNT
-                    // a count of the *significant* charcters in the rtf body. Doesn't count
-                    // whitespace and other ignorable characters
-                    LIST_COPY_EMAIL_INT32("RTF Sync Body character count", item->email->rtf_body_char_count);
-                    break;
-                case 0x1008: // PR_RTF_SYNC_BODY_TAG
-                    // the first couple of lines of RTF body so that after modification, then beginning can
-                    // once again be found
-                    LIST_COPY_EMAIL_STR("RTF Sync body tag", item->email->rtf_body_tag);
-                    break;
-                case 0x1009: // PR_RTF_COMPRESSED - rtf data is lzw compressed
-                    LIST_COPY_EMAIL_BIN("RTF Compressed body", item->email->rtf_compressed);
-                    break;
-                case 0x1010: // PR_RTF_SYNC_PREFIX_COUNT
-                    // a count of the ignored characters before the first significant character
-                    LIST_COPY_EMAIL_INT32("RTF whitespace prefix count", item->email->rtf_ws_prefix_count);
-                    break;
-                case 0x1011: // PR_RTF_SYNC_TRAILING_COUNT
-                    // a count of the ignored characters after the last significant character
-                    LIST_COPY_EMAIL_INT32("RTF whitespace tailing count", item->email->rtf_ws_trailing_count);
-                    break;
-                case 0x1013: // HTML body
-                    LIST_COPY_EMAIL_STR("HTML body", item->email->htmlbody);
-                    break;
-                case 0x1035: // Message ID
-                    LIST_COPY_EMAIL_STR("Message ID", item->email->messageid);
-                    break;
-                case 0x1042: // in-reply-to
-                    LIST_COPY_EMAIL_STR("In-Reply-To", item->email->in_reply_to);
-                    break;
-                case 0x1046: // Return Path - this seems to be the message-id of the rfc822 mail that is being returned
-                    LIST_COPY_EMAIL_STR("Return Path", item->email->return_path_address);
-                    break;
-                case 0x3001: // PR_DISPLAY_NAME File As
-                    LIST_COPY_STR("Display Name", item->file_as);
-                    break;
-                case 0x3002: // PR_ADDRTYPE
-                    LIST_COPY_CONTACT_STR("Address Type", item->contact->address1_transport);
-                    break;
-                case 0x3003: // PR_EMAIL_ADDRESS
-                    LIST_COPY_CONTACT_STR("Contact email Address", item->contact->address1);
-                    break;
-                case 0x3004: // PR_COMMENT Comment for item - usually folders
-                    LIST_COPY_STR("Comment", item->comment);
-                    break;
-                case 0x3007: // PR_CREATION_TIME Date 4 - Creation Date?
-                    LIST_COPY_TIME("Date 4 (Item Creation Date)", item->create_date);
-                    break;
-                case 0x3008: // PR_LAST_MODIFICATION_TIME Date 5 - Modify Date
-                    LIST_COPY_TIME("Date 5 (Modify Date)", item->modify_date);
-                    break;
-                case 0x300B: // PR_SEARCH_KEY Record Header 2
-                    LIST_COPY_EMAIL_STR("Record Search 2", item->email->outlook_search_key);
-                    break;
-                case 0x35DF: // PR_VALID_FOLDER_MASK
-                    LIST_COPY_STORE_INT32("Valid Folder Mask", item->message_store->valid_mask);
-                    break;
-                case 0x35E0: // PR_IPM_SUBTREE_ENTRYID Top of Personal Folder Record
-                    LIST_COPY_STORE_ENTRYID("Top of Personal Folder Record", item->message_store->top_of_personal_folder);
-                    break;
-                case 0x35E2: // PR_IPM_OUTBOX_ENTRYID
-                    LIST_COPY_STORE_ENTRYID("Default Outbox Folder record", item->message_store->default_outbox_folder);
-                    break;
-                case 0x35E3: // PR_IPM_WASTEBASKET_ENTRYID
-                    LIST_COPY_STORE_ENTRYID("Deleted Items Folder record", item->message_store->deleted_items_folder);
-                    break;
-                case 0x35E4: // PR_IPM_SENTMAIL_ENTRYID
-                    LIST_COPY_STORE_ENTRYID("Sent Items Folder record", item->message_store->sent_items_folder);
-                    break;
-                case 0x35E5: // PR_VIEWS_ENTRYID
-                    LIST_COPY_STORE_ENTRYID("User Views Folder record", item->message_store->user_views_folder);
-                    break;
-                case 0x35E6: // PR_COMMON_VIEWS_ENTRYID
-                    LIST_COPY_STORE_ENTRYID("Common View Folder record", item->message_store->common_view_folder);
-                    break;
-                case 0x35E7: // PR_FINDER_ENTRYID
-                    LIST_COPY_STORE_ENTRYID("Search Root Folder record", item->message_store->search_root_folder);
-                    break;
-                case 0x3602: // PR_CONTENT_COUNT Number of emails stored in a folder
-                    LIST_COPY_FOLDER_INT32("Folder Email Count", item->folder->item_count);
-                    break;
-                case 0x3603: // PR_CONTENT_UNREAD Number of unread emails
-                    LIST_COPY_FOLDER_INT32("Unread Email Count", item->folder->unseen_item_count);
-                    break;
-                case 0x360A: // PR_SUBFOLDERS Has children
-                    MALLOC_FOLDER(item);
-                    LIST_COPY_BOOL("Has Subfolders", item->folder->subfolder);
-                    break;
                 case 0x3613: // PR_CONTAINER_CLASS IPF.x
                     LIST_COPY_CSTR(item->ascii_type);
                     if (pst_strincmp("IPF.Note", item->ascii_type, 8) == 0)
@@ -2570,11 +4487,6 @@ static int pst_process(uint64_t block_id, pst_mapi_object *list, pst_item *item,
 
                     DEBUG_INFO(("Container class %s [%"PRIi32"]\n", item->ascii_type, item->type));
                     break;
-                case 0x3617: // PR_ASSOC_CONTENT_COUNT
-                    // associated content are items that are attached to this folder
-                    // but are hidden from users
-                    LIST_COPY_FOLDER_INT32("Associated Content count", item->folder->assoc_count);
-                    break;
                 case 0x3701: // PR_ATTACH_DATA_OBJ binary data of attachment
                     DEBUG_INFO(("Binary Data [Size %i]\n", list->elements[x]->size));
                     NULL_CHECK(attach);
@@ -2585,479 +4497,17 @@ static int pst_process(uint64_t block_id, pst_mapi_object *list, pst_item *item,
                         LIST_COPY_BIN(attach->data);
                     }
                     break;
-                case 0x3704: // PR_ATTACH_FILENAME Attachment filename (8.3)
-                    NULL_CHECK(attach);
-                    LIST_COPY_STR("Attachment Filename", attach->filename1);
-                    break;
-                case 0x3705: // PR_ATTACH_METHOD
-                    NULL_CHECK(attach);
-                    LIST_COPY_ENUM("Attachment method", attach->method, 0, 7,
-                        "No Attachment",
-                        "Attach By Value",
-                        "Attach By Reference",
-                        "Attach by Reference Resolve",
-                        "Attach by Reference Only",
-                        "Embedded Message",
-                        "OLE");
-                    break;
-                case 0x3707: // PR_ATTACH_LONG_FILENAME Attachment filename (long?)
-                    NULL_CHECK(attach);
-                    LIST_COPY_STR("Attachment Filename long", attach->filename2);
-                    break;
-                case 0x370B: // PR_RENDERING_POSITION
-                    // position in characters that the attachment appears in the plain text body
-                    NULL_CHECK(attach);
-                    LIST_COPY_INT32("Attachment Position", attach->position);
-                    break;
-                case 0x370E: // PR_ATTACH_MIME_TAG Mime type of encoding
-                    NULL_CHECK(attach);
-                    LIST_COPY_STR("Attachment mime encoding", attach->mimetype);
-                    break;
-                case 0x3710: // PR_ATTACH_MIME_SEQUENCE
-                    // sequence number for mime parts. Includes body
-                    NULL_CHECK(attach);
-                    LIST_COPY_INT32("Attachment Mime Sequence", attach->sequence);
-                    break;
-                case 0x3712: // PR_ATTACH_CONTENT_ID
-                    // content identification header (Content-ID)
-                    NULL_CHECK(attach);
-                    LIST_COPY_STR("Content ID", attach->content_id);
-                    break;
-                case 0x3A00: // PR_ACCOUNT
-                    LIST_COPY_CONTACT_STR("Contact's Account name", item->contact->account_name);
-                    break;
-                case 0x3A01: // PR_ALTERNATE_RECIPIENT
-                    DEBUG_INFO(("Contact Alternate Recipient - NOT PROCESSED\n"));
-                    break;
-                case 0x3A02: // PR_CALLBACK_TELEPHONE_NUMBER
-                    LIST_COPY_CONTACT_STR("Callback telephone number", item->contact->callback_phone);
-                    break;
-                case 0x3A03: // PR_CONVERSION_PROHIBITED
-                    LIST_COPY_EMAIL_BOOL("Message Conversion Prohibited", item->email->conversion_prohibited);
-                    break;
-                case 0x3A05: // PR_GENERATION suffix
-                    LIST_COPY_CONTACT_STR("Contacts Suffix", item->contact->suffix);
-                    break;
-                case 0x3A06: // PR_GIVEN_NAME Contact's first name
-                    LIST_COPY_CONTACT_STR("Contacts First Name", item->contact->first_name);
-                    break;
-                case 0x3A07: // PR_GOVERNMENT_ID_NUMBER
-                    LIST_COPY_CONTACT_STR("Contacts Government ID Number", item->contact->gov_id);
-                    break;
-                case 0x3A08: // PR_BUSINESS_TELEPHONE_NUMBER
-                    LIST_COPY_CONTACT_STR("Business Telephone Number", item->contact->business_phone);
-                    break;
-                case 0x3A09: // PR_HOME_TELEPHONE_NUMBER
-                    LIST_COPY_CONTACT_STR("Home Telephone Number", item->contact->home_phone);
-                    break;
-                case 0x3A0A: // PR_INITIALS Contact's Initials
-                    LIST_COPY_CONTACT_STR("Contacts Initials", item->contact->initials);
-                    break;
-                case 0x3A0B: // PR_KEYWORD
-                    LIST_COPY_CONTACT_STR("Keyword", item->contact->keyword);
-                    break;
-                case 0x3A0C: // PR_LANGUAGE
-                    LIST_COPY_CONTACT_STR("Contact's Language", item->contact->language);
-                    break;
-                case 0x3A0D: // PR_LOCATION
-                    LIST_COPY_CONTACT_STR("Contact's Location", item->contact->location);
-                    break;
-                case 0x3A0E: // PR_MAIL_PERMISSION - Can the recipient receive and send email
-                    LIST_COPY_CONTACT_BOOL("Mail Permission", item->contact->mail_permission);
-                    break;
-                case 0x3A0F: // PR_MHS_COMMON_NAME
-                    LIST_COPY_CONTACT_STR("MHS Common Name", item->contact->common_name);
-                    break;
-                case 0x3A10: // PR_ORGANIZATIONAL_ID_NUMBER
-                    LIST_COPY_CONTACT_STR("Organizational ID #", item->contact->org_id);
-                    break;
-                case 0x3A11: // PR_SURNAME Contact's Surname
-                    LIST_COPY_CONTACT_STR("Contacts Surname", item->contact->surname);
-                    break;
-                case 0x3A12: // PR_ORIGINAL_ENTRY_ID
-                    DEBUG_INFO(("Original Entry ID - NOT PROCESSED\n"));
-                    break;
-                case 0x3A13: // PR_ORIGINAL_DISPLAY_NAME
-                    DEBUG_INFO(("Original Display Name - NOT PROCESSED\n"));
-                    break;
-                case 0x3A14: // PR_ORIGINAL_SEARCH_KEY
-                    DEBUG_INFO(("Original Search Key - NOT PROCESSED\n"));
-                    break;
-                case 0x3A15: // PR_POSTAL_ADDRESS
-                    LIST_COPY_CONTACT_STR("Default Postal Address", item->contact->def_postal_address);
-                    break;
-                case 0x3A16: // PR_COMPANY_NAME
-                    LIST_COPY_CONTACT_STR("Company Name", item->contact->company_name);
-                    break;
-                case 0x3A17: // PR_TITLE - Job Title
-                    LIST_COPY_CONTACT_STR("Job Title", item->contact->job_title);
-                    break;
-                case 0x3A18: // PR_DEPARTMENT_NAME
-                    LIST_COPY_CONTACT_STR("Department Name", item->contact->department);
-                    break;
-                case 0x3A19: // PR_OFFICE_LOCATION
-                    LIST_COPY_CONTACT_STR("Office Location", item->contact->office_loc);
-                    break;
-                case 0x3A1A: // PR_PRIMARY_TELEPHONE_NUMBER
-                    LIST_COPY_CONTACT_STR("Primary Telephone", item->contact->primary_phone);
-                    break;
-                case 0x3A1B: // PR_BUSINESS2_TELEPHONE_NUMBER
-                    LIST_COPY_CONTACT_STR("Business Phone Number 2", item->contact->business_phone2);
-                    break;
-                case 0x3A1C: // PR_MOBILE_TELEPHONE_NUMBER
-                    LIST_COPY_CONTACT_STR("Mobile Phone Number", item->contact->mobile_phone);
-                    break;
-                case 0x3A1D: // PR_RADIO_TELEPHONE_NUMBER
-                    LIST_COPY_CONTACT_STR("Radio Phone Number", item->contact->radio_phone);
-                    break;
-                case 0x3A1E: // PR_CAR_TELEPHONE_NUMBER
-                    LIST_COPY_CONTACT_STR("Car Phone Number", item->contact->car_phone);
-                    break;
-                case 0x3A1F: // PR_OTHER_TELEPHONE_NUMBER
-                    LIST_COPY_CONTACT_STR("Other Phone Number", item->contact->other_phone);
-                    break;
-                case 0x3A20: // PR_TRANSMITTABLE_DISPLAY_NAME
-                    LIST_COPY_CONTACT_STR("Transmittable Display Name", item->contact->transmittable_display_name);
-                    break;
-                case 0x3A21: // PR_PAGER_TELEPHONE_NUMBER
-                    LIST_COPY_CONTACT_STR("Pager Phone Number", item->contact->pager_phone);
-                    break;
-                case 0x3A22: // PR_USER_CERTIFICATE
-                    DEBUG_INFO(("User Certificate - NOT PROCESSED\n"));
-                    break;
-                case 0x3A23: // PR_PRIMARY_FAX_NUMBER
-                    LIST_COPY_CONTACT_STR("Primary Fax Number", item->contact->primary_fax);
-                    break;
-                case 0x3A24: // PR_BUSINESS_FAX_NUMBER
-                    LIST_COPY_CONTACT_STR("Business Fax Number", item->contact->business_fax);
-                    break;
-                case 0x3A25: // PR_HOME_FAX_NUMBER
-                    LIST_COPY_CONTACT_STR("Home Fax Number", item->contact->home_fax);
-                    break;
-                case 0x3A26: // PR_BUSINESS_ADDRESS_COUNTRY
-                    LIST_COPY_CONTACT_STR("Business Address Country", item->contact->business_country);
-                    break;
-                case 0x3A27: // PR_BUSINESS_ADDRESS_CITY
-                    LIST_COPY_CONTACT_STR("Business Address City", item->contact->business_city);
-                    break;
-                case 0x3A28: // PR_BUSINESS_ADDRESS_STATE_OR_PROVINCE
-                    LIST_COPY_CONTACT_STR("Business Address State", item->contact->business_state);
-                    break;
-                case 0x3A29: // PR_BUSINESS_ADDRESS_STREET
-                    LIST_COPY_CONTACT_STR("Business Address Street", item->contact->business_street);
-                    break;
-                case 0x3A2A: // PR_BUSINESS_POSTAL_CODE
-                    LIST_COPY_CONTACT_STR("Business Postal Code", item->contact->business_postal_code);
-                    break;
-                case 0x3A2B: // PR_BUSINESS_PO_BOX
-                    LIST_COPY_CONTACT_STR("Business PO Box", item->contact->business_po_box);
-                    break;
-                case 0x3A2C: // PR_TELEX_NUMBER
-                    LIST_COPY_CONTACT_STR("Telex Number", item->contact->telex);
-                    break;
-                case 0x3A2D: // PR_ISDN_NUMBER
-                    LIST_COPY_CONTACT_STR("ISDN Number", item->contact->isdn_phone);
-                    break;
-                case 0x3A2E: // PR_ASSISTANT_TELEPHONE_NUMBER
-                    LIST_COPY_CONTACT_STR("Assistant Phone Number", item->contact->assistant_phone);
-                    break;
-                case 0x3A2F: // PR_HOME2_TELEPHONE_NUMBER
-                    LIST_COPY_CONTACT_STR("Home Phone 2", item->contact->home_phone2);
-                    break;
-                case 0x3A30: // PR_ASSISTANT
-                    LIST_COPY_CONTACT_STR("Assistant's Name", item->contact->assistant_name);
-                    break;
-                case 0x3A40: // PR_SEND_RICH_INFO
-                    LIST_COPY_CONTACT_BOOL("Can receive Rich Text", item->contact->rich_text);
-                    break;
-                case 0x3A41: // PR_WEDDING_ANNIVERSARY
-                    LIST_COPY_CONTACT_TIME("Wedding Anniversary", item->contact->wedding_anniversary);
-                    break;
-                case 0x3A42: // PR_BIRTHDAY
-                    LIST_COPY_CONTACT_TIME("Birthday", item->contact->birthday);
-                    break;
-                case 0x3A43: // PR_HOBBIES
-                    LIST_COPY_CONTACT_STR("Hobbies", item->contact->hobbies);
-                    break;
-                case 0x3A44: // PR_MIDDLE_NAME
-                    LIST_COPY_CONTACT_STR("Middle Name", item->contact->middle_name);
-                    break;
-                case 0x3A45: // PR_DISPLAY_NAME_PREFIX
-                    LIST_COPY_CONTACT_STR("Display Name Prefix (Title)", item->contact->display_name_prefix);
-                    break;
-                case 0x3A46: // PR_PROFESSION
-                    LIST_COPY_CONTACT_STR("Profession", item->contact->profession);
-                    break;
-                case 0x3A47: // PR_PREFERRED_BY_NAME
-                    LIST_COPY_CONTACT_STR("Preferred By Name", item->contact->pref_name);
-                    break;
-                case 0x3A48: // PR_SPOUSE_NAME
-                    LIST_COPY_CONTACT_STR("Spouse's Name", item->contact->spouse_name);
-                    break;
-                case 0x3A49: // PR_COMPUTER_NETWORK_NAME
-                    LIST_COPY_CONTACT_STR("Computer Network Name", item->contact->computer_name);
-                    break;
-                case 0x3A4A: // PR_CUSTOMER_ID
-                    LIST_COPY_CONTACT_STR("Customer ID", item->contact->customer_id);
-                    break;
-                case 0x3A4B: // PR_TTYTDD_PHONE_NUMBER
-                    LIST_COPY_CONTACT_STR("TTY/TDD Phone", item->contact->ttytdd_phone);
-                    break;
-                case 0x3A4C: // PR_FTP_SITE
-                    LIST_COPY_CONTACT_STR("Ftp Site", item->contact->ftp_site);
-                    break;
-                case 0x3A4D: // PR_GENDER
-                    LIST_COPY_CONTACT_ENUM16("Gender", item->contact->gender, 0, 3, "Unspecified", "Female", "Male");
-                    break;
-                case 0x3A4E: // PR_MANAGER_NAME
-                    LIST_COPY_CONTACT_STR("Manager's Name", item->contact->manager_name);
-                    break;
-                case 0x3A4F: // PR_NICKNAME
-                    LIST_COPY_CONTACT_STR("Nickname", item->contact->nickname);
-                    break;
-                case 0x3A50: // PR_PERSONAL_HOME_PAGE
-                    LIST_COPY_CONTACT_STR("Personal Home Page", item->contact->personal_homepage);
-                    break;
-                case 0x3A51: // PR_BUSINESS_HOME_PAGE
-                    LIST_COPY_CONTACT_STR("Business Home Page", item->contact->business_homepage);
-                    break;
-                case 0x3A57: // PR_COMPANY_MAIN_PHONE_NUMBER
-                    LIST_COPY_CONTACT_STR("Company Main Phone", item->contact->company_main_phone);
-                    break;
-                case 0x3A58: // PR_CHILDRENS_NAMES
-                    DEBUG_INFO(("Children's Names - NOT PROCESSED\n"));
-                    break;
-                case 0x3A59: // PR_HOME_ADDRESS_CITY
-                    LIST_COPY_CONTACT_STR("Home Address City", item->contact->home_city);
-                    break;
-                case 0x3A5A: // PR_HOME_ADDRESS_COUNTRY
-                    LIST_COPY_CONTACT_STR("Home Address Country", item->contact->home_country);
-                    break;
-                case 0x3A5B: // PR_HOME_ADDRESS_POSTAL_CODE
-                    LIST_COPY_CONTACT_STR("Home Address Postal Code", item->contact->home_postal_code);
-                    break;
-                case 0x3A5C: // PR_HOME_ADDRESS_STATE_OR_PROVINCE
-                    LIST_COPY_CONTACT_STR("Home Address State or Province", item->contact->home_state);
-                    break;
-                case 0x3A5D: // PR_HOME_ADDRESS_STREET
-                    LIST_COPY_CONTACT_STR("Home Address Street", item->contact->home_street);
-                    break;
-                case 0x3A5E: // PR_HOME_ADDRESS_POST_OFFICE_BOX
-                    LIST_COPY_CONTACT_STR("Home Address Post Office Box", item->contact->home_po_box);
-                    break;
-                case 0x3A5F: // PR_OTHER_ADDRESS_CITY
-                    LIST_COPY_CONTACT_STR("Other Address City", item->contact->other_city);
-                    break;
-                case 0x3A60: // PR_OTHER_ADDRESS_COUNTRY
-                    LIST_COPY_CONTACT_STR("Other Address Country", item->contact->other_country);
-                    break;
-                case 0x3A61: // PR_OTHER_ADDRESS_POSTAL_CODE
-                    LIST_COPY_CONTACT_STR("Other Address Postal Code", item->contact->other_postal_code);
-                    break;
-                case 0x3A62: // PR_OTHER_ADDRESS_STATE_OR_PROVINCE
-                    LIST_COPY_CONTACT_STR("Other Address State", item->contact->other_state);
-                    break;
-                case 0x3A63: // PR_OTHER_ADDRESS_STREET
-                    LIST_COPY_CONTACT_STR("Other Address Street", item->contact->other_street);
-                    break;
-                case 0x3A64: // PR_OTHER_ADDRESS_POST_OFFICE_BOX
-                    LIST_COPY_CONTACT_STR("Other Address Post Office box", item->contact->other_po_box);
-                    break;
-                case 0x3FDE: // PR_INTERNET_CPID
-                    LIST_COPY_INT32("Internet code page", item->internet_cpid);
-                    break;
-                case 0x3FFD: // PR_MESSAGE_CODEPAGE
-                    LIST_COPY_INT32("Message code page", item->message_codepage);
-                    break;
-                case 0x65E3: // PR_PREDECESSOR_CHANGE_LIST
-                    LIST_COPY_BIN(item->predecessor_change);
-                    DEBUG_INFO(("Predecessor Change\n"));
-                    DEBUG_HEXDUMP(item->predecessor_change.data, item->predecessor_change.size);
-                    break;
                 case 0x67F2: // ID2 value of the attachment
                     NULL_CHECK(attach);
                     LIST_COPY_INT32("Attachment ID2 value", ut);
                     attach->id2_val = ut;
                     break;
-                case 0x67FF: // Extra Property Identifier (Password CheckSum)
-                    LIST_COPY_STORE_INT32("Password checksum", item->message_store->pwd_chksum);
-                    break;
-                case 0x6F02: // Secure HTML Body
-                    LIST_COPY_EMAIL_BIN("Secure HTML Body", item->email->encrypted_htmlbody);
-                    break;
-                case 0x6F04: // Secure Text Body
-                    LIST_COPY_EMAIL_BIN("Secure Text Body", item->email->encrypted_body);
-                    break;
-                case 0x7C07: // top of folders ENTRYID
-                    LIST_COPY_STORE_ENTRYID("Top of folders RecID", item->message_store->top_of_folder);
-                    break;
-                case 0x8005: // Contact's Fullname
-                    LIST_COPY_CONTACT_STR("Contact Fullname", item->contact->fullname);
-                    break;
-                case 0x801A: // Full Home Address
-                    LIST_COPY_CONTACT_STR("Home Address", item->contact->home_address);
-                    break;
-                case 0x801B: // Full Business Address
-                    LIST_COPY_CONTACT_STR("Business Address", item->contact->business_address);
-                    break;
-                case 0x801C: // Full Other Address
-                    LIST_COPY_CONTACT_STR("Other Address", item->contact->other_address);
-                    break;
-                case 0x8045: // Work address street
-                    LIST_COPY_CONTACT_STR("Work address street", item->contact->work_address_street);
-                    break;
-                case 0x8046: // Work address city
-                    LIST_COPY_CONTACT_STR("Work address city", item->contact->work_address_city);
-                    break;
-                case 0x8047: // Work address state
-                    LIST_COPY_CONTACT_STR("Work address state", item->contact->work_address_state);
-                    break;
-                case 0x8048: // Work address postalcode
-                    LIST_COPY_CONTACT_STR("Work address postalcode", item->contact->work_address_postalcode);
-                    break;
-                case 0x8049: // Work address country
-                    LIST_COPY_CONTACT_STR("Work address country", item->contact->work_address_country);
-                    break;
-                case 0x804A: // Work address postofficebox
-                    LIST_COPY_CONTACT_STR("Work address postofficebox", item->contact->work_address_postofficebox);
-                    break;
-                case 0x8082: // Email Address 1 Transport
-                    LIST_COPY_CONTACT_STR("Email Address 1 Transport", item->contact->address1_transport);
-                    break;
-                case 0x8083: // Email Address 1 Address
-                    LIST_COPY_CONTACT_STR("Email Address 1 Address", item->contact->address1);
-                    break;
-                case 0x8084: // Email Address 1 Description
-                    LIST_COPY_CONTACT_STR("Email Address 1 Description", item->contact->address1_desc);
-                    break;
-                case 0x8085: // Email Address 1 Record
-                    LIST_COPY_CONTACT_STR("Email Address 1 Record", item->contact->address1a);
-                    break;
-                case 0x8092: // Email Address 2 Transport
-                    LIST_COPY_CONTACT_STR("Email Address 2 Transport", item->contact->address2_transport);
-                    break;
-                case 0x8093: // Email Address 2 Address
-                    LIST_COPY_CONTACT_STR("Email Address 2 Address", item->contact->address2);
-                    break;
-                case 0x8094: // Email Address 2 Description
-                    LIST_COPY_CONTACT_STR("Email Address 2 Description", item->contact->address2_desc);
-                    break;
-                case 0x8095: // Email Address 2 Record
-                    LIST_COPY_CONTACT_STR("Email Address 2 Record", item->contact->address2a);
-                    break;
-                case 0x80A2: // Email Address 3 Transport
-                    LIST_COPY_CONTACT_STR("Email Address 3 Transport", item->contact->address3_transport);
-                    break;
-                case 0x80A3: // Email Address 3 Address
-                    LIST_COPY_CONTACT_STR("Email Address 3 Address", item->contact->address3);
-                    break;
-                case 0x80A4: // Email Address 3 Description
-                    LIST_COPY_CONTACT_STR("Email Address 3 Description", item->contact->address3_desc);
-                    break;
-                case 0x80A5: // Email Address 3 Record
-                    LIST_COPY_CONTACT_STR("Email Address 3 Record", item->contact->address3a);
-                    break;
-                case 0x80D8: // Internet Free/Busy
-                    LIST_COPY_CONTACT_STR("Internet Free/Busy", item->contact->free_busy_address);
-                    break;
-                case 0x8205: // PR_OUTLOOK_EVENT_SHOW_TIME_AS
-                    LIST_COPY_APPT_ENUM("Appointment shows as", item->appointment->showas, 0, 4,
-                        "Free", "Tentative", "Busy", "Out Of Office");
-                    break;
-                case 0x8208: // PR_OUTLOOK_EVENT_LOCATION
-                    LIST_COPY_APPT_STR("Appointment Location", item->appointment->location);
-                    break;
-                case 0x820d: // PR_OUTLOOK_EVENT_START_DATE
-                    LIST_COPY_APPT_TIME("Appointment Date Start", item->appointment->start);
-                    break;
-                case 0x820e: // PR_OUTLOOK_EVENT_START_END
-                    LIST_COPY_APPT_TIME("Appointment Date End", item->appointment->end);
-                    break;
-                case 0x8214: // Label for an appointment
-                    LIST_COPY_APPT_ENUM("Label for appointment", item->appointment->label, 0, 11,
-                        "None",
-                        "Important",
-                        "Business",
-                        "Personal",
-                        "Vacation",
-                        "Must Attend",
-                        "Travel Required",
-                        "Needs Preparation",
-                        "Birthday",
-                        "Anniversary",
-                        "Phone Call");
-                    break;
-                case 0x8215: // PR_OUTLOOK_EVENT_ALL_DAY
-                    LIST_COPY_APPT_BOOL("All day flag", item->appointment->all_day);
-                    break;
-                case 0x8216: // PR_OUTLOOK_EVENT_RECURRENCE_DATA
-                    LIST_COPY_APPT_BIN("Appointment recurrence data", item->appointment->recurrence_data);
-                    break;
-                case 0x8223: // PR_OUTLOOK_EVENT_IS_RECURRING
-                    LIST_COPY_APPT_BOOL("Is recurring", item->appointment->is_recurring);
-                    break;
-                case 0x8231: // Recurrence type
-                    LIST_COPY_APPT_ENUM("Appointment recurrence type ", item->appointment->recurrence_type, 0, 5,
-                        "None",
-                        "Daily",
-                        "Weekly",
-                        "Monthly",
-                        "Yearly");
-                    break;
-                case 0x8232: // Recurrence description
-                    LIST_COPY_APPT_STR("Appointment recurrence description", item->appointment->recurrence_description);
-                    break;
-                case 0x8234: // TimeZone as String
-                    LIST_COPY_APPT_STR("TimeZone of times", item->appointment->timezonestring);
-                    break;
-                case 0x8235: // PR_OUTLOOK_EVENT_RECURRENCE_START
-                    LIST_COPY_APPT_TIME("Recurrence Start Date", item->appointment->recurrence_start);
-                    break;
-                case 0x8236: // PR_OUTLOOK_EVENT_RECURRENCE_END
-                    LIST_COPY_APPT_TIME("Recurrence End Date", item->appointment->recurrence_end);
-                    break;
-                case 0x8501: // PR_OUTLOOK_COMMON_REMINDER_MINUTES_BEFORE
-                    LIST_COPY_APPT_INT32("Alarm minutes", item->appointment->alarm_minutes);
-                    break;
-                case 0x8503: // PR_OUTLOOK_COMMON_REMINDER_SET
-                    LIST_COPY_APPT_BOOL("Reminder alarm", item->appointment->alarm);
-                    break;
                 case 0x8516: // Common start
                     DEBUG_INFO(("Common Start Date - %s\n", pst_fileTimeToAscii((FILETIME*)list->elements[x]->data, time_buffer)));
                     break;
                 case 0x8517: // Common end
                     DEBUG_INFO(("Common End Date - %s\n", pst_fileTimeToAscii((FILETIME*)list->elements[x]->data, time_buffer)));
                     break;
-                case 0x851f: // Play reminder sound filename
-                    LIST_COPY_APPT_STR("Appointment reminder sound filename", item->appointment->alarm_filename);
-                    break;
-                case 0x8530: // Followup
-                    LIST_COPY_CONTACT_STR("Followup String", item->contact->followup);
-                    break;
-                case 0x8534: // Mileage
-                    LIST_COPY_CONTACT_STR("Mileage", item->contact->mileage);
-                    break;
-                case 0x8535: // Billing Information
-                    LIST_COPY_CONTACT_STR("Billing Information", item->contact->billing_information);
-                    break;
-                case 0x8554: // PR_OUTLOOK_VERSION
-                    LIST_COPY_STR("Outlook Version", item->outlook_version);
-                    break;
-                case 0x8560: // Appointment Reminder Time
-                    LIST_COPY_APPT_TIME("Appointment Reminder Time", item->appointment->reminder);
-                    break;
-                case 0x8700: // Journal Type
-                    LIST_COPY_JOURNAL_STR("Journal Entry Type", item->journal->type);
-                    break;
-                case 0x8706: // Journal Start date/time
-                    LIST_COPY_JOURNAL_TIME("Start Timestamp", item->journal->start);
-                    break;
-                case 0x8708: // Journal End date/time
-                    LIST_COPY_JOURNAL_TIME("End Timestamp", item->journal->end);
-                    break;
-                case 0x8712: // Journal Type Description
-                    LIST_COPY_JOURNAL_STR("Journal description", item->journal->description);
-                    break;
                 default:
                     if (list->elements[x]->type == (uint32_t)0x0002) {
                         DEBUG_WARN(("Unknown type %#x 16bit int = %hi\n", list->elements[x]->mapi_id,
@@ -3160,51 +4610,166 @@ static int pst_process(uint64_t block_id, pst_mapi_object *list, pst_item *item,
                         DEBUG_HEXDUMP(list->elements[x]->data, list->elements[x]->size);
                     }
 
-                    if (list->elements[x]->data) {
-                        free(list->elements[x]->data);
-                        list->elements[x]->data = NULL;
-                    }
-            }
+                    list->elements[x]->data = NULL;    // still owned by the list's arena
+            }
+        }
+        list = list->next;
+        if (attach) attach = attach->next;
+    }
+    DEBUG_RET();
+    return 0;
+}
+
+
+static void pst_free_list(pst_mapi_object *list) {
+    DEBUG_ENT("pst_free_list");
+    // every object of the list lives in the same arena
+    if (list) pst_arena_release(list->arena);
+    DEBUG_RET();
+}
+
+
+static void pst_id2_cache_lock(struct pst_id2_cache *cache) {
+#ifdef HAVE_PTHREAD_H
+    if (cache) pthread_mutex_lock(&cache->lock);
+#endif
+}
+
+
+static void pst_id2_cache_unlock(struct pst_id2_cache *cache) {
+#ifdef HAVE_PTHREAD_H
+    if (cache) pthread_mutex_unlock(&cache->lock);
+#endif
+}
+
+
+static void pst_free_id2_set(pst_id2_set *set) {
+    free(set->nodes);
+    free(set->scope);
+    free(set->same);
+    free(set->first.slots);
+    free(set);
+}
+
+
+static void pst_id2_set_ref(pst_id2_set *set) {
+#ifdef HAVE_PTHREAD_H
+    __atomic_add_fetch(&set->refs, 1, __ATOMIC_RELAXED);
+#else
+    set->refs++;
+#endif
+}
+
+
+/** drop one reference, freeing the tree with the last one */
+static void pst_id2_set_unref(pst_id2_set *set) {
+#ifdef HAVE_PTHREAD_H
+    if (__atomic_sub_fetch(&set->refs, 1, __ATOMIC_ACQ_REL) == 0) pst_free_id2_set(set);
+#else
+    if (--set->refs == 0) pst_free_id2_set(set);
+#endif
+}
+
+
+/**
+ * take another reference to an id2 tree, so that it can be kept
+ * after whoever built it calls pst_free_id2().
+ *
+ * @param head any node of an id2 tree, or NULL
+ * @return     head
+ */
+static pst_id2_tree* pst_share_id2(pst_id2_tree *head) {
+    pst_id2_set *set;
+    if (!head || !(set = head->set)) return head;
+    pst_id2_set_ref(set);
+    return head;
+}
+
+
+static struct pst_id2_cache* pst_new_id2_cache(void) {
+    struct pst_id2_cache *cache = (struct pst_id2_cache*) pst_malloc(sizeof(struct pst_id2_cache));
+    memset(cache, 0, sizeof(struct pst_id2_cache));
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_init(&cache->lock, NULL);
+#endif
+    return cache;
+}
+
+
+/** Drop the references the cache holds. Trees still used by items
+ *  stay until those items are freed. */
+static void pst_free_id2_cache(struct pst_id2_cache *cache) {
+    if (!cache) return;
+    while (cache->lru_head) {
+        pst_id2_set *set = cache->lru_head;
+        cache->lru_head = set->lru_next;
+        pst_id2_set_unref(set);
+    }
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_destroy(&cache->lock);
+#endif
+    free(cache);
+}
+
+
+/** @return a new reference to the cached tree built from block i_id, or NULL */
+static pst_id2_set* pst_id2_cache_get(struct pst_id2_cache *cache, uint64_t i_id) {
+    pst_id2_set *set, *prev = NULL;
+    if (!cache) return NULL;
+    pst_id2_cache_lock(cache);
+    for (set = cache->lru_head; set; prev = set, set = set->lru_next) {
+        if (set->i_id != i_id) continue;
+        if (prev) {
+            prev->lru_next  = set->lru_next;
+            set->lru_next   = cache->lru_head;
+            cache->lru_head = set;
         }
-        list = list->next;
-        if (attach) attach = attach->next;
+        pst_id2_set_ref(set);
+        break;
     }
-    DEBUG_RET();
-    return 0;
+    pst_id2_cache_unlock(cache);
+    return set;
 }
 
 
-static void pst_free_list(pst_mapi_object *list) {
-    pst_mapi_object *l;
-    DEBUG_ENT("pst_free_list");
-    while (list) {
-        if (list->elements) {
-            int32_t x;
-            for (x=0; x < list->orig_count; x++) {
-                if (list->elements[x]) {
-                    if (list->elements[x]->data) free(list->elements[x]->data);
-                    free(list->elements[x]);
-                }
-            }
-            free(list->elements);
+/**
+ * add a freshly built tree to the cache, evicting the least recently
+ * used one if the cache is full. If another thread got there first,
+ * the new tree is thrown away in favour of the cached one.
+ *
+ * @return the tree the caller should use, holding one reference
+ */
+static pst_id2_set* pst_id2_cache_put(struct pst_id2_cache *cache, pst_id2_set *set) {
+    pst_id2_set *e, *prev = NULL;
+    if (!cache) return set;
+    pst_id2_cache_lock(cache);
+    for (e = cache->lru_head; e; e = e->lru_next) {
+        if (e->i_id == set->i_id) {
+            pst_id2_set_ref(e);
+            pst_id2_cache_unlock(cache);
+            pst_free_id2_set(set);
+            return e;
         }
-        l = list->next;
-        free (list);
-        list = l;
     }
-    DEBUG_RET();
+    pst_id2_set_ref(set);
+    set->lru_next   = cache->lru_head;
+    cache->lru_head = set;
+    if (++cache->count > PST_ID2_CACHE_SIZE) {
+        for (e = cache->lru_head; e->lru_next; e = e->lru_next) prev = e;
+        prev->lru_next = NULL;
+        cache->count--;
+        pst_id2_set_unref(e);
+    }
+    pst_id2_cache_unlock(cache);
+    return set;
 }
 
 
+/** Release a reference to an id2 tree from pst_build_id2() or pst_share_id2(). */
 static void pst_free_id2(pst_id2_tree * head) {
-    pst_id2_tree *t;
+    pst_id2_set *set;
     DEBUG_ENT("pst_free_id2");
-    while (head) {
-        pst_free_id2(head->child);
-        t = head->next;
-        free(head);
-        head = t;
-    }
+    if (head && (set = head->set)) pst_id2_set_unref(set);
     DEBUG_RET();
 }
 
@@ -3235,23 +4800,39 @@ static void pst_free_xattrib(pst_x_attrib_ll *x) {
 }
 
 
-static pst_id2_tree * pst_build_id2(pst_file *pf, pst_index_ll* list) {
+/** append one node to an id2 tree being read, @return its index */
+static size_t pst_id2_build_add(pst_id2_build *b, uint64_t id2, pst_index_ll *id) {
+    if (b->count == b->capacity) {
+        b->capacity = (b->capacity) ? b->capacity * 2 : 16;
+        b->nodes = (pst_id2_tree*) pst_realloc(b->nodes, sizeof(pst_id2_tree) * b->capacity);
+        b->scope = (size_t*) pst_realloc(b->scope, sizeof(size_t) * b->capacity);
+        b->end   = (size_t*) pst_realloc(b->end,   sizeof(size_t) * b->capacity);
+    }
+    memset(&b->nodes[b->count], 0, sizeof(pst_id2_tree));
+    b->nodes[b->count].id2 = id2;
+    b->nodes[b->count].id  = id;
+    b->end[b->count]       = b->count + 1;
+    return b->count++;
+}
+
+
+/** read one id2 block, and the child blocks it names, into b in depth first order */
+static void pst_id2_build_level(pst_file *pf, pst_index_ll *list, pst_id2_build *b, int32_t depth) {
     pst_block_header block_head;
-    pst_id2_tree *head = NULL, *tail = NULL;
     uint16_t x = 0;
     char *b_ptr = NULL;
     char *buf = NULL;
     pst_id2_assoc id2_rec;
     pst_index_ll *i_ptr = NULL;
-    pst_id2_tree *i2_ptr = NULL;
-    DEBUG_ENT("pst_build_id2");
+    size_t i, level = b->count;
+    DEBUG_ENT("pst_id2_build_level");
 
     if (pst_read_block_size(pf, list->offset, list->size, &buf) < list->size) {
         //an error occured in block read
-        DEBUG_WARN(("block read error occured. offset = %#"PRIx64", size = %#"PRIx64"\n", list->offset, list->size));
+        DEBUG_WARN(("block read error occured. offset = %#"PRIx64", size = %#x\n", list->offset, list->size));
         if (buf) free(buf);
         DEBUG_RET();
-        return NULL;
+        return;
     }
     DEBUG_HEXDUMPC(buf, list->size, 16);
 
@@ -3263,7 +4844,7 @@ static pst_id2_tree * pst_build_id2(pst_file *pf, pst_index_ll* list) {
         DEBUG_WARN(("Unknown constant [%#hx] at start of id2 values [offset %#"PRIx64"].\n", block_head.type, list->offset));
         if (buf) free(buf);
         DEBUG_RET();
-        return NULL;
+        return;
     }
 
     DEBUG_INFO(("ID %#"PRIx64" is likely to be a description record. Count is %i (offset %#"PRIx64")\n",
@@ -3276,31 +4857,89 @@ static pst_id2_tree * pst_build_id2(pst_file *pf, pst_index_ll* list) {
         if ((i_ptr = pst_getID(pf, id2_rec.id)) == NULL) {
             DEBUG_WARN(("%#"PRIx64" - Not Found\n", id2_rec.id));
         } else {
-            DEBUG_INFO(("%#"PRIx64" - Offset %#"PRIx64", u1 %#"PRIx64", Size %"PRIi64"(%#"PRIx64")\n",
+            DEBUG_INFO(("%#"PRIx64" - Offset %#"PRIx64", u1 %#x, Size %u(%#x)\n",
                          i_ptr->i_id, i_ptr->offset, i_ptr->u1, i_ptr->size, i_ptr->size));
-            // add it to the tree
-            i2_ptr = (pst_id2_tree*) pst_malloc(sizeof(pst_id2_tree));
-            i2_ptr->id2   = id2_rec.id2;
-            i2_ptr->id    = i_ptr;
-            i2_ptr->child = NULL;
-            i2_ptr->next  = NULL;
-            if (!head) head = i2_ptr;
-            if (tail)  tail->next = i2_ptr;
-            tail = i2_ptr;
+            // add it to the tree, its children follow it directly
+            i = pst_id2_build_add(b, id2_rec.id2, i_ptr);
             if (id2_rec.child_id) {
                 if ((i_ptr = pst_getID(pf, id2_rec.child_id)) == NULL) {
                     DEBUG_WARN(("child id [%#"PRIx64"] not found\n", id2_rec.child_id));
                 }
+                else if (depth >= PST_MAX_BTREE_DEPTH) {
+                    DEBUG_WARN(("id2 tree too deep at child id [%#"PRIx64"]\n", id2_rec.child_id));
+                }
                 else {
-                    i2_ptr->child = pst_build_id2(pf, i_ptr);
+                    pst_id2_build_level(pf, i_ptr, b, depth+1);
                 }
             }
+            b->end[i] = b->count;
         }
         x++;
     }
     if (buf) free (buf);
+    // a search starting at any node of this level runs to the end of the level
+    for (i = level; i < b->count; i = b->end[i]) b->scope[i] = b->count;
     DEBUG_RET();
-    return head;
+}
+
+
+/**
+ * Build the id2 tree of an assoc_tree block. The tree is kept in a
+ * small cache, so that items sharing the block, and the deferred
+ * bodies of an item, reuse it instead of reading it again.
+ *
+ * @return the head of the tree holding one reference that the caller
+ *         releases with pst_free_id2(), or NULL if the tree is empty
+ */
+static pst_id2_tree * pst_build_id2(pst_file *pf, pst_index_ll* list) {
+    pst_id2_build b;
+    pst_id2_set *set;
+    size_t i;
+    DEBUG_ENT("pst_build_id2");
+
+    if ((set = pst_id2_cache_get(pf->id2_cache, list->i_id))) {
+        DEBUG_RET();
+        return set->nodes;
+    }
+    memset(&b, 0, sizeof(b));
+    pst_id2_build_level(pf, list, &b, 0);
+    if (!b.count) {
+        free(b.nodes);
+        free(b.scope);
+        free(b.end);
+        DEBUG_RET();
+        return NULL;
+    }
+
+    set = (pst_id2_set*) pst_malloc(sizeof(pst_id2_set));
+    memset(set, 0, sizeof(pst_id2_set));
+    set->nodes = b.nodes;
+    set->scope = b.scope;
+    set->same  = b.end;
+    set->count = b.count;
+    set->i_id  = list->i_id;
+    set->refs  = 1;
+    pst_id_map_init(&set->first, b.count);
+    for (i = 0; i < b.count; i++) {
+        pst_id2_tree *node = &set->nodes[i];
+        node->set   = set;
+        node->child = (b.end[i] > i + 1)       ? &set->nodes[i + 1]    : NULL;
+        node->next  = (b.end[i] < b.scope[i])  ? &set->nodes[b.end[i]] : NULL;
+    }
+    // the end offsets are no longer needed, reuse them to chain equal id2 values
+    for (i = 0; i < b.count; i++) {
+        pst_id2_tree *f = (pst_id2_tree*) pst_id_map_get(&set->first, set->nodes[i].id2);
+        set->same[i] = b.count;
+        if (f) {
+            size_t j = (size_t)(f - set->nodes);
+            while (set->same[j] < b.count) j = set->same[j];
+            set->same[j] = i;
+        }
+        else pst_id_map_add(&set->first, set->nodes[i].id2, &set->nodes[i]);
+    }
+    set = pst_id2_cache_put(pf->id2_cache, set);
+    DEBUG_RET();
+    return set->nodes;
 }
 
 
@@ -3324,7 +4963,21 @@ void pst_freeItem(pst_item *item) {
     pst_item_extra_field *et;
 
     DEBUG_ENT("pst_freeItem");
+    if (item && item->arena) {
+        // only the attachments and the encrypted bodies live on the heap,
+        // everything else including the item goes with the arena
+        pst_free_deferred(item->deferred);
+        if (item->email) {
+            SAFE_FREE_BIN(item->email->encrypted_body);
+            SAFE_FREE_BIN(item->email->encrypted_htmlbody);
+        }
+        pst_free_attach(item->attach);
+        pst_arena_release(item->arena);
+        DEBUG_RET();
+        return;
+    }
     if (item) {
+        pst_free_deferred(item->deferred);
         if (item->email) {
             SAFE_FREE(item->email->arrival_date);
             SAFE_FREE_STR(item->email->cc_address);
@@ -3607,6 +5260,13 @@ static int pst_getBlockOffset(char *buf, size_t read_size, uint32_t i_offset, ui
 }
 
 
+static int pst_index_ll_compare(const void *a, const void *b) {
+    uint64_t a_id = ((const pst_index_ll*)a)->i_id;
+    uint64_t b_id = ((const pst_index_ll*)b)->i_id;
+    return (a_id > b_id) - (a_id < b_id);
+}
+
+
 static int pst_getID_compare(const void *key, const void *entry) {
     uint64_t key_id = *(const uint64_t*)key;
     uint64_t entry_id = ((const pst_index_ll*)entry)->i_id;
@@ -3628,7 +5288,17 @@ pst_index_ll* pst_getID(pst_file* pf, uint64_t i_id) {
     i_id -= (i_id & 1);
 
     DEBUG_INFO(("Trying to find %#"PRIx64"\n", i_id));
-    ptr = bsearch(&i_id, pf->i_table, pf->i_count, sizeof *pf->i_table, pst_getID_compare);
+    if (pf->i_keys) {
+        size_t i = (i_id <= UINT32_MAX) ? pst_lower_bound32(pf->i_keys, pf->i_count, (uint32_t)i_id) : pf->i_count;
+        ptr = ((i < pf->i_count) && (pf->i_keys[i] == i_id)) ? pf->i_table + i : NULL;
+    }
+    else {
+        ptr = bsearch(&i_id, pf->i_table, pf->i_count, sizeof *pf->i_table, pst_getID_compare);
+    }
+    if (!ptr && pf->lazy_index) {
+        ptr = (pst_index_ll*)pst_id_map_get(pf->i_map, i_id);
+        if (!ptr) ptr = pst_lazy_getID(pf, i_id);
+    }
     if (ptr) {DEBUG_INFO(("Found Value %#"PRIx64"\n", i_id));            }
     else     {DEBUG_INFO(("ERROR: Value %#"PRIx64" not found\n", i_id)); }
     DEBUG_RET();
@@ -3636,20 +5306,37 @@ pst_index_ll* pst_getID(pst_file* pf, uint64_t i_id) {
 }
 
 
+/**
+ * find an id2 value in the part of an id2 tree that a depth first walk
+ * from head would visit: head, its children and its later siblings.
+ */
 static pst_id2_tree *pst_getID2(pst_id2_tree *head, uint64_t id2) {
     DEBUG_ENT("pst_getID2");
     DEBUG_INFO(("looking for id2 = %#"PRIx64"\n", id2));
-    pst_id2_tree *ptr = head;
-    while (ptr) {
-        if (ptr->id2 == id2) break;
-        if (ptr->child) {
-            pst_id2_tree *rc = pst_getID2(ptr->child, id2);
-            if (rc) {
-                DEBUG_RET();
-                return rc;
+    pst_id2_tree *ptr = NULL;
+    pst_id2_set *set  = (head) ? head->set : NULL;
+    if (set) {
+        size_t i = (size_t)(head - set->nodes);
+        size_t j;
+        ptr = (pst_id2_tree*) pst_id_map_get(&set->first, id2);
+        j   = (ptr) ? (size_t)(ptr - set->nodes) : set->count;
+        while (j < i) j = set->same[j];
+        ptr = (j < set->scope[i]) ? &set->nodes[j] : NULL;
+    }
+    else {
+        // a tree that was not made by pst_build_id2()
+        ptr = head;
+        while (ptr) {
+            if (ptr->id2 == id2) break;
+            if (ptr->child) {
+                pst_id2_tree *rc = pst_getID2(ptr->child, id2);
+                if (rc) {
+                    DEBUG_RET();
+                    return rc;
+                }
             }
+            ptr = ptr->next;
         }
-        ptr = ptr->next;
     }
     if (ptr && ptr->id) {
         DEBUG_INFO(("Found value %#"PRIx64"\n", ptr->id->i_id));
@@ -3670,20 +5357,17 @@ static pst_id2_tree *pst_getID2(pst_id2_tree *head, uint64_t id2) {
  *
  * @return pointer to the pst_desc_tree node in the descriptor tree
 */
-static pst_desc_tree* pst_getDptr(pst_file *pf, uint64_t d_id) {
+pst_desc_tree* pst_getDptr(pst_file *pf, uint64_t d_id) {
     pst_desc_tree *ptr = pf->d_head;
     DEBUG_ENT("pst_getDptr");
-    while (ptr && (ptr->d_id != d_id)) {
-        //DEBUG_INFO(("Looking for %#"PRIx64" at node %#"PRIx64" with parent %#"PRIx64"\n", id, ptr->d_id, ptr->parent_d_id));
-        if (ptr->child) {
-            ptr = ptr->child;
-            continue;
-        }
-        while (!ptr->next && ptr->parent) {
-            ptr = ptr->parent;
-        }
-        ptr = ptr->next;
+    if (pf->d_map) {
+        ptr = (pst_desc_tree*)pst_id_map_get(pf->d_map, d_id);
+        if (!ptr && pf->lazy_index) ptr = pst_lazy_getDptr(pf, d_id);
+        DEBUG_RET();
+        return ptr;
     }
+    // no index, walk the tree
+    ptr = pst_walk_desc(ptr, d_id);
     DEBUG_RET();
     return ptr; // will be NULL or record we are looking for
 }
@@ -3738,12 +5422,20 @@ static size_t pst_read_block_size(pst_file *pf, int64_t offset, size_t size, cha
     rsize = pst_getAtPos(pf, offset, *buf, size);
     if (rsize != size) {
         DEBUG_WARN(("Didn't read all the data. fread returned less [%i instead of %i]\n", rsize, size));
-        if (feof(pf->fp)) {
-            DEBUG_WARN(("We tried to read past the end of the file at [offset %#"PRIx64", size %#x]\n", offset, size));
-        } else if (ferror(pf->fp)) {
-            DEBUG_WARN(("Error is set on file stream.\n"));
+        if (pf->map) {
+            DEBUG_WARN(("We tried to read past the end of the mapping at [offset %#"PRIx64", size %#x]\n", offset, size));
         } else {
-            DEBUG_WARN(("I can't tell why it failed\n"));
+#ifdef HAVE_PREAD
+            DEBUG_WARN(("We tried to read past the end of the file or pread failed at [offset %#"PRIx64", size %#x]\n", offset, size));
+#else
+            if (feof(pf->fp)) {
+                DEBUG_WARN(("We tried to read past the end of the file at [offset %#"PRIx64", size %#x]\n", offset, size));
+            } else if (ferror(pf->fp)) {
+                DEBUG_WARN(("Error is set on file stream.\n"));
+            } else {
+                DEBUG_WARN(("I can't tell why it failed\n"));
+            }
+#endif
         }
     }
 
@@ -3752,6 +5444,255 @@ static size_t pst_read_block_size(pst_file *pf, int64_t offset, size_t size, cha
 }
 
 
+/** scalar reference for "compressible" decryption */
+static void pst_decrypt_comp_scalar(unsigned char *buf, size_t size) {
+    size_t x;
+    for (x=0; x<size; x++) {
+        buf[x] = comp_enc[buf[x]];  // transpose from encrypt array
+    }
+}
+
+
+/** scalar reference for "strong" decryption, salt is taken from the i_id */
+static void pst_decrypt_high_scalar(uint16_t salt, unsigned char *buf, size_t size) {
+    // The following code was based on the information at
+    // http://www.passcape.com/outlook_passwords.htm
+    size_t x;
+    unsigned char y;
+    for (x=0; x<size; x++) {
+        uint8_t losalt = (salt & 0x00ff);
+        uint8_t hisalt = (salt & 0xff00) >> 8;
+        y = buf[x];
+        y += losalt;
+        y = comp_high1[y];
+        y += hisalt;
+        y = comp_high2[y];
+        y -= hisalt;
+        y = comp_enc[y];
+        y -= losalt;
+        buf[x] = y;
+        salt++;
+    }
+}
+
+
+/*
+ * The vector versions do a 256 entry table lookup as 16 lookups of 16
+ * entries with pshufb. For entry block k, (x - 16*k) is below 16 only
+ * in the lanes that belong to that block, and adding 0x70 with unsigned
+ * saturation leaves those lanes at 0x70..0x7f and sets the top bit of
+ * all others, so pshufb returns zero there. Or-ing the 16 results gives
+ * the lookup. The scalar code handles the tail of each buffer.
+ */
+#ifdef HAVE_X86_SIMD_DISPATCH
+
+/** load a 256 entry table as 16 vectors of 16 entries */
+__attribute__((target("ssse3")))
+static inline void pst_load_table_ssse3(const unsigned char *table, __m128i *t) {
+    int k;
+    for (k=0; k<16; k++) t[k] = _mm_loadu_si128((const __m128i*)(table + 16*k));
+}
+
+
+/** look up all 16 bytes of x in the table t */
+__attribute__((target("ssse3")))
+static inline __m128i pst_lookup_ssse3(__m128i x, const __m128i *t) {
+    const __m128i bias = _mm_set1_epi8(0x70);
+    const __m128i step = _mm_set1_epi8(0x10);
+    __m128i r = _mm_shuffle_epi8(t[0], _mm_adds_epu8(x, bias));
+    #define PST_LOOKUP_STEP(k) \
+        x = _mm_sub_epi8(x, step); \
+        r = _mm_or_si128(r, _mm_shuffle_epi8(t[k], _mm_adds_epu8(x, bias)));
+    PST_LOOKUP_STEP(1)  PST_LOOKUP_STEP(2)  PST_LOOKUP_STEP(3)  PST_LOOKUP_STEP(4)
+    PST_LOOKUP_STEP(5)  PST_LOOKUP_STEP(6)  PST_LOOKUP_STEP(7)  PST_LOOKUP_STEP(8)
+    PST_LOOKUP_STEP(9)  PST_LOOKUP_STEP(10) PST_LOOKUP_STEP(11) PST_LOOKUP_STEP(12)
+    PST_LOOKUP_STEP(13) PST_LOOKUP_STEP(14) PST_LOOKUP_STEP(15)
+    #undef PST_LOOKUP_STEP
+    return r;
+}
+
+
+/** "compressible" decryption, 16 bytes at a time */
+__attribute__((target("ssse3")))
+static void pst_decrypt_comp_ssse3(unsigned char *buf, size_t size) {
+    __m128i enc[16];
+    size_t x;
+    pst_load_table_ssse3(comp_enc, enc);
+    for (x=0; x+16<=size; x+=16) {
+        __m128i v = _mm_loadu_si128((__m128i*)(buf+x));
+        _mm_storeu_si128((__m128i*)(buf+x), pst_lookup_ssse3(v, enc));
+    }
+    pst_decrypt_comp_scalar(buf+x, size-x);
+}
+
+
+/** "strong" decryption, 16 bytes at a time */
+__attribute__((target("ssse3")))
+static void pst_decrypt_high_ssse3(uint16_t salt, unsigned char *buf, size_t size) {
+    __m128i enc[16], high1[16], high2[16];
+    const __m128i step0 = _mm_setr_epi16(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m128i step1 = _mm_setr_epi16(8, 9, 10, 11, 12, 13, 14, 15);
+    const __m128i lomask = _mm_set1_epi16(0x00ff);
+    size_t x;
+    pst_load_table_ssse3(comp_enc,   enc);
+    pst_load_table_ssse3(comp_high1, high1);
+    pst_load_table_ssse3(comp_high2, high2);
+    for (x=0; x+16<=size; x+=16) {
+        // the salt of each lane, split into low and high bytes
+        __m128i s0 = _mm_add_epi16(_mm_set1_epi16((short)salt), step0);
+        __m128i s1 = _mm_add_epi16(_mm_set1_epi16((short)salt), step1);
+        __m128i lo = _mm_packus_epi16(_mm_and_si128(s0, lomask), _mm_and_si128(s1, lomask));
+        __m128i hi = _mm_packus_epi16(_mm_srli_epi16(s0, 8), _mm_srli_epi16(s1, 8));
+        __m128i y  = _mm_loadu_si128((__m128i*)(buf+x));
+        y = pst_lookup_ssse3(_mm_add_epi8(y, lo), high1);
+        y = pst_lookup_ssse3(_mm_add_epi8(y, hi), high2);
+        y = pst_lookup_ssse3(_mm_sub_epi8(y, hi), enc);
+        _mm_storeu_si128((__m128i*)(buf+x), _mm_sub_epi8(y, lo));
+        salt += 16;
+    }
+    pst_decrypt_high_scalar(salt, buf+x, size-x);
+}
+
+
+/** load a 256 entry table as 16 vectors, each 16 entries repeated in both halves */
+__attribute__((target("avx2")))
+static inline void pst_load_table_avx2(const unsigned char *table, __m256i *t) {
+    int k;
+    for (k=0; k<16; k++) t[k] = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)(table + 16*k)));
+}
+
+
+/** look up all 32 bytes of x in the table t */
+__attribute__((target("avx2")))
+static inline __m256i pst_lookup_avx2(__m256i x, const __m256i *t) {
+    const __m256i bias = _mm256_set1_epi8(0x70);
+    const __m256i step = _mm256_set1_epi8(0x10);
+    __m256i r = _mm256_shuffle_epi8(t[0], _mm256_adds_epu8(x, bias));
+    #define PST_LOOKUP_STEP(k) \
+        x = _mm256_sub_epi8(x, step); \
+        r = _mm256_or_si256(r, _mm256_shuffle_epi8(t[k], _mm256_adds_epu8(x, bias)));
+    PST_LOOKUP_STEP(1)  PST_LOOKUP_STEP(2)  PST_LOOKUP_STEP(3)  PST_LOOKUP_STEP(4)
+    PST_LOOKUP_STEP(5)  PST_LOOKUP_STEP(6)  PST_LOOKUP_STEP(7)  PST_LOOKUP_STEP(8)
+    PST_LOOKUP_STEP(9)  PST_LOOKUP_STEP(10) PST_LOOKUP_STEP(11) PST_LOOKUP_STEP(12)
+    PST_LOOKUP_STEP(13) PST_LOOKUP_STEP(14) PST_LOOKUP_STEP(15)
+    #undef PST_LOOKUP_STEP
+    return r;
+}
+
+
+/** "compressible" decryption, 32 bytes at a time */
+__attribute__((target("avx2")))
+static void pst_decrypt_comp_avx2(unsigned char *buf, size_t size) {
+    __m256i enc[16];
+    size_t x;
+    pst_load_table_avx2(comp_enc, enc);
+    for (x=0; x+32<=size; x+=32) {
+        __m256i v = _mm256_loadu_si256((__m256i*)(buf+x));
+        _mm256_storeu_si256((__m256i*)(buf+x), pst_lookup_avx2(v, enc));
+    }
+    pst_decrypt_comp_scalar(buf+x, size-x);
+}
+
+
+/** "strong" decryption, 32 bytes at a time */
+__attribute__((target("avx2")))
+static void pst_decrypt_high_avx2(uint16_t salt, unsigned char *buf, size_t size) {
+    __m256i enc[16], high1[16], high2[16];
+    // packus works within each 128 bit half, so the lanes are interleaved to come out in order
+    const __m256i step0 = _mm256_setr_epi16(0, 1, 2, 3, 4, 5, 6, 7, 16, 17, 18, 19, 20, 21, 22, 23);
+    const __m256i step1 = _mm256_setr_epi16(8, 9, 10, 11, 12, 13, 14, 15, 24, 25, 26, 27, 28, 29, 30, 31);
+    const __m256i lomask = _mm256_set1_epi16(0x00ff);
+    size_t x;
+    pst_load_table_avx2(comp_enc,   enc);
+    pst_load_table_avx2(comp_high1, high1);
+    pst_load_table_avx2(comp_high2, high2);
+    for (x=0; x+32<=size; x+=32) {
+        __m256i s0 = _mm256_add_epi16(_mm256_set1_epi16((short)salt), step0);
+        __m256i s1 = _mm256_add_epi16(_mm256_set1_epi16((short)salt), step1);
+        __m256i lo = _mm256_packus_epi16(_mm256_and_si256(s0, lomask), _mm256_and_si256(s1, lomask));
+        __m256i hi = _mm256_packus_epi16(_mm256_srli_epi16(s0, 8), _mm256_srli_epi16(s1, 8));
+        __m256i y  = _mm256_loadu_si256((__m256i*)(buf+x));
+        y = pst_lookup_avx2(_mm256_add_epi8(y, lo), high1);
+        y = pst_lookup_avx2(_mm256_add_epi8(y, hi), high2);
+        y = pst_lookup_avx2(_mm256_sub_epi8(y, hi), enc);
+        _mm256_storeu_si256((__m256i*)(buf+x), _mm256_sub_epi8(y, lo));
+        salt += 32;
+    }
+    pst_decrypt_high_scalar(salt, buf+x, size-x);
+}
+
+#endif
+
+
+/*
+ * On aarch64 tbl/tbx look up 64 entries at once, and return zero or
+ * leave the lane alone for indexes out of range, so four lookups
+ * with the index moved down by 64 each time cover the table.
+ */
+#ifdef PST_HAVE_NEON
+
+/** load a 256 entry table as 4 groups of 64 entries */
+static inline void pst_load_table_neon(const unsigned char *table, uint8x16x4_t *t) {
+    int j, k;
+    for (j=0; j<4; j++) {
+        for (k=0; k<4; k++) t[j].val[k] = vld1q_u8(table + 64*j + 16*k);
+    }
+}
+
+
+/** look up all 16 bytes of x in the table t */
+static inline uint8x16_t pst_lookup_neon(uint8x16_t x, const uint8x16x4_t *t) {
+    const uint8x16_t step = vdupq_n_u8(64);
+    uint8x16_t r = vqtbl4q_u8(t[0], x);
+    x = vsubq_u8(x, step);
+    r = vqtbx4q_u8(r, t[1], x);
+    x = vsubq_u8(x, step);
+    r = vqtbx4q_u8(r, t[2], x);
+    x = vsubq_u8(x, step);
+    return vqtbx4q_u8(r, t[3], x);
+}
+
+
+/** "compressible" decryption, 16 bytes at a time */
+static void pst_decrypt_comp_neon(unsigned char *buf, size_t size) {
+    uint8x16x4_t enc[4];
+    size_t x;
+    pst_load_table_neon(comp_enc, enc);
+    for (x=0; x+16<=size; x+=16) {
+        vst1q_u8(buf+x, pst_lookup_neon(vld1q_u8(buf+x), enc));
+    }
+    pst_decrypt_comp_scalar(buf+x, size-x);
+}
+
+
+/** "strong" decryption, 16 bytes at a time */
+static void pst_decrypt_high_neon(uint16_t salt, unsigned char *buf, size_t size) {
+    static const uint16_t steps[16] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15};
+    const uint16x8_t step0 = vld1q_u16(steps);
+    const uint16x8_t step1 = vld1q_u16(steps + 8);
+    uint8x16x4_t enc[4], high1[4], high2[4];
+    size_t x;
+    pst_load_table_neon(comp_enc,   enc);
+    pst_load_table_neon(comp_high1, high1);
+    pst_load_table_neon(comp_high2, high2);
+    for (x=0; x+16<=size; x+=16) {
+        uint16x8_t s0 = vaddq_u16(vdupq_n_u16(salt), step0);
+        uint16x8_t s1 = vaddq_u16(vdupq_n_u16(salt), step1);
+        uint8x16_t lo = vcombine_u8(vmovn_u16(s0), vmovn_u16(s1));
+        uint8x16_t hi = vcombine_u8(vshrn_n_u16(s0, 8), vshrn_n_u16(s1, 8));
+        uint8x16_t y  = vld1q_u8(buf+x);
+        y = pst_lookup_neon(vaddq_u8(y, lo), high1);
+        y = pst_lookup_neon(vaddq_u8(y, hi), high2);
+        y = pst_lookup_neon(vsubq_u8(y, hi), enc);
+        vst1q_u8(buf+x, vsubq_u8(y, lo));
+        salt += 16;
+    }
+    pst_decrypt_high_scalar(salt, buf+x, size-x);
+}
+
+#endif
+
+
 /** Decrypt a block of data from the pst file.
  * @param i_id identifier of this block, needed as part of the key for the enigma cipher
  * @param buf  pointer to the buffer to be decrypted in place
@@ -3763,8 +5704,7 @@ static size_t pst_read_block_size(pst_file *pf, int64_t offset, size_t size, cha
  * @return 0 if ok, -1 if error (NULL buffer or unknown encryption type)
  */
 static int pst_decrypt(uint64_t i_id, char *buf, size_t size, unsigned char type) {
-    size_t x = 0;
-    unsigned char y;
+    unsigned char *ubuf = (unsigned char*)buf;
     DEBUG_ENT("pst_decrypt");
     if (!buf) {
         DEBUG_RET();
@@ -3772,33 +5712,27 @@ static int pst_decrypt(uint64_t i_id, char *buf, size_t size, unsigned char type
     }
 
     if (type == PST_COMP_ENCRYPT) {
-        x = 0;
-        while (x < size) {
-            y = (unsigned char)(buf[x]);
-            buf[x] = (char)comp_enc[y]; // transpose from encrypt array
-            x++;
-        }
+#if defined(HAVE_X86_SIMD_DISPATCH)
+        if      (__builtin_cpu_supports("avx2"))  pst_decrypt_comp_avx2(ubuf, size);
+        else if (__builtin_cpu_supports("ssse3")) pst_decrypt_comp_ssse3(ubuf, size);
+        else                                      pst_decrypt_comp_scalar(ubuf, size);
+#elif defined(PST_HAVE_NEON)
+        pst_decrypt_comp_neon(ubuf, size);
+#else
+        pst_decrypt_comp_scalar(ubuf, size);
+#endif
 
     } else if (type == PST_ENCRYPT) {
-        // The following code was based on the information at
-        // http://www.passcape.com/outlook_passwords.htm
         uint16_t salt = (uint16_t) (((i_id & 0x00000000ffff0000) >> 16) ^ (i_id & 0x000000000000ffff));
-        x = 0;
-        while (x < size) {
-            uint8_t losalt = (salt & 0x00ff);
-            uint8_t hisalt = (salt & 0xff00) >> 8;
-            y = (unsigned char)buf[x];
-            y += losalt;
-            y = comp_high1[y];
-            y += hisalt;
-            y = comp_high2[y];
-            y -= hisalt;
-            y = comp_enc[y];
-            y -= losalt;
-            buf[x] = (char)y;
-            x++;
-            salt++;
-        }
+#if defined(HAVE_X86_SIMD_DISPATCH)
+        if      (__builtin_cpu_supports("avx2"))  pst_decrypt_high_avx2(salt, ubuf, size);
+        else if (__builtin_cpu_supports("ssse3")) pst_decrypt_high_ssse3(salt, ubuf, size);
+        else                                      pst_decrypt_high_scalar(salt, ubuf, size);
+#elif defined(PST_HAVE_NEON)
+        pst_decrypt_high_neon(salt, ubuf, size);
+#else
+        pst_decrypt_high_scalar(salt, ubuf, size);
+#endif
 
     } else {
         DEBUG_WARN(("Unknown encryption: %i. Cannot decrypt\n", type));
@@ -3829,6 +5763,11 @@ static uint64_t pst_getIntAt(pst_file *pf, char *buf) {
 static uint64_t pst_getIntAtPos(pst_file *pf, int64_t pos ) {
     uint64_t buf64;
     uint32_t buf32;
+    if (pf->map) {
+        size_t size = (pf->do_read64) ? sizeof(buf64) : sizeof(buf32);
+        if ((pos < 0) || ((uint64_t)pos + size > pf->map_size)) return 0;
+        return pst_getIntAt(pf, pf->map + pos);
+    }
     if (pf->do_read64) {
         (void)pst_getAtPos(pf, pos, &buf64, sizeof(buf64));
         LE64_CPU(buf64);
@@ -3875,16 +5814,245 @@ static size_t pst_getAtPos(pst_file *pf, int64_t pos, void* buf, size_t size) {
 //  DEBUG_INFO(("pst file old offset %#"PRIx64" old size %#x read count %i offset %#"PRIx64" size %#x\n",
 //              p->offset, p->size, p->readcount, pos, size));
 
+    if (pf->map) {
+        if ((pos < 0) || ((uint64_t)pos >= pf->map_size)) {
+            DEBUG_RET();
+            return 0;
+        }
+        rc = size;
+        if ((uint64_t)pos + size > pf->map_size) rc = (size_t)(pf->map_size - (uint64_t)pos);
+        memcpy(buf, pf->map + pos, rc);
+        DEBUG_RET();
+        return rc;
+    }
+#ifdef HAVE_PREAD
+    // positional reads leave the shared file offset alone, so several
+    // threads (or forked processes) can read through the same descriptor
+    rc = 0;
+    while (rc < size) {
+        ssize_t r = pread(fileno(pf->fp), (char*)buf + rc, size - rc, (off_t)(pos + rc));
+        if ((r < 0) && (errno == EINTR)) continue;
+        if (r <= 0) break;
+        rc += (size_t)r;
+    }
+#else
     if (fseeko(pf->fp, pos, SEEK_SET) == -1) {
         DEBUG_RET();
         return 0;
     }
     rc = fread(buf, (size_t)1, size, pf->fp);
+#endif
     DEBUG_RET();
     return rc;
 }
 
 
+static size_t pst_block_cache_hash(struct pst_block_cache *cache, uint64_t i_id) {
+    return (size_t)((i_id * (uint64_t)0x9E3779B97F4A7C15) >> 24) & (cache->bucket_count - 1);
+}
+
+
+static void pst_block_cache_unlink(struct pst_block_cache *cache, pst_cached_block *e) {
+    if (e->lru_prev) e->lru_prev->lru_next = e->lru_next;
+    else             cache->lru_head       = e->lru_next;
+    if (e->lru_next) e->lru_next->lru_prev = e->lru_prev;
+    else             cache->lru_tail       = e->lru_prev;
+    e->lru_prev = NULL;
+    e->lru_next = NULL;
+}
+
+
+static void pst_block_cache_push(struct pst_block_cache *cache, pst_cached_block *e) {
+    e->lru_prev = NULL;
+    e->lru_next = cache->lru_head;
+    if (cache->lru_head) cache->lru_head->lru_prev = e;
+    cache->lru_head = e;
+    if (!cache->lru_tail) cache->lru_tail = e;
+}
+
+
+/** drop least recently used blocks until the cache fits into max_bytes */
+static void pst_block_cache_trim(struct pst_block_cache *cache, size_t max_bytes) {
+    while (cache->lru_tail && (cache->bytes > max_bytes)) {
+        pst_cached_block *e = cache->lru_tail;
+        pst_cached_block **pp = &cache->buckets[pst_block_cache_hash(cache, e->i_id)];
+        while (*pp != e) pp = &(*pp)->hash_next;
+        *pp = e->hash_next;
+        pst_block_cache_unlink(cache, e);
+        cache->bytes -= e->size + sizeof(pst_cached_block);
+        cache->count--;
+        cache->evictions++;
+        free(e->data);
+        free(e);
+    }
+}
+
+
+static void pst_block_cache_rehash(struct pst_block_cache *cache, size_t bucket_count) {
+    size_t i;
+    pst_cached_block **old = cache->buckets;
+    size_t old_count = cache->bucket_count;
+    cache->buckets      = (pst_cached_block**)pst_malloc(bucket_count * sizeof(pst_cached_block*));
+    cache->bucket_count = bucket_count;
+    memset(cache->buckets, 0, bucket_count * sizeof(pst_cached_block*));
+    for (i=0; i<old_count; i++) {
+        pst_cached_block *e = old[i];
+        while (e) {
+            pst_cached_block *next = e->hash_next;
+            size_t h = pst_block_cache_hash(cache, e->i_id);
+            e->hash_next = cache->buckets[h];
+            cache->buckets[h] = e;
+            e = next;
+        }
+    }
+    free(old);
+}
+
+
+static void pst_block_cache_lock(struct pst_block_cache *cache) {
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_lock(&cache->lock);
+#endif
+}
+
+
+static void pst_block_cache_unlock(struct pst_block_cache *cache) {
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_unlock(&cache->lock);
+#endif
+}
+
+
+static void pst_free_block_cache(struct pst_block_cache *cache) {
+    if (!cache) return;
+    pst_block_cache_trim(cache, 0);
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_destroy(&cache->lock);
+#endif
+    free(cache->buckets);
+    free(cache);
+}
+
+
+void pst_set_block_cache(pst_file *pf, size_t max_bytes) {
+    DEBUG_ENT("pst_set_block_cache");
+    if (!max_bytes) {
+        pst_free_block_cache(pf->block_cache);
+        pf->block_cache = NULL;
+        DEBUG_RET();
+        return;
+    }
+    if (!pf->block_cache) {
+        pf->block_cache = (struct pst_block_cache*)pst_malloc(sizeof(struct pst_block_cache));
+        memset(pf->block_cache, 0, sizeof(struct pst_block_cache));
+#ifdef HAVE_PTHREAD_H
+        pthread_mutex_init(&pf->block_cache->lock, NULL);
+#endif
+        pst_block_cache_rehash(pf->block_cache, 64);
+    }
+    pst_block_cache_lock(pf->block_cache);
+    pf->block_cache->max_bytes = max_bytes;
+    pst_block_cache_trim(pf->block_cache, max_bytes);
+    pst_block_cache_unlock(pf->block_cache);
+    DEBUG_RET();
+}
+
+
+void pst_get_block_cache_stats(pst_file *pf, pst_block_cache_stats *stats) {
+    struct pst_block_cache *cache = pf->block_cache;
+    memset(stats, 0, sizeof(*stats));
+    if (!cache) return;
+    pst_block_cache_lock(cache);
+    stats->hits      = cache->hits;
+    stats->misses    = cache->misses;
+    stats->evictions = cache->evictions;
+    stats->count     = cache->count;
+    stats->bytes     = cache->bytes;
+    stats->max_bytes = cache->max_bytes;
+    pst_block_cache_unlock(cache);
+}
+
+
+/**
+ * Look for a decrypted block in the cache.
+ * @param pf   PST file structure
+ * @param i_id ID of block to retrieve
+ * @param buf  reference to pointer to buffer that will receive a private copy
+ *             of the block. If this pointer is non-NULL, it will first be free()d.
+ * @return     size of the block, 0 if it is not in the cache
+ */
+static size_t pst_block_cache_get(pst_file *pf, uint64_t i_id, char **buf) {
+    struct pst_block_cache *cache = pf->block_cache;
+    pst_cached_block *e;
+    size_t size;
+    if (!cache) return 0;
+    pst_block_cache_lock(cache);
+    e = cache->buckets[pst_block_cache_hash(cache, i_id)];
+    while (e && (e->i_id != i_id)) e = e->hash_next;
+    if (!e) {
+        cache->misses++;
+        pst_block_cache_unlock(cache);
+        return 0;
+    }
+    cache->hits++;
+    if (cache->lru_head != e) {
+        pst_block_cache_unlink(cache, e);
+        pst_block_cache_push(cache, e);
+    }
+    if (*buf) free(*buf);
+    size = e->size;
+    *buf = (char*)pst_malloc(size);
+    memcpy(*buf, e->data, size);
+    pst_block_cache_unlock(cache);
+    return size;
+}
+
+
+/**
+ * Remember a copy of a decrypted block, evicting older blocks as needed.
+ * Blocks larger than a quarter of the budget are not cached.
+ */
+static void pst_block_cache_put(pst_file *pf, uint64_t i_id, char *buf, size_t size) {
+    struct pst_block_cache *cache = pf->block_cache;
+    pst_cached_block *e;
+    size_t h;
+    if (!cache || !buf || !size) return;
+    e = (pst_cached_block*)pst_malloc(sizeof(pst_cached_block));
+    e->i_id = i_id;
+    e->size = size;
+    e->data = (char*)pst_malloc(size);
+    memcpy(e->data, buf, size);
+    pst_block_cache_lock(cache);
+    if (size + sizeof(pst_cached_block) > cache->max_bytes / 4) {
+        pst_block_cache_unlock(cache);
+        free(e->data);
+        free(e);
+        return;
+    }
+    h = pst_block_cache_hash(cache, i_id);
+    {
+        // another thread may have read the same block in the meantime
+        pst_cached_block *x = cache->buckets[h];
+        while (x && (x->i_id != i_id)) x = x->hash_next;
+        if (x) {
+            pst_block_cache_unlock(cache);
+            free(e->data);
+            free(e);
+            return;
+        }
+    }
+    pst_block_cache_trim(cache, cache->max_bytes - size - sizeof(pst_cached_block));
+    if (cache->count >= cache->bucket_count) pst_block_cache_rehash(cache, cache->bucket_count * 2);
+    h = pst_block_cache_hash(cache, i_id);
+    e->hash_next = cache->buckets[h];
+    cache->buckets[h] = e;
+    pst_block_cache_push(cache, e);
+    cache->bytes += size + sizeof(pst_cached_block);
+    cache->count++;
+    pst_block_cache_unlock(cache);
+}
+
+
 /**
  * Get an ID block from file using pst_ff_getIDblock() and decrypt if necessary
  * @param pf   PST file structure
@@ -3898,10 +6066,17 @@ size_t pst_ff_getIDblock_dec(pst_file *pf, uint64_t i_id, char **buf) {
     int noenc = (int)(i_id & 2);   // disable encryption
     DEBUG_ENT("pst_ff_getIDblock_dec");
     DEBUG_INFO(("for id %#"PRIx64"\n", i_id));
+    r = pst_block_cache_get(pf, i_id, buf);
+    if (r) {
+        DEBUG_INFO(("served from the block cache\n"));
+        DEBUG_RET();
+        return r;
+    }
     r = pst_ff_getIDblock(pf, i_id, buf);
     if ((pf->encryption) && !(noenc)) {
         (void)pst_decrypt(i_id, *buf, r, pf->encryption);
     }
+    pst_block_cache_put(pf, i_id, *buf, r);
     DEBUG_HEXDUMPC(*buf, r, 16);
     DEBUG_RET();
     return r;
@@ -3997,7 +6172,10 @@ static size_t pst_ff_compile_ID(pst_file *pf, uint64_t i_id, pst_holder *h, size
     pst_table3_rec table3_rec;  //for type 3 (0x0101) blocks
 
     DEBUG_ENT("pst_ff_compile_ID");
-    a = pst_ff_getIDblock(pf, i_id, &buf3);
+    // blocks with the 0x02 bit set are never encrypted, so the decrypted
+    // (and cached) version is identical to the raw one
+    if (i_id & 2) a = pst_ff_getIDblock_dec(pf, i_id, &buf3);
+    else          a = pst_ff_getIDblock(pf, i_id, &buf3);
     if (!a) {
         if (buf3) free(buf3);
         DEBUG_RET();
@@ -4073,8 +6251,8 @@ static size_t pst_append_holder(pst_holder *h, size_t size, char **buf, size_t z
         DEBUG_INFO(("appending read data of size %i onto main buffer from pos %i\n", z, size));
         memcpy(*(h->buf)+size, *buf, z);
 
-    // base64 encoding to a file
-    } else if ((h->base64 == 1) && h->fp) {
+    // base64 encoding to a file or a buffer
+    } else if ((h->base64 == 1) && (h->fp || h->vb)) {
         //
         if (h->base64_extra) {
             // include any bytes left over from the last encoding
@@ -4095,7 +6273,8 @@ static size_t pst_append_holder(pst_holder *h, size_t size, char **buf, size_t z
         t = pst_base64_encode_multiple(*buf, z, &h->base64_line_count);
         if (t) {
             DEBUG_INFO(("writing %i bytes to file as base64 [%i]. Currently %i\n", z, strlen(t), size));
-            (void)pst_fwrite(t, (size_t)1, strlen(t), h->fp);
+            if (h->vb) pst_vbappend(h->vb, t, strlen(t));
+            else       (void)pst_fwrite(t, (size_t)1, strlen(t), h->fp);
             free(t);    // caught by valgrind
         }
 
@@ -4122,11 +6301,12 @@ static size_t pst_append_holder(pst_holder *h, size_t size, char **buf, size_t z
 static size_t pst_finish_cleanup_holder(pst_holder *h, size_t size) {
     char *t;
     DEBUG_ENT("pst_finish_cleanup_holder");
-    if ((h->base64 == 1) && h->fp && h->base64_extra) {
+    if ((h->base64 == 1) && (h->fp || h->vb) && h->base64_extra) {
         // need to encode any bytes left over
         t = pst_base64_encode_multiple(h->base64_extra_chars, h->base64_extra, &h->base64_line_count);
         if (t) {
-            (void)pst_fwrite(t, (size_t)1, strlen(t), h->fp);
+            if (h->vb) pst_vbappend(h->vb, t, strlen(t));
+            else       (void)pst_fwrite(t, (size_t)1, strlen(t), h->fp);
             free(t);    // caught by valgrind
         }
         size += h->base64_extra;
@@ -4368,11 +6548,28 @@ const char*    pst_default_charset(pst_item *item, int buflen, char* result) {
 }
 
 
+void pst_item_replace_str(pst_item *item, pst_string *str, char *value) {
+    if (item->arena) {
+        // pst_freeItem() releases the arena but no heap strings, so the new
+        // text goes into the arena, and a heap string put there by a caller
+        // is freed now
+        if (!pst_arena_owns(item->arena, str->str)) free(str->str);
+        str->str = pst_item_strdup(item->arena, value);
+        free(value);
+    }
+    else {
+        free(str->str);
+        str->str = value;
+    }
+}
+
+
 /** Convert str to rfc2231 encoding of str
  *
+ *  @param item  pointer to the containing mapi item
  *  @param str   pointer to the mapi string of interest
  */
-void pst_rfc2231(pst_string *str) {
+void pst_rfc2231(pst_item *item, pst_string *str) {
     int needs = 0;
     const int8_t *x = (int8_t *)str->str;
     while (*x) {
@@ -4399,8 +6596,7 @@ void pst_rfc2231(pst_string *str) {
         y++;
     }
     *z = '\0';
-    free(str->str);
-    str->str = buffer;
+    pst_item_replace_str(item, str, buffer);
 }
 
 
@@ -4422,18 +6618,17 @@ void pst_rfc2047(pst_item *item, pst_string *str, int needs_quote) {
     }
     if (needs_coding) {
         char *enc = pst_base64_encode_single(str->str, strlen(str->str));
-        free(str->str);
         int n = strlen(enc) + 20;
-        str->str = pst_malloc(n);
-        snprintf(str->str, n, "=?utf-8?B?%s?=", enc);
+        char *buffer = pst_malloc(n);
+        snprintf(buffer, n, "=?utf-8?B?%s?=", enc);
         free(enc);
+        pst_item_replace_str(item, str, buffer);
     }
     else if (has_space && needs_quote) {
         int n = strlen(str->str) + 10;
         char *buffer = pst_malloc(n);
         snprintf(buffer, n, "\"%s\"", str->str);
-        free(str->str);
-        str->str = buffer;
+        pst_item_replace_str(item, str, buffer);
     }
 }
 
@@ -4463,7 +6658,7 @@ void pst_convert_utf8(pst_item *item, pst_string *str) {
         return;
     }
     if (!str->str) {
-        str->str = strdup("");
+        pst_item_replace_str(item, str, strdup(""));
         DEBUG_WARN(("null to empty string\n"));
         DEBUG_RET();
         return;
@@ -4481,8 +6676,7 @@ void pst_convert_utf8(pst_item *item, pst_string *str) {
         DEBUG_WARN(("Failed to convert %s to utf-8 - %s\n", charset, str->str));
     }
     else {
-        free(str->str);
-        str->str = newer->b;
+        pst_item_replace_str(item, str, newer->b);
         str->is_utf8 = 1;
     }
     free(newer);
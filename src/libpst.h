@@ -104,8 +104,9 @@ typedef struct pst_entryid {
 typedef struct pst_index_ll {
     uint64_t i_id;
     uint64_t offset;
-    uint64_t size;
-    int64_t  u1;
+    /** block sizes are 16 bit in the file */
+    uint32_t size;
+    int32_t  u1;
 } pst_index_ll;
 
 
@@ -114,6 +115,8 @@ typedef struct pst_id2_tree {
     pst_index_ll        *id;
     struct pst_id2_tree *child;
     struct pst_id2_tree *next;
+    /** the shared, reference counted array holding this node */
+    struct pst_id2_set  *set;
 } pst_id2_tree;
 
 
@@ -851,6 +854,12 @@ typedef struct pst_item {
      *  @li 1 true
      *  @li 0 false */
     int         private_member;
+    /** large properties not read yet when the pst_file has lazy bodies
+     *  enabled, NULL once pst_load_bodies() has run */
+    struct pst_item_deferred *deferred;
+    /** memory holding the item and most of its fields when the pst_file
+     *  has item arenas enabled, NULL otherwise */
+    struct pst_arena *arena;
 } pst_item;
 
 
@@ -885,6 +894,48 @@ typedef struct pst_block_recorder {
 } pst_block_recorder;
 
 
+/** hit and miss counters of the decrypted block cache,
+ *  see pst_get_block_cache_stats() */
+typedef struct pst_block_cache_stats {
+    /** number of blocks served from the cache */
+    uint64_t    hits;
+    /** number of blocks that had to be read and decrypted */
+    uint64_t    misses;
+    /** number of blocks dropped to stay within the byte budget */
+    uint64_t    evictions;
+    /** number of blocks currently in the cache */
+    size_t      count;
+    /** bytes currently used by the cache */
+    size_t      bytes;
+    /** byte budget of the cache, 0 if the cache is disabled */
+    size_t      max_bytes;
+} pst_block_cache_stats;
+
+
+/** default byte budget of the decrypted block cache */
+#define PST_BLOCK_CACHE_DEFAULT (4*1024*1024)
+
+
+/** opaque decrypted block cache, see pst_set_block_cache() */
+struct pst_block_cache;
+
+
+/** opaque hash keyed by id, see pst_getDptr() */
+struct pst_id_map;
+
+
+/** opaque pool of the arenas used while parsing items */
+struct pst_arena_pool;
+
+
+/** opaque cache of recently built id2 trees */
+struct pst_id2_cache;
+
+
+/** variable length buffer, see vbuf.h */
+struct pst_varbuf;
+
+
 typedef struct pst_file {
     /** file pointer to opened PST file */
     FILE*   fp;
@@ -897,10 +948,15 @@ typedef struct pst_file {
     /** the array of index structures */
     pst_index_ll *i_table;
     size_t i_count, i_capacity;
+    /** the i_id column of i_table searched by pst_getID(), NULL
+     *  if some i_id does not fit in 32 bits */
+    uint32_t *i_keys;
     /** the head and tail of the top level of the descriptor tree */
     pst_desc_tree  *d_head, *d_tail;
     /** the head of the extended attributes linked list */
     pst_x_attrib_ll *x_head;
+    /** direct lookup table of the extended attributes, indexed by map - 0x8000 */
+    pst_x_attrib_ll **x_table;
     /** the head of the block recorder, a debug artifact
      *  used to detect cases where we might read the same
      *  block multiple times while processing a pst file. */
@@ -929,10 +985,49 @@ typedef struct pst_file {
      *  @li 0x15 64 bit Outlook 2003 or later
      *  @li 0x17 64 bit Outlook 2003 or later */
     unsigned char ind_type;
+    /** read-only mapping of the whole pst file when it was opened
+     *  with PST_OPEN_MMAP, NULL if reads go through fp */
+    char*   map;
+    /** size of the mapping in bytes */
+    uint64_t map_size;
+    /** LRU cache of decrypted blocks keyed by i_id, NULL if disabled */
+    struct pst_block_cache *block_cache;
+    /** hash of all the nodes in the descriptor tree by d_id,
+     *  built by pst_load_index() */
+    struct pst_id_map *d_map;
+    /** name of the sidecar index cache file, NULL if not used,
+     *  see pst_set_index_cache() */
+    char*   index_cache;
+    /** 1 if the index was restored from the sidecar index cache */
+    int     index_from_cache;
+    /** result of pst_load_extended_attributes() recorded in the sidecar */
+    int     x_from_cache;
+    /** 1 if the index was set up by pst_load_index_lazy() */
+    int     lazy_index;
+    /** index entries read so far in lazy mode, by i_id */
+    struct pst_id_map *i_map;
+    /** 1 if pst_parse_item() leaves the bodies and headers to
+     *  pst_load_bodies(), see pst_set_lazy_bodies() */
+    int     lazy_bodies;
+    /** idle arenas reused by successive pst_parse_item() calls */
+    struct pst_arena_pool *arena_pool;
+    /** 1 if items are allocated in an arena, see pst_set_item_arena() */
+    int     item_arena;
+    /** recently built id2 trees, reused by items sharing an assoc_tree */
+    struct pst_id2_cache *id2_cache;
 } pst_file;
 
 
-/** Open a pst file.
+/** flag for pst_open_flags(), map the pst file into memory and read
+ *  blocks directly from the mapping. If the mapping cannot be created
+ *  the file is silently read through stdio instead. */
+#define PST_OPEN_MMAP   0x01
+
+
+/** Open a pst file. Once the index and the extended attributes are
+ *  loaded, pst_parse_item() may be called concurrently from several
+ *  threads on one pst_file, provided the platform has pread() (or the
+ *  file is mapped with PST_OPEN_MMAP) and pthreads.
  * @param pf       pointer to uninitialized pst_file structure. This structure
  *                 will be filled in by this function.
  * @param name     name of the file, suitable for fopen().
@@ -942,13 +1037,40 @@ typedef struct pst_file {
 int             pst_open(pst_file *pf, const char *name, const char *charset);
 
 
-/** Reopen the pst file after a fork
+/** Open a pst file with additional options.
+ * @param pf       pointer to uninitialized pst_file structure. This structure
+ *                 will be filled in by this function.
+ * @param name     name of the file, suitable for fopen().
+ * @param charset  default charset for item with unspecified character sets
+ * @param flags    zero or more of the PST_OPEN_* flags or'ed together
+ * @return 0 if ok, -1 if error
+ */
+int             pst_open_flags(pst_file *pf, const char *name, const char *charset, int flags);
+
+
+/** Reopen the pst file after a fork. This is only needed on platforms
+ *  without pread(), where reads go through the shared file position.
+ *  A relative file name is resolved against the directory pst_open()
+ *  was called in; the current directory is not changed.
  * @param pf   pointer to the pst_file structure setup by pst_open().
  * @return 0 if ok, -1 if error
  */
 int             pst_reopen(pst_file *pf);
 
 
+/** Use a sidecar file to cache the index of an immutable pst file.
+ *  pst_load_index() will restore the index and the extended attribute
+ *  mapping from this file if it matches the pst file (size, mtime and
+ *  the b-tree root pointers), and pst_load_extended_attributes() will
+ *  (re)write it after a full load. Must be called between pst_open()
+ *  and pst_load_index().
+ * @param pf   pointer to the pst_file structure setup by pst_open().
+ * @param name name of the sidecar file, NULL to stop using a cache
+ * @return 0 if ok, -1 if error
+ */
+int             pst_set_index_cache(pst_file *pf, const char *name);
+
+
 /** Load the index entries from the pst file. This loads both the
  *  i_id linked list, and the d_id tree, and should normally be the
  *  first call after pst_open().
@@ -957,6 +1079,21 @@ int             pst_reopen(pst_file *pf);
 int             pst_load_index (pst_file *pf);
 
 
+/** Set up the index for lazy loading instead of reading it all. This
+ *  may be called instead of pst_load_index(). pst_getID() and
+ *  pst_getDptr() then read only the b-tree nodes on the path to the
+ *  requested id, so single items can be fetched right away from huge
+ *  files. The descriptor tree is not built: pf->d_head only holds the
+ *  descriptors looked up so far, without their children, so programs
+ *  that walk the folders must use pst_load_index(), which discards
+ *  everything found in lazy mode. Lookups in lazy mode modify the
+ *  pst_file, so they must not run concurrently.
+ * @param pf pointer to the pst_file structure setup by pst_open().
+ * @return 0 if ok, -1 if error
+ */
+int             pst_load_index_lazy(pst_file *pf);
+
+
 /** Load the extended attribute mapping table from the pst file. This
  *  should normally be the second call after pst_open().
  * @param pf pointer to the pst_file structure setup by pst_open().
@@ -964,7 +1101,8 @@ int             pst_load_index (pst_file *pf);
 int             pst_load_extended_attributes(pst_file *pf);
 
 
-/** Close a pst file.
+/** Close a pst file. Items parsed from it may still be freed afterwards
+ *  with pst_freeItem(), but nothing else can be read from them.
  * @param pf pointer to the pst_file structure setup by pst_open().
  */
 int             pst_close(pst_file *pf);
@@ -978,6 +1116,15 @@ int             pst_close(pst_file *pf);
 pst_desc_tree*  pst_getTopOfFolders(pst_file *pf, const pst_item *root);
 
 
+/** Find a node of the descriptor tree by its d_id. This uses the hash
+ *  index built by pst_load_index() and does not walk the tree.
+ * @param pf   pointer to the pst_file structure setup by pst_open().
+ * @param d_id the descriptor id we are looking for
+ * @return pointer to the node in the descriptor tree, or NULL if not found
+ */
+pst_desc_tree*  pst_getDptr(pst_file *pf, uint64_t d_id);
+
+
 /** Assemble the binary attachment into a single buffer.
  * @param pf     pointer to the pst_file structure setup by pst_open().
  * @param attach pointer to the attachment record
@@ -1003,6 +1150,16 @@ size_t          pst_attach_to_file(pst_file *pf, pst_item_attach *attach, FILE*
 size_t          pst_attach_to_file_base64(pst_file *pf, pst_item_attach *attach, FILE* fp);
 
 
+/** Append a binary attachment base64 encoded to a buffer. The attachment
+ *  is read and encoded a block at a time.
+ * @param pf     pointer to the pst_file structure setup by pst_open().
+ * @param attach pointer to the attachment record
+ * @param vb     buffer the encoding is appended to
+ * @return       size of the attachment before encoding
+ */
+size_t          pst_attach_to_vbuf_base64(pst_file *pf, pst_item_attach *attach, struct pst_varbuf *vb);
+
+
 /** Walk the descriptor tree.
  * @param d pointer to the current item in the descriptor tree.
  * @return  pointer to the next item in the descriptor tree.
@@ -1020,6 +1177,58 @@ pst_desc_tree*  pst_getNextDptr(pst_desc_tree* d);
 pst_item*       pst_parse_item (pst_file *pf, pst_desc_tree *d_ptr, pst_id2_tree *m_head);
 
 
+/** Assemble a mapi object from a descriptor pointer, keeping only some
+ *  of its properties. Elements whose MAPI id is not listed are dropped
+ *  before their values are read, so large bodies and attachment data
+ *  that the caller does not want cost nothing. The message and container
+ *  class, the message flags, the attachment id2 values and the code pages
+ *  and internet headers that decide the charset are always kept, so
+ *  pst_convert_utf8() gives the same text as after pst_parse_item().
+ *  The item gets the same sub structures (item->email, item->folder, ...)
+ *  that pst_parse_item() would have given it.
+ * @param pf     pointer to the pst_file structure setup by pst_open().
+ * @param d_ptr  pointer to an item in the descriptor tree.
+ * @param m_head normally NULL, see pst_parse_item().
+ * @param props  array of MAPI ids to keep, after named property mapping,
+ *               in any order. NULL keeps everything, like pst_parse_item().
+ * @param count  number of entries in props.
+ * @return pointer to the mapi object. Must be free'd by pst_freeItem().
+ */
+pst_item*       pst_parse_item_props(pst_file *pf, pst_desc_tree *d_ptr, pst_id2_tree *m_head, const uint32_t *props, size_t count);
+
+
+/** Make pst_parse_item() skip the potentially large properties of an
+ *  item: item->body, item->email->htmlbody, item->email->header and
+ *  item->email->rtf_compressed. They stay empty until pst_load_bodies()
+ *  is called on the item, so items that the caller drops after looking
+ *  at the type or the subject never read those blocks.
+ * @param pf     pointer to the pst_file structure setup by pst_open().
+ * @param enable 1 to defer the bodies, 0 to read everything (the default)
+ */
+void            pst_set_lazy_bodies(pst_file *pf, int enable);
+
+
+/** Read the properties that pst_parse_item() deferred because lazy
+ *  bodies are enabled. Does nothing if there are none, so it is safe
+ *  to call on every item before using the bodies.
+ * @param item  pointer to item returned from pst_parse_item().
+ * @return 0 if ok, -1 if the deferred properties could not be read
+ */
+int             pst_load_bodies(pst_item *item);
+
+
+/** Make pst_parse_item() allocate each item and its fields from a
+ *  single arena, so that pst_freeItem() releases them in one step.
+ *  Attachments and the encrypted bodies are still ordinary heap memory,
+ *  so pst_attach_to_mem() and moving those buffers between attachments
+ *  work as before. The other fields of such an item must not be freed
+ *  or realloc'ed by the caller; pst_convert_utf8() knows about arenas.
+ * @param pf     pointer to the pst_file structure setup by pst_open().
+ * @param enable 1 to use item arenas, 0 to malloc every field (the default)
+ */
+void            pst_set_item_arena(pst_file *pf, int enable);
+
+
 /** Free the item returned by pst_parse_item().
  * @param item  pointer to item returned from pst_parse_item().
  */
@@ -1044,6 +1253,30 @@ pst_index_ll*   pst_getID(pst_file* pf, uint64_t i_id);
 size_t          pst_ff_getIDblock_dec(pst_file *pf, uint64_t i_id, char **buf);
 
 
+/** Set the byte budget of the decrypted block cache used by
+ *  pst_ff_getIDblock_dec(). pst_open() enables the cache with a budget
+ *  of PST_BLOCK_CACHE_DEFAULT bytes. Shrinking the budget evicts the
+ *  least recently used blocks.
+ * @param pf        pointer to the pst_file structure setup by pst_open().
+ * @param max_bytes new byte budget, 0 disables the cache and frees it
+ */
+void            pst_set_block_cache(pst_file *pf, size_t max_bytes);
+
+
+/** Get the counters of the decrypted block cache.
+ * @param pf    pointer to the pst_file structure setup by pst_open().
+ * @param stats structure that will be filled in with the current counters
+ */
+void            pst_get_block_cache_stats(pst_file *pf, pst_block_cache_stats *stats);
+
+
+/** Release the conversion buffers and iconv descriptors that the
+ *  calling thread kept for parsing items. Call it before a thread that
+ *  used pst_parse_item() exits; the state is set up again on demand.
+ */
+void            pst_thread_cleanup();
+
+
 /** compare strings case-insensitive.
  *  @return  -1 if a < b, 0 if a==b, 1 if a > b
  */
@@ -1109,9 +1342,10 @@ const char*     pst_default_charset(pst_item *item, int buflen, char* result);
 
 
 /** Convert str to rfc2231 encoding of str
+ *  @param item  pointer to the containing mapi item
  *  @param str   pointer to the mapi string of interest
  */
-void            pst_rfc2231(pst_string *str);
+void            pst_rfc2231(pst_item *item, pst_string *str);
 
 
 /** Convert str to rfc2047 encoding of str, possibly enclosed in quotes if it contains spaces
@@ -1122,6 +1356,15 @@ void            pst_rfc2231(pst_string *str);
 void            pst_rfc2047(pst_item *item, pst_string *str, int needs_quote);
 
 
+/** Replace the text of a string field of an item. Use this rather than
+ *  free() on the fields of items from an arena, see pst_set_item_arena().
+ * @param item  pointer to the containing mapi item
+ * @param str   pointer to the mapi string of interest
+ * @param value new text, a malloc'ed string that this takes over
+ */
+void            pst_item_replace_str(pst_item *item, pst_string *str, char *value);
+
+
 /** Convert str to utf8 if possible; null strings are preserved.
  * @param item  pointer to the containing mapi item
  * @param str   pointer to the mapi string of interest
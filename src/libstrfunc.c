@@ -6,15 +6,111 @@
 
 static char base64_code_chars[]="ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/==";
 
-static void base64_append(char **ou, int *line_count, char data);
-static void base64_append(char **ou, int *line_count, char data)
+/** encode groups of three bytes from in to four characters each at out */
+static void base64_encode_scalar(const unsigned char *in, size_t groups, char *out);
+static void base64_encode_scalar(const unsigned char *in, size_t groups, char *out)
 {
-    if (*line_count == 76) {
-        *(*ou)++ = '\n';
-        *line_count = 0;
+    while (groups--) {
+        unsigned char x = in[0];
+        unsigned char y = in[1];
+        unsigned char z = in[2];
+        out[0] = base64_code_chars[ x >> 2 ];
+        out[1] = base64_code_chars[ ((x & 0x03) << 4) | (y >> 4) ];
+        out[2] = base64_code_chars[ ((y & 0x0F) << 2) | (z >> 6) ];
+        out[3] = base64_code_chars[ z & 0x3F ];
+        in  += 3;
+        out += 4;
     }
-    *(*ou)++ = data;
-    if (*line_count >= 0) (*line_count)++;
+}
+
+
+/*
+ * The vector versions encode 12 bytes per 128 bit lane. A shuffle places
+ * the bytes of each group in a 32 bit lane, two multiplies move the four
+ * 6 bit indexes into separate bytes, and a 16 entry pshufb table gives
+ * the offset from each index to its character: the index is reduced to
+ * 0 for a-z, 13 for A-Z, 1..10 for 0-9, 11 for + and 12 for /. Each load
+ * reads 16 bytes for the 12 it uses, so the scalar code does the groups
+ * near the end of the input.
+ */
+#ifdef HAVE_X86_SIMD_DISPATCH
+
+__attribute__((target("ssse3")))
+static inline __m128i base64_chars_ssse3(__m128i in) {
+    const __m128i spread = _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1);
+    const __m128i shift  = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                         '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+                                         '/' - 63, 'A', 0, 0);
+    __m128i t0, t1, idx, red;
+    in  = _mm_shuffle_epi8(in, spread);
+    t0  = _mm_mulhi_epu16(_mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00)), _mm_set1_epi32(0x04000040));
+    t1  = _mm_mullo_epi16(_mm_and_si128(in, _mm_set1_epi32(0x003f03f0)), _mm_set1_epi32(0x01000010));
+    idx = _mm_or_si128(t0, t1);
+    red = _mm_subs_epu8(idx, _mm_set1_epi8(51));
+    red = _mm_or_si128(red, _mm_and_si128(_mm_cmpgt_epi8(_mm_set1_epi8(26), idx), _mm_set1_epi8(13)));
+    return _mm_add_epi8(idx, _mm_shuffle_epi8(shift, red));
+}
+
+
+__attribute__((target("ssse3")))
+static void base64_encode_ssse3(const unsigned char *in, size_t groups, size_t size, char *out) {
+    size_t g;
+    for (g=0; g+4<=groups && 3*g+16<=size; g+=4) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(in + 3*g));
+        _mm_storeu_si128((__m128i*)(out + 4*g), base64_chars_ssse3(v));
+    }
+    base64_encode_scalar(in + 3*g, groups - g, out + 4*g);
+}
+
+
+__attribute__((target("avx2")))
+static inline __m256i base64_chars_avx2(__m256i in) {
+    const __m256i spread = _mm256_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1,
+                                           10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1);
+    const __m256i shift  = _mm256_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                            '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+                                            '/' - 63, 'A', 0, 0,
+                                            'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                            '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+                                            '/' - 63, 'A', 0, 0);
+    __m256i t0, t1, idx, red;
+    in  = _mm256_shuffle_epi8(in, spread);
+    t0  = _mm256_mulhi_epu16(_mm256_and_si256(in, _mm256_set1_epi32(0x0fc0fc00)), _mm256_set1_epi32(0x04000040));
+    t1  = _mm256_mullo_epi16(_mm256_and_si256(in, _mm256_set1_epi32(0x003f03f0)), _mm256_set1_epi32(0x01000010));
+    idx = _mm256_or_si256(t0, t1);
+    red = _mm256_subs_epu8(idx, _mm256_set1_epi8(51));
+    red = _mm256_or_si256(red, _mm256_and_si256(_mm256_cmpgt_epi8(_mm256_set1_epi8(26), idx), _mm256_set1_epi8(13)));
+    return _mm256_add_epi8(idx, _mm256_shuffle_epi8(shift, red));
+}
+
+
+__attribute__((target("avx2")))
+static void base64_encode_avx2(const unsigned char *in, size_t groups, size_t size, char *out) {
+    size_t g;
+    // the two halves are loaded 12 bytes apart, since pshufb stays within each half
+    for (g=0; g+8<=groups && 3*g+28<=size; g+=8) {
+        __m128i lo = _mm_loadu_si128((const __m128i*)(in + 3*g));
+        __m128i hi = _mm_loadu_si128((const __m128i*)(in + 3*g + 12));
+        __m256i v  = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+        _mm256_storeu_si256((__m256i*)(out + 4*g), base64_chars_avx2(v));
+    }
+    base64_encode_ssse3(in + 3*g, groups - g, size - 3*g, out + 4*g);
+}
+
+#endif
+
+
+/** encode all complete groups of the size bytes at in, without line breaks */
+static void base64_encode_groups(const unsigned char *in, size_t size, char *out);
+static void base64_encode_groups(const unsigned char *in, size_t size, char *out)
+{
+#ifdef HAVE_X86_SIMD_DISPATCH
+    if      (__builtin_cpu_supports("avx2"))  base64_encode_avx2(in, size / 3, size, out);
+    else if (__builtin_cpu_supports("ssse3")) base64_encode_ssse3(in, size / 3, size, out);
+    else                                      base64_encode_scalar(in, size / 3, out);
+#else
+    base64_encode_scalar(in, size / 3, out);
+#endif
 }
 
 
@@ -32,42 +128,53 @@ char *pst_base64_encode_single(void *data, size_t size)
 }
 
 
+/**
+ * Encode size bytes, with a newline before the 77th character of each
+ * line. *line_count holds the characters already on the current line and
+ * is updated so that the next call continues that line; -1 disables the
+ * line breaks.
+ *
+ * The characters are encoded without breaks into the end of the output
+ * buffer, and then moved down a line at a time to open a gap for each
+ * newline.
+ */
 char *pst_base64_encode_multiple(void *data, size_t size, int *line_count)
 {
     char *output;
     char *ou;
-    unsigned char *p   = (unsigned char *)data;
-    unsigned char *dte = p + size;
+    char *raw;
+    unsigned char *p = (unsigned char *)data;
+    unsigned char tail[3] = {0, 0, 0};
+    size_t chars, breaks = 0, len, rest;
+    int lc = *line_count;
 
     if (data == NULL || size == 0) return NULL;
 
-    ou = output = (char *)malloc(size / 3 * 4 + (size / 57) + 6);
+    chars = (size + 2) / 3 * 4;
+    if (lc >= 0 && lc <= 76) breaks = (lc + chars - 1) / 76;
+    output = (char *)malloc(chars + breaks + 1);
     if (!output) return NULL;
+    output[chars + breaks] = 0;
+
+    raw = output + breaks;
+    base64_encode_groups(p, size, raw);
+    rest = size % 3;
+    if (rest) {
+        memcpy(tail, p + size - rest, rest);
+        base64_encode_scalar(tail, 1, raw + chars - 4);
+        raw[chars-1] = '=';
+        if (rest == 1) raw[chars-2] = '=';
+    }
 
-    while((dte-p) >= 3) {
-        unsigned char x = p[0];
-        unsigned char y = p[1];
-        unsigned char z = p[2];
-        base64_append(&ou, line_count, base64_code_chars[ x >> 2 ]);
-        base64_append(&ou, line_count, base64_code_chars[ ((x & 0x03) << 4) | (y >> 4) ]);
-        base64_append(&ou, line_count, base64_code_chars[ ((y & 0x0F) << 2) | (z >> 6) ]);
-        base64_append(&ou, line_count, base64_code_chars[ z & 0x3F ]);
-        p+=3;
-    };
-    if ((dte-p) == 2) {
-        base64_append(&ou, line_count, base64_code_chars[ *p >> 2 ]);
-        base64_append(&ou, line_count, base64_code_chars[ ((*p & 0x03) << 4) | (p[1] >> 4) ]);
-        base64_append(&ou, line_count, base64_code_chars[ ((p[1] & 0x0F) << 2) ]);
-        base64_append(&ou, line_count, '=');
-    } else if ((dte-p) == 1) {
-        base64_append(&ou, line_count, base64_code_chars[ *p >> 2 ]);
-        base64_append(&ou, line_count, base64_code_chars[ ((*p & 0x03) << 4) ]);
-        base64_append(&ou, line_count, '=');
-        base64_append(&ou, line_count, '=');
-    };
-
-    *ou=0;
+    if (lc >= 0) *line_count = (int)(lc + chars - 76 * breaks);
+    ou  = output;
+    len = 76 - lc;
+    while (breaks--) {
+        memmove(ou, raw, len);
+        ou  += len;
+        raw += len;
+        *ou++ = '\n';
+        len  = 76;
+    }
     return output;
 };
-
-
@@ -25,6 +25,18 @@ void version();
 // global settings
 pst_file pstfile;
 
+// the only properties that process() prints
+static const uint32_t list_props[] = {
+    0x0037, // PR_SUBJECT
+    0x0042, // PR_SENT_REPRESENTING_NAME
+    0x3001, // PR_DISPLAY_NAME
+    0x3602, // PR_CONTENT_COUNT
+    0x8005, // contact fullname
+    0x820D, // appointment start
+    0x820E, // appointment end
+    0x8215, // all day flag
+};
+
 
 void create_enter_dir(struct file_ll* f, pst_item *item)
 {
@@ -62,7 +74,7 @@ void process(pst_item *outeritem, pst_desc_tree *d_ptr)
         else {
             DEBUG_INFO(("Desc Email ID %"PRIx64" [d_ptr->d_id = %"PRIx64"]\n", d_ptr->desc->i_id, d_ptr->d_id));
 
-            item = pst_parse_item(&pstfile, d_ptr, NULL);
+            item = pst_parse_item_props(&pstfile, d_ptr, NULL, list_props, sizeof(list_props)/sizeof(list_props[0]));
             DEBUG_INFO(("About to process item @ %p.\n", item));
             if (item) {
                 if (item->message_store) {
@@ -153,6 +165,7 @@ void usage(char *prog_name) {
 	printf("OPTIONS:\n");
     printf("\t-d <filename> \t- Debug to file. This is a binary log. Use readlog to print it\n");
 	printf("\t-h\t- Help. This screen\n");
+	printf("\t-i <filename>\t- Cache the pst file index in this file, to speed up the next run\n");
 	printf("\t-V\t- Version. Display program version\n");
 	DEBUG_RET();
 }
@@ -178,8 +191,9 @@ int main(int argc, char* const* argv) {
     char *temp  = NULL; //temporary char pointer
     int  c;
     char *d_log = NULL;
+    char *index_cache = NULL;
 
-	while ((c = getopt(argc, argv, "d:hV"))!= -1) {
+	while ((c = getopt(argc, argv, "d:hi:V"))!= -1) {
 		switch (c) {
 			case 'd':
 				d_log = optarg;
@@ -188,6 +202,9 @@ int main(int argc, char* const* argv) {
 				usage(argv[0]);
 				exit(0);
 				break;
+			case 'i':
+				index_cache = optarg;
+				break;
 			case 'V':
 				version();
 				exit(0);
@@ -213,6 +230,7 @@ int main(int argc, char* const* argv) {
 
     // Open PST file
     if (pst_open(&pstfile, argv[optind], NULL)) DIE(("Error opening File\n"));
+    if (index_cache) pst_set_index_cache(&pstfile, index_cache);
 
     // Load PST index
     if (pst_load_index(&pstfile)) DIE(("Index Error\n"));
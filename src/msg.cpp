@@ -29,11 +29,12 @@ typedef list<property> property_list;
 
 /** Convert str to an 8 bit charset if it is utf8, null strings are preserved.
  *
+ *  @param item    pointer to the containing mapi item
  *  @param str     reference to the mapi string of interest
  *  @param charset pointer to the 8 bit charset to use
  */
-static void convert_8bit(pst_string &str, const char *charset);
-static void convert_8bit(pst_string &str, const char *charset) {
+static void convert_8bit(pst_item *item, pst_string &str, const char *charset);
+static void convert_8bit(pst_item *item, pst_string &str, const char *charset) {
     if (!str.str)     return;  // null
     if (!str.is_utf8) return;  // not utf8
 
@@ -51,8 +52,7 @@ static void convert_8bit(pst_string &str, const char *charset) {
         // null terminate the output string
         pst_vbgrow(newer, 1);
         newer->b[newer->dlen] = '\0';
-        free(str.str);
-        str.str = newer->b;
+        pst_item_replace_str(item, &str, newer->b);
     }
     free(newer);
     DEBUG_RET();
@@ -123,19 +123,19 @@ static void string_property(GsfOutfile *out, property_list &prop, uint32_t tag,
 }
 
 
-static void string_property(GsfOutfile *out, property_list &prop, uint32_t tag, const char* charset, pst_string &contents);
-static void string_property(GsfOutfile *out, property_list &prop, uint32_t tag, const char* charset, pst_string &contents) {
+static void string_property(GsfOutfile *out, property_list &prop, uint32_t tag, pst_item *item, const char* charset, pst_string &contents);
+static void string_property(GsfOutfile *out, property_list &prop, uint32_t tag, pst_item *item, const char* charset, pst_string &contents) {
     if (contents.str) {
-        convert_8bit(contents, charset);
+        convert_8bit(item, contents, charset);
         string_property(out, prop, tag, contents.str, strlen(contents.str));
     }
 }
 
 
-static void strin0_property(GsfOutfile *out, property_list &prop, uint32_t tag, const char* charset, pst_string &contents);
-static void strin0_property(GsfOutfile *out, property_list &prop, uint32_t tag, const char* charset, pst_string &contents) {
+static void strin0_property(GsfOutfile *out, property_list &prop, uint32_t tag, pst_item *item, const char* charset, pst_string &contents);
+static void strin0_property(GsfOutfile *out, property_list &prop, uint32_t tag, pst_item *item, const char* charset, pst_string &contents) {
     if (contents.str) {
-        convert_8bit(contents, charset);
+        convert_8bit(item, contents, charset);
         string_property(out, prop, tag, contents.str, strlen(contents.str)+1);
     }
 }
@@ -196,9 +196,18 @@ static void nzi_property(property_list &prop_list, uint32_t tag, uint32_t flags,
 }
 
 
-void write_msg_email(char *fname, pst_item* item, pst_file* pst) {
+/** Write an email as a .msg file.
+ * @param fname  name of the file, for messages
+ * @param fp     the open file, which is closed here
+ * @param item   the email
+ * @param pst    the pst file it comes from
+ */
+void write_msg_email(char *fname, FILE *fp, pst_item* item, pst_file* pst) {
     // this is not an email item
-    if (!item->email) return;
+    if (!item->email) {
+        fclose(fp);
+        return;
+    }
     DEBUG_ENT("write_msg_email");
 
     pst_item_email &email = *(item->email);
@@ -208,15 +217,12 @@ void write_msg_email(char *fname, pst_item* item, pst_file* pst) {
     DEBUG_INFO(("%s body charset seems to be %s\n", fname, body_charset));
     body_charset = "iso-8859-1//TRANSLIT//IGNORE";
 
-    gsf_init();
-
     GsfOutfile *outfile;
     GsfOutput  *output;
-    GError    *err = NULL;
 
-    output = gsf_output_stdio_new(fname, &err);
+    output = gsf_output_stdio_new_FILE(fname, fp, FALSE);
     if (output == NULL) {
-        gsf_shutdown();
+        fclose(fp);
         DEBUG_INFO(("unable to open output .msg file %s\n", fname));
         DEBUG_RET();
         return;
@@ -254,40 +260,40 @@ void write_msg_email(char *fname, pst_item* item, pst_file* pst) {
     i64_property(prop_list, 0x00390040, 0x6, email.sent_date);
     GsfOutfile *out = GSF_OUTFILE (output);
     string_property(out, prop_list, 0x001A001E, item->ascii_type);
-    string_property(out, prop_list, 0x0037001E, body_charset, item->subject);
-    strin0_property(out, prop_list, 0x003B0102, body_charset, email.outlook_sender);
+    string_property(out, prop_list, 0x0037001E, item, body_charset, item->subject);
+    strin0_property(out, prop_list, 0x003B0102, item, body_charset, email.outlook_sender);
     string_property(out, prop_list, 0x003D001E, string(""));
-    string_property(out, prop_list, 0x0040001E, body_charset, email.outlook_received_name1);
-    string_property(out, prop_list, 0x0042001E, body_charset, email.outlook_sender_name);
-    string_property(out, prop_list, 0x0044001E, body_charset, email.outlook_recipient_name);
-    string_property(out, prop_list, 0x0050001E, body_charset, email.reply_to);
-    strin0_property(out, prop_list, 0x00510102, body_charset, email.outlook_recipient);
-    strin0_property(out, prop_list, 0x00520102, body_charset, email.outlook_recipient2);
-    string_property(out, prop_list, 0x0064001E, body_charset, email.sender_access);
-    string_property(out, prop_list, 0x0065001E, body_charset, email.sender_address);
-    string_property(out, prop_list, 0x0070001E, body_charset, email.processed_subject);
+    string_property(out, prop_list, 0x0040001E, item, body_charset, email.outlook_received_name1);
+    string_property(out, prop_list, 0x0042001E, item, body_charset, email.outlook_sender_name);
+    string_property(out, prop_list, 0x0044001E, item, body_charset, email.outlook_recipient_name);
+    string_property(out, prop_list, 0x0050001E, item, body_charset, email.reply_to);
+    strin0_property(out, prop_list, 0x00510102, item, body_charset, email.outlook_recipient);
+    strin0_property(out, prop_list, 0x00520102, item, body_charset, email.outlook_recipient2);
+    string_property(out, prop_list, 0x0064001E, item, body_charset, email.sender_access);
+    string_property(out, prop_list, 0x0065001E, item, body_charset, email.sender_address);
+    string_property(out, prop_list, 0x0070001E, item, body_charset, email.processed_subject);
     string_property(out, prop_list, 0x00710102,               email.conversation_index);
-    string_property(out, prop_list, 0x0072001E, body_charset, email.original_bcc);
-    string_property(out, prop_list, 0x0073001E, body_charset, email.original_cc);
-    string_property(out, prop_list, 0x0074001E, body_charset, email.original_to);
-    string_property(out, prop_list, 0x0075001E, body_charset, email.recip_access);
-    string_property(out, prop_list, 0x0076001E, body_charset, email.recip_address);
-    string_property(out, prop_list, 0x0077001E, body_charset, email.recip2_access);
-    string_property(out, prop_list, 0x0078001E, body_charset, email.recip2_address);
-    string_property(out, prop_list, 0x007D001E, body_charset, email.header);
-    string_property(out, prop_list, 0x0C1A001E, body_charset, email.outlook_sender_name2);
-    strin0_property(out, prop_list, 0x0C1D0102, body_charset, email.outlook_sender2);
-    string_property(out, prop_list, 0x0C1E001E, body_charset, email.sender2_access);
-    string_property(out, prop_list, 0x0C1F001E, body_charset, email.sender2_address);
-    string_property(out, prop_list, 0x0E02001E, body_charset, email.bcc_address);
-    string_property(out, prop_list, 0x0E03001E, body_charset, email.cc_address);
-    string_property(out, prop_list, 0x0E04001E, body_charset, email.sentto_address);
-    string_property(out, prop_list, 0x0E1D001E, body_charset, email.outlook_normalized_subject);
-    string_property(out, prop_list, 0x1000001E, body_charset, item->body);
-    string_property(out, prop_list, 0x1013001E, body_charset, email.htmlbody);
-    string_property(out, prop_list, 0x1035001E, body_charset, email.messageid);
-    string_property(out, prop_list, 0x1042001E, body_charset, email.in_reply_to);
-    string_property(out, prop_list, 0x1046001E, body_charset, email.return_path_address);
+    string_property(out, prop_list, 0x0072001E, item, body_charset, email.original_bcc);
+    string_property(out, prop_list, 0x0073001E, item, body_charset, email.original_cc);
+    string_property(out, prop_list, 0x0074001E, item, body_charset, email.original_to);
+    string_property(out, prop_list, 0x0075001E, item, body_charset, email.recip_access);
+    string_property(out, prop_list, 0x0076001E, item, body_charset, email.recip_address);
+    string_property(out, prop_list, 0x0077001E, item, body_charset, email.recip2_access);
+    string_property(out, prop_list, 0x0078001E, item, body_charset, email.recip2_address);
+    string_property(out, prop_list, 0x007D001E, item, body_charset, email.header);
+    string_property(out, prop_list, 0x0C1A001E, item, body_charset, email.outlook_sender_name2);
+    strin0_property(out, prop_list, 0x0C1D0102, item, body_charset, email.outlook_sender2);
+    string_property(out, prop_list, 0x0C1E001E, item, body_charset, email.sender2_access);
+    string_property(out, prop_list, 0x0C1F001E, item, body_charset, email.sender2_address);
+    string_property(out, prop_list, 0x0E02001E, item, body_charset, email.bcc_address);
+    string_property(out, prop_list, 0x0E03001E, item, body_charset, email.cc_address);
+    string_property(out, prop_list, 0x0E04001E, item, body_charset, email.sentto_address);
+    string_property(out, prop_list, 0x0E1D001E, item, body_charset, email.outlook_normalized_subject);
+    string_property(out, prop_list, 0x1000001E, item, body_charset, item->body);
+    string_property(out, prop_list, 0x1013001E, item, body_charset, email.htmlbody);
+    string_property(out, prop_list, 0x1035001E, item, body_charset, email.messageid);
+    string_property(out, prop_list, 0x1042001E, item, body_charset, email.in_reply_to);
+    string_property(out, prop_list, 0x1046001E, item, body_charset, email.return_path_address);
     // any property over 0x8000 needs entries in the __nameid to make them
     // either string named or numerical named properties.
 
@@ -302,13 +308,13 @@ void write_msg_email(char *fname, pst_item* item, pst_file* pst) {
                 int_property(prop_list, 0x0C150003, 0x6, v);                        // PidTagRecipientType
                 int_property(prop_list, 0x30000003, 0x6, top_head.recipient_count); // PR_ROWID
                 GsfOutfile *out = GSF_OUTFILE (output);
-                string_property(out, prop_list, 0x3001001E, body_charset, item->file_as);
+                string_property(out, prop_list, 0x3001001E, item, body_charset, item->file_as);
                 if (item->contact) {
-                    string_property(out, prop_list, 0x3002001E, body_charset, item->contact->address1_transport);
-                    string_property(out, prop_list, 0x3003001E, body_charset, item->contact->address1);
-                    string_property(out, prop_list, 0x5ff6001E, body_charset, item->contact->address1);
+                    string_property(out, prop_list, 0x3002001E, item, body_charset, item->contact->address1_transport);
+                    string_property(out, prop_list, 0x3003001E, item, body_charset, item->contact->address1);
+                    string_property(out, prop_list, 0x5ff6001E, item, body_charset, item->contact->address1);
                 }
-                strin0_property(out, prop_list, 0x300B0102, body_charset, email.outlook_search_key);
+                strin0_property(out, prop_list, 0x300B0102, item, body_charset, email.outlook_search_key);
                 write_properties(out, prop_list, (const guint8*)&top_head, 8);  // convenient 8 bytes of reserved zeros
                 gsf_output_close(output);
                 g_object_unref(G_OBJECT(output));
@@ -325,9 +331,9 @@ void write_msg_email(char *fname, pst_item* item, pst_file* pst) {
                 int_property(prop_list, 0x0C150003, 0x6, v);                        // PidTagRecipientType
                 int_property(prop_list, 0x30000003, 0x6, top_head.recipient_count); // PR_ROWID
                 GsfOutfile *out = GSF_OUTFILE (output);
-                string_property(out, prop_list, 0x3001001E, body_charset, email.cc_address);
-                string_property(out, prop_list, 0x3003001E, body_charset, email.cc_address);
-                string_property(out, prop_list, 0x5ff6001E, body_charset, email.cc_address);
+                string_property(out, prop_list, 0x3001001E, item, body_charset, email.cc_address);
+                string_property(out, prop_list, 0x3003001E, item, body_charset, email.cc_address);
+                string_property(out, prop_list, 0x5ff6001E, item, body_charset, email.cc_address);
                 write_properties(out, prop_list, (const guint8*)&top_head, 8);  // convenient 8 bytes of reserved zeros
                 gsf_output_close(output);
                 g_object_unref(G_OBJECT(output));
@@ -344,9 +350,9 @@ void write_msg_email(char *fname, pst_item* item, pst_file* pst) {
                 int_property(prop_list, 0x0C150003, 0x6, v);                        // PidTagRecipientType
                 int_property(prop_list, 0x30000003, 0x6, top_head.recipient_count); // PR_ROWID
                 GsfOutfile *out = GSF_OUTFILE (output);
-                string_property(out, prop_list, 0x3001001E, body_charset, email.bcc_address);
-                string_property(out, prop_list, 0x3003001E, body_charset, email.bcc_address);
-                string_property(out, prop_list, 0x5ff6001E, body_charset, email.bcc_address);
+                string_property(out, prop_list, 0x3001001E, item, body_charset, email.bcc_address);
+                string_property(out, prop_list, 0x3003001E, item, body_charset, email.bcc_address);
+                string_property(out, prop_list, 0x5ff6001E, item, body_charset, email.bcc_address);
                 write_properties(out, prop_list, (const guint8*)&top_head, 8);  // convenient 8 bytes of reserved zeros
                 gsf_output_close(output);
                 g_object_unref(G_OBJECT(output));
@@ -366,7 +372,7 @@ void write_msg_email(char *fname, pst_item* item, pst_file* pst) {
             snprintf(&n[0], n.size(), "__attach_version1.0_#%08X", top_head.attachment_count);
             GsfOutput  *output = gsf_outfile_new_child(out, &n[0], true);
             {
-                FILE *fp = fopen("temp_file_attachment", "w+b");
+                FILE *fp = tmpfile();   // private to this call, several threads may be here
                 if (fp) {
                     pst_attach_to_file(pst, a, fp); // data is now in the file
                     fseek(fp, 0, SEEK_SET);
@@ -383,18 +389,18 @@ void write_msg_email(char *fname, pst_item* item, pst_file* pst) {
                     string_property(out, prop_list, 0x37010102, fp);
                     if (a->filename2.str) {
                         // have long file name
-                        string_property(out, prop_list, 0x3707001E, body_charset, a->filename2);
+                        string_property(out, prop_list, 0x3707001E, item, body_charset, a->filename2);
                     }
                     else if (a->filename1.str) {
                         // have short file name
-                        string_property(out, prop_list, 0x3704001E, body_charset, a->filename1);
+                        string_property(out, prop_list, 0x3704001E, item, body_charset, a->filename1);
                     }
                     else {
                         // make up a name
                         const char *n = "inline";
                         string_property(out, prop_list, 0x3704001E, n, strlen(n));
                     }
-                    string_property(out, prop_list, 0x370E001E, body_charset, a->mimetype);
+                    string_property(out, prop_list, 0x370E001E, item, body_charset, a->mimetype);
                     write_properties(out, prop_list, (const guint8*)&top_head, 8);  // convenient 8 bytes of reserved zeros
                     gsf_output_close(output);
                     g_object_unref(G_OBJECT(output));
@@ -424,7 +430,18 @@ void write_msg_email(char *fname, pst_item* item, pst_file* pst) {
     gsf_output_close(output);
     g_object_unref(G_OBJECT(output));
 
-    gsf_shutdown();
     DEBUG_RET();
 }
 
+
+/** Set up libgsf once, before any thread calls write_msg_email(). */
+void msg_init() {
+    gsf_init();
+}
+
+
+/** Shut libgsf down once the last write_msg_email() has returned. */
+void msg_shutdown() {
+    gsf_shutdown();
+}
+
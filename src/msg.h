@@ -1,2 +1,4 @@
 
-void write_msg_email(char *fname, pst_item* item, pst_file* pst);
+void write_msg_email(char *fname, FILE *fp, pst_item* item, pst_file* pst);
+void msg_init();
+void msg_shutdown();
@@ -583,10 +583,11 @@ int main(int argc, char* const* argv) {
     char *fname = NULL;
     int c;
     char *d_log = NULL;
+    char *index_cache = NULL;
     prog_name = argv[0];
     pst_item *item = NULL;
 
-    while ((c = getopt(argc, argv, "b:c:d:l:oVh"))!= -1) {
+    while ((c = getopt(argc, argv, "b:c:d:i:l:oVh"))!= -1) {
         switch (c) {
         case 'b':
             ldap_base = optarg;
@@ -597,6 +598,9 @@ int main(int argc, char* const* argv) {
         case 'd':
             d_log = optarg;
             break;
+        case 'i':
+            index_cache = optarg;
+            break;
         case 'h':
             usage();
             exit(0);
@@ -632,6 +636,7 @@ int main(int argc, char* const* argv) {
     DEBUG_INIT(d_log, NULL);
     DEBUG_ENT("main");
     RET_DERROR(pst_open(&pstfile, fname, NULL), 1, ("Error opening File\n"));
+    if (index_cache) pst_set_index_cache(&pstfile, index_cache);
     RET_DERROR(pst_load_index(&pstfile), 2, ("Index Error\n"));
 
     pst_load_extended_attributes(&pstfile);
@@ -687,6 +692,7 @@ void usage(void) {
     printf("\t-c class\t- set the class of the LDAP objects (may contain more than one)\n");
     printf("\t-d <filename>\t- Debug to file.\n");
     printf("\t-h\t- Help. This screen\n");
+    printf("\t-i <filename>\t- Cache the pst file index in this file, to speed up the next run\n");
     printf("\t-l line\t- extra line to insert in the LDIF file for each contact\n");
     printf("\t-o\t- use old schema, default is new schema\n");
 }
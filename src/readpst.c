@@ -17,36 +17,132 @@
 // max size of the c_time char*. It will store the date of the email
 #define C_TIME_SIZE 500
 
+// an output directory. Where the *at() calls are available it is an open
+// descriptor, so files are made relative to it without walking the path
+// again and without touching the cwd, which all the threads share;
+// otherwise it is the path of the directory
+#if defined(HAVE_OPENAT) && defined(HAVE_MKDIRAT) && defined(HAVE_FSTATAT) && defined(HAVE_UNLINKAT) && defined(HAVE_FDOPENDIR)
+    #define OUT_DIR_FD 1
+    typedef int   out_dir;
+    #ifndef O_DIRECTORY
+        #define O_DIRECTORY 0
+    #endif
+#else
+    typedef char* out_dir;
+#endif
+
 struct file_ll {
     char *name[PST_TYPE_MAX];
     char *dname;
+    out_dir dir;        // directory holding the output files
+    out_dir child_dir;  // directory holding the subfolders
     FILE * output[PST_TYPE_MAX];
     int32_t stored_count;
     int32_t item_count;
     int32_t skip_count;
 };
 
-int       grim_reaper();
-pid_t     try_fork(char* folder);
-void      process(pst_item *outeritem, pst_desc_tree *d_ptr);
-void      write_email_body(FILE *f, char *body);
+// items of a folder that may be rendered ahead of the one appended next
+#define MAX_RENDER_AHEAD 64
+
+// initial size of the buffers items are composed in, they grow as needed
+// and are reused for the next item
+#define ITEM_BUFFER_SIZE 16384
+
+// a buffer grown beyond this by a large item goes back to ITEM_BUFFER_SIZE once written
+#define ITEM_BUFFER_KEEP (256*1024)
+
+/** an item of an mbox style folder, rendered into memory */
+struct mbox_slot {
+    int32_t     t;          // output file of the item
+    pst_vbuf   *out;        // the rendering, the buffer is kept for the next item in this slot
+    int         done;       // rendered, ready to be appended
+};
+
+/** items of one folder in MODE_NORMAL, MODE_KMAIL or MODE_RECURSE,
+ *  rendered by any export thread and appended to the folder's files
+ *  in descriptor order, so the output is the same as a serial run */
+struct mbox_sequence {
+    struct file_ll     *ff;
+    struct mbox_slot    slots[MAX_RENDER_AHEAD];    // item n is in slots[n % MAX_RENDER_AHEAD]
+    size_t              reserved;   // items given a slot so far
+    size_t              written;    // items appended so far
+    int                 writing;    // a thread is appending items
+};
+
+/** memory an item is rendered into, see open_item_output() */
+struct mbox_render {
+    pst_vbuf   *out;
+    size_t      n;          // number of the item in its sequence
+    int32_t     t;          // output file of the item
+};
+
+/** a folder, or a single email waiting for one of the export threads */
+struct export_task {
+    struct file_ll      ff;     // output files, set up by the submitter
+    pst_desc_tree      *d_ptr;  // first child of a folder, NULL for an email
+    pst_item           *item;   // the email, NULL for a folder
+    struct mbox_sequence *seq;  // folder of an mbox style email, NULL in MODE_SEPARATE
+    size_t              seq_no; // place of the email in seq
+    size_t              fds;    // descriptors the task holds while it is queued
+    struct export_task *newer;
+    struct export_task *older;
+};
+
+/** tasks submitted by one export thread. The thread takes back its
+ *  newest task, idle threads steal the oldest one */
+struct export_deque {
+    struct export_task *newest;
+    struct export_task *oldest;
+};
+
+size_t    task_fds(struct export_task *task);
+void      submit_task(struct export_task *task);
+struct export_task* take_task();
+void      run_task(struct export_task *task);
+void      export_loop(int main_thread, struct mbox_sequence *seq, size_t in_flight);
+void*     export_worker(void *arg);
+void      start_export_threads(int count);
+void      finish_export_threads();
+void      process(struct file_ll *ff, pst_desc_tree *d_ptr);
+int32_t   output_type(int32_t t);
+size_t    reserve_slot(struct mbox_sequence *seq, int32_t t);
+void      finish_slot(struct mbox_sequence *seq, size_t n);
+void      free_sequence(struct mbox_sequence *seq);
+pst_vbuf* item_buffer();
+void      free_item_buffer();
+pst_vbuf* open_item_output(struct mbox_sequence *seq, int32_t t, struct mbox_render *r);
+void      close_item_output(struct file_ll *ff, struct mbox_sequence *seq, struct mbox_render *r);
+void      render_email(struct mbox_sequence *seq, size_t n, pst_item *item);
+void      write_separate_email(struct file_ll *f, pst_item *item);
+out_dir   open_out_dir(out_dir parent, const char *name);
+out_dir   dup_out_dir(out_dir dir);
+void      close_out_dir(out_dir dir);
+int       mkdir_at(out_dir parent, const char *name);
+FILE*     fopen_at(out_dir dir, const char *name, const char *mode);
+int       lstat_at(out_dir dir, const char *name, struct stat *st);
+int       unlink_at(out_dir dir, const char *name);
+void      out_mem(pst_vbuf *out, const void *data, size_t len);
+void      out_str(pst_vbuf *out, const char *str);
+void      out_cat(pst_vbuf *out, ...);
+void      out_printf(pst_vbuf *out, const char *fmt, ...);
+void      out_flush(pst_vbuf *out, FILE *fp);
+void      write_email_body(pst_vbuf *out, char *body);
 void      removeCR(char *c);
 void      usage();
 void      version();
-char*     mk_kmail_dir(char* fname);
-int       close_kmail_dir();
-void      mk_recurse_dir(char* dir);
-int       close_recurse_dir();
-void      mk_separate_dir(char *dir);
-int       close_separate_dir();
+char*     mk_kmail_dir(out_dir parent, char* fname, out_dir *child_dir);
+out_dir   mk_recurse_dir(out_dir parent, char* dir);
+out_dir   mk_separate_dir(out_dir parent, char *dir);
 void      mk_separate_file(struct file_ll *f, int32_t t, char *extension, int openit);
 void      close_separate_file(struct file_ll *f);
+void      close_output_file(struct file_ll *f, int32_t t);
 char*     my_stristr(char *haystack, char *needle);
 void      check_filename(char *fname);
 int       acceptable_ext(pst_item_attach* attach);
-void      write_separate_attachment(char f_name[], pst_item_attach* attach, int attach_num, pst_file* pst);
-void      write_embedded_message(FILE* f_output, pst_item_attach* attach, char *boundary, pst_file* pf, int save_rtf, char** extra_mime_headers);
-void      write_inline_attachment(FILE* f_output, pst_item_attach* attach, char *boundary, pst_file* pst);
+void      write_separate_attachment(out_dir dir, char f_name[], pst_item_attach* attach, int attach_num, pst_file* pst);
+void      write_embedded_message(pst_vbuf* out, pst_item_attach* attach, char *boundary, pst_file* pf, int save_rtf, char** extra_mime_headers);
+void      write_inline_attachment(pst_vbuf* out, pst_item *item, pst_item_attach* attach, char *boundary, pst_file* pst);
 int       valid_headers(char *header);
 void      header_has_field(char *header, char *field, int *flag);
 void      header_get_subfield(char *field, const char *subfield, char *body_subfield, size_t size_subfield);
@@ -56,20 +152,21 @@ void      header_strip_field(char *header, char *field);
 int       test_base64(char *body, size_t len);
 void      find_html_charset(char *html, char *charset, size_t charsetlen);
 void      find_rfc822_headers(char** extra_mime_headers);
-void      write_body_part(FILE* f_output, pst_string *body, char *mime, char *charset, char *boundary, pst_file* pst);
-void      write_schedule_part_data(FILE* f_output, pst_item* item, const char* sender, const char* method);
-void      write_schedule_part(FILE* f_output, pst_item* item, const char* sender, const char* boundary);
-void      write_normal_email(FILE* f_output, char f_name[], pst_item* item, int mode, int mode_MH, pst_file* pst, int save_rtf, int embedding, char** extra_mime_headers);
-void      write_vcard(FILE* f_output, pst_item *item, pst_item_contact* contact, char comment[]);
-int       write_extra_categories(FILE* f_output, pst_item* item);
-void      write_journal(FILE* f_output, pst_item* item);
-void      write_appointment(FILE* f_output, pst_item *item);
-void      create_enter_dir(struct file_ll* f, pst_item *item);
+void      write_body_part(pst_vbuf* out, pst_item *item, pst_string *body, char *mime, char *charset, char *boundary, pst_file* pst);
+void      write_schedule_part_data(pst_vbuf* out, pst_item* item, const char* sender, const char* method);
+void      write_schedule_part(pst_vbuf* out, pst_item* item, const char* sender, const char* boundary);
+void      write_normal_email(pst_vbuf* out, out_dir dir, char f_name[], pst_item* item, int mode, int mode_MH, pst_file* pst, int save_rtf, int embedding, char** extra_mime_headers);
+void      write_vcard(pst_vbuf* out, pst_item *item, pst_item_contact* contact, char comment[]);
+int       write_extra_categories(pst_vbuf* out, pst_item* item);
+void      write_journal(pst_vbuf* out, pst_item* item);
+void      write_appointment(pst_vbuf* out, pst_item *item);
+void      create_enter_dir(struct file_ll* f, pst_item *item, out_dir parent);
+void      open_enter_dir(struct file_ll* f);
 void      close_enter_dir(struct file_ll *f);
 
 const char*  prog_name;
 char*  output_dir = ".";
-char*  kmail_chdir = NULL;
+out_dir output_top;     // output_dir, opened once
 
 // Normal mode just creates mbox format files in the current directory. Each file is named
 // the same as the folder's name that it represents
@@ -138,117 +235,439 @@ pst_file    pstfile;
 regex_t     meta_charset_pattern;
 char*       default_charset = NULL;
 char*       acceptable_extensions = NULL;
+char*       index_cache = NULL;
 
 int         number_processors = 1;  // number of cpus we have
-int         max_children  = 0;      // based on number of cpus and command line args
-int         max_child_specified = 0;// have command line arg -j
-int         active_children;        // number of children of this process, cannot be larger than max_children
-pid_t*      child_processes;        // setup by main(), and at the start of new child process
+int         max_threads   = 0;      // based on number of cpus and command line args
+int         max_threads_specified = 0;  // have command line arg -j
+
+// tasks one export thread may have queued, more are run by the submitter itself
+#define MAX_QUEUED_TASKS 16
+
+// descriptor limit assumed where getrlimit() is missing
+#define DEFAULT_FD_LIMIT 1024
+
+int                  export_threads  = 0;   // threads with a deque, the main thread is number 0
+struct export_deque *export_deques   = NULL;
+size_t               export_queued   = 0;   // tasks in the deques
+size_t               export_pending  = 0;   // tasks submitted and not finished yet
+size_t               export_fds      = 0;   // descriptors held by the tasks in the deques
+size_t               export_fd_budget = 0;  // most descriptors the queued tasks may hold
+int                  export_shutdown = 0;
+PST_THREAD_LOCAL int export_self     = 0;   // deque of the calling thread
+#ifdef HAVE_PTHREAD_H
+pthread_t*           export_tids     = NULL;
+pthread_mutex_t      export_lock     = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t       export_wake     = PTHREAD_COND_INITIALIZER;
+#endif
 
 #ifdef HAVE_SEMAPHORE_H
-int         shared_memory_id;
-sem_t*      global_children = NULL;
-sem_t*      output_mutex    = NULL;
+sem_t       output_mutex;
 #endif
 
 
-int grim_reaper(int waitall)
+/**
+ * Count the descriptors a task keeps open until it runs: the two
+ * directories of a folder, or the directory of a MODE_SEPARATE email.
+ * The output files of a folder are only opened once it runs.
+ * @param task  the task
+ * @return      number of open descriptors
+ */
+size_t task_fds(struct export_task *task)
 {
-    int available = 0;
-#ifdef HAVE_FORK
-#ifdef HAVE_SEMAPHORE_H
-    if (global_children) {
-        //sem_getvalue(global_children, &available);
-        //printf("grim reaper %s for pid %d (parent %d) with %d children, %d available\n", (waitall) ? "all" : "", getpid(), getppid(), active_children, available);
-        //fflush(stdout);
-        int i,j;
-        for (i=0; i<active_children; i++) {
-            int status;
-            pid_t child = child_processes[i];
-            pid_t ch = waitpid(child, &status, ((waitall) ? 0 : WNOHANG));
-            if (ch == child) {
-                // check termination status
-                //if (WIFEXITED(status)) {
-                //    int ext = WEXITSTATUS(status);
-                //    printf("Process %d exited with status  %d\n", child, ext);
-                //    fflush(stdout);
-                //}
-                if (WIFSIGNALED(status)) {
-                    int sig = WTERMSIG(status);
-                    DEBUG_INFO(("Process %d terminated with signal %d\n", child, sig));
-                    //printf("Process %d terminated with signal %d\n", child, sig);
-                    //fflush(stdout);
-                }
-                if (status != 0) {
-                    exit(status);
-                }
-                // this has terminated, remove it from the list
-                for (j=i; j<active_children-1; j++) {
-                    child_processes[j] = child_processes[j+1];
-                }
-                active_children--;
-                i--;
-            }
+#ifdef OUT_DIR_FD
+    if (task->seq) return 0;
+    return (task->d_ptr) ? 2 : 1;
+#else
+    return 0;
+#endif
+}
+
+
+/**
+ * Queue a task for the export threads, or run it right away if there
+ * are no export threads, enough tasks are queued already, or the queued
+ * tasks hold their share of the descriptors. Each task writes files of
+ * its own, so the order in which the tasks run does not change the
+ * output.
+ * @param task  task to run, freed once it is done
+ */
+void submit_task(struct export_task *task)
+{
+#ifdef HAVE_PTHREAD_H
+    if (export_threads) {
+        struct export_deque *q = &export_deques[export_self];
+        task->fds = task_fds(task);
+        pthread_mutex_lock(&export_lock);
+        if ((export_queued < (size_t)export_threads * MAX_QUEUED_TASKS) &&
+            (export_fds + task->fds <= export_fd_budget)) {
+            task->newer = NULL;
+            task->older = q->newest;
+            if (q->newest) q->newest->newer = task;
+            else           q->oldest = task;
+            q->newest = task;
+            export_queued++;
+            export_fds += task->fds;
+            export_pending++;
+            pthread_cond_signal(&export_wake);
+            pthread_mutex_unlock(&export_lock);
+            return;
         }
-        sem_getvalue(global_children, &available);
-        //printf("grim reaper %s for pid %d with %d children, %d available\n", (waitall) ? "all" : "", getpid(), active_children, available);
-        //fflush(stdout);
+        pthread_mutex_unlock(&export_lock);
     }
 #endif
-#endif
-    return available;
+    run_task(task);
 }
 
 
-pid_t try_fork(char *folder)
+/**
+ * Take the newest task of the calling thread, which is most likely to
+ * find its data still in the caches, or else steal the oldest task of
+ * another thread, which is most likely a whole folder. export_lock
+ * must be held.
+ * @return the task, or NULL if no task is queued
+ */
+struct export_task* take_task()
 {
-#ifdef HAVE_FORK
-#ifdef HAVE_SEMAPHORE_H
-    int available = grim_reaper(0);
-    // If children have called sem_post but not exited yet, we could have available > 0 but active_children == max_children
-    if (available && active_children < max_children) {
-        sem_wait(global_children);
-        pid_t child = fork();
-        if (child < 0) {
-            // fork failed, pretend it worked and we are the child
-            return 0;
+    int i;
+    struct export_task *task;
+    struct export_deque *q = &export_deques[export_self];
+    if ((task = q->newest)) {
+        q->newest = task->older;
+        if (q->newest) q->newest->newer = NULL;
+        else           q->oldest = NULL;
+    }
+    for (i=1; !task && i<export_threads; i++) {
+        q = &export_deques[(export_self + i) % export_threads];
+        if ((task = q->oldest)) {
+            q->oldest = task->newer;
+            if (q->oldest) q->oldest->older = NULL;
+            else           q->newest = NULL;
         }
-        else if (child == 0) {
-            // fork worked, and we are the child, reinitialize *our* list of children
-            active_children = 0;
-            memset(child_processes, 0, sizeof(pid_t) * max_children);
-            pst_reopen(&pstfile);   // close and reopen the pst file to get an independent file position pointer
+    }
+    if (task) {
+        export_queued--;
+        export_fds -= task->fds;
+    }
+    return task;
+}
+
+
+void run_task(struct export_task *task)
+{
+    if (task->d_ptr) {
+        process(&task->ff, task->d_ptr);
+    }
+    else if (task->seq) {
+        render_email(task->seq, task->seq_no, task->item);
+        pst_freeItem(task->item);
+    }
+    else {
+        write_separate_email(&task->ff, task->item);
+        pst_freeItem(task->item);
+        free(task->ff.name[PST_TYPE_NOTE]);
+        close_out_dir(task->ff.dir);
+    }
+    free(task);
+}
+
+
+/**
+ * Run queued tasks. The export threads keep waiting for more until
+ * finish_export_threads(), the main thread returns as soon as every
+ * submitted task is done. With seq, the calling thread returns once at
+ * most in_flight items of that folder are not appended yet.
+ * @param main_thread  1 if called from the main thread
+ * @param seq          folder to wait for, or NULL
+ * @param in_flight    items of seq that may still be outstanding
+ */
+void export_loop(int main_thread, struct mbox_sequence *seq, size_t in_flight)
+{
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_lock(&export_lock);
+    while (1) {
+        struct export_task *task;
+        if (seq && (seq->reserved - seq->written <= in_flight)) {
+            // a wakeup meant for an idle thread may have ended up here
+            if (export_queued) pthread_cond_signal(&export_wake);
+            break;
         }
-        else {
-            // fork worked, and we are the parent, record this child that we need to wait for
-            //pid_t me = getpid();
-            //printf("parent %d forked child pid %d to process folder %s\n", me, child, folder);
-            //fflush(stdout);
-            child_processes[active_children++] = child;
+        task = take_task();
+        if (!task) {
+            if (seq) {
+                pthread_cond_wait(&export_wake, &export_lock);
+                continue;
+            }
+            if (main_thread ? !export_pending : export_shutdown) break;
+            pthread_cond_wait(&export_wake, &export_lock);
+            continue;
         }
-        return child;
+        pthread_mutex_unlock(&export_lock);
+        run_task(task);
+        pthread_mutex_lock(&export_lock);
+        if (!--export_pending) pthread_cond_broadcast(&export_wake);
     }
-    else {
-        return 0;   // pretend to have forked and we are the child
+    pthread_mutex_unlock(&export_lock);
+#endif
+}
+
+
+void* export_worker(void *arg)
+{
+    export_self = (int)(intptr_t)arg;
+    export_loop(0, NULL, 0);
+    free_item_buffer();
+    pst_thread_cleanup();
+    return NULL;
+}
+
+
+/**
+ * Start the export threads, which share the folders and MODE_SEPARATE
+ * emails with the main thread. Without pread() the threads would share
+ * the file position of the pst file, so everything stays in the main
+ * thread then.
+ * @param count  number of threads besides the main thread
+ */
+void start_export_threads(int count)
+{
+#ifdef HAVE_PTHREAD_H
+    int i;
+#ifndef HAVE_PREAD
+    count = 0;
+#endif
+#if defined(HAVE_GETRLIMIT) && defined(HAVE_SYS_RESOURCE_H)
+    struct rlimit limit;
+#endif
+    if (count <= 0) return;
+    // the queued tasks may use half the descriptors, the running tasks
+    // and their attachments need the rest
+    export_fd_budget = DEFAULT_FD_LIMIT / 2;
+#if defined(HAVE_GETRLIMIT) && defined(HAVE_SYS_RESOURCE_H)
+    if (!getrlimit(RLIMIT_NOFILE, &limit)) {
+        if (limit.rlim_cur == RLIM_INFINITY)   export_fd_budget = (size_t)-1;
+        else                                   export_fd_budget = (size_t)(limit.rlim_cur / 2);
     }
 #endif
+    export_deques = (struct export_deque*)pst_malloc(sizeof(struct export_deque) * (count+1));
+    memset(export_deques, 0, sizeof(struct export_deque) * (count+1));
+    export_tids   = (pthread_t*)pst_malloc(sizeof(pthread_t) * count);
+    export_threads = count + 1;
+    for (i=0; i<count; i++) {
+        if (pthread_create(&export_tids[i], NULL, export_worker, (void*)(intptr_t)(i+1))) {
+            DEBUG_WARN(("could only start %d of %d export threads\n", i, count));
+            break;
+        }
+    }
+    max_threads = i;
+    if (!max_threads) {
+        free(export_tids);
+        free(export_deques);
+        export_threads = 0;
+    }
 #endif
-    return 0;
 }
 
 
-void process(pst_item *outeritem, pst_desc_tree *d_ptr)
+/** Help with the queued tasks until all are done, then stop the export threads. */
+void finish_export_threads()
+{
+#ifdef HAVE_PTHREAD_H
+    int i;
+    if (!export_threads) return;
+    export_loop(1, NULL, 0);
+    pthread_mutex_lock(&export_lock);
+    export_shutdown = 1;
+    pthread_cond_broadcast(&export_wake);
+    pthread_mutex_unlock(&export_lock);
+    for (i=0; i<max_threads; i++) pthread_join(export_tids[i], NULL);
+    free(export_tids);
+    free(export_deques);
+    export_threads = 0;
+#endif
+}
+
+
+// the file of a folder that items of type t go to, normal and kmail
+// mode keep all the items of a folder in its one mbox
+int32_t output_type(int32_t t)
+{
+    return (mode == MODE_NORMAL || mode == MODE_KMAIL) ? PST_TYPE_NOTE : t;
+}
+
+
+/**
+ * Give the next item of a folder its place in the output. If too many
+ * items are rendered ahead already, help with the queued tasks until
+ * the oldest of them is appended.
+ * @param seq  the folder
+ * @param t    output file of the item
+ * @return     number of the item, see finish_slot()
+ */
+size_t reserve_slot(struct mbox_sequence *seq, int32_t t)
+{
+    struct mbox_slot *slot;
+    size_t n;
+    export_loop(0, seq, MAX_RENDER_AHEAD-1);
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_lock(&export_lock);
+#endif
+    n = seq->reserved++;
+    slot = &seq->slots[n % MAX_RENDER_AHEAD];
+    slot->t    = t;
+    slot->done = 0;
+    if (!slot->out) slot->out = pst_vballoc(ITEM_BUFFER_SIZE);
+    slot->out->dlen = 0;
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_unlock(&export_lock);
+#endif
+    return n;
+}
+
+
+/**
+ * Hand in a rendered item. The thread that completes the oldest item
+ * of the folder appends it, and every later item that is ready, to
+ * the folder's files.
+ * @param seq  the folder
+ * @param n    number of the item from reserve_slot(), rendered into
+ *             the out buffer of its slot
+ */
+void finish_slot(struct mbox_sequence *seq, size_t n)
+{
+    struct mbox_slot *slot = &seq->slots[n % MAX_RENDER_AHEAD];
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_lock(&export_lock);
+#endif
+    slot->done = 1;
+    if (!seq->writing) {
+        seq->writing = 1;
+        while (seq->written < seq->reserved) {
+            slot = &seq->slots[seq->written % MAX_RENDER_AHEAD];
+            if (!slot->done) break;
+#ifdef HAVE_PTHREAD_H
+            pthread_mutex_unlock(&export_lock);
+#endif
+            out_flush(slot->out, seq->ff->output[slot->t]);
+#ifdef HAVE_PTHREAD_H
+            pthread_mutex_lock(&export_lock);
+#endif
+            slot->done = 0;
+            seq->written++;
+        }
+        seq->writing = 0;
+#ifdef HAVE_PTHREAD_H
+        pthread_cond_broadcast(&export_wake);
+#endif
+    }
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_unlock(&export_lock);
+#endif
+}
+
+
+void free_sequence(struct mbox_sequence *seq)
+{
+    int i;
+    for (i=0; i<MAX_RENDER_AHEAD; i++) {
+        if (seq->slots[i].out) {
+            free(seq->slots[i].out->buf);
+            free(seq->slots[i].out);
+        }
+    }
+    free(seq);
+}
+
+
+// the calling thread's buffer for items that go straight to their file
+static PST_THREAD_LOCAL pst_vbuf *thread_out = NULL;
+
+/** @return the calling thread's item buffer, emptied */
+pst_vbuf *item_buffer()
+{
+    if (!thread_out) thread_out = pst_vballoc(ITEM_BUFFER_SIZE);
+    thread_out->dlen = 0;
+    return thread_out;
+}
+
+
+void free_item_buffer()
+{
+    if (!thread_out) return;
+    free(thread_out->buf);
+    free(thread_out);
+    thread_out = NULL;
+}
+
+
+/**
+ * Get the buffer an item of type t is composed in. That is the slot
+ * of the item if seq is set, otherwise the item goes to the folder's
+ * own file from close_item_output().
+ */
+pst_vbuf* open_item_output(struct mbox_sequence *seq, int32_t t, struct mbox_render *r)
+{
+    r->t = output_type(t);
+    if (!seq) {
+        r->out = item_buffer();
+    }
+    else {
+        r->n   = reserve_slot(seq, r->t);
+        r->out = seq->slots[r->n % MAX_RENDER_AHEAD].out;
+    }
+    return r->out;
+}
+
+
+void close_item_output(struct file_ll *ff, struct mbox_sequence *seq, struct mbox_render *r)
+{
+    if (seq) finish_slot(seq, r->n);
+    else     out_flush(r->out, ff->output[r->t]);
+}
+
+
+/**
+ * Render an email of an mbox style folder into its slot, and hand
+ * it to the folder's sequence.
+ * @param seq   the folder
+ * @param n     number of the email from reserve_slot()
+ * @param item  the email
+ */
+void render_email(struct mbox_sequence *seq, size_t n, pst_item *item)
+{
+    char *extra_mime_headers = NULL;
+    DEBUG_ENT("render_email");
+    write_normal_email(seq->slots[n % MAX_RENDER_AHEAD].out, seq->ff->dir, seq->ff->name[PST_TYPE_NOTE], item, mode, mode_MH, &pstfile, save_rtf_body, 0, &extra_mime_headers);
+    finish_slot(seq, n);
+    DEBUG_RET();
+}
+
+
+/**
+ * Write the items of one folder to the output files set up by
+ * create_enter_dir(), opening them only now, then close them. Subfolders, and the emails of
+ * a MODE_SEPARATE folder, are handed to the export threads.
+ */
+void process(struct file_ll *ff, pst_desc_tree *d_ptr)
 {
-    struct file_ll ff;
     pst_item *item = NULL;
+    struct mbox_sequence *seq = NULL;
+    struct mbox_render render;
+    pst_vbuf *out;
 
     DEBUG_ENT("process");
-    create_enter_dir(&ff, outeritem);
+    open_enter_dir(ff);
+    if (export_threads && (mode != MODE_SEPARATE)) {
+        // the emails are rendered by any thread, and appended in order
+        seq = (struct mbox_sequence*)pst_malloc(sizeof(struct mbox_sequence));
+        memset(seq, 0, sizeof(struct mbox_sequence));
+        seq->ff = ff;
+    }
 
     for (; d_ptr; d_ptr = d_ptr->next) {
         DEBUG_INFO(("New item record\n"));
         if (!d_ptr->desc) {
-            ff.skip_count++;
+            ff->skip_count++;
             DEBUG_WARN(("ERROR item's desc record is NULL\n"));
             continue;
         }
@@ -258,7 +677,7 @@ void process(pst_item *outeritem, pst_desc_tree *d_ptr)
         DEBUG_INFO(("About to process item\n"));
 
         if (!item) {
-            ff.skip_count++;
+            ff->skip_count++;
             DEBUG_INFO(("A NULL item was seen\n"));
             continue;
         }
@@ -275,135 +694,163 @@ void process(pst_item *outeritem, pst_desc_tree *d_ptr)
                     fflush(stdout);
                 pst_debug_unlock();
             }
-            ff.item_count++;
+            ff->item_count++;
             if (d_ptr->child && (deleted_mode == DMODE_INCLUDE || strcasecmp(item->file_as.str, "Deleted Items"))) {
-                //if this is a non-empty folder other than deleted items, we want to recurse into it
-                pid_t parent = getpid();
-                pid_t child = try_fork(item->file_as.str);
-                if (child == 0) {
-                    // we are the child process, or the original parent if no children were available
-                    pid_t me = getpid();
-                    process(item, d_ptr->child);
-#ifdef HAVE_FORK
-#ifdef HAVE_SEMAPHORE_H
-                    if (me != parent) {
-                        // we really were a child, forked for the sole purpose of processing this folder
-                        // free my child count slot before really exiting, since
-                        // all I am doing here is waiting for my children to exit
-                        sem_post(global_children);
-                        grim_reaper(1); // wait for all my child processes to exit
-                        exit(0);        // really exit
-                    }
-#endif
-#endif
-                }
+                //if this is a non-empty folder other than deleted items, we want to recurse into it.
+                //its directory and files are made right here, so their names do not depend on
+                //which thread gets to the folder first
+                struct export_task *task = (struct export_task*)pst_malloc(sizeof(struct export_task));
+                memset(task, 0, sizeof(struct export_task));
+                create_enter_dir(&task->ff, item, ff->child_dir);
+                task->d_ptr = d_ptr->child;
+                // normal mode puts all the folders in one directory, and the
+                // names of duplicates depend on the order of the folders
+                if (mode == MODE_NORMAL) run_task(task);
+                else                     submit_task(task);
             }
 
         } else if (item->contact && (item->type == PST_TYPE_CONTACT)) {
             DEBUG_INFO(("Processing Contact\n"));
             if (!(output_type_mode & OTMODE_CONTACT)) {
-                ff.skip_count++;
+                ff->skip_count++;
                 DEBUG_INFO(("skipping contact: not in output type list\n"));
             }
             else {
-                ff.item_count++;
-                if (mode == MODE_SEPARATE) mk_separate_file(&ff, PST_TYPE_CONTACT, (mode_EX) ? ".vcf" : "", 1);
+                ff->item_count++;
+                pst_load_bodies(item);
+                if (mode == MODE_SEPARATE) mk_separate_file(ff, PST_TYPE_CONTACT, (mode_EX) ? ".vcf" : "", 1);
+                out = open_item_output(seq, PST_TYPE_CONTACT, &render);
                 if (contact_mode == CMODE_VCARD) {
                     pst_convert_utf8_null(item, &item->comment);
-                    write_vcard(ff.output[PST_TYPE_CONTACT], item, item->contact, item->comment.str);
+                    write_vcard(out, item, item->contact, item->comment.str);
                 }
                 else {
                     pst_convert_utf8(item, &item->contact->fullname);
                     pst_convert_utf8(item, &item->contact->address1);
-                    fprintf(ff.output[PST_TYPE_CONTACT], "%s <%s>\n", item->contact->fullname.str, item->contact->address1.str);
+                    out_cat(out, (item->contact->fullname.str) ? item->contact->fullname.str : "", " <",
+                                 (item->contact->address1.str) ? item->contact->address1.str : "", ">\n", NULL);
                 }
-                if (mode == MODE_SEPARATE) close_separate_file(&ff);
+                close_item_output(ff, seq, &render);
+                if (mode == MODE_SEPARATE) close_separate_file(ff);
             }
 
         } else if (item->email && ((item->type == PST_TYPE_NOTE) || (item->type == PST_TYPE_SCHEDULE) || (item->type == PST_TYPE_REPORT))) {
             DEBUG_INFO(("Processing Email\n"));
             if (!(output_type_mode & OTMODE_EMAIL)) {
-                ff.skip_count++;
+                ff->skip_count++;
                 DEBUG_INFO(("skipping email: not in output type list\n"));
             }
             else {
                 char *extra_mime_headers = NULL;
-                ff.item_count++;
+                ff->item_count++;
                 if (mode == MODE_SEPARATE) {
-                    // process this single email message, possibly forking
-                    pid_t parent = getpid();
-                    pid_t child = try_fork(item->file_as.str);
-                    if (child == 0) {
-                        // we are the child process, or the original parent if no children were available
-                        pid_t me = getpid();
-                        mk_separate_file(&ff, PST_TYPE_NOTE, (mode_EX) ? ".eml" : "", 1);
-                        write_normal_email(ff.output[PST_TYPE_NOTE], ff.name[PST_TYPE_NOTE], item, mode, mode_MH, &pstfile, save_rtf_body, PST_TYPE_NOTE, &extra_mime_headers);
-                        close_separate_file(&ff);
-                        if (mode_MSG) {
-                            mk_separate_file(&ff, PST_TYPE_NOTE, ".msg", 0);
-                            write_msg_email(ff.name[PST_TYPE_NOTE], item, &pstfile);
-                        }
-#ifdef HAVE_FORK
-#ifdef HAVE_SEMAPHORE_H
-                        if (me != parent) {
-                            // we really were a child, forked for the sole purpose of processing this message
-                            // free my child count slot before really exiting, since
-                            // all I am doing here is waiting for my children to exit
-                            sem_post(global_children);
-                            grim_reaper(1); // wait for all my child processes to exit - there should not be any
-                            exit(0);        // really exit
-                        }
-#endif
-#endif
-                    }
+                    // this single email message goes to its own file, so another thread may write it
+                    struct export_task *task = (struct export_task*)pst_malloc(sizeof(struct export_task));
+                    memset(task, 0, sizeof(struct export_task));
+                    task->ff.dir        = dup_out_dir(ff->dir);
+                    task->ff.item_count = ff->item_count;
+                    task->ff.name[PST_TYPE_NOTE] = (char*) pst_malloc(file_name_len);
+                    memset(task->ff.name[PST_TYPE_NOTE], 0, file_name_len);
+                    task->item = item;
+                    item = NULL;    // freed by the task
+                    submit_task(task);
+                }
+                else if (seq) {
+                    // rendered into memory by any thread, appended to the mbox in turn
+                    struct export_task *task = (struct export_task*)pst_malloc(sizeof(struct export_task));
+                    memset(task, 0, sizeof(struct export_task));
+                    task->seq    = seq;
+                    task->seq_no = reserve_slot(seq, output_type(PST_TYPE_NOTE));
+                    task->item   = item;
+                    item = NULL;    // freed by the task
+                    submit_task(task);
                 }
                 else {
-                    // process this single email message, cannot fork since not separate mode
-                    write_normal_email(ff.output[PST_TYPE_NOTE], ff.name[PST_TYPE_NOTE], item, mode, mode_MH, &pstfile, save_rtf_body, 0, &extra_mime_headers);
+                    // process this single email message
+                    out = open_item_output(NULL, PST_TYPE_NOTE, &render);
+                    write_normal_email(out, ff->dir, ff->name[PST_TYPE_NOTE], item, mode, mode_MH, &pstfile, save_rtf_body, 0, &extra_mime_headers);
+                    close_item_output(ff, NULL, &render);
                 }
             }
 
         } else if (item->journal && (item->type == PST_TYPE_JOURNAL)) {
             DEBUG_INFO(("Processing Journal Entry\n"));
             if (!(output_type_mode & OTMODE_JOURNAL)) {
-                ff.skip_count++;
+                ff->skip_count++;
                 DEBUG_INFO(("skipping journal entry: not in output type list\n"));
             }
             else {
-                ff.item_count++;
-                if (mode == MODE_SEPARATE) mk_separate_file(&ff, PST_TYPE_JOURNAL, (mode_EX) ? ".ics" : "", 1);
-                write_journal(ff.output[PST_TYPE_JOURNAL], item);
-                fprintf(ff.output[PST_TYPE_JOURNAL], "\n");
-                if (mode == MODE_SEPARATE) close_separate_file(&ff);
+                ff->item_count++;
+                pst_load_bodies(item);
+                if (mode == MODE_SEPARATE) mk_separate_file(ff, PST_TYPE_JOURNAL, (mode_EX) ? ".ics" : "", 1);
+                out = open_item_output(seq, PST_TYPE_JOURNAL, &render);
+                write_journal(out, item);
+                out_str(out, "\n");
+                close_item_output(ff, seq, &render);
+                if (mode == MODE_SEPARATE) close_separate_file(ff);
             }
 
         } else if (item->appointment && (item->type == PST_TYPE_APPOINTMENT)) {
             DEBUG_INFO(("Processing Appointment Entry\n"));
             if (!(output_type_mode & OTMODE_APPOINTMENT)) {
-                ff.skip_count++;
+                ff->skip_count++;
                 DEBUG_INFO(("skipping appointment: not in output type list\n"));
             }
             else {
-                ff.item_count++;
-                if (mode == MODE_SEPARATE) mk_separate_file(&ff, PST_TYPE_APPOINTMENT, (mode_EX) ? ".ics" : "", 1);
-                write_schedule_part_data(ff.output[PST_TYPE_APPOINTMENT], item, NULL, NULL);
-                fprintf(ff.output[PST_TYPE_APPOINTMENT], "\n");
-                if (mode == MODE_SEPARATE) close_separate_file(&ff);
+                ff->item_count++;
+                pst_load_bodies(item);
+                if (mode == MODE_SEPARATE) mk_separate_file(ff, PST_TYPE_APPOINTMENT, (mode_EX) ? ".ics" : "", 1);
+                out = open_item_output(seq, PST_TYPE_APPOINTMENT, &render);
+                write_schedule_part_data(out, item, NULL, NULL);
+                out_str(out, "\n");
+                close_item_output(ff, seq, &render);
+                if (mode == MODE_SEPARATE) close_separate_file(ff);
             }
 
         } else if (item->message_store) {
             // there should only be one message_store, and we have already done it
-            ff.skip_count++;
+            ff->skip_count++;
             DEBUG_WARN(("item with message store content, type %i %s, skipping it\n", item->type, item->ascii_type));
 
         } else {
-            ff.skip_count++;
+            ff->skip_count++;
             DEBUG_WARN(("Unknown item type %i (%s) name (%s)\n",
                         item->type, item->ascii_type, item->file_as.str));
         }
         pst_freeItem(item);
     }
-    close_enter_dir(&ff);
+    if (seq) {
+        export_loop(0, seq, 0);     // wait until every item is appended
+        free_sequence(seq);
+    }
+    close_enter_dir(ff);
+    DEBUG_RET();
+}
+
+
+/**
+ * Write one email of a MODE_SEPARATE folder to its own file, and to
+ * a .msg file as well for -m.
+ * @param f     directory and number of the email, with room for its file name
+ * @param item  the email
+ */
+void write_separate_email(struct file_ll *f, pst_item *item)
+{
+    char *extra_mime_headers = NULL;
+    pst_vbuf *out = item_buffer();
+    DEBUG_ENT("write_separate_email");
+    mk_separate_file(f, PST_TYPE_NOTE, (mode_EX) ? ".eml" : "", 1);
+    write_normal_email(out, f->dir, f->name[PST_TYPE_NOTE], item, mode, mode_MH, &pstfile, save_rtf_body, PST_TYPE_NOTE, &extra_mime_headers);
+    out_flush(out, f->output[PST_TYPE_NOTE]);
+    close_separate_file(f);
+    if (mode_MSG) {
+        FILE *fp;
+        mk_separate_file(f, PST_TYPE_NOTE, ".msg", 0);
+        if (!(fp = fopen_at(f->dir, f->name[PST_TYPE_NOTE], "wb"))) {
+            DEBUG_WARN(("write_separate_email: Cannot open file to save email \"%s\"\n", f->name[PST_TYPE_NOTE]));
+        }
+        else write_msg_email(f->name[PST_TYPE_NOTE], fp, item, &pstfile);
+    }
     DEBUG_RET();
 }
 
@@ -412,6 +859,7 @@ void process(pst_item *outeritem, pst_desc_tree *d_ptr)
 int main(int argc, char* const* argv) {
     pst_item *item = NULL;
     pst_desc_tree *d_ptr;
+    struct file_ll ff;
     char * fname = NULL;
     char *d_log  = NULL;
     int c,x;
@@ -427,7 +875,7 @@ int main(int argc, char* const* argv) {
     }
 
     // command-line option handling
-    while ((c = getopt(argc, argv, "a:bC:c:Dd:emhj:kMo:qrSt:uVwL:8"))!= -1) {
+    while ((c = getopt(argc, argv, "a:bC:c:Dd:emhi:j:kMo:qrSt:uVwL:8"))!= -1) {
         switch (c) {
         case 'a':
             if (optarg) {
@@ -478,9 +926,12 @@ int main(int argc, char* const* argv) {
             usage();
             exit(0);
             break;
+        case 'i':
+            index_cache = optarg;
+            break;
         case 'j':
-            max_children = atoi(optarg);
-            max_child_specified = 1;
+            max_threads = atoi(optarg);
+            max_threads_specified = 1;
             break;
         case 'k':
             mode = MODE_KMAIL;
@@ -585,25 +1036,10 @@ int main(int argc, char* const* argv) {
 #ifdef _SC_NPROCESSORS_ONLN
     number_processors =  sysconf(_SC_NPROCESSORS_ONLN);
 #endif
-    max_children    = (max_child_specified) ? max_children : number_processors * 4;
-    active_children = 0;
-    child_processes = (pid_t *)pst_malloc(sizeof(pid_t) * max_children);
-    memset(child_processes, 0, sizeof(pid_t) * max_children);
+    max_threads = (max_threads_specified) ? max_threads : number_processors;
 
 #ifdef HAVE_SEMAPHORE_H
-    if (max_children) {
-        shared_memory_id = shmget(IPC_PRIVATE, sizeof(sem_t)*2, 0777);
-        if (shared_memory_id >= 0) {
-            global_children = (sem_t *)shmat(shared_memory_id, NULL, 0);
-            if (global_children == (sem_t *)-1) global_children = NULL;
-            if (global_children) {
-                output_mutex = &(global_children[1]);
-                sem_init(global_children, 1, max_children);
-                sem_init(output_mutex, 1, 1);
-            }
-            shmctl(shared_memory_id, IPC_RMID, NULL);
-        }
-    }
+    sem_init(&output_mutex, 0, 1);
 #endif
 
     #ifdef DEBUG_ALL
@@ -611,7 +1047,7 @@ int main(int argc, char* const* argv) {
         if (!d_log) d_log = "readpst.log";
     #endif // defined DEBUG_ALL
     #ifdef HAVE_SEMAPHORE_H
-        DEBUG_INIT(d_log, output_mutex);
+        DEBUG_INIT(d_log, &output_mutex);
     #else
         DEBUG_INIT(d_log, NULL);
     #endif
@@ -619,15 +1055,28 @@ int main(int argc, char* const* argv) {
 
     if (output_mode != OUTPUT_QUIET) printf("Opening PST file and indexes...\n");
     RET_DERROR(pst_open(&pstfile, fname, default_charset), 1, ("Error opening File\n"));
+    if (index_cache) pst_set_index_cache(&pstfile, index_cache);
     RET_DERROR(pst_load_index(&pstfile), 2, ("Index Error\n"));
+    // items skipped by type or folder never need their bodies
+    pst_set_lazy_bodies(&pstfile, 1);
 
     pst_load_extended_attributes(&pstfile);
 
-    if (chdir(output_dir)) {
-        x = errno;
+    // the output files are made relative to output_top, the cwd is left alone
+#ifdef OUT_DIR_FD
+    output_top = open(output_dir, O_RDONLY | O_DIRECTORY);
+    x = (output_top == -1) ? errno : 0;
+#else
+    {
+        struct stat st;
+        output_top = strdup(output_dir);
+        x = (stat(output_dir, &st)) ? errno : (!S_ISDIR(st.st_mode)) ? ENOTDIR : 0;
+    }
+#endif
+    if (x) {
         pst_close(&pstfile);
         DEBUG_RET();
-        DIE(("Cannot change to output dir %s: %s\n", output_dir, strerror(x)));
+        DIE(("Cannot open output dir %s: %s\n", output_dir, strerror(x)));
     }
 
     d_ptr = pstfile.d_head; // first record is main record
@@ -659,19 +1108,32 @@ int main(int argc, char* const* argv) {
         DIE(("Top of folders record not found. Cannot continue\n"));
     }
 
-    process(item, d_ptr->child);    // do the children of TOPF
-    grim_reaper(1); // wait for all child processes
+    // the root item above has a hand made file_as, so it stays on the heap;
+    // every other item goes away with a single arena release
+    pst_set_item_arena(&pstfile, 1);
+    create_enter_dir(&ff, item, output_top);
+    if (mode_MSG) msg_init();       // libgsf is set up once, not by each export thread
+    start_export_threads(max_threads);
+    process(&ff, d_ptr->child);     // do the children of TOPF
+    finish_export_threads();        // wait for the other threads to finish their folders
+    if (mode_MSG) msg_shutdown();
+    free_item_buffer();
+    close_out_dir(output_top);
 
     pst_freeItem(item);
     pst_close(&pstfile);
+    pst_thread_cleanup();
+    {
+        // every export thread has added its counts by now
+        pst_vb_charset_cache_stats stats;
+        pst_vb_charset_stats(&stats);
+        DEBUG_INFO(("charset cache: %"PRIu64" hits, %"PRIu64" misses, %"PRIu64" evictions\n",
+                    stats.hits, stats.misses, stats.evictions));
+    }
     DEBUG_RET();
 
 #ifdef HAVE_SEMAPHORE_H
-    if (global_children) {
-        sem_destroy(global_children);
-        sem_destroy(output_mutex);
-        shmdt(global_children);
-    }
+    sem_destroy(&output_mutex);
 #endif
 
     regfree(&meta_charset_pattern);
@@ -679,22 +1141,89 @@ int main(int argc, char* const* argv) {
 }
 
 
-void write_email_body(FILE *f, char *body) {
+/*
+ * Items are composed in a pst_vbuf with the out_ calls below, and
+ * written to their file with a single out_flush(). Headers are put
+ * together from their pieces with out_cat(), so the format strings
+ * of printf are only parsed for the few numbers an item carries.
+ */
+
+void out_mem(pst_vbuf *out, const void *data, size_t len)
+{
+    if (len) pst_vbappend(out, (void*)data, len);
+}
+
+
+void out_str(pst_vbuf *out, const char *str)
+{
+    out_mem(out, str, strlen(str));
+}
+
+
+/** append the strings given, up to a NULL */
+void out_cat(pst_vbuf *out, ...)
+{
+    const char *str;
+    va_list ap;
+    va_start(ap, out);
+    while ((str = va_arg(ap, const char*))) out_mem(out, str, strlen(str));
+    va_end(ap);
+}
+
+
+void out_printf(pst_vbuf *out, const char *fmt, ...)
+{
+    char buf[100];
+    int n;
+    va_list ap;
+    va_start(ap, fmt);
+    n = vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    if (n < 0) return;
+    if ((size_t)n < sizeof(buf)) {
+        out_mem(out, buf, n);
+    }
+    else {
+        char *big = pst_malloc(n+1);
+        va_start(ap, fmt);
+        vsnprintf(big, n+1, fmt, ap);
+        va_end(ap);
+        out_mem(out, big, n);
+        free(big);
+    }
+}
+
+
+/** write everything composed so far to fp, and empty the buffer */
+void out_flush(pst_vbuf *out, FILE *fp)
+{
+    if (out->dlen) pst_fwrite(out->b, 1, out->dlen, fp);
+    out->dlen = 0;
+    if (out->blen > ITEM_BUFFER_KEEP) {
+        free(out->buf);
+        out->buf  = pst_malloc(ITEM_BUFFER_SIZE);
+        out->b    = out->buf;
+        out->blen = ITEM_BUFFER_SIZE;
+    }
+}
+
+
+void write_email_body(pst_vbuf *out, char *body) {
     char *n = body;
     DEBUG_ENT("write_email_body");
     if (mode != MODE_SEPARATE) {
         while (n) {
             char *p = body;
             while (*p == '>') p++;
-            if (strncmp(p, "From ", 5) == 0) fprintf(f, ">");
+            if (strncmp(p, "From ", 5) == 0) out_mem(out, ">", 1);
             if ((n = strchr(body, '\n'))) {
                 n++;
-                pst_fwrite(body, n-body, 1, f); //write just a line
+                out_mem(out, body, n-body); //write just a line
                 body = n;
             }
         }
     }
-    pst_fwrite(body, strlen(body), 1, f);
+    out_str(out, body);
     DEBUG_RET();
 }
 
@@ -731,10 +1260,11 @@ void usage() {
     printf("\t-d <filename> \t- Debug to file.\n");
     printf("\t-e\t- As with -M, but include extensions on output files\n");
     printf("\t-h\t- Help. This screen\n");
-    printf("\t-j <integer>\t- Number of parallel jobs to run\n");
+    printf("\t-i <filename>\t- Cache the pst file index in this file, to speed up the next run\n");
+    printf("\t-j <integer>\t- Number of threads to run besides the main thread, default is one per processor\n");
     printf("\t-k\t- KMail. Output in kmail format\n");
     printf("\t-m\t- As with -e, but write .msg files also\n");
-    printf("\t-o <dirname>\t- Output directory to write files to. CWD is changed *after* opening pst file\n");
+    printf("\t-o <dirname>\t- Output directory to write files to\n");
     printf("\t-q\t- Quiet. Only print error messages\n");
     printf("\t-r\t- Recursive. Output in a recursive format\n");
     printf("\t-t[eajc]\t- Set the output type list. e = email, a = attachment, j = journal, c = contact\n");
@@ -761,35 +1291,145 @@ void version() {
 }
 
 
-char *mk_kmail_dir(char *fname) {
-    //change to that directory
-    //make a directory based on OUTPUT_KMAIL_DIR_TEMPLATE
+/**
+ * Open a directory below an output directory.
+ * @param parent  output directory
+ * @param name    directory inside it, which must exist
+ * @return        the directory, close it with close_out_dir()
+ */
+out_dir open_out_dir(out_dir parent, const char *name) {
+#ifdef OUT_DIR_FD
+    int fd = openat(parent, name, O_RDONLY | O_DIRECTORY);
+    if (fd == -1) {
+        int x = errno;
+        DIE(("open_out_dir: Cannot open directory %s: %s\n", name, strerror(x)));
+    }
+    return fd;
+#else
+    char *path = pst_malloc(strlen(parent)+strlen(name)+2);
+    sprintf(path, "%s/%s", parent, name);
+    return path;
+#endif
+}
+
+
+out_dir dup_out_dir(out_dir dir) {
+#ifdef OUT_DIR_FD
+    int fd = dup(dir);
+    if (fd == -1) {
+        int x = errno;
+        DIE(("dup_out_dir: Cannot duplicate directory descriptor: %s\n", strerror(x)));
+    }
+    return fd;
+#else
+    return strdup(dir);
+#endif
+}
+
+
+void close_out_dir(out_dir dir) {
+#ifdef OUT_DIR_FD
+    if (dir != -1) close(dir);
+#else
+    free(dir);
+#endif
+}
+
+
+#ifndef OUT_DIR_FD
+// the path of name inside dir, the fallback for the *at() calls below
+static char *at_path(out_dir dir, const char *name) {
+    char *path = pst_malloc(strlen(dir)+strlen(name)+2);
+    sprintf(path, "%s/%s", dir, name);
+    return path;
+}
+#endif
+
+
+/** like mkdir(), with name relative to parent */
+int mkdir_at(out_dir parent, const char *name) {
+#ifdef OUT_DIR_FD
+    return mkdirat(parent, name, PERM_DIRS);
+#else
+    char *path = at_path(parent, name);
+    int r = D_MKDIR(path);
+    int x = errno;
+    free(path);
+    errno = x;
+    return r;
+#endif
+}
+
+
+/** like fopen() with a mode of "r", "w" or "wb", with name relative to dir */
+FILE *fopen_at(out_dir dir, const char *name, const char *mode) {
+#ifdef OUT_DIR_FD
+    FILE *fp;
+    int fd = (mode[0] == 'w') ? openat(dir, name, O_WRONLY | O_CREAT | O_TRUNC, 0666)
+                              : openat(dir, name, O_RDONLY);
+    if (fd == -1) return NULL;
+    if (!(fp = fdopen(fd, mode))) close(fd);
+    return fp;
+#else
+    char *path = at_path(dir, name);
+    FILE *fp = fopen(path, mode);
+    free(path);
+    return fp;
+#endif
+}
+
+
+/** like lstat(), with name relative to dir */
+int lstat_at(out_dir dir, const char *name, struct stat *st) {
+#ifdef OUT_DIR_FD
+    return fstatat(dir, name, st, AT_SYMLINK_NOFOLLOW);
+#else
+    char *path = at_path(dir, name);
+    int r = lstat(path, st);
+    free(path);
+    return r;
+#endif
+}
+
+
+/** like unlink(), with name relative to dir */
+int unlink_at(out_dir dir, const char *name) {
+#ifdef OUT_DIR_FD
+    return unlinkat(dir, name, 0);
+#else
+    char *path = at_path(dir, name);
+    int r = unlink(path);
+    int x = errno;
+    free(path);
+    errno = x;
+    return r;
+#endif
+}
+
+
+char *mk_kmail_dir(out_dir parent, char *fname, out_dir *child_dir) {
+    //make a directory in parent based on OUTPUT_KMAIL_DIR_TEMPLATE to hold the subfolders
     //allocate space for OUTPUT_TEMPLATE and form a char* with fname
     //return that value
     char *dir, *out_name, *index;
     int x;
     DEBUG_ENT("mk_kmail_dir");
-    if (kmail_chdir && chdir(kmail_chdir)) {
-        x = errno;
-        DIE(("mk_kmail_dir: Cannot change to directory %s: %s\n", kmail_chdir, strerror(x)));
-    }
     dir = pst_malloc(strlen(fname)+strlen(OUTPUT_KMAIL_DIR_TEMPLATE)+1);
     sprintf(dir, OUTPUT_KMAIL_DIR_TEMPLATE, fname);
     check_filename(dir);
-    if (D_MKDIR(dir)) {
+    if (mkdir_at(parent, dir)) {
         if (errno != EEXIST) {  // not an error because it exists
             x = errno;
             DIE(("mk_kmail_dir: Cannot create directory %s: %s\n", dir, strerror(x)));
         }
     }
-    kmail_chdir = pst_realloc(kmail_chdir, strlen(dir)+1);
-    strcpy(kmail_chdir, dir);
+    *child_dir = open_out_dir(parent, dir);
     free (dir);
 
     //we should remove any existing indexes created by KMail, cause they might be different now
     index = pst_malloc(strlen(fname)+strlen(KMAIL_INDEX)+1);
     sprintf(index, KMAIL_INDEX, fname);
-    unlink(index);
+    unlink_at(parent, index);
     free(index);
 
     out_name = pst_malloc(strlen(fname)+strlen(OUTPUT_TEMPLATE)+1);
@@ -799,24 +1439,6 @@ char *mk_kmail_dir(char *fname) {
 }
 
 
-int close_kmail_dir() {
-    // change ..
-    int x;
-    DEBUG_ENT("close_kmail_dir");
-    if (kmail_chdir) { //only free kmail_chdir if not NULL. do not change directory
-        free(kmail_chdir);
-        kmail_chdir = NULL;
-    } else {
-        if (chdir("..")) {
-            x = errno;
-            DIE(("close_kmail_dir: Cannot move up dir (..): %s\n", strerror(x)));
-        }
-    }
-    DEBUG_RET();
-    return 0;
-}
-
-
 char *item_type_to_name(int32_t item_type) {
     char *name;
     switch (item_type) {
@@ -863,40 +1485,28 @@ int32_t reduced_item_type(int32_t item_type) {
 }
 
 
-// this will create a directory by that name
-void mk_recurse_dir(char *dir) {
+// this will create a directory by that name in parent, and return it opened
+out_dir mk_recurse_dir(out_dir parent, char *dir) {
     int x;
+    out_dir d;
     DEBUG_ENT("mk_recurse_dir");
     check_filename(dir);
-    if (D_MKDIR (dir)) {
+    if (mkdir_at(parent, dir)) {
         if (errno != EEXIST) {  // not an error because it exists
             x = errno;
             DIE(("mk_recurse_dir: Cannot create directory %s: %s\n", dir, strerror(x)));
         }
     }
-    if (chdir (dir)) {
-        x = errno;
-        DIE(("mk_recurse_dir: Cannot change to directory %s: %s\n", dir, strerror(x)));
-    }
+    d = open_out_dir(parent, dir);
     DEBUG_RET();
+    return d;
 }
 
 
-int close_recurse_dir() {
-    int x;
-    DEBUG_ENT("close_recurse_dir");
-    if (chdir("..")) {
-        x = errno;
-        DIE(("close_recurse_dir: Cannot go up dir (..): %s\n", strerror(x)));
-    }
-    DEBUG_RET();
-    return 0;
-}
-
-
-void mk_separate_dir(char *dir) {
+out_dir mk_separate_dir(out_dir parent, char *dir) {
     size_t dirsize = strlen(dir) + 10;
     char dir_name[dirsize];
+    out_dir d;
     int x = 0, y = 0;
 
     DEBUG_ENT("mk_separate_dir");
@@ -908,7 +1518,7 @@ void mk_separate_dir(char *dir) {
 
         check_filename(dir_name);
         DEBUG_INFO(("about to try creating %s\n", dir_name));
-        if (D_MKDIR(dir_name)) {
+        if (mkdir_at(parent, dir_name)) {
             if (errno != EEXIST) { // if there is an error, and it doesn't already exist
                 x = errno;
                 DIE(("mk_separate_dir: Cannot create directory %s: %s\n", dir, strerror(x)));
@@ -918,11 +1528,7 @@ void mk_separate_dir(char *dir) {
         }
         y++;
     } while (overwrite == 0);
-
-    if (chdir(dir_name)) {
-        x = errno;
-        DIE(("mk_separate_dir: Cannot change to directory %s: %s\n", dir, strerror(x)));
-    }
+    d = open_out_dir(parent, dir_name);
 
     if (overwrite) {
         // we should probably delete all files from this directory
@@ -930,13 +1536,20 @@ void mk_separate_dir(char *dir) {
         DIR * sdir = NULL;
         struct dirent *dirent = NULL;
         struct stat filestat;
-        if (!(sdir = opendir("./"))) {
-            DEBUG_WARN(("mk_separate_dir: Cannot open dir \"%s\" for deletion of old contents\n", "./"));
+#ifdef OUT_DIR_FD
+        // the stream owns its descriptor
+        int fd = dup_out_dir(d);
+        if (!(sdir = fdopendir(fd))) close(fd);
+#else
+        sdir = opendir(d);
+#endif
+        if (!sdir) {
+            DEBUG_WARN(("mk_separate_dir: Cannot open dir \"%s\" for deletion of old contents\n", dir_name));
         } else {
             while ((dirent = readdir(sdir))) {
-                if (lstat(dirent->d_name, &filestat) != -1)
+                if (lstat_at(d, dirent->d_name, &filestat) != -1)
                     if (S_ISREG(filestat.st_mode)) {
-                        if (unlink(dirent->d_name)) {
+                        if (unlink_at(d, dirent->d_name)) {
                             y = errno;
                             DIE(("mk_separate_dir: unlink returned error on file %s: %s\n", dirent->d_name, strerror(y)));
                         }
@@ -948,18 +1561,7 @@ void mk_separate_dir(char *dir) {
     }
 
     DEBUG_RET();
-}
-
-
-int close_separate_dir() {
-    int x;
-    DEBUG_ENT("close_separate_dir");
-    if (chdir("..")) {
-        x = errno;
-        DIE(("close_separate_dir: Cannot go up dir (..): %s\n", strerror(x)));
-    }
-    DEBUG_RET();
-    return 0;
+    return d;
 }
 
 
@@ -972,7 +1574,7 @@ void mk_separate_file(struct file_ll *f, int32_t t, char *extension, int openit)
     sprintf(f->name[t], SEP_MAIL_FILE_TEMPLATE, f->item_count, extension);
     check_filename(f->name[t]);
     if (openit) {
-        if (!(f->output[t] = fopen(f->name[t], "w"))) {
+        if (!(f->output[t] = fopen_at(f->dir, f->name[t], "w"))) {
             DIE(("mk_separate_file: Cannot open file to save email \"%s\"\n", f->name[t]));
         }
     }
@@ -984,21 +1586,32 @@ void close_separate_file(struct file_ll *f) {
     int32_t t;
     DEBUG_ENT("close_separate_file");
     for (t=0; t<PST_TYPE_MAX; t++) {
-        if (f->output[t]) {
-            struct stat st;
-            fclose(f->output[t]);
-            stat(f->name[t], &st);
-            if (!st.st_size) {
-                DEBUG_WARN(("removing empty output file %s\n", f->name[t]));
-                remove(f->name[t]);
-            }
-            f->output[t] = NULL;
-        }
+        if (f->output[t]) close_output_file(f, t);
     }
     DEBUG_RET();
 }
 
 
+/**
+ * Close an output file of a folder, and remove it if nothing was
+ * written to it.
+ * @param f  the folder
+ * @param t  which of its files
+ */
+void close_output_file(struct file_ll *f, int32_t t) {
+    struct stat st;
+    int empty;
+    fflush(f->output[t]);
+    empty = !fstat(fileno(f->output[t]), &st) && !st.st_size;
+    fclose(f->output[t]);
+    f->output[t] = NULL;
+    if (empty) {
+        DEBUG_WARN(("removing empty output file %s\n", f->name[t]));
+        unlink_at(f->dir, f->name[t]);
+    }
+}
+
+
 char *my_stristr(char *haystack, char *needle) {
     // my_stristr varies from strstr in that its searches are case-insensitive
     char *x=haystack, *y=needle, *z = NULL;
@@ -1070,7 +1683,7 @@ int  acceptable_ext(pst_item_attach* attach)
 }
 
 
-void write_separate_attachment(char f_name[], pst_item_attach* attach, int attach_num, pst_file* pst)
+void write_separate_attachment(out_dir dir, char f_name[], pst_item_attach* attach, int attach_num, pst_file* pst)
 {
     FILE *fp = NULL;
     int x = 0;
@@ -1107,13 +1720,13 @@ void write_separate_attachment(char f_name[], pst_item_attach* attach, int attac
                 sprintf(temp, "%s-%s", f_name, attach_filename);
             else
                 sprintf(temp, "%s-%s-%i", f_name, attach_filename, x);
-        } while ((fp = fopen(temp, "r")) && ++x < 99999999);
+        } while ((fp = fopen_at(dir, temp, "r")) && ++x < 99999999);
         if (x > 99999999) {
             DIE(("error finding attachment name. exhausted possibilities to %s\n", temp));
         }
     }
     DEBUG_INFO(("Saving attachment to %s\n", temp));
-    if (!(fp = fopen(temp, "w"))) {
+    if (!(fp = fopen_at(dir, temp, "w"))) {
         DEBUG_WARN(("write_separate_attachment: Cannot open attachment save file \"%s\"\n", temp));
     } else {
         (void)pst_attach_to_file(pst, attach, fp);
@@ -1124,7 +1737,7 @@ void write_separate_attachment(char f_name[], pst_item_attach* attach, int attac
 }
 
 
-void write_embedded_message(FILE* f_output, pst_item_attach* attach, char *boundary, pst_file* pf, int save_rtf, char** extra_mime_headers)
+void write_embedded_message(pst_vbuf* out, pst_item_attach* attach, char *boundary, pst_file* pf, int save_rtf, char** extra_mime_headers)
 {
     pst_index_ll *ptr;
     DEBUG_ENT("write_embedded_message");
@@ -1155,9 +1768,9 @@ void write_embedded_message(FILE* f_output, pst_item_attach* attach, char *bound
         if (!item->email) {
             DEBUG_WARN(("write_embedded_message: pst_parse_item returned type %d, not an email message", item->type));
         } else {
-            fprintf(f_output, "\n--%s\n", boundary);
-            fprintf(f_output, "Content-Type: %s\n\n", attach->mimetype.str);
-            write_normal_email(f_output, "", item, MODE_NORMAL, 0, pf, save_rtf, 1, extra_mime_headers);
+            out_cat(out, "\n--", boundary, "\n", NULL);
+            out_cat(out, "Content-Type: ", attach->mimetype.str, "\n\n", NULL);
+            write_normal_email(out, output_top, "", item, MODE_NORMAL, 0, pf, save_rtf, 1, extra_mime_headers);
         }
         pst_freeItem(item);
     }
@@ -1166,7 +1779,7 @@ void write_embedded_message(FILE* f_output, pst_item_attach* attach, char *bound
 }
 
 
-void write_inline_attachment(FILE* f_output, pst_item_attach* attach, char *boundary, pst_file* pst)
+void write_inline_attachment(pst_vbuf* out, pst_item *item, pst_item_attach* attach, char *boundary, pst_file* pst)
 {
     DEBUG_ENT("write_inline_attachment");
     DEBUG_INFO(("Attachment Size is %#"PRIx64", data = %#"PRIxPTR", id %#"PRIx64"\n", (uint64_t)attach->data.size, attach->data.data, attach->i_id));
@@ -1181,35 +1794,35 @@ void write_inline_attachment(FILE* f_output, pst_item_attach* attach, char *boun
         }
     }
 
-    fprintf(f_output, "\n--%s\n", boundary);
+    out_cat(out, "\n--", boundary, "\n", NULL);
     if (!attach->mimetype.str) {
-        fprintf(f_output, "Content-Type: %s\n", MIME_TYPE_DEFAULT);
+        out_cat(out, "Content-Type: ", MIME_TYPE_DEFAULT, "\n", NULL);
     } else {
-        fprintf(f_output, "Content-Type: %s\n", attach->mimetype.str);
+        out_cat(out, "Content-Type: ", attach->mimetype.str, "\n", NULL);
     }
-    fprintf(f_output, "Content-Transfer-Encoding: base64\n");
+    out_str(out, "Content-Transfer-Encoding: base64\n");
 
     if (attach->content_id.str) {
-        fprintf(f_output, "Content-ID: <%s>\n", attach->content_id.str);
+        out_cat(out, "Content-ID: <", attach->content_id.str, ">\n", NULL);
     }
 
     if (attach->filename2.str) {
         // use the long filename, converted to proper encoding if needed.
         // it is already utf8
-        pst_rfc2231(&attach->filename2);
-        fprintf(f_output, "Content-Disposition: attachment; \n        filename*=%s\n\n", attach->filename2.str);
+        pst_rfc2231(item, &attach->filename2);
+        out_cat(out, "Content-Disposition: attachment; \n        filename*=", attach->filename2.str, "\n\n", NULL);
     }
     else if (attach->filename1.str) {
         // short filename never needs encoding
-        fprintf(f_output, "Content-Disposition: attachment; filename=\"%s\"\n\n", attach->filename1.str);
+        out_cat(out, "Content-Disposition: attachment; filename=\"", attach->filename1.str, "\"\n\n", NULL);
     }
     else {
         // no filename is inline
-        fprintf(f_output, "Content-Disposition: inline\n\n");
+        out_str(out, "Content-Disposition: inline\n\n");
     }
 
-    (void)pst_attach_to_file_base64(pst, attach, f_output);
-    fprintf(f_output, "\n\n");
+    (void)pst_attach_to_vbuf_base64(pst, attach, out);
+    out_str(out, "\n\n");
     DEBUG_RET();
 }
 
@@ -1420,7 +2033,7 @@ void find_rfc822_headers(char** extra_mime_headers)
 }
 
 
-void write_body_part(FILE* f_output, pst_string *body, char *mime, char *charset, char *boundary, pst_file* pst)
+void write_body_part(pst_vbuf* out, pst_item *item, pst_string *body, char *mime, char *charset, char *boundary, pst_file* pst)
 {
     DEBUG_ENT("write_body_part");
     removeCR(body->str);
@@ -1446,54 +2059,53 @@ void write_body_part(FILE* f_output, pst_string *body, char *mime, char *charset
                 // null terminate the output string
                 pst_vbgrow(newer, 1);
                 newer->b[newer->dlen] = '\0';
-                free(body->str);
-                body->str = newer->b;
-                body_len = newer->dlen;
+                pst_item_replace_str(item, body, newer->b);
+                body_len = strlen(body->str);
             }
             free(newer);
         }
     }
     int base64 = test_base64(body->str, body_len);
-    fprintf(f_output, "\n--%s\n", boundary);
-    fprintf(f_output, "Content-Type: %s; charset=\"%s\"\n", mime, charset);
-    if (base64) fprintf(f_output, "Content-Transfer-Encoding: base64\n");
-    fprintf(f_output, "\n");
+    out_cat(out, "\n--", boundary, "\n", NULL);
+    out_cat(out, "Content-Type: ", mime, "; charset=\"", charset, "\"\n", NULL);
+    if (base64) out_str(out, "Content-Transfer-Encoding: base64\n");
+    out_str(out, "\n");
     // Any body that uses an encoding with NULLs, e.g. UTF16, will be base64-encoded here.
     if (base64) {
         char *enc = pst_base64_encode(body->str, body_len);
         if (enc) {
-            write_email_body(f_output, enc);
-            fprintf(f_output, "\n");
+            write_email_body(out, enc);
+            out_str(out, "\n");
             free(enc);
         }
     }
     else {
-        write_email_body(f_output, body->str);
+        write_email_body(out, body->str);
     }
     DEBUG_RET();
 }
 
 
-void write_schedule_part_data(FILE* f_output, pst_item* item, const char* sender, const char* method)
+void write_schedule_part_data(pst_vbuf* out, pst_item* item, const char* sender, const char* method)
 {
-    fprintf(f_output, "BEGIN:VCALENDAR\n");
-    fprintf(f_output, "VERSION:2.0\n");
-    fprintf(f_output, "PRODID:LibPST v%s\n", VERSION);
-    if (method) fprintf(f_output, "METHOD:%s\n", method);
-    fprintf(f_output, "BEGIN:VEVENT\n");
+    out_str(out, "BEGIN:VCALENDAR\n");
+    out_str(out, "VERSION:2.0\n");
+    out_str(out, "PRODID:LibPST v" VERSION "\n");
+    if (method) out_cat(out, "METHOD:", method, "\n", NULL);
+    out_str(out, "BEGIN:VEVENT\n");
     if (sender) {
         if (item->email->outlook_sender_name.str) {
-            fprintf(f_output, "ORGANIZER;CN=\"%s\":MAILTO:%s\n", item->email->outlook_sender_name.str, sender);
+            out_cat(out, "ORGANIZER;CN=\"", item->email->outlook_sender_name.str, "\":MAILTO:", sender, "\n", NULL);
         } else {
-            fprintf(f_output, "ORGANIZER;CN=\"\":MAILTO:%s\n", sender);
+            out_cat(out, "ORGANIZER;CN=\"\":MAILTO:", sender, "\n", NULL);
         }
     }
-    write_appointment(f_output, item);
-    fprintf(f_output, "END:VCALENDAR\n");
+    write_appointment(out, item);
+    out_str(out, "END:VCALENDAR\n");
 }
 
 
-void write_schedule_part(FILE* f_output, pst_item* item, const char* sender, const char* boundary)
+void write_schedule_part(pst_vbuf* out, pst_item* item, const char* sender, const char* boundary)
 {
     const char* method  = "REQUEST";
     const char* charset = "utf-8";
@@ -1501,22 +2113,22 @@ void write_schedule_part(FILE* f_output, pst_item* item, const char* sender, con
     if (!item->appointment) return;
 
     // inline appointment request
-    fprintf(f_output, "\n--%s\n", boundary);
-    fprintf(f_output, "Content-Type: %s; method=\"%s\"; charset=\"%s\"\n\n", "text/calendar", method, charset);
-    write_schedule_part_data(f_output, item, sender, method);
-    fprintf(f_output, "\n");
+    out_cat(out, "\n--", boundary, "\n", NULL);
+    out_cat(out, "Content-Type: text/calendar; method=\"", method, "\"; charset=\"", charset, "\"\n\n", NULL);
+    write_schedule_part_data(out, item, sender, method);
+    out_str(out, "\n");
 
     // attachment appointment request
     snprintf(fname, sizeof(fname), "i%i.ics", rand());
-    fprintf(f_output, "\n--%s\n", boundary);
-    fprintf(f_output, "Content-Type: %s; charset=\"%s\"; name=\"%s\"\n", "text/calendar", "utf-8", fname);
-    fprintf(f_output, "Content-Disposition: attachment; filename=\"%s\"\n\n", fname);
-    write_schedule_part_data(f_output, item, sender, method);
-    fprintf(f_output, "\n");
+    out_cat(out, "\n--", boundary, "\n", NULL);
+    out_cat(out, "Content-Type: text/calendar; charset=\"utf-8\"; name=\"", fname, "\"\n", NULL);
+    out_cat(out, "Content-Disposition: attachment; filename=\"", fname, "\"\n\n", NULL);
+    write_schedule_part_data(out, item, sender, method);
+    out_str(out, "\n");
 }
 
 
-void write_normal_email(FILE* f_output, char f_name[], pst_item* item, int mode, int mode_MH, pst_file* pst, int save_rtf, int embedding, char** extra_mime_headers)
+void write_normal_email(pst_vbuf* out, out_dir dir, char f_name[], pst_item* item, int mode, int mode_MH, pst_file* pst, int save_rtf, int embedding, char** extra_mime_headers)
 {
     char boundary[60];
     char altboundary[66];
@@ -1529,11 +2141,13 @@ void write_normal_email(FILE* f_output, char f_name[], pst_item* item, int mode,
     char *temp = NULL;
     time_t em_time;
     char *c_time;
+    char c_time_buf[C_TIME_SIZE];
     char *headers = NULL;
     int has_from, has_subject, has_to, has_cc, has_date, has_msgid;
     has_from = has_subject = has_to = has_cc = has_date = has_msgid = 0;
     DEBUG_ENT("write_normal_email");
 
+    pst_load_bodies(item);
     pst_convert_utf8_null(item, &item->email->header);
     headers = valid_headers(item->email->header.str) ? item->email->header.str :
               valid_headers(*extra_mime_headers)     ? *extra_mime_headers     :
@@ -1560,7 +2174,7 @@ void write_normal_email(FILE* f_output, char f_name[], pst_item* item, int mode,
     // convert the sent date if it exists, or set it to a fixed date
     if (item->email->sent_date) {
         em_time = pst_fileTimeToUnixTime(item->email->sent_date);
-        c_time = ctime(&em_time);
+        c_time = ctime_r(&em_time, c_time_buf);    // ctime() shares its buffer between the export threads
         if (c_time)
             c_time[strlen(c_time)-1] = '\0'; //remove end \n
         else
@@ -1642,16 +2256,16 @@ void write_normal_email(FILE* f_output, char f_name[], pst_item* item, int mode,
         // sender email address, but apparently some Mac email client needs
         // those quotes, and they don't seem to cause problems for anyone else.
         char *quo = (embedding) ? ">" : "";
-        fprintf(f_output, "%sFrom \"%s\" %s\n", quo, sender, c_time);
+        out_cat(out, quo, "From \"", sender, "\" ", c_time, "\n", NULL);
     }
 
     // print the supplied email headers
     if (headers) {
         int len = strlen(headers);
         if (len > 0) {
-            fprintf(f_output, "%s", headers);
+            out_mem(out, headers, len);
             // make sure the headers end with a \n
-            if (headers[len-1] != '\n') fprintf(f_output, "\n");
+            if (headers[len-1] != '\n') out_str(out, "\n");
             //char *h = headers;
             //while (*h) {
             //    char *e = strchr(h, '\n');
@@ -1661,7 +2275,8 @@ void write_normal_email(FILE* f_output, char f_name[], pst_item* item, int mode,
             //        d = 0;
             //    }
             //    // we could do rfc2047 encoding here if needed
-            //    fprintf(f_output, "%.*s\n", (int)(e-h), h);
+            //    out_mem(out, h, e-h);
+            //    out_str(out, "\n");
             //    h = e + d;
             //}
         }
@@ -1669,7 +2284,7 @@ void write_normal_email(FILE* f_output, char f_name[], pst_item* item, int mode,
 
     // record read status
     if ((item->flags & PST_FLAG_READ) == PST_FLAG_READ) {
-        fprintf(f_output, "Status: RO\n");
+        out_str(out, "Status: RO\n");
     }
 
     // create required header fields that are not already written
@@ -1677,29 +2292,29 @@ void write_normal_email(FILE* f_output, char f_name[], pst_item* item, int mode,
     if (!has_from) {
         if (item->email->outlook_sender_name.str){
             pst_rfc2047(item, &item->email->outlook_sender_name, 1);
-            fprintf(f_output, "From: %s <%s>\n", item->email->outlook_sender_name.str, sender);
+            out_cat(out, "From: ", item->email->outlook_sender_name.str, " <", sender, ">\n", NULL);
         } else {
-            fprintf(f_output, "From: <%s>\n", sender);
+            out_cat(out, "From: <", sender, ">\n", NULL);
         }
     }
 
     if (!has_subject) {
         if (item->subject.str) {
             pst_rfc2047(item, &item->subject, 0);
-            fprintf(f_output, "Subject: %s\n", item->subject.str);
+            out_cat(out, "Subject: ", item->subject.str, "\n", NULL);
         } else {
-            fprintf(f_output, "Subject: \n");
+            out_str(out, "Subject: \n");
         }
     }
 
     if (!has_to && item->email->sentto_address.str) {
         pst_rfc2047(item, &item->email->sentto_address, 0);
-        fprintf(f_output, "To: %s\n", item->email->sentto_address.str);
+        out_cat(out, "To: ", item->email->sentto_address.str, "\n", NULL);
     }
 
     if (!has_cc && item->email->cc_address.str) {
         pst_rfc2047(item, &item->email->cc_address, 0);
-        fprintf(f_output, "Cc: %s\n", item->email->cc_address.str);
+        out_cat(out, "Cc: ", item->email->cc_address.str, "\n", NULL);
     }
 
     if (!has_date && item->email->sent_date) {
@@ -1707,12 +2322,12 @@ void write_normal_email(FILE* f_output, char f_name[], pst_item* item, int mode,
         struct tm stm;
         gmtime_r(&em_time, &stm);
         strftime(c_time, C_TIME_SIZE, "%a, %d %b %Y %H:%M:%S %z", &stm);
-        fprintf(f_output, "Date: %s\n", c_time);
+        out_cat(out, "Date: ", c_time, "\n", NULL);
     }
 
     if (!has_msgid && item->email->messageid.str) {
         pst_convert_utf8(item, &item->email->messageid);
-        fprintf(f_output, "Message-Id: %s\n", item->email->messageid.str);
+        out_cat(out, "Message-Id: ", item->email->messageid.str, "\n", NULL);
     }
 
     // add forensic headers to capture some .pst stuff that is not really
@@ -1721,35 +2336,35 @@ void write_normal_email(FILE* f_output, char f_name[], pst_item* item, int mode,
     if (item->email->sender_address.str && !strchr(item->email->sender_address.str, '@')
                                         && strcmp(item->email->sender_address.str, ".")
                                         && (strlen(item->email->sender_address.str) > 0)) {
-        fprintf(f_output, "X-libpst-forensic-sender: %s\n", item->email->sender_address.str);
+        out_cat(out, "X-libpst-forensic-sender: ", item->email->sender_address.str, "\n", NULL);
     }
 
     if (item->email->bcc_address.str) {
         pst_convert_utf8(item, &item->email->bcc_address);
-        fprintf(f_output, "X-libpst-forensic-bcc: %s\n", item->email->bcc_address.str);
+        out_cat(out, "X-libpst-forensic-bcc: ", item->email->bcc_address.str, "\n", NULL);
     }
 
     // add our own mime headers
-    fprintf(f_output, "MIME-Version: 1.0\n");
+    out_str(out, "MIME-Version: 1.0\n");
     if (item->type == PST_TYPE_REPORT) {
         // multipart/report for DSN/MDN reports
-        fprintf(f_output, "Content-Type: multipart/report; report-type=%s;\n\tboundary=\"%s\"\n", body_report, boundary);
+        out_cat(out, "Content-Type: multipart/report; report-type=", body_report, ";\n\tboundary=\"", boundary, "\"\n", NULL);
     }
     else {
-        fprintf(f_output, "Content-Type: multipart/mixed;\n\tboundary=\"%s\"\n", boundary);
+        out_cat(out, "Content-Type: multipart/mixed;\n\tboundary=\"", boundary, "\"\n", NULL);
     }
-    fprintf(f_output, "\n");    // end of headers, start of body
+    out_str(out, "\n");    // end of headers, start of body
 
     // now dump the body parts
     if ((item->type == PST_TYPE_REPORT) && (item->email->report_text.str)) {
-        write_body_part(f_output, &item->email->report_text, "text/plain", body_charset, boundary, pst);
-        fprintf(f_output, "\n");
+        write_body_part(out, item, &item->email->report_text, "text/plain", body_charset, boundary, pst);
+        out_str(out, "\n");
     }
 
     if (item->body.str && item->email->htmlbody.str) {
         // start the nested alternative part
-        fprintf(f_output, "\n--%s\n", boundary);
-        fprintf(f_output, "Content-Type: multipart/alternative;\n\tboundary=\"%s\"\n", altboundary);
+        out_cat(out, "\n--", boundary, "\n", NULL);
+        out_cat(out, "Content-Type: multipart/alternative;\n\tboundary=\"", altboundary, "\"\n", NULL);
         altboundaryp = altboundary;
     }
     else {
@@ -1757,17 +2372,17 @@ void write_normal_email(FILE* f_output, char f_name[], pst_item* item, int mode,
     }
 
     if (item->body.str) {
-        write_body_part(f_output, &item->body, "text/plain", body_charset, altboundaryp, pst);
+        write_body_part(out, item, &item->body, "text/plain", body_charset, altboundaryp, pst);
     }
 
     if (item->email->htmlbody.str) {
         find_html_charset(item->email->htmlbody.str, body_charset, sizeof(body_charset));
-        write_body_part(f_output, &item->email->htmlbody, "text/html", body_charset, altboundaryp, pst);
+        write_body_part(out, item, &item->email->htmlbody, "text/html", body_charset, altboundaryp, pst);
     }
 
     if (item->body.str && item->email->htmlbody.str) {
         // end the nested alternative part
-        fprintf(f_output, "\n--%s--\n", altboundary);
+        out_cat(out, "\n--", altboundary, "--\n", NULL);
     }
 
     if (item->email->rtf_compressed.data && save_rtf) {
@@ -1806,7 +2421,7 @@ void write_normal_email(FILE* f_output, char f_name[], pst_item* item, int mode,
     }
 
     if (item->type == PST_TYPE_SCHEDULE) {
-        write_schedule_part(f_output, item, sender, boundary);
+        write_schedule_part(out, item, sender, boundary);
     }
 
     // other attachments
@@ -1822,30 +2437,29 @@ void write_normal_email(FILE* f_output, char f_name[], pst_item* item, int mode,
                 DEBUG_INFO(("have an embedded rfc822 message attachment\n"));
                 if (attach->mimetype.str) {
                     DEBUG_INFO(("which already has a mime-type of %s\n", attach->mimetype.str));
-                    free(attach->mimetype.str);
                 }
-                attach->mimetype.str = strdup(RFC822);
+                pst_item_replace_str(item, &attach->mimetype, strdup(RFC822));
                 attach->mimetype.is_utf8 = 1;
                 find_rfc822_headers(extra_mime_headers);
-                write_embedded_message(f_output, attach, boundary, pst, save_rtf, extra_mime_headers);
+                write_embedded_message(out, attach, boundary, pst, save_rtf, extra_mime_headers);
             }
             else if (attach->data.data || attach->i_id) {
                 if (acceptable_ext(attach)) {
                     if (mode == MODE_SEPARATE && !mode_MH)
-                        write_separate_attachment(f_name, attach, ++attach_num, pst);
+                        write_separate_attachment(dir, f_name, attach, ++attach_num, pst);
                     else
-                        write_inline_attachment(f_output, attach, boundary, pst);
+                        write_inline_attachment(out, item, attach, boundary, pst);
                 }
             }
         }
     }
 
-    fprintf(f_output, "\n--%s--\n\n", boundary);
+    out_cat(out, "\n--", boundary, "--\n\n", NULL);
     DEBUG_RET();
 }
 
 
-void write_vcard(FILE* f_output, pst_item* item, pst_item_contact* contact, char comment[])
+void write_vcard(pst_vbuf* out, pst_item* item, pst_item_contact* contact, char comment[])
 {
     char*  result = NULL;
     size_t resultlen = 0;
@@ -1911,93 +2525,93 @@ void write_vcard(FILE* f_output, pst_item* item, pst_item_contact* contact, char
     pst_convert_utf8_null(item, &item->body);
 
     // the specification I am following is (hopefully) RFC2426 vCard Mime Directory Profile
-    fprintf(f_output, "BEGIN:VCARD\n");
-    fprintf(f_output, "FN:%s\n", pst_rfc2426_escape(contact->fullname.str, &result, &resultlen));
+    out_str(out, "BEGIN:VCARD\n");
+    out_cat(out, "FN:", (!contact->fullname.str) ? "" : pst_rfc2426_escape(contact->fullname.str, &result, &resultlen), "\n", NULL);
 
     //fprintf(f_output, "N:%s;%s;%s;%s;%s\n",
-    fprintf(f_output, "N:%s;", (!contact->surname.str)             ? "" : pst_rfc2426_escape(contact->surname.str, &result, &resultlen));
-    fprintf(f_output, "%s;",   (!contact->first_name.str)          ? "" : pst_rfc2426_escape(contact->first_name.str, &result, &resultlen));
-    fprintf(f_output, "%s;",   (!contact->middle_name.str)         ? "" : pst_rfc2426_escape(contact->middle_name.str, &result, &resultlen));
-    fprintf(f_output, "%s;",   (!contact->display_name_prefix.str) ? "" : pst_rfc2426_escape(contact->display_name_prefix.str, &result, &resultlen));
-    fprintf(f_output, "%s\n",  (!contact->suffix.str)              ? "" : pst_rfc2426_escape(contact->suffix.str, &result, &resultlen));
+    out_cat(out, "N:", (!contact->surname.str)             ? "" : pst_rfc2426_escape(contact->surname.str, &result, &resultlen), ";", NULL);
+    out_cat(out,       (!contact->first_name.str)          ? "" : pst_rfc2426_escape(contact->first_name.str, &result, &resultlen), ";", NULL);
+    out_cat(out,       (!contact->middle_name.str)         ? "" : pst_rfc2426_escape(contact->middle_name.str, &result, &resultlen), ";", NULL);
+    out_cat(out,       (!contact->display_name_prefix.str) ? "" : pst_rfc2426_escape(contact->display_name_prefix.str, &result, &resultlen), ";", NULL);
+    out_cat(out,       (!contact->suffix.str)              ? "" : pst_rfc2426_escape(contact->suffix.str, &result, &resultlen), "\n", NULL);
 
     if (contact->nickname.str)
-        fprintf(f_output, "NICKNAME:%s\n", pst_rfc2426_escape(contact->nickname.str, &result, &resultlen));
+        out_cat(out, "NICKNAME:", pst_rfc2426_escape(contact->nickname.str, &result, &resultlen), "\n", NULL);
     if (contact->address1.str)
-        fprintf(f_output, "EMAIL:%s\n", pst_rfc2426_escape(contact->address1.str, &result, &resultlen));
+        out_cat(out, "EMAIL:", pst_rfc2426_escape(contact->address1.str, &result, &resultlen), "\n", NULL);
     if (contact->address2.str)
-        fprintf(f_output, "EMAIL:%s\n", pst_rfc2426_escape(contact->address2.str, &result, &resultlen));
+        out_cat(out, "EMAIL:", pst_rfc2426_escape(contact->address2.str, &result, &resultlen), "\n", NULL);
     if (contact->address3.str)
-        fprintf(f_output, "EMAIL:%s\n", pst_rfc2426_escape(contact->address3.str, &result, &resultlen));
+        out_cat(out, "EMAIL:", pst_rfc2426_escape(contact->address3.str, &result, &resultlen), "\n", NULL);
     if (contact->birthday)
-        fprintf(f_output, "BDAY:%s\n", pst_rfc2425_datetime_format(contact->birthday, sizeof(time_buffer), time_buffer));
+        out_cat(out, "BDAY:", pst_rfc2425_datetime_format(contact->birthday, sizeof(time_buffer), time_buffer), "\n", NULL);
 
     if (contact->home_address.str) {
         //fprintf(f_output, "ADR;TYPE=home:%s;%s;%s;%s;%s;%s;%s\n",
-        fprintf(f_output, "ADR;TYPE=home:%s;",  (!contact->home_po_box.str)      ? "" : pst_rfc2426_escape(contact->home_po_box.str, &result, &resultlen));
-        fprintf(f_output, "%s;",                ""); // extended Address
-        fprintf(f_output, "%s;",                (!contact->home_street.str)      ? "" : pst_rfc2426_escape(contact->home_street.str, &result, &resultlen));
-        fprintf(f_output, "%s;",                (!contact->home_city.str)        ? "" : pst_rfc2426_escape(contact->home_city.str, &result, &resultlen));
-        fprintf(f_output, "%s;",                (!contact->home_state.str)       ? "" : pst_rfc2426_escape(contact->home_state.str, &result, &resultlen));
-        fprintf(f_output, "%s;",                (!contact->home_postal_code.str) ? "" : pst_rfc2426_escape(contact->home_postal_code.str, &result, &resultlen));
-        fprintf(f_output, "%s\n",               (!contact->home_country.str)     ? "" : pst_rfc2426_escape(contact->home_country.str, &result, &resultlen));
-        fprintf(f_output, "LABEL;TYPE=home:%s\n", pst_rfc2426_escape(contact->home_address.str, &result, &resultlen));
+        out_cat(out, "ADR;TYPE=home:", (!contact->home_po_box.str)      ? "" : pst_rfc2426_escape(contact->home_po_box.str, &result, &resultlen), ";", NULL);
+        out_str(out, ";");  // extended Address
+        out_cat(out,                   (!contact->home_street.str)      ? "" : pst_rfc2426_escape(contact->home_street.str, &result, &resultlen), ";", NULL);
+        out_cat(out,                   (!contact->home_city.str)        ? "" : pst_rfc2426_escape(contact->home_city.str, &result, &resultlen), ";", NULL);
+        out_cat(out,                   (!contact->home_state.str)       ? "" : pst_rfc2426_escape(contact->home_state.str, &result, &resultlen), ";", NULL);
+        out_cat(out,                   (!contact->home_postal_code.str) ? "" : pst_rfc2426_escape(contact->home_postal_code.str, &result, &resultlen), ";", NULL);
+        out_cat(out,                   (!contact->home_country.str)     ? "" : pst_rfc2426_escape(contact->home_country.str, &result, &resultlen), "\n", NULL);
+        out_cat(out, "LABEL;TYPE=home:", pst_rfc2426_escape(contact->home_address.str, &result, &resultlen), "\n", NULL);
     }
 
     if (contact->business_address.str) {
         //fprintf(f_output, "ADR;TYPE=work:%s;%s;%s;%s;%s;%s;%s\n",
-        fprintf(f_output, "ADR;TYPE=work:%s;",  (!contact->business_po_box.str)      ? "" : pst_rfc2426_escape(contact->business_po_box.str, &result, &resultlen));
-        fprintf(f_output, "%s;",                ""); // extended Address
-        fprintf(f_output, "%s;",                (!contact->business_street.str)      ? "" : pst_rfc2426_escape(contact->business_street.str, &result, &resultlen));
-        fprintf(f_output, "%s;",                (!contact->business_city.str)        ? "" : pst_rfc2426_escape(contact->business_city.str, &result, &resultlen));
-        fprintf(f_output, "%s;",                (!contact->business_state.str)       ? "" : pst_rfc2426_escape(contact->business_state.str, &result, &resultlen));
-        fprintf(f_output, "%s;",                (!contact->business_postal_code.str) ? "" : pst_rfc2426_escape(contact->business_postal_code.str, &result, &resultlen));
-        fprintf(f_output, "%s\n",               (!contact->business_country.str)     ? "" : pst_rfc2426_escape(contact->business_country.str, &result, &resultlen));
-        fprintf(f_output, "LABEL;TYPE=work:%s\n", pst_rfc2426_escape(contact->business_address.str, &result, &resultlen));
+        out_cat(out, "ADR;TYPE=work:", (!contact->business_po_box.str)      ? "" : pst_rfc2426_escape(contact->business_po_box.str, &result, &resultlen), ";", NULL);
+        out_str(out, ";");  // extended Address
+        out_cat(out,                   (!contact->business_street.str)      ? "" : pst_rfc2426_escape(contact->business_street.str, &result, &resultlen), ";", NULL);
+        out_cat(out,                   (!contact->business_city.str)        ? "" : pst_rfc2426_escape(contact->business_city.str, &result, &resultlen), ";", NULL);
+        out_cat(out,                   (!contact->business_state.str)       ? "" : pst_rfc2426_escape(contact->business_state.str, &result, &resultlen), ";", NULL);
+        out_cat(out,                   (!contact->business_postal_code.str) ? "" : pst_rfc2426_escape(contact->business_postal_code.str, &result, &resultlen), ";", NULL);
+        out_cat(out,                   (!contact->business_country.str)     ? "" : pst_rfc2426_escape(contact->business_country.str, &result, &resultlen), "\n", NULL);
+        out_cat(out, "LABEL;TYPE=work:", pst_rfc2426_escape(contact->business_address.str, &result, &resultlen), "\n", NULL);
     }
 
     if (contact->other_address.str) {
         //fprintf(f_output, "ADR;TYPE=postal:%s;%s;%s;%s;%s;%s;%s\n",
-        fprintf(f_output, "ADR;TYPE=postal:%s;",(!contact->other_po_box.str)       ? "" : pst_rfc2426_escape(contact->other_po_box.str, &result, &resultlen));
-        fprintf(f_output, "%s;",                ""); // extended Address
-        fprintf(f_output, "%s;",                (!contact->other_street.str)       ? "" : pst_rfc2426_escape(contact->other_street.str, &result, &resultlen));
-        fprintf(f_output, "%s;",                (!contact->other_city.str)         ? "" : pst_rfc2426_escape(contact->other_city.str, &result, &resultlen));
-        fprintf(f_output, "%s;",                (!contact->other_state.str)        ? "" : pst_rfc2426_escape(contact->other_state.str, &result, &resultlen));
-        fprintf(f_output, "%s;",                (!contact->other_postal_code.str)  ? "" : pst_rfc2426_escape(contact->other_postal_code.str, &result, &resultlen));
-        fprintf(f_output, "%s\n",               (!contact->other_country.str)      ? "" : pst_rfc2426_escape(contact->other_country.str, &result, &resultlen));
-        fprintf(f_output, "LABEL;TYPE=postal:%s\n", pst_rfc2426_escape(contact->other_address.str, &result, &resultlen));
-    }
-
-    if (contact->business_fax.str)      fprintf(f_output, "TEL;TYPE=work,fax:%s\n",         pst_rfc2426_escape(contact->business_fax.str, &result, &resultlen));
-    if (contact->business_phone.str)    fprintf(f_output, "TEL;TYPE=work,voice:%s\n",       pst_rfc2426_escape(contact->business_phone.str, &result, &resultlen));
-    if (contact->business_phone2.str)   fprintf(f_output, "TEL;TYPE=work,voice:%s\n",       pst_rfc2426_escape(contact->business_phone2.str, &result, &resultlen));
-    if (contact->car_phone.str)         fprintf(f_output, "TEL;TYPE=car,voice:%s\n",        pst_rfc2426_escape(contact->car_phone.str, &result, &resultlen));
-    if (contact->home_fax.str)          fprintf(f_output, "TEL;TYPE=home,fax:%s\n",         pst_rfc2426_escape(contact->home_fax.str, &result, &resultlen));
-    if (contact->home_phone.str)        fprintf(f_output, "TEL;TYPE=home,voice:%s\n",       pst_rfc2426_escape(contact->home_phone.str, &result, &resultlen));
-    if (contact->home_phone2.str)       fprintf(f_output, "TEL;TYPE=home,voice:%s\n",       pst_rfc2426_escape(contact->home_phone2.str, &result, &resultlen));
-    if (contact->isdn_phone.str)        fprintf(f_output, "TEL;TYPE=isdn:%s\n",             pst_rfc2426_escape(contact->isdn_phone.str, &result, &resultlen));
-    if (contact->mobile_phone.str)      fprintf(f_output, "TEL;TYPE=cell,voice:%s\n",       pst_rfc2426_escape(contact->mobile_phone.str, &result, &resultlen));
-    if (contact->other_phone.str)       fprintf(f_output, "TEL;TYPE=msg:%s\n",              pst_rfc2426_escape(contact->other_phone.str, &result, &resultlen));
-    if (contact->pager_phone.str)       fprintf(f_output, "TEL;TYPE=pager:%s\n",            pst_rfc2426_escape(contact->pager_phone.str, &result, &resultlen));
-    if (contact->primary_fax.str)       fprintf(f_output, "TEL;TYPE=fax,pref:%s\n",         pst_rfc2426_escape(contact->primary_fax.str, &result, &resultlen));
-    if (contact->primary_phone.str)     fprintf(f_output, "TEL;TYPE=phone,pref:%s\n",       pst_rfc2426_escape(contact->primary_phone.str, &result, &resultlen));
-    if (contact->radio_phone.str)       fprintf(f_output, "TEL;TYPE=pcs:%s\n",              pst_rfc2426_escape(contact->radio_phone.str, &result, &resultlen));
-    if (contact->telex.str)             fprintf(f_output, "TEL;TYPE=bbs:%s\n",              pst_rfc2426_escape(contact->telex.str, &result, &resultlen));
-    if (contact->job_title.str)         fprintf(f_output, "TITLE:%s\n",                     pst_rfc2426_escape(contact->job_title.str, &result, &resultlen));
-    if (contact->profession.str)        fprintf(f_output, "ROLE:%s\n",                      pst_rfc2426_escape(contact->profession.str, &result, &resultlen));
+        out_cat(out, "ADR;TYPE=postal:", (!contact->other_po_box.str)       ? "" : pst_rfc2426_escape(contact->other_po_box.str, &result, &resultlen), ";", NULL);
+        out_str(out, ";");  // extended Address
+        out_cat(out,                     (!contact->other_street.str)       ? "" : pst_rfc2426_escape(contact->other_street.str, &result, &resultlen), ";", NULL);
+        out_cat(out,                     (!contact->other_city.str)         ? "" : pst_rfc2426_escape(contact->other_city.str, &result, &resultlen), ";", NULL);
+        out_cat(out,                     (!contact->other_state.str)        ? "" : pst_rfc2426_escape(contact->other_state.str, &result, &resultlen), ";", NULL);
+        out_cat(out,                     (!contact->other_postal_code.str)  ? "" : pst_rfc2426_escape(contact->other_postal_code.str, &result, &resultlen), ";", NULL);
+        out_cat(out,                     (!contact->other_country.str)      ? "" : pst_rfc2426_escape(contact->other_country.str, &result, &resultlen), "\n", NULL);
+        out_cat(out, "LABEL;TYPE=postal:", pst_rfc2426_escape(contact->other_address.str, &result, &resultlen), "\n", NULL);
+    }
+
+    if (contact->business_fax.str)      out_cat(out, "TEL;TYPE=work,fax:", pst_rfc2426_escape(contact->business_fax.str, &result, &resultlen), "\n", NULL);
+    if (contact->business_phone.str)    out_cat(out, "TEL;TYPE=work,voice:", pst_rfc2426_escape(contact->business_phone.str, &result, &resultlen), "\n", NULL);
+    if (contact->business_phone2.str)   out_cat(out, "TEL;TYPE=work,voice:", pst_rfc2426_escape(contact->business_phone2.str, &result, &resultlen), "\n", NULL);
+    if (contact->car_phone.str)         out_cat(out, "TEL;TYPE=car,voice:", pst_rfc2426_escape(contact->car_phone.str, &result, &resultlen), "\n", NULL);
+    if (contact->home_fax.str)          out_cat(out, "TEL;TYPE=home,fax:", pst_rfc2426_escape(contact->home_fax.str, &result, &resultlen), "\n", NULL);
+    if (contact->home_phone.str)        out_cat(out, "TEL;TYPE=home,voice:", pst_rfc2426_escape(contact->home_phone.str, &result, &resultlen), "\n", NULL);
+    if (contact->home_phone2.str)       out_cat(out, "TEL;TYPE=home,voice:", pst_rfc2426_escape(contact->home_phone2.str, &result, &resultlen), "\n", NULL);
+    if (contact->isdn_phone.str)        out_cat(out, "TEL;TYPE=isdn:", pst_rfc2426_escape(contact->isdn_phone.str, &result, &resultlen), "\n", NULL);
+    if (contact->mobile_phone.str)      out_cat(out, "TEL;TYPE=cell,voice:", pst_rfc2426_escape(contact->mobile_phone.str, &result, &resultlen), "\n", NULL);
+    if (contact->other_phone.str)       out_cat(out, "TEL;TYPE=msg:", pst_rfc2426_escape(contact->other_phone.str, &result, &resultlen), "\n", NULL);
+    if (contact->pager_phone.str)       out_cat(out, "TEL;TYPE=pager:", pst_rfc2426_escape(contact->pager_phone.str, &result, &resultlen), "\n", NULL);
+    if (contact->primary_fax.str)       out_cat(out, "TEL;TYPE=fax,pref:", pst_rfc2426_escape(contact->primary_fax.str, &result, &resultlen), "\n", NULL);
+    if (contact->primary_phone.str)     out_cat(out, "TEL;TYPE=phone,pref:", pst_rfc2426_escape(contact->primary_phone.str, &result, &resultlen), "\n", NULL);
+    if (contact->radio_phone.str)       out_cat(out, "TEL;TYPE=pcs:", pst_rfc2426_escape(contact->radio_phone.str, &result, &resultlen), "\n", NULL);
+    if (contact->telex.str)             out_cat(out, "TEL;TYPE=bbs:", pst_rfc2426_escape(contact->telex.str, &result, &resultlen), "\n", NULL);
+    if (contact->job_title.str)         out_cat(out, "TITLE:", pst_rfc2426_escape(contact->job_title.str, &result, &resultlen), "\n", NULL);
+    if (contact->profession.str)        out_cat(out, "ROLE:", pst_rfc2426_escape(contact->profession.str, &result, &resultlen), "\n", NULL);
     if (contact->assistant_name.str || contact->assistant_phone.str) {
-        fprintf(f_output, "AGENT:BEGIN:VCARD\n");
-        if (contact->assistant_name.str)    fprintf(f_output, "FN:%s\n",                    pst_rfc2426_escape(contact->assistant_name.str, &result, &resultlen));
-        if (contact->assistant_phone.str)   fprintf(f_output, "TEL:%s\n",                   pst_rfc2426_escape(contact->assistant_phone.str, &result, &resultlen));
+        out_str(out, "AGENT:BEGIN:VCARD\n");
+        if (contact->assistant_name.str)    out_cat(out, "FN:", pst_rfc2426_escape(contact->assistant_name.str, &result, &resultlen), "\n", NULL);
+        if (contact->assistant_phone.str)   out_cat(out, "TEL:", pst_rfc2426_escape(contact->assistant_phone.str, &result, &resultlen), "\n", NULL);
     }
-    if (contact->company_name.str)      fprintf(f_output, "ORG:%s\n",                       pst_rfc2426_escape(contact->company_name.str, &result, &resultlen));
-    if (comment)                        fprintf(f_output, "NOTE:%s\n",                      pst_rfc2426_escape(comment, &result, &resultlen));
-    if (item->body.str)                 fprintf(f_output, "NOTE:%s\n",                      pst_rfc2426_escape(item->body.str, &result, &resultlen));
+    if (contact->company_name.str)      out_cat(out, "ORG:", pst_rfc2426_escape(contact->company_name.str, &result, &resultlen), "\n", NULL);
+    if (comment)                        out_cat(out, "NOTE:", pst_rfc2426_escape(comment, &result, &resultlen), "\n", NULL);
+    if (item->body.str)                 out_cat(out, "NOTE:", pst_rfc2426_escape(item->body.str, &result, &resultlen), "\n", NULL);
 
-    write_extra_categories(f_output, item);
+    write_extra_categories(out, item);
 
-    fprintf(f_output, "VERSION: 3.0\n");
-    fprintf(f_output, "END:VCARD\n\n");
+    out_str(out, "VERSION: 3.0\n");
+    out_str(out, "END:VCARD\n\n");
     if (result) free(result);
     DEBUG_RET();
 }
@@ -2006,32 +2620,33 @@ void write_vcard(FILE* f_output, pst_item* item, pst_item_contact* contact, char
 /**
  * write extra vcard or vcalendar categories from the extra keywords fields
  *
- * @param f_output open file pointer
+ * @param out      buffer the item is composed in
  * @param item     pst item containing the keywords
  * @return         true if we write a categories line
  */
-int write_extra_categories(FILE* f_output, pst_item* item)
+int write_extra_categories(pst_vbuf* out, pst_item* item)
 {
     char*  result = NULL;
     size_t resultlen = 0;
     pst_item_extra_field *ef = item->extra_fields;
-    const char *fmt = "CATEGORIES:%s";
+    const char *sep = "CATEGORIES:";
     int category_started = 0;
     while (ef) {
         if (strcmp(ef->field_name, "Keywords") == 0) {
-            fprintf(f_output, fmt, pst_rfc2426_escape(ef->value, &result, &resultlen));
-            fmt = ", %s";
+            out_str(out, sep);
+            out_str(out, pst_rfc2426_escape(ef->value, &result, &resultlen));
+            sep = ", ";
             category_started = 1;
         }
         ef = ef->next;
     }
-    if (category_started) fprintf(f_output, "\n");
+    if (category_started) out_str(out, "\n");
     if (result) free(result);
     return category_started;
 }
 
 
-void write_journal(FILE* f_output, pst_item* item)
+void write_journal(pst_vbuf* out, pst_item* item)
 {
     char*  result = NULL;
     size_t resultlen = 0;
@@ -2042,24 +2657,24 @@ void write_journal(FILE* f_output, pst_item* item)
     pst_convert_utf8_null(item, &item->subject);
     pst_convert_utf8_null(item, &item->body);
 
-    fprintf(f_output, "BEGIN:VJOURNAL\n");
-    fprintf(f_output, "DTSTAMP:%s\n",                     pst_rfc2445_datetime_format_now(sizeof(time_buffer), time_buffer));
+    out_str(out, "BEGIN:VJOURNAL\n");
+    out_cat(out, "DTSTAMP:", pst_rfc2445_datetime_format_now(sizeof(time_buffer), time_buffer), "\n", NULL);
     if (item->create_date)
-        fprintf(f_output, "CREATED:%s\n",                 pst_rfc2445_datetime_format(item->create_date, sizeof(time_buffer), time_buffer));
+        out_cat(out, "CREATED:", pst_rfc2445_datetime_format(item->create_date, sizeof(time_buffer), time_buffer), "\n", NULL);
     if (item->modify_date)
-        fprintf(f_output, "LAST-MOD:%s\n",                pst_rfc2445_datetime_format(item->modify_date, sizeof(time_buffer), time_buffer));
+        out_cat(out, "LAST-MOD:", pst_rfc2445_datetime_format(item->modify_date, sizeof(time_buffer), time_buffer), "\n", NULL);
     if (item->subject.str)
-        fprintf(f_output, "SUMMARY:%s\n",                 pst_rfc2426_escape(item->subject.str, &result, &resultlen));
+        out_cat(out, "SUMMARY:", pst_rfc2426_escape(item->subject.str, &result, &resultlen), "\n", NULL);
     if (item->body.str)
-        fprintf(f_output, "DESCRIPTION:%s\n",             pst_rfc2426_escape(item->body.str, &result, &resultlen));
+        out_cat(out, "DESCRIPTION:", pst_rfc2426_escape(item->body.str, &result, &resultlen), "\n", NULL);
     if (journal && journal->start)
-        fprintf(f_output, "DTSTART;VALUE=DATE-TIME:%s\n", pst_rfc2445_datetime_format(journal->start, sizeof(time_buffer), time_buffer));
-    fprintf(f_output, "END:VJOURNAL\n");
+        out_cat(out, "DTSTART;VALUE=DATE-TIME:", pst_rfc2445_datetime_format(journal->start, sizeof(time_buffer), time_buffer), "\n", NULL);
+    out_str(out, "END:VJOURNAL\n");
     if (result) free(result);
 }
 
 
-void write_appointment(FILE* f_output, pst_item* item)
+void write_appointment(pst_vbuf* out, pst_item* item)
 {
     char*  result = NULL;
     size_t resultlen = 0;
@@ -2071,46 +2686,46 @@ void write_appointment(FILE* f_output, pst_item* item)
     pst_convert_utf8_null(item, &item->body);
     pst_convert_utf8_null(item, &appointment->location);
 
-    fprintf(f_output, "UID:%#"PRIx64"\n", item->block_id);
-    fprintf(f_output, "DTSTAMP:%s\n",                     pst_rfc2445_datetime_format_now(sizeof(time_buffer), time_buffer));
+    out_printf(out, "UID:%#"PRIx64"\n", item->block_id);
+    out_cat(out, "DTSTAMP:", pst_rfc2445_datetime_format_now(sizeof(time_buffer), time_buffer), "\n", NULL);
     if (item->create_date)
-        fprintf(f_output, "CREATED:%s\n",                 pst_rfc2445_datetime_format(item->create_date, sizeof(time_buffer), time_buffer));
+        out_cat(out, "CREATED:", pst_rfc2445_datetime_format(item->create_date, sizeof(time_buffer), time_buffer), "\n", NULL);
     if (item->modify_date)
-        fprintf(f_output, "LAST-MOD:%s\n",                pst_rfc2445_datetime_format(item->modify_date, sizeof(time_buffer), time_buffer));
+        out_cat(out, "LAST-MOD:", pst_rfc2445_datetime_format(item->modify_date, sizeof(time_buffer), time_buffer), "\n", NULL);
     if (item->subject.str)
-        fprintf(f_output, "SUMMARY:%s\n",                 pst_rfc2426_escape(item->subject.str, &result, &resultlen));
+        out_cat(out, "SUMMARY:", pst_rfc2426_escape(item->subject.str, &result, &resultlen), "\n", NULL);
     if (item->body.str)
-        fprintf(f_output, "DESCRIPTION:%s\n",             pst_rfc2426_escape(item->body.str, &result, &resultlen));
+        out_cat(out, "DESCRIPTION:", pst_rfc2426_escape(item->body.str, &result, &resultlen), "\n", NULL);
     if (appointment && appointment->start)
-        fprintf(f_output, "DTSTART;VALUE=DATE-TIME:%s\n", pst_rfc2445_datetime_format(appointment->start, sizeof(time_buffer), time_buffer));
+        out_cat(out, "DTSTART;VALUE=DATE-TIME:", pst_rfc2445_datetime_format(appointment->start, sizeof(time_buffer), time_buffer), "\n", NULL);
     if (appointment && appointment->end)
-        fprintf(f_output, "DTEND;VALUE=DATE-TIME:%s\n",   pst_rfc2445_datetime_format(appointment->end, sizeof(time_buffer), time_buffer));
+        out_cat(out, "DTEND;VALUE=DATE-TIME:", pst_rfc2445_datetime_format(appointment->end, sizeof(time_buffer), time_buffer), "\n", NULL);
     if (appointment && appointment->location.str)
-        fprintf(f_output, "LOCATION:%s\n",                pst_rfc2426_escape(appointment->location.str, &result, &resultlen));
+        out_cat(out, "LOCATION:", pst_rfc2426_escape(appointment->location.str, &result, &resultlen), "\n", NULL);
     if (appointment) {
         switch (appointment->showas) {
             case PST_FREEBUSY_TENTATIVE:
-                fprintf(f_output, "STATUS:TENTATIVE\n");
+                out_str(out, "STATUS:TENTATIVE\n");
                 break;
             case PST_FREEBUSY_FREE:
                 // mark as transparent and as confirmed
-                fprintf(f_output, "TRANSP:TRANSPARENT\n");
+                out_str(out, "TRANSP:TRANSPARENT\n");
             case PST_FREEBUSY_BUSY:
             case PST_FREEBUSY_OUT_OF_OFFICE:
-                fprintf(f_output, "STATUS:CONFIRMED\n");
+                out_str(out, "STATUS:CONFIRMED\n");
                 break;
         }
         if (appointment->is_recurring) {
             const char* rules[] = {"DAILY", "WEEKLY", "MONTHLY", "YEARLY"};
             const char* days[]  = {"SU", "MO", "TU", "WE", "TH", "FR", "SA"};
             pst_recurrence *rdata = pst_convert_recurrence(appointment);
-            fprintf(f_output, "RRULE:FREQ=%s", rules[rdata->type]);
-            if (rdata->count)       fprintf(f_output, ";COUNT=%u",      rdata->count);
+            out_cat(out, "RRULE:FREQ=", rules[rdata->type], NULL);
+            if (rdata->count)       out_printf(out, ";COUNT=%u",      rdata->count);
             if ((rdata->interval != 1) &&
-                (rdata->interval))  fprintf(f_output, ";INTERVAL=%u",   rdata->interval);
-            if (rdata->dayofmonth)  fprintf(f_output, ";BYMONTHDAY=%d", rdata->dayofmonth);
-            if (rdata->monthofyear) fprintf(f_output, ";BYMONTH=%d",    rdata->monthofyear);
-            if (rdata->position)    fprintf(f_output, ";BYSETPOS=%d",   rdata->position);
+                (rdata->interval))  out_printf(out, ";INTERVAL=%u",   rdata->interval);
+            if (rdata->dayofmonth)  out_printf(out, ";BYMONTHDAY=%d", rdata->dayofmonth);
+            if (rdata->monthofyear) out_printf(out, ";BYMONTH=%d",    rdata->monthofyear);
+            if (rdata->position)    out_printf(out, ";BYSETPOS=%d",   rdata->position);
             if (rdata->bydaymask) {
                 char byday[40];
                 int  empty = 1;
@@ -2125,61 +2740,69 @@ void write_appointment(FILE* f_output, pst_item* item)
                         empty = 0;
                     }
                 }
-                fprintf(f_output, "%s", byday);
+                out_str(out, byday);
             }
-            fprintf(f_output, "\n");
+            out_str(out, "\n");
             pst_free_recurrence(rdata);
         }
         switch (appointment->label) {
             case PST_APP_LABEL_NONE:
-                if (!write_extra_categories(f_output, item)) fprintf(f_output, "CATEGORIES:NONE\n");
+                if (!write_extra_categories(out, item)) out_str(out, "CATEGORIES:NONE\n");
                 break;
             case PST_APP_LABEL_IMPORTANT:
-                fprintf(f_output, "CATEGORIES:IMPORTANT\n");
+                out_str(out, "CATEGORIES:IMPORTANT\n");
                 break;
             case PST_APP_LABEL_BUSINESS:
-                fprintf(f_output, "CATEGORIES:BUSINESS\n");
+                out_str(out, "CATEGORIES:BUSINESS\n");
                 break;
             case PST_APP_LABEL_PERSONAL:
-                fprintf(f_output, "CATEGORIES:PERSONAL\n");
+                out_str(out, "CATEGORIES:PERSONAL\n");
                 break;
             case PST_APP_LABEL_VACATION:
-                fprintf(f_output, "CATEGORIES:VACATION\n");
+                out_str(out, "CATEGORIES:VACATION\n");
                 break;
             case PST_APP_LABEL_MUST_ATTEND:
-                fprintf(f_output, "CATEGORIES:MUST-ATTEND\n");
+                out_str(out, "CATEGORIES:MUST-ATTEND\n");
                 break;
             case PST_APP_LABEL_TRAVEL_REQ:
-                fprintf(f_output, "CATEGORIES:TRAVEL-REQUIRED\n");
+                out_str(out, "CATEGORIES:TRAVEL-REQUIRED\n");
                 break;
             case PST_APP_LABEL_NEEDS_PREP:
-                fprintf(f_output, "CATEGORIES:NEEDS-PREPARATION\n");
+                out_str(out, "CATEGORIES:NEEDS-PREPARATION\n");
                 break;
             case PST_APP_LABEL_BIRTHDAY:
-                fprintf(f_output, "CATEGORIES:BIRTHDAY\n");
+                out_str(out, "CATEGORIES:BIRTHDAY\n");
                 break;
             case PST_APP_LABEL_ANNIVERSARY:
-                fprintf(f_output, "CATEGORIES:ANNIVERSARY\n");
+                out_str(out, "CATEGORIES:ANNIVERSARY\n");
                 break;
             case PST_APP_LABEL_PHONE_CALL:
-                fprintf(f_output, "CATEGORIES:PHONE-CALL\n");
+                out_str(out, "CATEGORIES:PHONE-CALL\n");
                 break;
         }
         // ignore bogus alarms
         if (appointment->alarm && (appointment->alarm_minutes >= 0) && (appointment->alarm_minutes < 1440)) {
-            fprintf(f_output, "BEGIN:VALARM\n");
-            fprintf(f_output, "TRIGGER:-PT%dM\n", appointment->alarm_minutes);
-            fprintf(f_output, "ACTION:DISPLAY\n");
-            fprintf(f_output, "DESCRIPTION:Reminder\n");
-            fprintf(f_output, "END:VALARM\n");
+            out_str(out, "BEGIN:VALARM\n");
+            out_printf(out, "TRIGGER:-PT%dM\n", appointment->alarm_minutes);
+            out_str(out, "ACTION:DISPLAY\n");
+            out_str(out, "DESCRIPTION:Reminder\n");
+            out_str(out, "END:VALARM\n");
         }
     }
-    fprintf(f_output, "END:VEVENT\n");
+    out_str(out, "END:VEVENT\n");
     if (result) free(result);
 }
 
 
-void create_enter_dir(struct file_ll* f, pst_item *item)
+/**
+ * Make the directory of a folder and reserve the names of its output
+ * files. The files are opened by open_enter_dir(), so a folder waiting
+ * for an export thread holds no open files.
+ * @param f       receives the output files of the folder
+ * @param item    the folder
+ * @param parent  directory of the parent folder's subfolders
+ */
+void create_enter_dir(struct file_ll* f, pst_item *item, out_dir parent)
 {
     memset(f, 0, sizeof(*f));
     f->stored_count = (item->folder) ? item->folder->item_count : 0;
@@ -2188,29 +2811,39 @@ void create_enter_dir(struct file_ll* f, pst_item *item)
     strcpy(f->dname, item->file_as.str);
 
     DEBUG_ENT("create_enter_dir");
-    if (mode == MODE_KMAIL)
-        f->name[0] = mk_kmail_dir(item->file_as.str);
-    else if (mode == MODE_RECURSE) {
+    if (mode == MODE_KMAIL) {
+        f->dir = dup_out_dir(parent);
+        f->name[PST_TYPE_NOTE] = mk_kmail_dir(parent, item->file_as.str, &f->child_dir);
+    } else if (mode == MODE_RECURSE) {
         int32_t t;
-        mk_recurse_dir(item->file_as.str);
+        f->dir = mk_recurse_dir(parent, item->file_as.str);
+        f->child_dir = dup_out_dir(f->dir);
         for (t=0; t<PST_TYPE_MAX; t++) {
             if (t == reduced_item_type(t)) {
                 f->name[t] = strdup(item_type_to_name(t));
             }
         }
         if (mode_thunder) {
-            FILE *type_file = fopen(".type", "w");
+            FILE *type_file = fopen_at(f->dir, ".type", "w");
             fprintf(type_file, "%d\n", item->type);
             fclose(type_file);
         }
     } else if (mode == MODE_SEPARATE) {
         // do similar stuff to recurse here.
-        mk_separate_dir(item->file_as.str);
-        f->name[0] = (char*) pst_malloc(file_name_len);
-        memset(f->name[0], 0, file_name_len);
+        int32_t t;
+        f->dir = mk_separate_dir(parent, item->file_as.str);
+        f->child_dir = dup_out_dir(f->dir);
+        for (t=0; t<PST_TYPE_MAX; t++) {
+            if (t == reduced_item_type(t)) {
+                f->name[t] = (char*) pst_malloc(file_name_len);
+                memset(f->name[t], 0, file_name_len);
+            }
+        }
     } else {
-        f->name[0] = (char*) pst_malloc(strlen(item->file_as.str)+strlen(OUTPUT_TEMPLATE)+1);
-        sprintf(f->name[0], OUTPUT_TEMPLATE, item->file_as.str);
+        f->dir       = dup_out_dir(parent);
+        f->child_dir = dup_out_dir(parent);
+        f->name[PST_TYPE_NOTE] = (char*) pst_malloc(strlen(item->file_as.str)+strlen(OUTPUT_TEMPLATE)+1);
+        sprintf(f->name[PST_TYPE_NOTE], OUTPUT_TEMPLATE, item->file_as.str);
     }
 
     if (mode != MODE_SEPARATE) {
@@ -2223,14 +2856,14 @@ void create_enter_dir(struct file_ll* f, pst_item *item)
 
                     sprintf(temp, "%s", f->name[t]);
                     check_filename(temp);
-                    while ((f->output[t] = fopen(temp, "r"))) {
+                    while ((f->output[t] = fopen_at(f->dir, temp, "r"))) {
                         DEBUG_INFO(("need to increase filename because one already exists with that name\n"));
-                        DEBUG_INFO(("- increasing it to %s%d\n", f->name, x));
+                        DEBUG_INFO(("- increasing it to %s%d\n", f->name[t], x));
                         x++;
-                        sprintf(temp, "%s%08d", f->name, x);
-                        DEBUG_INFO(("- trying \"%s\"\n", f->name));
+                        sprintf(temp, "%s%08d", f->name[t], x);
+                        DEBUG_INFO(("- trying \"%s\"\n", temp));
                         if (x == 99999999) {
-                            DIE(("create_enter_dir: Why can I not create a folder %s? I have tried %i extensions...\n", f->name, x));
+                            DIE(("create_enter_dir: Why can I not create a folder %s? I have tried %i extensions...\n", f->name[t], x));
                         }
                         fclose(f->output[t]);
                     }
@@ -2242,9 +2875,12 @@ void create_enter_dir(struct file_ll* f, pst_item *item)
                     }
                 }
                 check_filename(f->name[t]);
-                if (!(f->output[t] = fopen(f->name[t], "w"))) {
+                // made right away, so the next folder of the same name picks another one
+                if (!(f->output[t] = fopen_at(f->dir, f->name[t], "w"))) {
                     DIE(("create_enter_dir: Could not open file \"%s\" for write\n", f->name[t]));
                 }
+                fclose(f->output[t]);
+                f->output[t] = NULL;
                 DEBUG_INFO(("f->name = %s\nitem->folder_name = %s\n", f->name[t], item->file_as.str));
             }
         }
@@ -2253,6 +2889,24 @@ void create_enter_dir(struct file_ll* f, pst_item *item)
 }
 
 
+/**
+ * Open the output files that create_enter_dir() made for a folder.
+ * @param f  the output files of the folder
+ */
+void open_enter_dir(struct file_ll *f)
+{
+    int32_t t;
+    if (mode == MODE_SEPARATE) return;
+    DEBUG_ENT("open_enter_dir");
+    for (t=0; t<PST_TYPE_MAX; t++) {
+        if (f->name[t] && !(f->output[t] = fopen_at(f->dir, f->name[t], "w"))) {
+            DIE(("open_enter_dir: Could not open file \"%s\" for write\n", f->name[t]));
+        }
+    }
+    DEBUG_RET();
+}
+
+
 void close_enter_dir(struct file_ll *f)
 {
     int32_t t;
@@ -2267,30 +2921,19 @@ void close_enter_dir(struct file_ll *f)
     for (t=0; t<PST_TYPE_MAX; t++) {
         if (f->output[t]) {
             if (mode == MODE_SEPARATE) DEBUG_WARN(("close_enter_dir finds open separate file\n"));
-            struct stat st;
-            fclose(f->output[t]);
-            stat(f->name[t], &st);
-            if (!st.st_size) {
-                DEBUG_WARN(("removing empty output file %s\n", f->name[t]));
-                remove(f->name[t]);
-            }
-            f->output[t] = NULL;
+            close_output_file(f, t);
         }
         free(f->name[t]);
         f->name[t] = NULL;
     }
     free(f->dname);
 
-    if (mode == MODE_KMAIL)
-        close_kmail_dir();
-    else if (mode == MODE_RECURSE) {
-        if (mode_thunder) {
-            FILE *type_file = fopen(".size", "w");
-            fprintf(type_file, "%i %i\n", f->item_count, f->stored_count);
-            fclose(type_file);
-        }
-        close_recurse_dir();
-    } else if (mode == MODE_SEPARATE)
-        close_separate_dir();
+    if ((mode == MODE_RECURSE) && mode_thunder) {
+        FILE *type_file = fopen_at(f->dir, ".size", "w");
+        fprintf(type_file, "%i %i\n", f->item_count, f->stored_count);
+        fclose(type_file);
+    }
+    close_out_dir(f->dir);
+    close_out_dir(f->child_dir);
 }
 
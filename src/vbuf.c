@@ -1,13 +1,39 @@
 
 #include "define.h"
 
-static int unicode_up = 0;
-static iconv_t i16to8;
-static const char *target_charset = NULL;
-static int         target_open_from = 0;
-static int         target_open_to   = 0;
-static iconv_t     i8totarget = (iconv_t)-1;
-static iconv_t     target2i8  = (iconv_t)-1;
+#define PST_CHARSET_CACHE_SIZE  8   // charsets whose iconv descriptors are kept open
+
+
+// the two iconv descriptors of one charset, each opened on first use
+typedef struct pst_charset_conv {
+    char       *charset;
+    int         tried_from;     // i8totarget has been opened, or failed to open
+    int         tried_to;       // target2i8 has been opened, or failed to open
+    iconv_t     i8totarget;
+    iconv_t     target2i8;
+} pst_charset_conv;
+
+
+// the charsets most recently converted by one thread, most recent first
+typedef struct pst_charset_cache {
+    pst_charset_conv    conv[PST_CHARSET_CACHE_SIZE];
+    size_t              count;
+    uint64_t            hits;
+    uint64_t            misses;
+    uint64_t            evictions;
+} pst_charset_cache;
+
+
+// iconv descriptors carry conversion state, so every thread gets its own set
+static PST_THREAD_LOCAL int         unicode_up = 0;
+static PST_THREAD_LOCAL iconv_t     i16to8;
+static PST_THREAD_LOCAL pst_charset_cache charsets;
+
+// counts of the threads that closed their descriptors
+static pst_vb_charset_cache_stats charset_totals;
+#ifdef HAVE_PTHREAD_H
+static pthread_mutex_t charset_totals_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
 
 
 #define ASSERT(x,...) { if( !(x) ) DIE(( __VA_ARGS__)); }
@@ -38,27 +64,76 @@ static size_t pst_vbavail(pst_vbuf * vb)
 }
 
 
-static void open_targets(const char* charset);
-static void open_targets(const char* charset)
+static void close_charset(pst_charset_conv *conv);
+static void close_charset(pst_charset_conv *conv)
+{
+    if (conv->tried_from && (conv->i8totarget != (iconv_t)-1)) iconv_close(conv->i8totarget);
+    if (conv->tried_to   && (conv->target2i8  != (iconv_t)-1)) iconv_close(conv->target2i8);
+    free(conv->charset);
+    memset(conv, 0, sizeof(*conv));
+}
+
+
+/** find the descriptors of a charset, making room for them if needed,
+ *  and move them to the front of the cache */
+static pst_charset_conv *find_charset(const char* charset);
+static pst_charset_conv *find_charset(const char* charset)
+{
+    pst_charset_conv found;
+    size_t i;
+    for (i = 0; i < charsets.count; i++) {
+        if (!strcasecmp(charsets.conv[i].charset, charset)) break;
+    }
+    if (i < charsets.count) {
+        charsets.hits++;
+        found = charsets.conv[i];
+    }
+    else {
+        charsets.misses++;
+        if (charsets.count == PST_CHARSET_CACHE_SIZE) {
+            // drop the least recently used charset
+            charsets.evictions++;
+            close_charset(&charsets.conv[--charsets.count]);
+        }
+        i = charsets.count++;
+        memset(&found, 0, sizeof(found));
+        found.charset = strdup(charset);
+    }
+    memmove(&charsets.conv[1], &charsets.conv[0], i * sizeof(pst_charset_conv));
+    charsets.conv[0] = found;
+    return &charsets.conv[0];
+}
+
+
+/** @return the utf-8 to charset descriptor, or (iconv_t)-1 */
+static iconv_t open_from_utf8(const char* charset);
+static iconv_t open_from_utf8(const char* charset)
 {
-    if (!target_charset || strcasecmp(target_charset, charset)) {
-        if (target_open_from) iconv_close(i8totarget);
-        if (target_open_to)   iconv_close(target2i8);
-        if (target_charset)   free((char *)target_charset);
-        target_charset   = strdup(charset);
-        target_open_from = 1;
-        target_open_to   = 1;
-        i8totarget = iconv_open(target_charset, "utf-8");
-        if (i8totarget == (iconv_t)-1) {
-            target_open_from = 0;
-            DEBUG_WARN(("Couldn't open iconv descriptor for utf-8 to %s.\n", target_charset));
+    pst_charset_conv *conv = find_charset(charset);
+    if (!conv->tried_from) {
+        conv->tried_from = 1;
+        conv->i8totarget = iconv_open(conv->charset, "utf-8");
+        if (conv->i8totarget == (iconv_t)-1) {
+            DEBUG_WARN(("Couldn't open iconv descriptor for utf-8 to %s.\n", conv->charset));
         }
-        target2i8 = iconv_open("utf-8", target_charset);
-        if (target2i8 == (iconv_t)-1) {
-            target_open_to = 0;
-            DEBUG_WARN(("Couldn't open iconv descriptor for %s to utf-8.\n", target_charset));
+    }
+    return conv->i8totarget;
+}
+
+
+/** @return the charset to utf-8 descriptor, or (iconv_t)-1 */
+static iconv_t open_to_utf8(const char* charset);
+static iconv_t open_to_utf8(const char* charset)
+{
+    pst_charset_conv *conv = find_charset(charset);
+    if (!conv->tried_to) {
+        conv->tried_to  = 1;
+        conv->target2i8 = iconv_open("utf-8", conv->charset);
+        if (conv->target2i8 == (iconv_t)-1) {
+            DEBUG_WARN(("Couldn't open iconv descriptor for %s to utf-8.\n", conv->charset));
         }
     }
+    return conv->target2i8;
 }
 
 
@@ -85,7 +160,7 @@ static size_t sbcs_conversion(pst_vbuf *dest, const char *inbuf, int iblen, icon
 
     if (icresult == (size_t)-1) {
         DEBUG_WARN(("iconv failure: %s\n", strerror(myerrno)));
-        pst_unicode_init();
+        iconv(conversion, NULL, NULL, NULL, NULL);  // back to the initial shift state
         DEBUG_RET();
         return (size_t)-1;
     }
@@ -94,17 +169,23 @@ static size_t sbcs_conversion(pst_vbuf *dest, const char *inbuf, int iblen, icon
 }
 
 
-static void pst_unicode_close();
-static void pst_unicode_close()
+void pst_unicode_close()
 {
-    iconv_close(i16to8);
-    if (target_open_from) iconv_close(i8totarget);
-    if (target_open_to)   iconv_close(target2i8);
-    if (target_charset)   free((char *)target_charset);
-    target_charset   = NULL;
-    target_open_from = 0;
-    target_open_to   = 0;
+    if (unicode_up && (i16to8 != (iconv_t)-1)) iconv_close(i16to8);
+    while (charsets.count) close_charset(&charsets.conv[--charsets.count]);
     unicode_up = 0;
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_lock(&charset_totals_lock);
+#endif
+    charset_totals.hits      += charsets.hits;
+    charset_totals.misses    += charsets.misses;
+    charset_totals.evictions += charsets.evictions;
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_unlock(&charset_totals_lock);
+#endif
+    charsets.hits      = 0;
+    charsets.misses    = 0;
+    charsets.evictions = 0;
 }
 
 
@@ -218,7 +299,8 @@ size_t pst_vb_utf16to8(pst_vbuf *dest, const char *inbuf, int iblen)
     char *outbuf        = NULL;
     int   myerrno;
 
-    if (!unicode_up) return (size_t)-1;   // failure to open iconv
+    if (!unicode_up) pst_unicode_init();  // first conversion in this thread
+    if (i16to8 == (iconv_t)-1) return (size_t)-1;   // failure to open iconv
     pst_vbresize(dest, iblen);
 
     //Bad Things can happen if a non-zero-terminated utf16 string comes through here
@@ -236,7 +318,7 @@ size_t pst_vb_utf16to8(pst_vbuf *dest, const char *inbuf, int iblen)
 
     if (icresult == (size_t)-1) {
         DEBUG_WARN(("iconv failure: %s\n", strerror(myerrno)));
-        pst_unicode_init();
+        iconv(i16to8, NULL, NULL, NULL, NULL);      // back to the initial shift state
         return (size_t)-1;
     }
     return (icresult) ? (size_t)-1 : 0;
@@ -245,16 +327,31 @@ size_t pst_vb_utf16to8(pst_vbuf *dest, const char *inbuf, int iblen)
 
 size_t pst_vb_utf8to8bit(pst_vbuf *dest, const char *inbuf, int iblen, const char* charset)
 {
-    open_targets(charset);
-    if (!target_open_from) return (size_t)-1;   // failure to open the target
-    return sbcs_conversion(dest, inbuf, iblen, i8totarget);
+    iconv_t conversion = open_from_utf8(charset);
+    if (conversion == (iconv_t)-1) return (size_t)-1;   // failure to open the target
+    return sbcs_conversion(dest, inbuf, iblen, conversion);
 }
 
 
 size_t pst_vb_8bit2utf8(pst_vbuf *dest, const char *inbuf, int iblen, const char* charset)
 {
-    open_targets(charset);
-    if (!target_open_to) return (size_t)-1;     // failure to open the target
-    return sbcs_conversion(dest, inbuf, iblen, target2i8);
+    iconv_t conversion = open_to_utf8(charset);
+    if (conversion == (iconv_t)-1) return (size_t)-1;   // failure to open the target
+    return sbcs_conversion(dest, inbuf, iblen, conversion);
+}
+
+
+void pst_vb_charset_stats(pst_vb_charset_cache_stats *stats)
+{
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_lock(&charset_totals_lock);
+#endif
+    stats->hits      = charset_totals.hits      + charsets.hits;
+    stats->misses    = charset_totals.misses    + charsets.misses;
+    stats->evictions = charset_totals.evictions + charsets.evictions;
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_unlock(&charset_totals_lock);
+#endif
+    stats->count     = charsets.count;
 }
 
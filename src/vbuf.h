@@ -16,14 +16,27 @@ struct pst_varbuf {
 
 typedef struct pst_varbuf pst_vbuf;
 
+
+// counters of the caches of iconv descriptors per charset, summed over
+// the calling thread and every thread that called pst_unicode_close()
+typedef struct pst_vb_charset_cache_stats {
+    uint64_t    hits;       // conversions to or from a charset that was already open
+    uint64_t    misses;     // conversions that had to look up a new charset
+    uint64_t    evictions;  // charsets closed to make room for another
+    size_t      count;      // charsets the calling thread keeps open
+} pst_vb_charset_cache_stats;
+
+
 pst_vbuf  *pst_vballoc(size_t len);
 void       pst_vbgrow(pst_vbuf *vb, size_t len);    // grow buffer by len bytes, data are preserved
 void       pst_vbset(pst_vbuf *vb, void *data, size_t len);
 void       pst_vbappend(pst_vbuf *vb, void *data, size_t length);
 void       pst_unicode_init();
+void       pst_unicode_close();     // close the calling thread's iconv descriptors, keeping its counts
 size_t     pst_vb_utf16to8(pst_vbuf *dest, const char *inbuf, int iblen);
 size_t     pst_vb_utf8to8bit(pst_vbuf *dest, const char *inbuf, int iblen, const char* charset);
 size_t     pst_vb_8bit2utf8(pst_vbuf *dest, const char *inbuf, int iblen, const char* charset);
+void       pst_vb_charset_stats(pst_vb_charset_cache_stats *stats);
 
 
 #endif